@@ -0,0 +1,456 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/bitmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_BITMAP_WORDS 1024
+
+typedef enum dt_bitmap_op_t
+{
+  DT_BITMAP_OR,
+  DT_BITMAP_AND,
+  DT_BITMAP_ANDNOT
+}
+dt_bitmap_op_t;
+
+/* index of the first container with a key >= key */
+static uint32_t _find(const dt_bitmap_t *b, const uint32_t key)
+{
+  uint32_t lo = 0, hi = b->num;
+  while(lo < hi)
+  {
+    const uint32_t mid = (lo + hi) / 2;
+    if(b->c[mid].key < key) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/* index of the first entry >= v */
+static uint32_t _lower_bound(const uint16_t *a, const uint32_t n, const uint32_t v)
+{
+  uint32_t lo = 0, hi = n;
+  while(lo < hi)
+  {
+    const uint32_t mid = (lo + hi) / 2;
+    if(a[mid] < v) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static inline int _container_contains(const dt_bitmap_container_t *c, const uint32_t low)
+{
+  if(c->bits) return (c->bits[low >> 6] >> (low & 63)) & 1;
+  const uint32_t pos = _lower_bound(c->array, c->card, low);
+  return pos < c->card && c->array[pos] == low;
+}
+
+static void _container_free(dt_bitmap_container_t *c)
+{
+  free(c->array);
+  free(c->bits);
+  c->array = NULL;
+  c->bits = NULL;
+  c->alloc = c->card = 0;
+}
+
+static void _container_copy(dt_bitmap_container_t *dst, const dt_bitmap_container_t *src)
+{
+  *dst = *src;
+  if(src->bits)
+  {
+    dst->bits = (uint64_t *)malloc(sizeof(uint64_t) * DT_BITMAP_WORDS);
+    memcpy(dst->bits, src->bits, sizeof(uint64_t) * DT_BITMAP_WORDS);
+  }
+  else
+  {
+    dst->alloc = src->card ? src->card : 1;
+    dst->array = (uint16_t *)malloc(sizeof(uint16_t) * dst->alloc);
+    memcpy(dst->array, src->array, sizeof(uint16_t) * src->card);
+  }
+}
+
+static void _to_bits(dt_bitmap_container_t *c)
+{
+  if(c->bits) return;
+  c->bits = (uint64_t *)calloc(DT_BITMAP_WORDS, sizeof(uint64_t));
+  for(uint32_t k = 0; k < c->card; k++) c->bits[c->array[k] >> 6] |= 1ull << (c->array[k] & 63);
+  free(c->array);
+  c->array = NULL;
+  c->alloc = 0;
+}
+
+static void _to_array(dt_bitmap_container_t *c)
+{
+  if(!c->bits) return;
+  c->alloc = c->card ? c->card : 1;
+  c->array = (uint16_t *)malloc(sizeof(uint16_t) * c->alloc);
+  uint32_t n = 0;
+  for(uint32_t w = 0; w < DT_BITMAP_WORDS; w++)
+    for(uint64_t word = c->bits[w]; word; word &= word - 1)
+      c->array[n++] = (w << 6) + __builtin_ctzll(word);
+  free(c->bits);
+  c->bits = NULL;
+}
+
+static uint32_t _popcount(const uint64_t *bits)
+{
+  uint32_t card = 0;
+  for(uint32_t w = 0; w < DT_BITMAP_WORDS; w++) card += __builtin_popcountll(bits[w]);
+  return card;
+}
+
+static dt_bitmap_container_t *_insert_container(dt_bitmap_t *b, const uint32_t idx, const uint32_t key)
+{
+  if(b->num == b->alloc)
+  {
+    b->alloc = b->alloc ? 2 * b->alloc : 4;
+    b->c = (dt_bitmap_container_t *)realloc(b->c, sizeof(dt_bitmap_container_t) * b->alloc);
+  }
+  memmove(b->c + idx + 1, b->c + idx, sizeof(dt_bitmap_container_t) * (b->num - idx));
+  b->num++;
+  dt_bitmap_container_t *c = b->c + idx;
+  memset(c, 0, sizeof(dt_bitmap_container_t));
+  c->key = key;
+  return c;
+}
+
+static void _remove_container(dt_bitmap_t *b, const uint32_t idx)
+{
+  _container_free(b->c + idx);
+  memmove(b->c + idx, b->c + idx + 1, sizeof(dt_bitmap_container_t) * (b->num - idx - 1));
+  b->num--;
+}
+
+void dt_bitmap_init(dt_bitmap_t *b)
+{
+  memset(b, 0, sizeof(dt_bitmap_t));
+}
+
+void dt_bitmap_clear(dt_bitmap_t *b)
+{
+  for(uint32_t k = 0; k < b->num; k++) _container_free(b->c + k);
+  b->num = 0;
+  b->card = 0;
+}
+
+void dt_bitmap_cleanup(dt_bitmap_t *b)
+{
+  dt_bitmap_clear(b);
+  free(b->c);
+  dt_bitmap_init(b);
+}
+
+void dt_bitmap_copy(dt_bitmap_t *dst, const dt_bitmap_t *src)
+{
+  if(dst == src) return;
+  dt_bitmap_clear(dst);
+  if(dst->alloc < src->num)
+  {
+    dst->alloc = src->num;
+    dst->c = (dt_bitmap_container_t *)realloc(dst->c, sizeof(dt_bitmap_container_t) * dst->alloc);
+  }
+  for(uint32_t k = 0; k < src->num; k++) _container_copy(dst->c + k, src->c + k);
+  dst->num = src->num;
+  dst->card = src->card;
+}
+
+void dt_bitmap_swap(dt_bitmap_t *a, dt_bitmap_t *b)
+{
+  const dt_bitmap_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+int dt_bitmap_add(dt_bitmap_t *b, const uint32_t v)
+{
+  const uint32_t key = v >> 16, low = v & 0xffff;
+  const uint32_t idx = _find(b, key);
+  dt_bitmap_container_t *c = (idx < b->num && b->c[idx].key == key) ? b->c + idx : _insert_container(b, idx, key);
+
+  if(!c->bits)
+  {
+    // appending is the common case when filling in sorted order
+    const uint32_t pos = (c->card && c->array[c->card - 1] < low) ? c->card : _lower_bound(c->array, c->card, low);
+    if(pos < c->card && c->array[pos] == low) return 0;
+    if(c->card < DT_BITMAP_ARRAY_MAX)
+    {
+      if(c->card == c->alloc)
+      {
+        c->alloc = c->alloc ? 2 * c->alloc : 4;
+        if(c->alloc > DT_BITMAP_ARRAY_MAX) c->alloc = DT_BITMAP_ARRAY_MAX;
+        c->array = (uint16_t *)realloc(c->array, sizeof(uint16_t) * c->alloc);
+      }
+      memmove(c->array + pos + 1, c->array + pos, sizeof(uint16_t) * (c->card - pos));
+      c->array[pos] = low;
+      c->card++;
+      b->card++;
+      return 1;
+    }
+    _to_bits(c);
+  }
+
+  uint64_t *word = c->bits + (low >> 6);
+  const uint64_t mask = 1ull << (low & 63);
+  if(*word & mask) return 0;
+  *word |= mask;
+  c->card++;
+  b->card++;
+  return 1;
+}
+
+void dt_bitmap_add_array(dt_bitmap_t *b, const uint32_t *v, const uint32_t n)
+{
+  // set bits in every block we touch, whatever the order, and count and shrink them afterwards.
+  dt_bitmap_container_t *c = NULL;
+  for(uint32_t k = 0; k < n; k++)
+  {
+    const uint32_t key = v[k] >> 16, low = v[k] & 0xffff;
+    if(!c || c->key != key)
+    {
+      const uint32_t idx = _find(b, key);
+      c = (idx < b->num && b->c[idx].key == key) ? b->c + idx : _insert_container(b, idx, key);
+      _to_bits(c);
+    }
+    c->bits[low >> 6] |= 1ull << (low & 63);
+  }
+  if(!n) return;
+
+  b->card = 0;
+  for(uint32_t k = 0; k < b->num; k++)
+  {
+    c = b->c + k;
+    if(c->bits)
+    {
+      c->card = _popcount(c->bits);
+      if(c->card <= DT_BITMAP_ARRAY_MAX) _to_array(c);
+    }
+    b->card += c->card;
+  }
+}
+
+int dt_bitmap_remove(dt_bitmap_t *b, const uint32_t v)
+{
+  const uint32_t key = v >> 16, low = v & 0xffff;
+  const uint32_t idx = _find(b, key);
+  if(idx == b->num || b->c[idx].key != key) return 0;
+  dt_bitmap_container_t *c = b->c + idx;
+
+  if(c->bits)
+  {
+    uint64_t *word = c->bits + (low >> 6);
+    const uint64_t mask = 1ull << (low & 63);
+    if(!(*word & mask)) return 0;
+    *word &= ~mask;
+    c->card--;
+    // some slack, so toggling around the limit doesn't convert back and forth
+    if(c->card < DT_BITMAP_ARRAY_MAX / 2) _to_array(c);
+  }
+  else
+  {
+    const uint32_t pos = _lower_bound(c->array, c->card, low);
+    if(pos == c->card || c->array[pos] != low) return 0;
+    memmove(c->array + pos, c->array + pos + 1, sizeof(uint16_t) * (c->card - pos - 1));
+    c->card--;
+  }
+  b->card--;
+  if(!c->card) _remove_container(b, idx);
+  return 1;
+}
+
+int dt_bitmap_contains(const dt_bitmap_t *b, const uint32_t v)
+{
+  const uint32_t key = v >> 16;
+  const uint32_t idx = _find(b, key);
+  if(idx == b->num || b->c[idx].key != key) return 0;
+  return _container_contains(b->c + idx, v & 0xffff);
+}
+
+int dt_bitmap_next(const dt_bitmap_t *b, const uint32_t v, uint32_t *next)
+{
+  const uint32_t key = v >> 16;
+  for(uint32_t idx = _find(b, key); idx < b->num; idx++)
+  {
+    const dt_bitmap_container_t *c = b->c + idx;
+    const uint32_t low = c->key == key ? v & 0xffff : 0;
+    if(c->bits)
+    {
+      uint32_t w = low >> 6;
+      uint64_t word = c->bits[w] & (~0ull << (low & 63));
+      while(!word && ++w < DT_BITMAP_WORDS) word = c->bits[w];
+      if(word)
+      {
+        *next = (c->key << 16) | ((w << 6) + __builtin_ctzll(word));
+        return 1;
+      }
+    }
+    else
+    {
+      const uint32_t pos = _lower_bound(c->array, c->card, low);
+      if(pos < c->card)
+      {
+        *next = (c->key << 16) | c->array[pos];
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* d = d op s for two containers with the same key. */
+static void _container_op(dt_bitmap_container_t *d, const dt_bitmap_container_t *s, const dt_bitmap_op_t op)
+{
+  if(op == DT_BITMAP_OR)
+  {
+    if(!d->bits && !s->bits && d->card + s->card <= DT_BITMAP_ARRAY_MAX)
+    {
+      // merge two sorted arrays
+      uint16_t *out = (uint16_t *)malloc(sizeof(uint16_t) * (d->card + s->card));
+      uint32_t i = 0, j = 0, n = 0;
+      while(i < d->card && j < s->card)
+      {
+        if(d->array[i] < s->array[j]) out[n++] = d->array[i++];
+        else if(s->array[j] < d->array[i]) out[n++] = s->array[j++];
+        else
+        {
+          out[n++] = d->array[i++];
+          j++;
+        }
+      }
+      while(i < d->card) out[n++] = d->array[i++];
+      while(j < s->card) out[n++] = s->array[j++];
+      free(d->array);
+      d->array = out;
+      d->alloc = d->card + s->card;
+      d->card = n;
+      return;
+    }
+    _to_bits(d);
+    if(s->bits)
+      for(uint32_t w = 0; w < DT_BITMAP_WORDS; w++) d->bits[w] |= s->bits[w];
+    else
+      for(uint32_t k = 0; k < s->card; k++) d->bits[s->array[k] >> 6] |= 1ull << (s->array[k] & 63);
+    d->card = _popcount(d->bits);
+  }
+  else if(op == DT_BITMAP_AND && d->bits && s->bits)
+  {
+    for(uint32_t w = 0; w < DT_BITMAP_WORDS; w++) d->bits[w] &= s->bits[w];
+    d->card = _popcount(d->bits);
+  }
+  else if(op == DT_BITMAP_AND && d->bits)
+  {
+    // the result is a subset of the array
+    uint16_t *out = (uint16_t *)malloc(sizeof(uint16_t) * (s->card ? s->card : 1));
+    uint32_t n = 0;
+    for(uint32_t k = 0; k < s->card; k++)
+      if(_container_contains(d, s->array[k])) out[n++] = s->array[k];
+    free(d->bits);
+    d->bits = NULL;
+    d->array = out;
+    d->alloc = s->card ? s->card : 1;
+    d->card = n;
+  }
+  else if(op == DT_BITMAP_ANDNOT && d->bits)
+  {
+    if(s->bits)
+      for(uint32_t w = 0; w < DT_BITMAP_WORDS; w++) d->bits[w] &= ~s->bits[w];
+    else
+      for(uint32_t k = 0; k < s->card; k++) d->bits[s->array[k] >> 6] &= ~(1ull << (s->array[k] & 63));
+    d->card = _popcount(d->bits);
+  }
+  else
+  {
+    // and/andnot on an array: filter it in place
+    const int keep = op == DT_BITMAP_AND;
+    uint32_t n = 0;
+    for(uint32_t k = 0; k < d->card; k++)
+      if(_container_contains(s, d->array[k]) == keep) d->array[n++] = d->array[k];
+    d->card = n;
+  }
+  if(d->bits && d->card <= DT_BITMAP_ARRAY_MAX) _to_array(d);
+}
+
+static void _bitmap_op(dt_bitmap_t *dst, const dt_bitmap_t *src, const dt_bitmap_op_t op)
+{
+  if(dst == src)
+  {
+    if(op == DT_BITMAP_ANDNOT) dt_bitmap_clear(dst);
+    return;
+  }
+
+  // walk both sorted container lists, writing the result into a new list
+  const uint32_t alloc = op == DT_BITMAP_OR ? dst->num + src->num : dst->num;
+  dt_bitmap_container_t *out = (dt_bitmap_container_t *)malloc(sizeof(dt_bitmap_container_t) * (alloc ? alloc : 1));
+  uint32_t i = 0, j = 0, n = 0;
+  uint64_t card = 0;
+  while(i < dst->num || j < src->num)
+  {
+    dt_bitmap_container_t *d = i < dst->num ? dst->c + i : NULL;
+    const dt_bitmap_container_t *s = j < src->num ? src->c + j : NULL;
+    if(d && (!s || d->key < s->key))
+    {
+      // only in dst
+      if(op == DT_BITMAP_AND) _container_free(d);
+      else out[n++] = *d;
+      i++;
+    }
+    else if(!d || s->key < d->key)
+    {
+      // only in src
+      if(op == DT_BITMAP_OR) _container_copy(out + n++, s);
+      j++;
+    }
+    else
+    {
+      _container_op(d, s, op);
+      if(d->card) out[n++] = *d;
+      else _container_free(d);
+      i++;
+      j++;
+    }
+  }
+  for(uint32_t k = 0; k < n; k++) card += out[k].card;
+
+  free(dst->c);
+  dst->c = out;
+  dst->num = n;
+  dst->alloc = alloc ? alloc : 1;
+  dst->card = card;
+}
+
+void dt_bitmap_or(dt_bitmap_t *dst, const dt_bitmap_t *src)
+{
+  _bitmap_op(dst, src, DT_BITMAP_OR);
+}
+
+void dt_bitmap_and(dt_bitmap_t *dst, const dt_bitmap_t *src)
+{
+  _bitmap_op(dst, src, DT_BITMAP_AND);
+}
+
+void dt_bitmap_andnot(dt_bitmap_t *dst, const dt_bitmap_t *src)
+{
+  _bitmap_op(dst, src, DT_BITMAP_ANDNOT);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,88 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_BITMAP_H
+#define DT_BITMAP_H
+
+#include <inttypes.h>
+
+/** containers with up to this many entries are kept as sorted arrays, bigger ones as plain 64k bit sets. */
+#define DT_BITMAP_ARRAY_MAX 4096
+
+/** the values sharing the upper 16 bits key. */
+typedef struct dt_bitmap_container_t
+{
+  uint32_t key;
+  uint32_t card;
+  uint32_t alloc;   // size of array, 0 while it's a bit set
+  uint16_t *array;  // sorted lower 16 bits
+  uint64_t *bits;   // 1024 words
+}
+dt_bitmap_container_t;
+
+/**
+ * compressed set of 32-bit values (image ids) in the spirit of roaring bitmaps: one
+ * container per 64k block of values, which is a sorted array while sparse and a bit set
+ * when dense. membership is a binary search over the blocks plus either a binary search
+ * or a bit test, the count is kept up to date, and set operations work block by block
+ * (word by word on the dense ones). 200k consecutive ids take about 25kB.
+ *
+ * not thread safe, callers have to lock around it.
+ */
+typedef struct dt_bitmap_t
+{
+  dt_bitmap_container_t *c;  // sorted by key
+  uint32_t num, alloc;
+  uint64_t card;
+}
+dt_bitmap_t;
+
+/** empty set, to be released with dt_bitmap_cleanup(). a zeroed struct is fine, too. */
+void dt_bitmap_init(dt_bitmap_t *b);
+void dt_bitmap_cleanup(dt_bitmap_t *b);
+/** remove everything. */
+void dt_bitmap_clear(dt_bitmap_t *b);
+/** make dst a copy of src. */
+void dt_bitmap_copy(dt_bitmap_t *dst, const dt_bitmap_t *src);
+/** exchange the contents of a and b. */
+void dt_bitmap_swap(dt_bitmap_t *a, dt_bitmap_t *b);
+
+/** returns 1 if v wasn't in there before. */
+int dt_bitmap_add(dt_bitmap_t *b, const uint32_t v);
+/** add n values in any order, duplicates are fine. */
+void dt_bitmap_add_array(dt_bitmap_t *b, const uint32_t *v, const uint32_t n);
+/** returns 1 if v was in there. */
+int dt_bitmap_remove(dt_bitmap_t *b, const uint32_t v);
+int dt_bitmap_contains(const dt_bitmap_t *b, const uint32_t v);
+static inline uint64_t dt_bitmap_count(const dt_bitmap_t *b)
+{
+  return b->card;
+}
+/** finds the smallest value >= v, returns 0 if there is none. */
+int dt_bitmap_next(const dt_bitmap_t *b, const uint32_t v, uint32_t *next);
+
+/** dst = dst | src */
+void dt_bitmap_or(dt_bitmap_t *dst, const dt_bitmap_t *src);
+/** dst = dst & src */
+void dt_bitmap_and(dt_bitmap_t *dst, const dt_bitmap_t *src);
+/** dst = dst & ~src */
+void dt_bitmap_andnot(dt_bitmap_t *dst, const dt_bitmap_t *src);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
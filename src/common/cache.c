@@ -51,7 +51,7 @@ typedef struct dt_cache_bucket_t
   int32_t  cost;   // cost associated with this entry (such as byte size)
   uint32_t hash;   // hash of the element
   uint32_t key;    // key of the element
-  // due to alignment, we waste 32 bits here
+  uint32_t stamp;  // value of the clock at the last access
   void*    data;   // actual data
 }
 dt_cache_bucket_t;
@@ -369,6 +369,8 @@ dt_cache_init(dt_cache_t *cache, const int32_t capacity, const int32_t num_threa
   cache->cost = 0;
   cache->cost_quota = cost_quota;
   cache->lru_lock = 0;
+  cache->own_clock = 0;
+  cache->clock = &cache->own_clock;
   cache->allocate = NULL;
   cache->allocate_data = NULL;
   cache->cleanup = NULL;
@@ -390,6 +392,7 @@ dt_cache_init(dt_cache_t *cache, const int32_t capacity, const int32_t num_threa
     cache->table[k].write       = 0;
     cache->table[k].lru         = -2;
     cache->table[k].mru         = -2;
+    cache->table[k].stamp       = 0;
   }
   cache->lru = cache->mru = -1;
 #ifndef DT_UNIT_TEST
@@ -515,6 +518,8 @@ lru_insert(dt_cache_t        *cache,
   // could use the segment locks for better scalability.
   // would need to roll back changes in proximity after all (up to) three locks have been obtained.
   const int idx = bucket - cache->table;
+  // the clock might be shared with other caches, which hold other locks.
+  bucket->stamp = __sync_add_and_fetch(cache->clock, 1);
 
   // only if it's not in front already:
   if(cache->mru != idx)
@@ -1024,6 +1029,63 @@ dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
   return 0;
 }
 
+int32_t
+dt_cache_lru_stamp(dt_cache_t *cache, uint32_t *stamp)
+{
+  int32_t rc = 1;
+  dt_cache_lock(&cache->lru_lock);
+  int32_t curr = cache->lru;
+  // skip the ones in use, but don't walk the whole list for it.
+  for(int i=0; curr >= 0 && i < 16; i++)
+  {
+    if(!cache->table[curr].read && !cache->table[curr].write)
+    {
+      *stamp = cache->table[curr].stamp;
+      rc = 0;
+      break;
+    }
+    curr = cache->table[curr].mru;
+  }
+  dt_cache_unlock(&cache->lru_lock);
+  return rc;
+}
+
+int32_t
+dt_cache_evict_lru(dt_cache_t *cache)
+{
+  int32_t rc = 1;
+#ifdef DT_CACHE_BFL
+  dt_cache_lock(&cache->lru_lock);
+  int32_t curr = cache->lru;
+  for(int i=0; curr >= 0 && i < 16; i++)
+  {
+    if(!dt_cache_remove_bucket_no_lru_lock(cache, curr))
+    {
+      rc = 0;
+      break;
+    }
+    curr = cache->table[curr].mru;
+  }
+  dt_cache_unlock(&cache->lru_lock);
+#else
+  dt_cache_lock(&cache->lru_lock);
+  int32_t curr = cache->lru;
+  dt_cache_unlock(&cache->lru_lock);
+  for(int i=0; curr >= 0 && i < 16; i++)
+  {
+    if(!dt_cache_remove_bucket(cache, curr))
+    {
+      rc = 0;
+      break;
+    }
+    dt_cache_lock(&cache->lru_lock);
+    curr = cache->table[curr].mru;
+    dt_cache_unlock(&cache->lru_lock);
+  }
+#endif
+  return rc;
+}
+
 void
 dt_cache_read_release(dt_cache_t *cache, const uint32_t key)
 {
@@ -41,6 +41,11 @@ typedef struct dt_cache_t
   // one fat lru lock, no use locking segments and possibly rolling back changes.
   uint32_t lru_lock;
 
+  // counts accesses, to stamp the buckets with. can be shared between caches,
+  // to compare their least recently used entries.
+  uint32_t *clock;
+  uint32_t own_clock;
+
   // callback functions for cache misses/garbage collection
   // allocate should return != 0 if a write lock on alloc is needed.
   // this might be useful for cases where the allocation takes a lot of time and you don't want
@@ -71,6 +76,13 @@ dt_cache_set_allocate_callback(
   cache->allocate_data = allocate_data;
 }
 static inline void
+dt_cache_set_clock(
+  dt_cache_t *cache,
+  uint32_t *clock)
+{
+  cache->clock = clock;
+}
+static inline void
 dt_cache_set_cleanup_callback(
   dt_cache_t *cache,
   void (*cleanup)(void*, const uint32_t, void*),
@@ -97,6 +109,12 @@ int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 // of the hashtable goes below the given parameter, in terms
 // of the user defined cost measure.
 int32_t dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
+// clock value of the last access to the least recently used entry which is not locked.
+// returns 0 on success, 1 if there is no such entry.
+int32_t dt_cache_lru_stamp(dt_cache_t *cache, uint32_t *stamp);
+// removes the least recently used entry which is not locked, regardless of the cost.
+// returns 0 on success, 1 if nothing could be removed.
+int32_t dt_cache_evict_lru(dt_cache_t *cache);
 
 // returns the number of elements currently stored in the cache.
 // O(N), where N is the total capacity. don't use!
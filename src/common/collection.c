@@ -23,6 +23,8 @@
 #include "common/metadata.h"
 #include "common/utility.h"
 #include "common/image.h"
+#include "common/image_cache.h"
+#include "common/selection.h"
 
 #include <stdio.h>
 #include <memory.h>
@@ -47,18 +49,23 @@ static const char* comparators[] =
 
 /* Stores the collection query, returns 1 if changed.. */
 static int _dt_collection_store (const dt_collection_t *collection, gchar *query);
-/* Counts the number of images in the current collection */
-static uint32_t _dt_collection_compute_count(const dt_collection_t *collection);
+/* Runs the collection query and keeps the result in memory, this also updates the count */
+static void _dt_collection_materialize(dt_collection_t *collection);
+/* Tests the images passed to dt_collection_image_changed() against the filter and patches the result */
+static void _dt_collection_resolve_changed(dt_collection_t *collection);
 /* signal handlers to update the cached count when something interesting might have happened.
  * we need 2 different since there are different kinds of signals we need to listen to. */
 static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data);
 static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data);
+static void _dt_collection_image_import_callback(gpointer instance, uint32_t imgid, gpointer user_data);
 
 
 const dt_collection_t *
 dt_collection_new (const dt_collection_t *clone)
 {
   dt_collection_t *collection = g_malloc0(sizeof(dt_collection_t));
+  collection->positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+  collection->changed = g_hash_table_new(g_direct_hash, g_direct_equal);
 
   /* initialize collection context*/
   if (clone)   /* if clone is provided let's copy it into this context */
@@ -69,6 +76,7 @@ dt_collection_new (const dt_collection_t *clone)
     collection->query = g_strdup(clone->query);
     collection->clone = 1;
     collection->count = clone->count;
+    collection->member_where = g_strdup(clone->member_where);
   }
   else  /* else we just initialize using the reset */
     dt_collection_reset (collection);
@@ -78,7 +86,7 @@ dt_collection_new (const dt_collection_t *clone)
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED, G_CALLBACK(_dt_collection_recount_callback_1), collection);
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_REMOVED, G_CALLBACK(_dt_collection_recount_callback_1), collection);
 
-  dt_control_signal_connect(darktable.signals, DT_SIGNAL_IMAGE_IMPORT, G_CALLBACK(_dt_collection_recount_callback_2), collection);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_IMAGE_IMPORT, G_CALLBACK(_dt_collection_image_import_callback), collection);
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED, G_CALLBACK(_dt_collection_recount_callback_2), collection);
 
   return collection;
@@ -89,11 +97,16 @@ dt_collection_free (const dt_collection_t *collection)
 {
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_recount_callback_1), (gpointer)collection);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_recount_callback_2), (gpointer)collection);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_image_import_callback), (gpointer)collection);
 
   if (collection->query)
     g_free (collection->query);
   if (collection->where_ext)
     g_free (collection->where_ext);
+  g_free(collection->member_where);
+  g_free(collection->ids);
+  g_hash_table_destroy(collection->positions);
+  g_hash_table_destroy(collection->changed);
   g_free ((dt_collection_t *)collection);
 }
 
@@ -110,6 +123,9 @@ dt_collection_update (const dt_collection_t *collection)
   gchar *wq, *sq, *selq, *query;
   wq = sq = selq = query = NULL;
 
+  /* the count below has to see the latest flags, not what is still queued */
+  dt_image_cache_flush(darktable.image_cache);
+
   /* build where part */
   if (!(collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
@@ -151,6 +167,11 @@ dt_collection_update (const dt_collection_t *collection)
     wq = dt_util_dstrcat(wq, " and (group_id = id or group_id = %d)", darktable.gui->expanded_group_id);
   }
 
+  /* single images can be tested against the plain where part, the extended one might carry joins */
+  g_free(collection->member_where);
+  ((dt_collection_t *)collection)->member_where =
+    (collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT) ? NULL : g_strdup(wq);
+
   /* build select part includes where */
   if (collection->params.sort == DT_COLLECTION_SORT_COLOR && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT))
     selq = dt_util_dstrcat(selq, "select distinct id from (select * from images where %s) as a left outer join color_labels as b on a.id = b.imgid", wq);
@@ -177,8 +198,8 @@ dt_collection_update (const dt_collection_t *collection)
   g_free(selq);
   g_free (query);
 
-  /* update the cached count. collection isn't a real const anyway, we are writing to it in _dt_collection_store, too. */
-  ((dt_collection_t*)collection)->count = _dt_collection_compute_count(collection);
+  /* update the cached result and count. collection isn't a real const anyway, we are writing to it in _dt_collection_store, too. */
+  _dt_collection_materialize((dt_collection_t *)collection);
   dt_collection_hint_message(collection);
 
   return result;
@@ -211,6 +232,9 @@ dt_collection_get_query (const dt_collection_t *collection)
   /* ensure there is a query string for collection */
   if(!collection->query)
     dt_collection_update(collection);
+  else
+    /* callers run it right away, it must not miss queued image changes */
+    dt_image_cache_flush(darktable.image_cache);
 
   return collection->query;
 }
@@ -400,48 +424,159 @@ _dt_collection_store (const dt_collection_t *collection, gchar *query)
   return 1;
 }
 
-static uint32_t _dt_collection_compute_count(const dt_collection_t *collection)
+static void _dt_collection_materialize(dt_collection_t *collection)
 {
   sqlite3_stmt *stmt = NULL;
-  uint32_t count=1;
   const gchar *query = dt_collection_get_query(collection);
-  gchar *count_query = NULL;
 
-  gchar *fq = g_strstr_len(query, strlen(query), "from");
-  if ((collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
-    count_query = dt_util_dstrcat(NULL, "select count(images.id) from images %s", collection->where_ext);
-  else
-    count_query = dt_util_dstrcat(count_query, "select count(id) %s", fq);
+  collection->ids_num = 0;
+  if(query && query[0] != '\0')
+  {
+    // a long sort shouldn't hold up everyone else on the main connection
+    sqlite3 *reader = dt_database_get_reader(darktable.db);
+    DT_DEBUG_SQLITE3_PREPARE_V2(reader, query, -1, &stmt, NULL);
+    if (collection->params.query_flags&COLLECTION_QUERY_USE_LIMIT)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+    }
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      if(collection->ids_num == collection->ids_alloc)
+      {
+        collection->ids_alloc = MAX(1024, 2*collection->ids_alloc);
+        collection->ids = g_realloc(collection->ids, sizeof(int32_t)*collection->ids_alloc);
+      }
+      collection->ids[collection->ids_num++] = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    dt_database_release_reader(darktable.db, reader);
+  }
+
+  collection->ids_valid = TRUE;
+  collection->positions_valid = FALSE;
+  g_hash_table_remove_all(collection->changed);
+  collection->count = collection->ids_num;
+}
+
+static void _dt_collection_build_positions(dt_collection_t *collection)
+{
+  g_hash_table_remove_all(collection->positions);
+  for(int k=collection->ids_num-1; k>=0; k--)
+    g_hash_table_insert(collection->positions, GINT_TO_POINTER(collection->ids[k]), GINT_TO_POINTER(k+1));
+  collection->positions_valid = TRUE;
+}
+
+/* makes sure ids and positions are up to date, running the query again only if we have to */
+static void _dt_collection_ensure_ids(dt_collection_t *collection)
+{
+  _dt_collection_resolve_changed(collection);
+  if(!collection->ids_valid) _dt_collection_materialize(collection);
+  if(!collection->positions_valid) _dt_collection_build_positions(collection);
+}
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
-  if ((collection->params.query_flags&COLLECTION_QUERY_USE_LIMIT) &&
-      !(collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+static void _dt_collection_resolve_changed(dt_collection_t *collection)
+{
+  if(g_hash_table_size(collection->changed) == 0) return;
+
+  /* without the old result we can't tell what changed, and without a where part we can't test single images */
+  if(!collection->ids_valid || !collection->member_where)
   {
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+    _dt_collection_materialize(collection);
+    return;
+  }
+  if(!collection->positions_valid) _dt_collection_build_positions(collection);
+
+  GHashTableIter iter;
+  gpointer key;
+  gchar *query = dt_util_dstrcat(NULL, "select id from images where (%s) and id in (", collection->member_where);
+  int first = 1;
+  g_hash_table_iter_init(&iter, collection->changed);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    query = dt_util_dstrcat(query, first ? "%d" : ",%d", GPOINTER_TO_INT(key));
+    first = 0;
   }
+  query = dt_util_dstrcat(query, ")");
 
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-    count = sqlite3_column_int(stmt, 0);
+  GHashTable *members = g_hash_table_new(g_direct_hash, g_direct_equal);
+  sqlite3_stmt *stmt = NULL;
+  dt_image_cache_flush(darktable.image_cache);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int id = sqlite3_column_int(stmt, 0);
+    g_hash_table_insert(members, GINT_TO_POINTER(id), GINT_TO_POINTER(id));
+  }
   sqlite3_finalize(stmt);
-  g_free(count_query);
-  return count;
+  g_free(query);
+
+  int entered = 0, left = 0, stayed = 0;
+  g_hash_table_iter_init(&iter, collection->changed);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    const int pos = GPOINTER_TO_INT(g_hash_table_lookup(collection->positions, key));
+    const int member = g_hash_table_lookup(members, key) != NULL;
+    if(member && !pos) entered++;
+    else if(member) stayed++;
+    else if(pos)
+    {
+      /* leaving images are simply cut out below */
+      collection->ids[pos-1] = -1;
+      left++;
+    }
+  }
+  g_hash_table_destroy(members);
+  g_hash_table_remove_all(collection->changed);
+
+  if(left)
+  {
+    uint32_t j = 0;
+    for(uint32_t k=0; k<collection->ids_num; k++)
+      if(collection->ids[k] != -1) collection->ids[j++] = collection->ids[k];
+    collection->ids_num = j;
+    collection->positions_valid = FALSE;
+  }
+  collection->count = collection->ids_num + entered;
+
+  /* we don't know where new images go, and rating and color sorting might have changed the order */
+  const int sort_changed = stayed && (collection->params.query_flags&COLLECTION_QUERY_USE_SORT) &&
+                           (collection->params.sort == DT_COLLECTION_SORT_RATING ||
+                            collection->params.sort == DT_COLLECTION_SORT_COLOR);
+  if(entered || sort_changed) collection->ids_valid = FALSE;
+}
+
+void dt_collection_image_changed(const dt_collection_t *collection, const int32_t imgid)
+{
+  if(imgid <= 0) return;
+  g_hash_table_insert(collection->changed, GINT_TO_POINTER(imgid), GINT_TO_POINTER(imgid));
 }
 
 uint32_t dt_collection_get_count(const dt_collection_t *collection)
 {
+  _dt_collection_resolve_changed((dt_collection_t *)collection);
   return collection->count;
 }
 
+int32_t dt_collection_get_nth(const dt_collection_t *collection, const int nth)
+{
+  _dt_collection_ensure_ids((dt_collection_t *)collection);
+  if(nth < 0 || (uint32_t)nth >= collection->ids_num) return -1;
+  return collection->ids[nth];
+}
+
+const int32_t *dt_collection_get_ids(const dt_collection_t *collection, uint32_t *num)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  _dt_collection_resolve_changed(c);
+  if(!c->ids_valid) _dt_collection_materialize(c);
+  *num = c->ids_num;
+  return c->ids;
+}
+
 uint32_t dt_collection_get_selected_count (const dt_collection_t *collection)
 {
-  sqlite3_stmt *stmt = NULL;
-  uint32_t count=0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select count (distinct imgid) from selected_images", -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-    count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
-  return count;
+  return dt_selection_get_count();
 }
 
 GList *dt_collection_get_selected (const dt_collection_t *collection, int limit)
@@ -565,8 +700,9 @@ get_query_string(const dt_collection_properties_t property, const gchar *escaped
       snprintf(query, query_len, "(maker || ' ' || model like '%%%s%%')", escaped_text);
       break;
     case DT_COLLECTION_PROP_TAG: // tag
-      snprintf(query, query_len, "(id in (select imgid from tagged_images as a join "
-               "tags as b on a.tagid = b.id where name like '%s'))", escaped_text);
+      // cross join: without statistics sqlite would scan all of tagged_images and look up the tags.
+      snprintf(query, query_len, "(id in (select imgid from tags as b cross join "
+               "tagged_images as a on a.tagid = b.id where name like '%s'))", escaped_text);
       break;
 
       // TODO: How to handle images without metadata? In the moment they are not shown.
@@ -813,42 +949,31 @@ void dt_collection_hint_message(const dt_collection_t *collection)
 
 int dt_collection_image_offset(int imgid)
 {
-  const gchar *qin = dt_collection_get_query (darktable.collection);
-  int offset = 0;
-  sqlite3_stmt *stmt;
+  dt_collection_t *collection = (dt_collection_t *)darktable.collection;
+  _dt_collection_ensure_ids(collection);
+  // 0 if it isn't part of the collection
+  const int pos = GPOINTER_TO_INT(g_hash_table_lookup(collection->positions, GINT_TO_POINTER(imgid)));
+  return pos ? pos - 1 : 0;
+}
 
-  if(qin)
+static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data)
+{
+  dt_collection_t *collection = (dt_collection_t*)user_data;
+  int old_count = collection->count;
+  _dt_collection_materialize(collection);
+  if(!collection->clone)
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1,  0);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-
-    gboolean found = FALSE;
-
-    while (sqlite3_step (stmt) == SQLITE_ROW)
-    {
-      int id = sqlite3_column_int(stmt, 0);
-      if (imgid == id)
-      {
-        found = TRUE;
-        break;
-      }
-      offset++;
-    }
-
-    if (!found)
-      offset = 0;
-
-    sqlite3_finalize(stmt);
+    if(old_count != collection->count)
+      dt_collection_hint_message(collection);
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
   }
-  return offset;
 }
 
-static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data)
+static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t*)user_data;
   int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection);
+  _dt_collection_materialize(collection);
   if(!collection->clone)
   {
     if(old_count != collection->count)
@@ -857,11 +982,30 @@ static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_da
   }
 }
 
-static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data)
+static void _dt_collection_image_import_callback(gpointer instance, uint32_t imgid, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t*)user_data;
   int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection);
+  if(collection->member_where)
+  {
+    /* a fresh image can't have been part of the collection, so testing it is enough to keep the count.
+     * where it goes in the order is left for the next time somebody asks for it. */
+    dt_image_cache_flush(darktable.image_cache);
+    gchar *query = dt_util_dstrcat(NULL, "select id from images where (%s) and id = ?1", collection->member_where);
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      collection->count++;
+      collection->ids_valid = FALSE;
+    }
+    sqlite3_finalize(stmt);
+    g_free(query);
+  }
+  else
+    _dt_collection_materialize(collection);
+
   if(!collection->clone)
   {
     if(old_count != collection->count)
@@ -133,6 +133,15 @@ typedef struct dt_collection_t
   unsigned int count;
   dt_collection_params_t params;
   dt_collection_params_t store;
+
+  /** the result of the query, kept in memory and patched on image changes. */
+  int32_t *ids;           // image ids in collection order
+  uint32_t ids_num, ids_alloc;
+  gboolean ids_valid;     // ids is what the query would return (count always is)
+  GHashTable *positions;  // image id -> position in ids + 1, rebuilt lazily
+  gboolean positions_valid;
+  GHashTable *changed;    // image ids which might have entered or left the collection
+  gchar *member_where;    // where part to test single images against, NULL if unknown
 }
 dt_collection_t;
 
@@ -198,6 +207,14 @@ void dt_collection_hint_message(const dt_collection_t *collection);
 
 /** returns the image offset in the collection */
 int dt_collection_image_offset(int imgid);
+/** the ids of the whole result in collection order, num of them. valid until the collection changes. */
+const int32_t *dt_collection_get_ids(const dt_collection_t *collection, uint32_t *num);
+/** returns the id of the image at offset nth in the collection, -1 if there is none */
+int32_t dt_collection_get_nth(const dt_collection_t *collection, const int nth);
+/** tell the collection that rating, labels or the like of an image changed, so it might have
+ *  entered or left the collection. membership is tested again (for all such images in one go)
+ *  next time the count or the order is needed. */
+void dt_collection_image_changed(const dt_collection_t *collection, const int32_t imgid);
 
 /* serialize and deserialize into a string. */
 void dt_collection_deserialize(char *buf);
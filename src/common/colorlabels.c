@@ -122,26 +122,19 @@ void dt_colorlabels_toggle_label (const int imgid, const int color)
   }
   sqlite3_finalize(stmt);
 
+  dt_collection_image_changed(darktable.collection, imgid);
   dt_collection_hint_message(darktable.collection);
 }
 
 int dt_colorlabels_check_label (const int imgid, const int color)
 {
   if(imgid <= 0) return 0;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select * from color_labels where imgid=?1 and color=?2", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "select * from color_labels where imgid=?1 and color=?2");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    sqlite3_finalize(stmt);
-    return 1;
-  }
-  else
-  {
-    sqlite3_finalize(stmt);
-    return 0;
-  }
+  const int found = sqlite3_step(stmt) == SQLITE_ROW;
+  dt_database_release_statement(darktable.db, stmt);
+  return found;
 }
 
 gboolean dt_colorlabels_key_accel_callback(GtkAccelGroup *accel_group,
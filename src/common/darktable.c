@@ -45,6 +45,7 @@
 #include "common/mipmap_cache.h"
 #include "common/opencl.h"
 #include "common/points.h"
+#include "common/tags.h"
 #include "develop/imageop.h"
 #include "develop/blend.h"
 #include "libs/lib.h"
@@ -634,7 +635,9 @@ int dt_init(int argc, char *argv[], const int init_gui,lua_State *L)
       gtk_disable_setlocale();
   }
 
-  // initialize the database
+  // initialize the database, the tag and selection indexes have to be there for its triggers and tables
+  dt_tag_index_init();
+  dt_selection_index_init();
   darktable.db = dt_database_init(dbfilename_from_command);
   if(darktable.db == NULL)
   {
@@ -918,7 +921,11 @@ void dt_cleanup()
   DestroyMagick();
 #endif
 
+  // the writer commits what's still queued when it goes
+  dt_selection_index_persist();
   dt_database_destroy(darktable.db);
+  dt_tag_index_cleanup();
+  dt_selection_index_cleanup();
 
   dt_bauhaus_cleanup();
 
@@ -20,6 +20,8 @@
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/database.h"
+#include "common/selection.h"
+#include "common/tags.h"
 #include "control/control.h"
 #include "control/conf.h"
 #include "gui/legacy_presets.h"
@@ -35,7 +37,7 @@
 #include <errno.h>
 
 // whenever _create_schema() gets changed you HAVE to bump this version and add an update path to _upgrade_schema_step()!
-#define CURRENT_DATABASE_VERSION 6
+#define CURRENT_DATABASE_VERSION 8
 
 typedef struct dt_database_t
 {
@@ -47,8 +49,51 @@ typedef struct dt_database_t
 
   /* ondisk DB */
   sqlite3 *handle;
+
+  /* prepared statements not in use right now, sql text -> GSList of sqlite3_stmt */
+  dt_pthread_mutex_t statements_mutex;
+  GHashTable *statements;
+
+  /* the following is only set up when the db could be switched to wal mode */
+  gboolean wal;
+
+  /* idle read only connections, and how many there are in total */
+  dt_pthread_mutex_t readers_mutex;
+  GSList *readers;
+  int readers_open;
+
+  /* the writer thread with its own connection and statement cache */
+  sqlite3 *writer;
+  GHashTable *writer_statements;
+  pthread_t writer_thread;
+  dt_pthread_mutex_t writer_mutex;
+  pthread_cond_t writer_cond;
+  GQueue *writes;
+  int writes_busy;
+  int writer_stop;
 } dt_database_t;
 
+typedef struct dt_database_write_job_t
+{
+  dt_database_write_t write;
+  void *data;
+  GDestroyNotify free_data;
+} dt_database_write_job_t;
+
+// statements kept per sql text (one is in use per thread at most, usually)
+#define DT_DATABASE_MAX_IDLE_STATEMENTS 8
+// distinct queries kept. there are far fewer fixed ones, this only catches generated sql piling up.
+#define DT_DATABASE_MAX_STATEMENTS 128
+// read only connections kept open at most, more readers than that share the main connection.
+#define DT_DATABASE_MAX_READERS 4
+// how long [ms] a connection waits for the write lock held by another one.
+#define DT_DATABASE_BUSY_TIMEOUT 30000
+
+
+static void _database_free_statements(gpointer data)
+{
+  g_slist_free_full((GSList *)data, (GDestroyNotify)sqlite3_finalize);
+}
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
@@ -492,6 +537,41 @@ static int _upgrade_schema_step(dt_database_t *db, int version)
 
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 6;
+  }
+  else if(version == 6)
+  {
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    if(sqlite3_exec(db->handle,
+                      "CREATE TABLE pending_sidecars (imgid INTEGER PRIMARY KEY, generation INTEGER)", NULL, NULL, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[init] can't create table pending_sidecars\n");
+      fprintf(stderr, "[init]   %s\n", sqlite3_errmsg(db->handle));
+      sqlite3_exec(db->handle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      return version;
+    }
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 7;
+  }
+  else if(version == 7)
+  {
+    // indexes for the tag and metadata filters of the collect module. see tests/library_bench.c
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    if(sqlite3_exec(db->handle,
+                      "CREATE INDEX IF NOT EXISTS tags_name_index ON tags (name)", NULL, NULL, NULL) != SQLITE_OK ||
+       sqlite3_exec(db->handle,
+                      "CREATE INDEX IF NOT EXISTS meta_data_key_index ON meta_data (key, id)", NULL, NULL, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[init] can't create indexes for tags and meta_data\n");
+      fprintf(stderr, "[init]   %s\n", sqlite3_errmsg(db->handle));
+      sqlite3_exec(db->handle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      return version;
+    }
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 8;
   }// maybe in the future, see commented out code elsewhere
 //   else if(version == XXX)
 //   {
@@ -564,6 +644,9 @@ static void _create_schema(dt_database_t *db)
   ////////////////////////////// selected_images
   DT_DEBUG_SQLITE3_EXEC(db->handle,
                         "CREATE TABLE selected_images (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  ////////////////////////////// pending_sidecars
+  DT_DEBUG_SQLITE3_EXEC(db->handle,
+                        "CREATE TABLE pending_sidecars (imgid INTEGER PRIMARY KEY, generation INTEGER)", NULL, NULL, NULL);
   ////////////////////////////// history
   DT_DEBUG_SQLITE3_EXEC(db->handle,
                         "CREATE TABLE history (imgid INTEGER, num INTEGER, module INTEGER, "
@@ -579,6 +662,8 @@ static void _create_schema(dt_database_t *db)
   DT_DEBUG_SQLITE3_EXEC(db->handle,
                         "CREATE TABLE tags (id INTEGER PRIMARY KEY, name VARCHAR, icon BLOB, "
                         "description VARCHAR, flags INTEGER)", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db->handle,
+                        "CREATE INDEX tags_name_index ON tags (name)", NULL, NULL, NULL);
   ////////////////////////////// tagged_images
   DT_DEBUG_SQLITE3_EXEC(db->handle,
                         "CREATE TABLE tagged_images (imgid INTEGER, tagid INTEGER, "
@@ -641,6 +726,8 @@ static void _create_schema(dt_database_t *db)
                         NULL, NULL, NULL);
   DT_DEBUG_SQLITE3_EXEC(db->handle,
                         "CREATE INDEX metadata_index ON meta_data (id, key)", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db->handle,
+                        "CREATE INDEX meta_data_key_index ON meta_data (key, id)", NULL, NULL, NULL);
   ////////////////////////////// presets
   DT_DEBUG_SQLITE3_EXEC(db->handle,
                         "CREATE TABLE presets (name VARCHAR, description VARCHAR, operation VARCHAR, op_version INTEGER, op_params BLOB, "
@@ -653,6 +740,151 @@ static void _create_schema(dt_database_t *db)
 
 }
 
+/* the tables of the memory database attached to each read-write connection */
+static void _create_memory_schema(sqlite3 *handle)
+{
+  // temporary stuff for some ops, need this for some reason with newer sqlite3:
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE memory.color_labels_temp (imgid INTEGER PRIMARY KEY)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE memory.tmp_selection (imgid INTEGER)", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE memory.tagq (tmpid INTEGER PRIMARY KEY, id INTEGER)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE memory.taglist "
+                        "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT REPLACE, "
+                        "count INTEGER)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE memory.history (imgid INTEGER, num INTEGER, module INTEGER, "
+                        "operation VARCHAR(256) UNIQUE ON CONFLICT REPLACE, op_params BLOB, enabled INTEGER, "
+                        "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TABLE MEMORY.style_items (styleid INTEGER, num INTEGER, module INTEGER, "
+                        "operation VARCHAR(256), op_params BLOB, enabled INTEGER, "
+                        "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))", NULL, NULL, NULL);
+}
+
+/* keeps the in-memory tag index of tags.c in sync with whatever any code writes to tags and tagged_images,
+   the first argument is a dt_tag_index_op_t.
+   temporary, so they live only as long as the connection and never end up in the db file. */
+static void _create_tag_index_triggers(sqlite3 *handle)
+{
+  sqlite3_create_function(handle, "dt_tag_index_update", 3, SQLITE_UTF8, NULL, dt_tag_index_sql_update, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TEMP TRIGGER dt_tag_index_insert_tag AFTER INSERT ON main.tags"
+                        " BEGIN SELECT dt_tag_index_update(0, new.id, new.name); END", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TEMP TRIGGER dt_tag_index_delete_tag AFTER DELETE ON main.tags"
+                        " BEGIN SELECT dt_tag_index_update(1, old.id, NULL); END", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TEMP TRIGGER dt_tag_index_rename_tag AFTER UPDATE OF name ON main.tags"
+                        " BEGIN SELECT dt_tag_index_update(2, new.id, new.name); END", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TEMP TRIGGER dt_tag_index_attach AFTER INSERT ON main.tagged_images"
+                        " BEGIN SELECT dt_tag_index_update(3, new.tagid, new.imgid); END", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle,
+                        "CREATE TEMP TRIGGER dt_tag_index_detach AFTER DELETE ON main.tagged_images"
+                        " BEGIN SELECT dt_tag_index_update(4, old.tagid, old.imgid); END", NULL, NULL, NULL);
+}
+
+/* the background thread doing the writes queued with dt_database_write(). everything queued
+   by the time it wakes up goes into one transaction on its own connection. */
+static void *_database_writer_thread(void *data)
+{
+  dt_database_t *db = (dt_database_t *)data;
+  dt_pthread_mutex_lock(&db->writer_mutex);
+  while(1)
+  {
+    while(!db->writer_stop && g_queue_is_empty(db->writes))
+      dt_pthread_cond_wait(&db->writer_cond, &db->writer_mutex);
+    if(g_queue_is_empty(db->writes)) break;
+
+    GQueue *jobs = db->writes;
+    db->writes = g_queue_new();
+    db->writes_busy = 1;
+    dt_pthread_mutex_unlock(&db->writer_mutex);
+
+    // immediate, so we wait for the write lock here instead of failing half way through.
+    sqlite3_exec(db->writer, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL);
+    for(GList *l = jobs->head; l; l = g_list_next(l))
+    {
+      dt_database_write_job_t *job = (dt_database_write_job_t *)l->data;
+      job->write(db->writer, job->data);
+    }
+    if(sqlite3_exec(db->writer, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[database] writer couldn't commit: %s\n", sqlite3_errmsg(db->writer));
+      sqlite3_exec(db->writer, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+    }
+    for(GList *l = jobs->head; l; l = g_list_next(l))
+    {
+      dt_database_write_job_t *job = (dt_database_write_job_t *)l->data;
+      if(job->free_data) job->free_data(job->data);
+      g_free(job);
+    }
+    g_queue_free(jobs);
+
+    dt_pthread_mutex_lock(&db->writer_mutex);
+    db->writes_busy = 0;
+    pthread_cond_broadcast(&db->writer_cond);
+  }
+  dt_pthread_mutex_unlock(&db->writer_mutex);
+  return NULL;
+}
+
+/* switches the db to wal mode, so that readers don't wait for writers any more */
+static void _database_init_wal(dt_database_t *db)
+{
+  sqlite3_stmt *stmt;
+  db->wal = FALSE;
+  if(sqlite3_prepare_v2(db->handle, "PRAGMA main.journal_mode = WAL", -1, &stmt, NULL) == SQLITE_OK)
+  {
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+      db->wal = !g_strcmp0((const char *)sqlite3_column_text(stmt, 0), "wal");
+    sqlite3_finalize(stmt);
+  }
+  if(!db->wal)
+  {
+    // network file systems and the like: stick to one connection
+    fprintf(stderr, "[init] database `%s' can't use wal mode, falling back to a single connection\n", db->dbfilename);
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  }
+}
+
+/* opens the connection of the writer thread and starts it, once the schema is in place */
+static void _database_init_writer(dt_database_t *db)
+{
+  if(!db->wal) return;
+  if(sqlite3_open(db->dbfilename, &db->writer))
+  {
+    fprintf(stderr, "[init] could not open a second connection to `%s', writing from the main one\n", db->dbfilename);
+    sqlite3_close(db->writer);
+    db->writer = NULL;
+    return;
+  }
+  sqlite3_busy_timeout(db->writer, DT_DATABASE_BUSY_TIMEOUT);
+  sqlite3_exec(db->writer, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+  sqlite3_exec(db->writer, "attach database ':memory:' as memory", NULL, NULL, NULL);
+  _create_memory_schema(db->writer);
+  _create_tag_index_triggers(db->writer);
+  dt_selection_index_attach(db->writer);
+
+  db->writer_statements = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _database_free_statements);
+  db->writes = g_queue_new();
+  db->writes_busy = 0;
+  db->writer_stop = 0;
+  dt_pthread_mutex_init(&db->writer_mutex, NULL);
+  pthread_cond_init(&db->writer_cond, NULL);
+  pthread_create(&db->writer_thread, NULL, &_database_writer_thread, db);
+}
+
 dt_database_t *dt_database_init(char *alternative)
 {
   /* migrate default database location to new default */
@@ -689,6 +921,9 @@ dt_database_t *dt_database_init(char *alternative)
   db->dbfilename = g_strdup(dbfilename);
   db->is_new_database = FALSE;
   db->lock_acquired = FALSE;
+  dt_pthread_mutex_init(&db->statements_mutex, NULL);
+  db->statements = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _database_free_statements);
+  dt_pthread_mutex_init(&db->readers_mutex, NULL);
 
   /* having more than one instance of darktable using the same database is a bad idea */
   /* try to get a lock for the database */
@@ -789,8 +1024,10 @@ lock_again:
   sqlite3_exec(db->handle, "attach database ':memory:' as memory",NULL,NULL,NULL);
 
   sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  // the page size can't be changed any more once the db is in wal mode
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+  sqlite3_busy_timeout(db->handle, DT_DATABASE_BUSY_TIMEOUT);
+  _database_init_wal(db);
 
   /* now that we got a functional database that is locked for us we can make sure that the schema is set up */
   // does the db contain the new 'db_info' table?
@@ -859,32 +1096,10 @@ lock_again:
   }
 
   // create the in-memory tables
-  // temporary stuff for some ops, need this for some reason with newer sqlite3:
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE memory.color_labels_temp (imgid INTEGER PRIMARY KEY)",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE memory.tmp_selection (imgid INTEGER)", NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE memory.tagq (tmpid INTEGER PRIMARY KEY, id INTEGER)",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE memory.taglist "
-                        "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT REPLACE, "
-                        "count INTEGER)",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE memory.history (imgid INTEGER, num INTEGER, module INTEGER, "
-                        "operation VARCHAR(256) UNIQUE ON CONFLICT REPLACE, op_params BLOB, enabled INTEGER, "
-                        "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(db->handle,
-                        "CREATE TABLE MEMORY.style_items (styleid INTEGER, num INTEGER, module INTEGER, "
-                        "operation VARCHAR(256), op_params BLOB, enabled INTEGER, "
-                        "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))", NULL, NULL, NULL);
+  _create_memory_schema(db->handle);
+  _create_tag_index_triggers(db->handle);
+  dt_selection_index_attach(db->handle);
+  dt_selection_index_load(db->handle);
 
   // create a table legacy_presets with all the presets from pre-auto-apply-cleanup darktable.
   dt_legacy_presets_create(db);
@@ -892,6 +1107,8 @@ lock_again:
   // drop table settings -- we don't want old versions of dt to drop our tables
   sqlite3_exec(db->handle, "drop table settings", NULL, NULL, NULL);
 
+  _database_init_writer(db);
+
 error:
   g_free(dbname);
 
@@ -900,17 +1117,171 @@ error:
 
 void dt_database_destroy(const dt_database_t *db)
 {
+  dt_database_t *d = (dt_database_t *)db;
+  if(d->writer)
+  {
+    // commits whatever is still queued
+    dt_pthread_mutex_lock(&d->writer_mutex);
+    d->writer_stop = 1;
+    pthread_cond_broadcast(&d->writer_cond);
+    dt_pthread_mutex_unlock(&d->writer_mutex);
+    pthread_join(d->writer_thread, NULL);
+    g_queue_free(d->writes);
+    pthread_cond_destroy(&d->writer_cond);
+    dt_pthread_mutex_destroy(&d->writer_mutex);
+    g_hash_table_destroy(d->writer_statements);
+    sqlite3_close(d->writer);
+  }
+  g_slist_free_full(d->readers, (GDestroyNotify)sqlite3_close);
+  dt_pthread_mutex_destroy(&d->readers_mutex);
+
+  // the cached statements have to be gone before the connection can be closed
+  g_hash_table_destroy(db->statements);
+  dt_pthread_mutex_destroy((dt_pthread_mutex_t *)&db->statements_mutex);
   sqlite3_close(db->handle);
   unlink(db->lockfile);
   g_free(db->lockfile);
   g_free((dt_database_t *)db);
 }
 
+static inline gboolean _database_is_writer(const dt_database_t *db)
+{
+  return db->writer && pthread_equal(pthread_self(), db->writer_thread);
+}
+
 sqlite3 *dt_database_get(const dt_database_t *db)
 {
+  // code run by the writer thread ends up in its transaction, whoever calls it.
+  if(_database_is_writer(db)) return db->writer;
   return db->handle;
 }
 
+sqlite3 *dt_database_get_reader(const dt_database_t *db)
+{
+  // the writer has to see what it wrote itself.
+  if(!db->wal || _database_is_writer(db)) return dt_database_get(db);
+
+  dt_database_t *d = (dt_database_t *)db;
+  sqlite3 *handle = NULL;
+  dt_pthread_mutex_lock(&d->readers_mutex);
+  if(d->readers)
+  {
+    handle = (sqlite3 *)d->readers->data;
+    d->readers = g_slist_delete_link(d->readers, d->readers);
+  }
+  else if(d->readers_open < DT_DATABASE_MAX_READERS)
+  {
+    if(sqlite3_open_v2(d->dbfilename, &handle, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+      d->readers_open++;
+    else
+    {
+      fprintf(stderr, "[database] could not open a read only connection: %s\n", sqlite3_errmsg(handle));
+      sqlite3_close(handle);
+      handle = NULL;
+    }
+  }
+  dt_pthread_mutex_unlock(&d->readers_mutex);
+
+  return handle ? handle : d->handle;
+}
+
+void dt_database_release_reader(const dt_database_t *db, sqlite3 *handle)
+{
+  if(!handle || handle == db->handle || handle == db->writer) return;
+  dt_database_t *d = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&d->readers_mutex);
+  d->readers = g_slist_prepend(d->readers, handle);
+  dt_pthread_mutex_unlock(&d->readers_mutex);
+}
+
+void dt_database_write(const dt_database_t *db, dt_database_write_t write, void *data, GDestroyNotify free_data)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(!d->writer || _database_is_writer(d))
+  {
+    // no writer thread, or we are it already: do it right away. the writer is in its transaction already,
+    // the main connection is shared between threads and any transaction opened on it would take in
+    // whatever they do in the meantime, so the statements just commit one by one there.
+    write(dt_database_get(d), data);
+    if(free_data) free_data(data);
+    return;
+  }
+
+  dt_database_write_job_t *job = (dt_database_write_job_t *)g_malloc(sizeof(dt_database_write_job_t));
+  job->write = write;
+  job->data = data;
+  job->free_data = free_data;
+  dt_pthread_mutex_lock(&d->writer_mutex);
+  g_queue_push_tail(d->writes, job);
+  pthread_cond_broadcast(&d->writer_cond);
+  dt_pthread_mutex_unlock(&d->writer_mutex);
+}
+
+void dt_database_write_sync(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(!d->writer || _database_is_writer(d)) return;
+  dt_pthread_mutex_lock(&d->writer_mutex);
+  while(!g_queue_is_empty(d->writes) || d->writes_busy)
+    dt_pthread_cond_wait(&d->writer_cond, &d->writer_mutex);
+  dt_pthread_mutex_unlock(&d->writer_mutex);
+}
+
+sqlite3_stmt *dt_database_get_statement(const dt_database_t *db, const char *sql)
+{
+  sqlite3_stmt *stmt = NULL;
+  sqlite3 *handle = dt_database_get(db);
+  GHashTable *statements = handle == db->writer ? db->writer_statements : db->statements;
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&db->statements_mutex);
+  gpointer key = NULL, value = NULL;
+  if(g_hash_table_lookup_extended(statements, sql, &key, &value) && value)
+  {
+    GSList *idle = (GSList *)value;
+    stmt = (sqlite3_stmt *)idle->data;
+    // the key stays, an empty list just means all of them are in use.
+    g_hash_table_steal(statements, sql);
+    g_hash_table_insert(statements, key, g_slist_delete_link(idle, idle));
+  }
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&db->statements_mutex);
+
+  if(!stmt) DT_DEBUG_SQLITE3_PREPARE_V2(handle, sql, -1, &stmt, NULL);
+  return stmt;
+}
+
+void dt_database_release_statement(const dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  // sqlite3_sql() gives back exactly the text we prepared it from.
+  const char *sql = sqlite3_sql(stmt);
+  GHashTable *statements = sqlite3_db_handle(stmt) == db->writer ? db->writer_statements : db->statements;
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&db->statements_mutex);
+  gpointer key = NULL, value = NULL;
+  if(g_hash_table_lookup_extended(statements, sql, &key, &value))
+  {
+    GSList *idle = (GSList *)value;
+    if(g_slist_length(idle) < DT_DATABASE_MAX_IDLE_STATEMENTS)
+    {
+      g_hash_table_steal(statements, sql);
+      g_hash_table_insert(statements, key, g_slist_prepend(idle, stmt));
+      stmt = NULL;
+    }
+  }
+  else
+  {
+    if(g_hash_table_size(statements) >= DT_DATABASE_MAX_STATEMENTS)
+      g_hash_table_remove_all(statements);
+    g_hash_table_insert(statements, g_strdup(sql), g_slist_prepend(NULL, stmt));
+    stmt = NULL;
+  }
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&db->statements_mutex);
+
+  // cache is full for this one
+  if(stmt) sqlite3_finalize(stmt);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename;
@@ -35,6 +35,35 @@ gboolean dt_database_is_new(const struct dt_database_t *db);
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
 gboolean dt_database_get_lock_acquired(const struct dt_database_t *db);
+
+struct sqlite3_stmt;
+/** get a reset, unbound statement for sql from the connection's statement cache, preparing it on first use.
+ *  meant for queries which run over and over again (per image, per thumbnail). the statement belongs to the
+ *  caller until it's handed back with dt_database_release_statement(), never sqlite3_finalize() it.
+ *  only use it for fixed sql, not for query text put together at runtime: once DT_DATABASE_MAX_STATEMENTS
+ *  different queries are cached, the next one handed back finalizes all the idle ones and starts over. */
+struct sqlite3_stmt *dt_database_get_statement(const struct dt_database_t *db, const char *sql);
+/** reset the statement, clear its bindings and put it back into the cache. */
+void dt_database_release_statement(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
+
+/** get a read only connection for bulk queries, so they don't hold up the main connection. it sees
+ *  the tables on disk as of the last commit, the memory.* tables aren't there and selected_images is the
+ *  last persisted selection (see dt_selection_index_persist()). falls back to the main
+ *  connection if the db isn't in wal mode. hand it back with dt_database_release_reader(). */
+struct sqlite3 *dt_database_get_reader(const struct dt_database_t *db);
+/** put a connection from dt_database_get_reader() back into the pool. */
+void dt_database_release_reader(const struct dt_database_t *db, struct sqlite3 *handle);
+
+typedef void (*dt_database_write_t)(struct sqlite3 *handle, void *data);
+/** queue write(handle, data) for the writer thread, which runs it on its own connection, in one
+ *  transaction with whatever else is queued at that time. dt_database_get() returns that connection
+ *  to everything write() calls. free_data(data) is called after the commit, if given. neither of them
+ *  may take the gdk lock (raise signals, update progress): the gui thread might hold it while it waits
+ *  for the database. without wal mode, or when called from the writer
+ *  thread itself, write() runs right away, without a transaction of its own. */
+void dt_database_write(const struct dt_database_t *db, dt_database_write_t write, void *data, GDestroyNotify free_data);
+/** wait until everything queued with dt_database_write() so far is committed. */
+void dt_database_write_sync(const struct dt_database_t *db);
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
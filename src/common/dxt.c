@@ -0,0 +1,220 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/dxt.h"
+
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+// spreads the 4 bits of a movemask to bits 0, 2, 4, 6 (one 2-bit index per pixel)
+static const uint8_t _dxt_spread[16] =
+{
+  0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+  0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55
+};
+
+static inline int
+_dxt_565(const uint8_t *const c)
+{
+  const int r = (c[0] * 31 + 127) / 255;
+  const int g = (c[1] * 63 + 127) / 255;
+  const int b = (c[2] * 31 + 127) / 255;
+  return (r << 11) | (g << 5) | b;
+}
+
+static inline void
+_dxt_unpack_565(const int v, int *c)
+{
+  const int r = (v >> 11) & 0x1f, g = (v >> 5) & 0x3f, b = v & 0x1f;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// block of 16 pixels, 4 bytes each, row major.
+static void
+_dxt1_compress_block(const uint8_t *const px, uint8_t *const block)
+{
+  // mean and covariance of the first three channels
+  int sum[3] = {0};
+  for(int k=0; k<16; k++) for(int c=0; c<3; c++) sum[c] += px[4*k+c];
+  const float mean[3] = { sum[0]/16.0f, sum[1]/16.0f, sum[2]/16.0f };
+  float cov[6] = {0.0f};
+  for(int k=0; k<16; k++)
+  {
+    const float d0 = px[4*k+0] - mean[0], d1 = px[4*k+1] - mean[1], d2 = px[4*k+2] - mean[2];
+    cov[0] += d0*d0; cov[1] += d0*d1; cov[2] += d0*d2;
+    cov[3] += d1*d1; cov[4] += d1*d2; cov[5] += d2*d2;
+  }
+
+  // principal axis by power iteration, starting at the row with the largest variance
+  float v[3];
+  if(cov[0] >= cov[3] && cov[0] >= cov[5]) { v[0] = cov[0]; v[1] = cov[1]; v[2] = cov[2]; }
+  else if(cov[3] >= cov[5])                { v[0] = cov[1]; v[1] = cov[3]; v[2] = cov[4]; }
+  else                                     { v[0] = cov[2]; v[1] = cov[4]; v[2] = cov[5]; }
+  for(int it=0; it<8; it++)
+  {
+    const float w0 = cov[0]*v[0] + cov[1]*v[1] + cov[2]*v[2];
+    const float w1 = cov[1]*v[0] + cov[3]*v[1] + cov[4]*v[2];
+    const float w2 = cov[2]*v[0] + cov[4]*v[1] + cov[5]*v[2];
+    const float m = fmaxf(fabsf(w0), fmaxf(fabsf(w1), fabsf(w2)));
+    if(m <= 0.0f) break;
+    v[0] = w0/m; v[1] = w1/m; v[2] = w2/m;
+  }
+
+  // endpoints are the extreme pixels along that axis
+  int imin = 0, imax = 0;
+  float pmin = INFINITY, pmax = -INFINITY;
+  for(int k=0; k<16; k++)
+  {
+    const float p = px[4*k+0]*v[0] + px[4*k+1]*v[1] + px[4*k+2]*v[2];
+    if(p < pmin) { pmin = p; imin = k; }
+    if(p > pmax) { pmax = p; imax = k; }
+  }
+  int a = _dxt_565(px + 4*imax), b = _dxt_565(px + 4*imin);
+
+  // four colour mode needs a > b. if both quantise to the same value, everything is index 0.
+  if(a < b) { const int t = a; a = b; b = t; }
+  block[0] = a & 0xff;
+  block[1] = a >> 8;
+  block[2] = b & 0xff;
+  block[3] = b >> 8;
+  if(a == b)
+  {
+    memset(block + 4, 0, 4);
+    return;
+  }
+
+  // project onto the quantised endpoints: t = (p - e0).d, l = d.d. with f = t/l, the palette
+  // has 0 at index 0, 1/3 at 2, 2/3 at 3 and 1 at index 1, so the nearest entry follows from
+  // comparing 6t against l, 3l and 5l.
+  int e0[3], e1[3];
+  _dxt_unpack_565(a, e0);
+  _dxt_unpack_565(b, e1);
+  const int d0 = e1[0] - e0[0], d1 = e1[1] - e0[1], d2 = e1[2] - e0[2];
+  const int l = d0*d0 + d1*d1 + d2*d2;
+  const __m128i dir = _mm_set_epi16(0, d2, d1, d0, 0, d2, d1, d0);
+  const __m128i off = _mm_set1_epi32(e0[0]*d0 + e0[1]*d1 + e0[2]*d2);
+  const __m128i l1 = _mm_set1_epi32(l), l3 = _mm_set1_epi32(3*l), l5 = _mm_set1_epi32(5*l);
+  const __m128i zero = _mm_setzero_si128();
+  for(int j=0; j<4; j++)
+  {
+    const __m128i row = _mm_loadu_si128((const __m128i *)(px + 16*j));
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(row, zero), dir);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(row, zero), dir);
+    const __m128 lof = _mm_castsi128_ps(lo), hif = _mm_castsi128_ps(hi);
+    const __m128i dot = _mm_add_epi32(
+                          _mm_castps_si128(_mm_shuffle_ps(lof, hif, _MM_SHUFFLE(2, 0, 2, 0))),
+                          _mm_castps_si128(_mm_shuffle_ps(lof, hif, _MM_SHUFFLE(3, 1, 3, 1))));
+    const __m128i t = _mm_sub_epi32(dot, off);
+    const __m128i t6 = _mm_add_epi32(_mm_slli_epi32(t, 2), _mm_slli_epi32(t, 1));
+    const __m128i c1 = _mm_cmpgt_epi32(t6, l1);
+    const __m128i c2 = _mm_cmpgt_epi32(t6, l3);
+    const __m128i c3 = _mm_cmpgt_epi32(t6, l5);
+    const int bit0 = _mm_movemask_ps(_mm_castsi128_ps(c2));
+    const int bit1 = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(c3, c1)));
+    block[4+j] = _dxt_spread[bit0] | (_dxt_spread[bit1] << 1);
+  }
+}
+
+void
+dt_dxt1_compress(const uint8_t *const in, const int width, const int height, uint8_t *const out)
+{
+  const int bw = (width+3)/4, bh = (height+3)/4;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) shared(out)
+#endif
+  for(int by=0; by<bh; by++)
+  {
+    uint8_t px[64] __attribute__((aligned(16)));
+    for(int bx=0; bx<bw; bx++)
+    {
+      const int x = 4*bx, y = 4*by;
+      if(x + 4 <= width && y + 4 <= height)
+      {
+        for(int j=0; j<4; j++)
+          memcpy(px + 16*j, in + 4*((size_t)width*(y+j) + x), 16);
+      }
+      else
+      {
+        // repeat the last row/column on the border, it doesn't pull the endpoints around.
+        for(int j=0; j<4; j++) for(int i=0; i<4; i++)
+        {
+          const int xx = x+i < width ? x+i : width-1, yy = y+j < height ? y+j : height-1;
+          memcpy(px + 16*j + 4*i, in + 4*((size_t)width*yy + xx), 4);
+        }
+      }
+      _dxt1_compress_block(px, out + 8*((size_t)bw*by + bx));
+    }
+  }
+}
+
+void
+dt_dxt1_decompress(const uint8_t *const in, const int width, const int height, uint8_t *const out)
+{
+  const int bw = (width+3)/4, bh = (height+3)/4;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) shared(out)
+#endif
+  for(int by=0; by<bh; by++)
+  {
+    for(int bx=0; bx<bw; bx++)
+    {
+      const uint8_t *block = in + 8*((size_t)bw*by + bx);
+      const int a = block[0] | (block[1] << 8), b = block[2] | (block[3] << 8);
+      int c0[3], c1[3];
+      _dxt_unpack_565(a, c0);
+      _dxt_unpack_565(b, c1);
+      // same palette as squish, including the transparent black of three colour blocks:
+      uint32_t pal[4];
+      pal[0] = c0[0] | (c0[1] << 8) | (c0[2] << 16) | (0xffu << 24);
+      pal[1] = c1[0] | (c1[1] << 8) | (c1[2] << 16) | (0xffu << 24);
+      if(a > b)
+      {
+        pal[2] = (2*c0[0] + c1[0])/3 | ((2*c0[1] + c1[1])/3 << 8) | ((2*c0[2] + c1[2])/3 << 16) | (0xffu << 24);
+        pal[3] = (c0[0] + 2*c1[0])/3 | ((c0[1] + 2*c1[1])/3 << 8) | ((c0[2] + 2*c1[2])/3 << 16) | (0xffu << 24);
+      }
+      else
+      {
+        pal[2] = (c0[0] + c1[0])/2 | ((c0[1] + c1[1])/2 << 8) | ((c0[2] + c1[2])/2 << 16) | (0xffu << 24);
+        pal[3] = 0;
+      }
+
+      const int x = 4*bx, y = 4*by;
+      if(x + 4 <= width && y + 4 <= height)
+      {
+        for(int j=0; j<4; j++)
+        {
+          const int idx = block[4+j];
+          _mm_storeu_si128((__m128i *)(out + 4*((size_t)width*(y+j) + x)),
+                           _mm_set_epi32(pal[idx >> 6], pal[(idx >> 4) & 3], pal[(idx >> 2) & 3], pal[idx & 3]));
+        }
+      }
+      else
+      {
+        for(int j=0; j<4 && y+j<height; j++) for(int i=0; i<4 && x+i<width; i++)
+          memcpy(out + 4*((size_t)width*(y+j) + x+i), pal + ((block[4+j] >> (2*i)) & 3), 4);
+      }
+    }
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,44 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_DXT_H
+#define DT_DXT_H
+
+#include <inttypes.h>
+
+/**
+ * dxt1 for the thumbnails in the mipmap cache: 8-bit, 4 channels per pixel (the fourth is
+ * ignored), 8 bytes per 4x4 block. the blocks are laid out as squish does it, and the first
+ * channel goes to the 5 high bits, so the two can read each other's output.
+ */
+
+/** size of the compressed image in bytes. */
+static inline int dt_dxt1_size(const int width, const int height)
+{
+  return ((width+3)/4) * ((height+3)/4) * 8;
+}
+
+/** range fit encoder: endpoints on the principal axis of each block, indices by projection. */
+void dt_dxt1_compress(const uint8_t *const in, const int width, const int height, uint8_t *const out);
+
+/** decodes to 4 channels per pixel, alpha 255 (0 for transparent 3-colour blocks). */
+void dt_dxt1_decompress(const uint8_t *const in, const int width, const int height, uint8_t *const out);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -31,6 +31,9 @@
 #include <glib.h>
 #include <zlib.h>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -839,23 +842,28 @@ int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size)
   }
 }
 
-/** read the metadata of an image.
- * XMP data trumps IPTC data trumps EXIF data
- */
-int dt_exif_read(dt_image_t *img, const char* path)
+struct dt_exif_prefetch_t
+{
+  Exiv2::Image::AutoPtr image;  // the image file, empty if it couldn't be parsed
+  Exiv2::Image::AutoPtr xmp;    // the xmp sidecar, empty if there is none
+};
+
+// at least set datetime taken to something useful in case there is no exif data in this file (pfm, png, ...)
+static void dt_exif_read_mtime(dt_image_t *img, const char* path)
 {
-  // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png, ...)
   struct stat statbuf;
   stat(path, &statbuf);
   struct tm result;
   strftime(img->exif_datetime_taken, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
+}
 
+/** apply the already parsed metadata of an image.
+ * XMP data trumps IPTC data trumps EXIF data
+ */
+static int dt_exif_read_image_data(dt_image_t *img, const char* path, Exiv2::Image *image)
+{
   try
   {
-    Exiv2::Image::AutoPtr image;
-    image = Exiv2::ImageFactory::open(path);
-    assert(image.get() != 0);
-    image->readMetadata();
     bool res = true;
 
     // EXIF metadata
@@ -894,6 +902,83 @@ int dt_exif_read(dt_image_t *img, const char* path)
   }
 }
 
+/** read the metadata of an image. */
+static int dt_exif_read_image(dt_image_t *img, const char* path, const uint8_t *data, const size_t size)
+{
+  dt_exif_read_mtime(img, path);
+
+  try
+  {
+    Exiv2::Image::AutoPtr image;
+    // parse straight from memory if the caller already has the file mapped
+    if(data)
+      image = Exiv2::ImageFactory::open((const Exiv2::byte *)data, size);
+    else
+      image = Exiv2::ImageFactory::open(path);
+    assert(image.get() != 0);
+    image->readMetadata();
+    return dt_exif_read_image_data(img, path, image.get());
+  }
+  catch (Exiv2::AnyError& e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+    return 1;
+  }
+}
+
+int dt_exif_read(dt_image_t *img, const char* path)
+{
+  return dt_exif_read_image(img, path, NULL, 0);
+}
+
+int dt_exif_read_from_map(dt_image_t *img, const char* path, const uint8_t *data, const size_t size)
+{
+  return dt_exif_read_image(img, path, data, size);
+}
+
+dt_exif_prefetch_t *dt_exif_prefetch(const char* path, const char* xmp_path)
+{
+  dt_exif_prefetch_t *p = new dt_exif_prefetch_t;
+  try
+  {
+    p->image = Exiv2::ImageFactory::open(path);
+    p->image->readMetadata();
+  }
+  catch (Exiv2::AnyError& e)
+  {
+    // reported again by dt_exif_read_prefetched(), from the importing thread
+    p->image.reset();
+  }
+  // exclude pfm to avoid stupid errors on the console, like dt_exif_xmp_read() does
+  const char *c = path + strlen(path) - 4;
+  if(xmp_path && !(c >= path && !strcmp(c, ".pfm")) && g_file_test(xmp_path, G_FILE_TEST_IS_REGULAR))
+  {
+    try
+    {
+      p->xmp = Exiv2::ImageFactory::open(xmp_path);
+      p->xmp->readMetadata();
+    }
+    catch (Exiv2::AnyError& e)
+    {
+      p->xmp.reset();
+    }
+  }
+  return p;
+}
+
+void dt_exif_prefetch_free(dt_exif_prefetch_t *p)
+{
+  delete p;
+}
+
+int dt_exif_read_prefetched(dt_image_t *img, const char* path, dt_exif_prefetch_t *p)
+{
+  if(!p->image.get()) return dt_exif_read(img, path);
+  dt_exif_read_mtime(img, path);
+  return dt_exif_read_image_data(img, path, p->image.get());
+}
+
 int dt_exif_write_blob(uint8_t *blob,uint32_t size, const char* path)
 {
   try
@@ -1459,18 +1544,10 @@ static void _exif_import_tags(dt_image_t *img,Exiv2::XmpData::iterator &pos)
 }
 
 // need a write lock on *img (non-const) to write stars (and soon color labels).
-int dt_exif_xmp_read (dt_image_t *img, const char* filename, const int history_only)
+static int dt_exif_xmp_read_image(dt_image_t *img, Exiv2::Image *image, const int history_only)
 {
-  // exclude pfm to avoid stupid errors on the console
-  const char *c = filename + strlen(filename) - 4;
-  if(c >= filename && !strcmp(c, ".pfm")) return 1;
   try
   {
-    // read xmp sidecar
-    Exiv2::Image::AutoPtr image;
-    image = Exiv2::ImageFactory::open(filename);
-    assert(image.get() != 0);
-    image->readMetadata();
     Exiv2::XmpData &xmpData = image->xmpData();
 
     sqlite3_stmt *stmt;
@@ -1736,35 +1813,208 @@ int dt_exif_xmp_read (dt_image_t *img, const char* filename, const int history_o
   return 0;
 }
 
-// helper to create an xmp data thing. throws exiv2 exceptions if stuff goes wrong.
-static void
-dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
+int dt_exif_xmp_read (dt_image_t *img, const char* filename, const int history_only)
 {
-  const int xmp_version = 1;
-  int stars = 1, raw_params = 0;
-  double longitude = NAN, latitude = NAN;
-  gchar *filename = NULL;
-  // get stars and raw params from db
+  // exclude pfm to avoid stupid errors on the console
+  const char *c = filename + strlen(filename) - 4;
+  if(c >= filename && !strcmp(c, ".pfm")) return 1;
+  try
+  {
+    // read xmp sidecar
+    Exiv2::Image::AutoPtr image;
+    image = Exiv2::ImageFactory::open(filename);
+    assert(image.get() != 0);
+    image->readMetadata();
+    return dt_exif_xmp_read_image(img, image.get(), history_only);
+  }
+  catch (Exiv2::AnyError& e)
+  {
+    // actually nobody's interested in that if the file doesn't exist
+    return 1;
+  }
+}
+
+int dt_exif_xmp_read_prefetched (dt_image_t *img, dt_exif_prefetch_t *p)
+{
+  if(!p->xmp.get()) return 1;
+  return dt_exif_xmp_read_image(img, p->xmp.get(), 0);
+}
+
+// everything about one image dt_exif_xmp_read_data() takes from the database.
+typedef struct dt_exif_xmp_mask_t
+{
+  int id, type, version, nb;
+  std::string name, points, src;
+}
+dt_exif_xmp_mask_t;
+
+typedef struct dt_exif_xmp_history_t
+{
+  int modversion, enabled, blendop_version, multi_priority;
+  bool has_operation, has_blendop;
+  std::string operation, params, blendop_params, multi_name;
+}
+dt_exif_xmp_history_t;
+
+typedef struct dt_exif_xmp_record_t
+{
+  int imgid;
+  int stars, raw_params;
+  double longitude, latitude;
+  bool has_filename;
+  std::string filename;
+  std::vector<std::pair<int, std::string> > metadata;
+  std::vector<std::string> tags;  // names of the attached tags
+  std::vector<int> colorlabels;
+  std::vector<dt_exif_xmp_mask_t> masks;
+  std::vector<dt_exif_xmp_history_t> history;
+}
+dt_exif_xmp_record_t;
+
+static std::string dt_exif_xmp_column_string(sqlite3_stmt *stmt, const int col)
+{
+  const char *s = (const char *)sqlite3_column_text(stmt, col);
+  return s ? std::string(s) : std::string();
+}
+
+static std::string dt_exif_xmp_column_blob(sqlite3_stmt *stmt, const int col)
+{
+  const char *b = (const char *)sqlite3_column_blob(stmt, col);
+  return b ? std::string(b, sqlite3_column_bytes(stmt, col)) : std::string();
+}
+
+// fills in the records for all their images with one query per table instead of five per image.
+// rows of one image keep the order the per image queries had.
+static void dt_exif_xmp_read_records(std::vector<dt_exif_xmp_record_t> &records)
+{
+  if(records.empty()) return;
+  // the image rows might still be queued in the image cache
+  dt_image_cache_flush(darktable.image_cache);
+  std::map<int, dt_exif_xmp_record_t *> by_id;
+  std::ostringstream ids;
+  for(size_t k = 0; k < records.size(); k++)
+  {
+    dt_exif_xmp_record_t &r = records[k];
+    r.stars = 1;
+    r.raw_params = 0;
+    r.longitude = r.latitude = NAN;
+    r.has_filename = false;
+    by_id[r.imgid] = &r;
+    ids << (k ? "," : "") << r.imgid;
+  }
+
+  sqlite3 *db = dt_database_get(darktable.db);
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select filename, flags, raw_parameters, longitude, latitude from images where id = ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  std::string query;
+
+  // get stars and raw params from db
+  query = "select id, filename, flags, raw_parameters, longitude, latitude from images where id in (" + ids.str() + ")";
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query.c_str(), -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    filename   = (gchar*)sqlite3_column_text(stmt, 0);
-    stars      = sqlite3_column_int(stmt, 1);
-    raw_params = sqlite3_column_int(stmt, 2);
-    if(sqlite3_column_type(stmt, 3) == SQLITE_FLOAT)
-      longitude  = sqlite3_column_double(stmt, 3);
+    dt_exif_xmp_record_t *r = by_id[sqlite3_column_int(stmt, 0)];
+    r->has_filename = sqlite3_column_type(stmt, 1) != SQLITE_NULL;
+    r->filename   = dt_exif_xmp_column_string(stmt, 1);
+    r->stars      = sqlite3_column_int(stmt, 2);
+    r->raw_params = sqlite3_column_int(stmt, 3);
     if(sqlite3_column_type(stmt, 4) == SQLITE_FLOAT)
-      latitude   = sqlite3_column_double(stmt, 4);
+      r->longitude  = sqlite3_column_double(stmt, 4);
+    if(sqlite3_column_type(stmt, 5) == SQLITE_FLOAT)
+      r->latitude   = sqlite3_column_double(stmt, 5);
   }
+  sqlite3_finalize(stmt);
+
+  // the meta data
+  query = "select id, key, value from meta_data where id in (" + ids.str() + ")";
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query.c_str(), -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    by_id[sqlite3_column_int(stmt, 0)]->metadata.push_back(
+      std::make_pair(sqlite3_column_int(stmt, 1), dt_exif_xmp_column_string(stmt, 2)));
+  sqlite3_finalize(stmt);
+
+  // tags, what dt_tag_get_attached() returns
+  query = "select distinct tagged_images.imgid, T.id, T.name from tagged_images join tags T on T.id = tagged_images.tagid "
+          "where tagged_images.imgid in (" + ids.str() + ")";
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query.c_str(), -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    by_id[sqlite3_column_int(stmt, 0)]->tags.push_back(dt_exif_xmp_column_string(stmt, 2));
+  sqlite3_finalize(stmt);
+
+  // color labels
+  query = "select imgid, color from color_labels where imgid in (" + ids.str() + ")";
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query.c_str(), -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    by_id[sqlite3_column_int(stmt, 0)]->colorlabels.push_back(sqlite3_column_int(stmt, 1));
+  sqlite3_finalize(stmt);
+
+  // masks
+  query = "select imgid, formid, form, name, version, points, points_count, source from mask where imgid in (" + ids.str() + ")";
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query.c_str(), -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_exif_xmp_mask_t m;
+    m.id      = sqlite3_column_int(stmt, 1);
+    m.type    = sqlite3_column_int(stmt, 2);
+    m.name    = dt_exif_xmp_column_string(stmt, 3);
+    m.version = sqlite3_column_int(stmt, 4);
+    m.points  = dt_exif_xmp_column_blob(stmt, 5);
+    m.nb      = sqlite3_column_int(stmt, 6);
+    m.src     = dt_exif_xmp_column_blob(stmt, 7);
+    by_id[sqlite3_column_int(stmt, 0)]->masks.push_back(m);
+  }
+  sqlite3_finalize(stmt);
+
+  // history stack
+  query = "select imgid, num, module, operation, op_params, enabled, blendop_params, "
+          "blendop_version, multi_priority, multi_name from history where imgid in (" + ids.str() + ") order by imgid, num";
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query.c_str(), -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_exif_xmp_history_t h;
+    h.modversion      = sqlite3_column_int(stmt, 2);
+    h.has_operation   = sqlite3_column_type(stmt, 3) != SQLITE_NULL;
+    h.operation       = dt_exif_xmp_column_string(stmt, 3);
+    h.params          = dt_exif_xmp_column_blob(stmt, 4);
+    h.enabled         = sqlite3_column_int(stmt, 5);
+    h.has_blendop     = sqlite3_column_blob(stmt, 6) != NULL;
+    h.blendop_params  = dt_exif_xmp_column_blob(stmt, 6);
+    h.blendop_version = sqlite3_column_int(stmt, 7);
+    h.multi_priority  = sqlite3_column_int(stmt, 8);
+    h.multi_name      = dt_exif_xmp_column_string(stmt, 9);
+    by_id[sqlite3_column_int(stmt, 0)]->history.push_back(h);
+  }
+  sqlite3_finalize(stmt);
+}
+
+// reads a ',' separated list into an xmp array the way it always has been, empty entries included.
+static void dt_exif_xmp_read_list(Exiv2::Value *v, const std::vector<std::string> &list)
+{
+  for(size_t k = 0; k < list.size(); k++)
+  {
+    size_t beg = 0, next;
+    while((next = list[k].find(',', beg)) != std::string::npos)
+    {
+      v->read(list[k].substr(beg, next - beg));
+      beg = next + 1;
+    }
+    v->read(list[k].substr(beg));
+  }
+}
+
+// helper to create an xmp data thing from what's in the record. doesn't touch the database,
+// so it can run on any thread. throws exiv2 exceptions if stuff goes wrong.
+static void
+dt_exif_xmp_fill_data(Exiv2::XmpData &xmpData, const dt_exif_xmp_record_t &r)
+{
+  const int xmp_version = 1;
+  const int stars = r.stars;
+  double longitude = r.longitude, latitude = r.latitude;
+
   xmpData["Xmp.xmp.Rating"] = ((stars & 0x7) == 6) ? -1 : (stars & 0x7); //rejected image = -1, others = 0..5
 
   // The original file name
-  if(filename)
-    xmpData["Xmp.xmpMM.DerivedFrom"] = filename;
+  if(r.has_filename)
+    xmpData["Xmp.xmpMM.DerivedFrom"] = r.filename;
 
   // GPS data
   if(!isnan(longitude) && !isnan(latitude))
@@ -1794,71 +2044,63 @@ dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
     g_free(lat_str);
     g_free(str);
   }
-  sqlite3_finalize(stmt);
 
   // the meta data
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select key, value from meta_data where id = ?1", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(size_t k = 0; k < r.metadata.size(); k++)
   {
-    int key = sqlite3_column_int(stmt, 0);
-    switch(key)
+    const std::string &value = r.metadata[k].second;
+    switch(r.metadata[k].first)
     {
       case DT_METADATA_XMP_DC_CREATOR:
-        xmpData["Xmp.dc.creator"] = sqlite3_column_text(stmt, 1);
+        xmpData["Xmp.dc.creator"] = value;
         break;
       case DT_METADATA_XMP_DC_PUBLISHER:
-        xmpData["Xmp.dc.publisher"] = sqlite3_column_text(stmt, 1);
+        xmpData["Xmp.dc.publisher"] = value;
         break;
       case DT_METADATA_XMP_DC_TITLE:
-        xmpData["Xmp.dc.title"] = sqlite3_column_text(stmt, 1);
+        xmpData["Xmp.dc.title"] = value;
         break;
       case DT_METADATA_XMP_DC_DESCRIPTION:
-        xmpData["Xmp.dc.description"] = sqlite3_column_text(stmt, 1);
+        xmpData["Xmp.dc.description"] = value;
         break;
       case DT_METADATA_XMP_DC_RIGHTS:
-        xmpData["Xmp.dc.rights"] = sqlite3_column_text(stmt, 1);
+        xmpData["Xmp.dc.rights"] = value;
         break;
 
     }
   }
-  sqlite3_finalize(stmt);
 
   xmpData["Xmp.darktable.xmp_version"] = xmp_version;
-  xmpData["Xmp.darktable.raw_params"] = raw_params;
+  xmpData["Xmp.darktable.raw_params"] = r.raw_params;
 
   if(stars & DT_IMAGE_AUTO_PRESETS_APPLIED)
     xmpData["Xmp.darktable.auto_presets_applied"] = 1;
   else
     xmpData["Xmp.darktable.auto_presets_applied"] = 0;
 
-  // get tags from db, store in dublin core
+  // tags, store in dublin core. the same as dt_tag_get_list() and dt_tag_get_hierarchical() give:
+  // the internal darktable ones left out, newest first, split into their parts for the flat list.
   Exiv2::Value::AutoPtr v1 = Exiv2::Value::create(Exiv2::xmpSeq); // or xmpBag or xmpAlt.
   Exiv2::Value::AutoPtr v2 = Exiv2::Value::create(Exiv2::xmpSeq); // or xmpBag or xmpAlt.
 
-  gchar *tags = NULL;
-  gchar *hierarchical = NULL;
-
-  tags = dt_tag_get_list(imgid, ",");
-  char *beg = tags;
-  while(beg)
-  {
-    char *next = strstr(beg, ",");
-    if(next) *(next++) = 0;
-    v1->read(beg);
-    beg = next;
-  }
-
-  hierarchical = dt_tag_get_hierarchical(imgid, ",");
-  beg = hierarchical;
-  while(beg)
+  std::vector<std::string> tags, hierarchical;
+  for(size_t k = 0; k < r.tags.size(); k++)
   {
-    char *next = strstr(beg, ",");
-    if(next) *(next++) = 0;
-    v2->read(beg);
-    beg = next;
+    const std::string &tag = r.tags[k];
+    if(g_str_has_prefix(tag.c_str(), "darktable|")) continue;
+    hierarchical.push_back(tag);
+    size_t beg = 0, next;
+    while((next = tag.find('|', beg)) != std::string::npos)
+    {
+      tags.push_back(tag.substr(beg, next - beg));
+      beg = next + 1;
+    }
+    tags.push_back(tag.substr(beg));
   }
+  std::reverse(tags.begin(), tags.end());
+  std::reverse(hierarchical.begin(), hierarchical.end());
+  dt_exif_xmp_read_list(v1.get(), tags);
+  dt_exif_xmp_read_list(v2.get(), hierarchical);
 
   if(v1->count() > 0)
     xmpData.add(Exiv2::XmpKey("Xmp.dc.subject"), v1.get());
@@ -1870,15 +2112,11 @@ dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   char val[2048];
   Exiv2::Value::AutoPtr v = Exiv2::Value::create(Exiv2::xmpSeq); // or xmpBag or xmpAlt.
   /* Already initialized v = Exiv2::Value::create(Exiv2::xmpSeq); // or xmpBag or xmpAlt.*/
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select color from color_labels where imgid=?1", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(size_t k = 0; k < r.colorlabels.size(); k++)
   {
-    snprintf(val, sizeof(val), "%d", sqlite3_column_int(stmt, 0));
+    snprintf(val, sizeof(val), "%d", r.colorlabels[k]);
     v->read(val);
   }
-  sqlite3_finalize(stmt);
   if(v->count() > 0)
     xmpData.add(Exiv2::XmpKey("Xmp.darktable.colorlabels"), v.get());
 
@@ -1900,50 +2138,40 @@ dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   // reset tv
   tvm.setXmpArrayType(Exiv2::XmpValue::xaNone);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select imgid, formid, form, name, version, points, points_count, source from mask where imgid = ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(size_t k = 0; k < r.masks.size(); k++)
   {
-    int32_t mask_id = sqlite3_column_int(stmt, 1);
-    snprintf(val, sizeof(val), "%d", mask_id);
+    const dt_exif_xmp_mask_t &m = r.masks[k];
+    snprintf(val, sizeof(val), "%d", m.id);
     tvm.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.mask_id[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
 
-    int32_t mask_type = sqlite3_column_int(stmt, 2);
-    snprintf(val, sizeof(val), "%d", mask_type);
+    snprintf(val, sizeof(val), "%d", m.type);
     tvm.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.mask_type[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
 
-    const char *mask_name = (const char *)sqlite3_column_text(stmt, 3);
-    tvm.read(mask_name);
+    tvm.read(m.name);
     snprintf(key, sizeof(key), "Xmp.darktable.mask_name[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
 
-    int32_t mask_version = sqlite3_column_int(stmt, 4);
-    snprintf(val, sizeof(val), "%d", mask_version);
+    snprintf(val, sizeof(val), "%d", m.version);
     tvm.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.mask_version[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
 
-    int32_t len = sqlite3_column_bytes(stmt, 5);
-    char *mask_d = dt_exif_xmp_encode ((const unsigned char *)sqlite3_column_blob(stmt, 5), len, NULL);
+    char *mask_d = dt_exif_xmp_encode ((const unsigned char *)m.points.data(), m.points.size(), NULL);
     tvm.read(mask_d);
     snprintf(key, sizeof(key), "Xmp.darktable.mask[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
     free(mask_d);
 
-    int32_t mask_nb = sqlite3_column_int(stmt, 6);
-    snprintf(val, sizeof(val), "%d", mask_nb);
+    snprintf(val, sizeof(val), "%d", m.nb);
     tvm.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.mask_nb[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
 
-    len = sqlite3_column_bytes(stmt, 7);
-    char *mask_src = dt_exif_xmp_encode ((const unsigned char *)sqlite3_column_blob(stmt, 7), len, NULL);
+    char *mask_src = dt_exif_xmp_encode ((const unsigned char *)m.src.data(), m.src.size(), NULL);
     tvm.read(mask_src);
     snprintf(key, sizeof(key), "Xmp.darktable.mask_src[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tvm);
@@ -1951,7 +2179,6 @@ dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
 
     num ++;
   }
-  sqlite3_finalize (stmt);
 
 
   // history stack:
@@ -1972,73 +2199,66 @@ dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   // reset tv
   tv.setXmpArrayType(Exiv2::XmpValue::xaNone);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select imgid, num, module, operation, op_params, enabled, blendop_params, "
-                              "blendop_version, multi_priority, multi_name from history where imgid = ?1 order by num",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(size_t k = 0; k < r.history.size(); k++)
   {
-    int32_t modversion = sqlite3_column_int(stmt, 2);
-    snprintf(val, sizeof(val), "%d", modversion);
+    const dt_exif_xmp_history_t &h = r.history[k];
+    snprintf(val, sizeof(val), "%d", h.modversion);
     tv.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.history_modversion[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
 
-    int32_t enabled = sqlite3_column_int(stmt, 5);
-    snprintf(val, sizeof(val), "%d", enabled);
+    snprintf(val, sizeof(val), "%d", h.enabled);
     tv.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.history_enabled[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
 
-    const char *op = (const char *)sqlite3_column_text(stmt, 3);
-    if(!op) continue; // no op is fatal.
-    tv.read(op);
+    if(!h.has_operation) continue; // no op is fatal.
+    tv.read(h.operation);
     snprintf(key, sizeof(key), "Xmp.darktable.history_operation[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
 
     /* read and add history params */
-    int32_t len = sqlite3_column_bytes(stmt, 4);
-    char *vparams = dt_exif_xmp_encode ((const unsigned char *)sqlite3_column_blob(stmt, 4), len, NULL);
+    char *vparams = dt_exif_xmp_encode ((const unsigned char *)h.params.data(), h.params.size(), NULL);
     tv.read(vparams);
     snprintf(key, sizeof(key), "Xmp.darktable.history_params[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
     free(vparams);
 
     /* read and add blendop params */
-    const void *blob = sqlite3_column_blob(stmt, 6);
-    if(!blob) continue; // no params, no history item.
-    len = sqlite3_column_bytes(stmt, 6);
-    vparams = dt_exif_xmp_encode ((const unsigned char *)blob, len, NULL);
+    if(!h.has_blendop) continue; // no params, no history item.
+    vparams = dt_exif_xmp_encode ((const unsigned char *)h.blendop_params.data(), h.blendop_params.size(), NULL);
     tv.read(vparams);
     snprintf(key, sizeof(key), "Xmp.darktable.blendop_params[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
     free(vparams);
 
     /* read and add blendop version */
-    int32_t blversion = sqlite3_column_int(stmt, 7);
-    snprintf(val, sizeof(val), "%d", blversion);
+    snprintf(val, sizeof(val), "%d", h.blendop_version);
     tv.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.blendop_version[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
 
     /* read and add multi instances */
-    int32_t mprio = sqlite3_column_int(stmt, 8);
-    snprintf(val, sizeof(val), "%d", mprio);
+    snprintf(val, sizeof(val), "%d", h.multi_priority);
     tv.read(val);
     snprintf(key, sizeof(key), "Xmp.darktable.multi_priority[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
-    const char *mname = (const char *)sqlite3_column_text(stmt, 9);
-    if(mname) tv.read(mname);
-    else tv.read("");
+    tv.read(h.multi_name);
     snprintf(key, sizeof(key), "Xmp.darktable.multi_name[%d]", num);
     xmpData.add(Exiv2::XmpKey(key), &tv);
 
     num ++;
   }
-  sqlite3_finalize (stmt);
-  g_free(tags);
-  g_free(hierarchical);
+}
+
+// helper to create an xmp data thing. throws exiv2 exceptions if stuff goes wrong.
+static void
+dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
+{
+  std::vector<dt_exif_xmp_record_t> records(1);
+  records[0].imgid = imgid;
+  dt_exif_xmp_read_records(records);
+  dt_exif_xmp_fill_data(xmpData, records[0]);
 }
 
 int dt_exif_xmp_attach (const int imgid, const char* filename)
@@ -2074,14 +2294,10 @@ int dt_exif_xmp_attach (const int imgid, const char* filename)
   }
 }
 
-// write xmp sidecar file:
-int dt_exif_xmp_write (const int imgid, const char* filename)
+// write the xmp sidecar file of the image at imgfname from the record, merging with what's there.
+static int dt_exif_xmp_write_record (const dt_exif_xmp_record_t &r, const char *imgfname, const char* filename)
 {
   // refuse to write sidecar for non-existent image:
-  char imgfname[PATH_MAX];
-  gboolean from_cache = TRUE;
-
-  dt_image_full_path(imgid, imgfname, sizeof(imgfname), &from_cache);
   if(!g_file_test(imgfname, G_FILE_TEST_IS_REGULAR)) return 1;
 
   try
@@ -2099,7 +2315,7 @@ int dt_exif_xmp_write (const int imgid, const char* filename)
     }
 
     // initialize xmp data:
-    dt_exif_xmp_read_data(xmpData, imgid);
+    dt_exif_xmp_fill_data(xmpData, r);
 
     // serialize the xmp data and output the xmp packet
     if (Exiv2::XmpParser::encode(xmpPacket, xmpData) != 0)
@@ -2121,6 +2337,47 @@ int dt_exif_xmp_write (const int imgid, const char* filename)
   }
 }
 
+// write xmp sidecar file:
+int dt_exif_xmp_write (const int imgid, const char* filename)
+{
+  char imgfname[PATH_MAX];
+  gboolean from_cache = TRUE;
+
+  dt_image_full_path(imgid, imgfname, sizeof(imgfname), &from_cache);
+
+  std::vector<dt_exif_xmp_record_t> records(1);
+  records[0].imgid = imgid;
+  dt_exif_xmp_read_records(records);
+  return dt_exif_xmp_write_record(records[0], imgfname, filename);
+}
+
+void dt_exif_xmp_write_list (const int *imgids, const char *const *imgfnames, const char *const *filenames,
+                             const int num, int *results)
+{
+  // one record per image, even if it's in the list more than once
+  std::map<int, size_t> index;
+  std::vector<dt_exif_xmp_record_t> records;
+  for(int k = 0; k < num; k++)
+  {
+    if(index.count(imgids[k])) continue;
+    index[imgids[k]] = records.size();
+    records.push_back(dt_exif_xmp_record_t());
+    records.back().imgid = imgids[k];
+  }
+  dt_exif_xmp_read_records(records);
+
+  std::vector<const dt_exif_xmp_record_t *> record(num);
+  for(int k = 0; k < num; k++) record[k] = &records[index[imgids[k]]];
+
+  // the xmp toolkit itself is serialised by dt_exif_xmp_lock(), reading and writing the files and
+  // encoding the history aren't.
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic, 1) shared(record, imgfnames, filenames, results)
+#endif
+  for(int k = 0; k < num; k++)
+    results[k] = dt_exif_xmp_write_record(*record[k], imgfnames[k], filenames[k]);
+}
+
 int dt_exif_thumbnail(
   const char *filename,
   uint8_t    *out,
@@ -2167,6 +2424,12 @@ int dt_exif_thumbnail(
         y_beg = 0;
         y_end = jpg.height - 1;
       }
+      // decode at the smallest size which still covers the thumbnail, the valid area scales along:
+      const int full_height = jpg.height;
+      if(orientation & ORIENTATION_SWAP_XY) dt_imageio_jpeg_scale(&jpg, height, width);
+      else dt_imageio_jpeg_scale(&jpg, width, height);
+      y_beg = y_beg * jpg.height / full_height;
+      y_end = MIN(jpg.height - 1, y_end * jpg.height / full_height);
       uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t)*jpg.width*jpg.height*4);
       if(!tmp) return 1;
       if(!dt_imageio_jpeg_decompress(&jpg, tmp))
@@ -2193,6 +2456,16 @@ static void dt_exif_log_handler(int log_level, const char *message)
     fprintf(stderr, "[exiv2] %s\n", message);
 }
 
+// the adobe xmp toolkit isn't thread safe, exiv2 calls this around it so files can be parsed concurrently.
+static dt_pthread_mutex_t dt_exif_xmp_mutex;
+static void dt_exif_xmp_lock(void *data, bool lock)
+{
+  if(lock)
+    dt_pthread_mutex_lock((dt_pthread_mutex_t *)data);
+  else
+    dt_pthread_mutex_unlock((dt_pthread_mutex_t *)data);
+}
+
 void dt_exif_init()
 {
   // mute exiv2:
@@ -2200,7 +2473,12 @@ void dt_exif_init()
   // preface the exiv2 messages with "[exiv2] "
   Exiv2::LogMsg::setHandler(&dt_exif_log_handler);
 
-  Exiv2::XmpParser::initialize();
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  dt_pthread_mutex_init(&dt_exif_xmp_mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  Exiv2::XmpParser::initialize(dt_exif_xmp_lock, &dt_exif_xmp_mutex);
   // this has te stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -2209,6 +2487,7 @@ void dt_exif_init()
 void dt_exif_cleanup()
 {
   Exiv2::XmpParser::terminate();
+  dt_pthread_mutex_destroy(&dt_exif_xmp_mutex);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
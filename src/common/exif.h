@@ -30,6 +30,24 @@ extern "C"
   /** read metadata from file with full path name, XMP data trumps IPTC data trumps EXIF data, store to image struct. returns 0 on success. */
   int dt_exif_read(dt_image_t *img, const char* path);
 
+  /** same as dt_exif_read(), but parse the whole file which is already in memory (see common/file_map.h). path is only used for the fallback timestamp. */
+  int dt_exif_read_from_map(dt_image_t *img, const char* path, const uint8_t *data, const size_t size);
+
+  /** metadata of an image file and its xmp sidecar, parsed but not yet applied. */
+  typedef struct dt_exif_prefetch_t dt_exif_prefetch_t;
+
+  /** parse the metadata of path and of the sidecar xmp_path (may be NULL or missing). doesn't touch the database, so it can run on any thread. */
+  dt_exif_prefetch_t *dt_exif_prefetch(const char* path, const char* xmp_path);
+
+  /** free the result of dt_exif_prefetch(). */
+  void dt_exif_prefetch_free(dt_exif_prefetch_t *p);
+
+  /** same as dt_exif_read(), but use the metadata parsed by dt_exif_prefetch(). */
+  int dt_exif_read_prefetched(dt_image_t *img, const char* path, dt_exif_prefetch_t *p);
+
+  /** same as dt_exif_xmp_read(img, xmp_path, 0), but use the sidecar parsed by dt_exif_prefetch(). */
+  int dt_exif_xmp_read_prefetched(dt_image_t *img, dt_exif_prefetch_t *p);
+
   /** read exif data to image struct from given data blob, wherever you got it from. */
   int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
@@ -42,6 +60,12 @@ extern "C"
   /** write xmp sidecar file. */
   int dt_exif_xmp_write (const int imgid, const char* filename);
 
+  /** write the xmp sidecar files of num images at once, imgids[k] to filenames[k], if its image file imgfnames[k]
+   *  exists. the database is read with a few queries for all of them, the files are merged and written in parallel.
+   *  results[k] is what dt_exif_xmp_write() would have returned. */
+  void dt_exif_xmp_write_list (const int *imgids, const char *const *imgfnames, const char *const *filenames,
+                               const int num, int *results);
+
   /** write xmp packet inside an image. */
   int dt_exif_xmp_attach (const int imgid, const char* filename);
 
@@ -0,0 +1,128 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/file_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#endif
+
+// no mmap, or no room for the padding: read the file in one go.
+static int
+_file_map_read(dt_file_map_t *map, const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f) return 1;
+  map->data = (uint8_t *)calloc(map->size + DT_FILE_MAP_PADDING, 1);
+  if(!map->data || fread(map->data, 1, map->size, f) != map->size)
+  {
+    free(map->data);
+    map->data = NULL;
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  map->mapped_size = map->size + DT_FILE_MAP_PADDING;
+  map->mapped = 0;
+  return 0;
+}
+
+dt_file_map_t *
+dt_file_map_open(const char *filename, dt_file_map_access_t access)
+{
+  struct stat st;
+  if(stat(filename, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0) return NULL;
+
+  dt_file_map_t *map = (dt_file_map_t *)calloc(1, sizeof(dt_file_map_t));
+  if(!map) return NULL;
+  map->size = st.st_size;
+
+#ifdef __WIN32__
+  if(_file_map_read(map, filename))
+  {
+    free(map);
+    return NULL;
+  }
+  return map;
+#else
+  // the tail of the last page reads as zeroes, but whole pages past the end of the
+  // file would raise SIGBUS. in the rare case the padding doesn't fit, just read it.
+  const size_t page = sysconf(_SC_PAGESIZE);
+  if(map->size % page == 0 || map->size % page + DT_FILE_MAP_PADDING > page)
+  {
+    if(_file_map_read(map, filename))
+    {
+      free(map);
+      return NULL;
+    }
+    return map;
+  }
+
+  const int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+  {
+    free(map);
+    return NULL;
+  }
+  map->mapped_size = ((map->size + page - 1) / page) * page;
+  void *base = mmap(NULL, map->mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED)
+  {
+    free(map);
+    return NULL;
+  }
+
+#ifdef POSIX_MADV_SEQUENTIAL
+  if(access == DT_FILE_MAP_SEQUENTIAL)
+  {
+    // start reading ahead right away, and drop pages behind us early.
+    posix_madvise(base, map->size, POSIX_MADV_SEQUENTIAL);
+    posix_madvise(base, map->size, POSIX_MADV_WILLNEED);
+  }
+  else
+    posix_madvise(base, map->size, POSIX_MADV_RANDOM);
+#endif
+
+  map->data = (uint8_t *)base;
+  map->mapped = 1;
+  return map;
+#endif
+}
+
+void
+dt_file_map_close(dt_file_map_t *map)
+{
+  if(!map) return;
+#ifndef __WIN32__
+  if(map->mapped) munmap(map->data, map->mapped_size);
+  else
+#endif
+    free(map->data);
+  free(map);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
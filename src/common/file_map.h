@@ -0,0 +1,63 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_FILE_MAP_H
+#define DT_FILE_MAP_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** zeroed bytes guaranteed to be readable after the end of the file, rawspeed's bit pumps read ahead that far. */
+#define DT_FILE_MAP_PADDING 16
+
+typedef enum dt_file_map_access_t
+{
+  DT_FILE_MAP_SEQUENTIAL = 0, // the whole file will be decoded front to back (raw data)
+  DT_FILE_MAP_RANDOM     = 1  // only a few bits will be touched (headers, embedded thumbnails)
+}
+dt_file_map_access_t;
+
+/** read-only view of a whole file. data is private copy-on-write, so decoders may scribble on it. */
+typedef struct dt_file_map_t
+{
+  uint8_t *data;
+  size_t size;
+  // internal: what has been mapped/allocated, including padding.
+  size_t mapped_size;
+  int mapped;
+}
+dt_file_map_t;
+
+/** map the given file into memory, returns NULL on failure. */
+dt_file_map_t *dt_file_map_open(const char *filename, dt_file_map_access_t access);
+
+/** unmap and free the view. */
+void dt_file_map_close(dt_file_map_t *map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -26,6 +26,7 @@
 #include "common/collection.h"
 #include "common/image_cache.h"
 #include "common/debug.h"
+#include "common/exif.h"
 #include "views/view.h"
 
 #include <stdio.h>
@@ -343,37 +344,69 @@ int _film_filename_cmp(gchar *a, gchar *b)
   return ret;
 }
 
-void dt_film_import1(dt_film_t *film)
-{
-  gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
+/* minimum number of files whose metadata is parsed concurrently and then
+   written to the database in one transaction. */
+#define DT_FILM_IMPORT_BATCH 64
 
-  /* first of all gather all images to import */
-  GList *images = NULL;
-  images = _film_recursive_get_files(film->dirname, recursive, &images);
-  if(g_list_length(images) == 0)
-  {
-    dt_control_log(_("no supported images were found to be imported"));
-    return;
-  }
+/* state of an import shared by its batches, only touched by the database writer */
+typedef struct dt_film_import_t
+{
+  dt_film_t *film, *cfr;
+  dt_progress_t *progress;
+  double fraction;
+  guint total;
+}
+dt_film_import_t;
 
-  /* we got ourself a list of images, lets sort and start import */
-  images = g_list_sort(images,(GCompareFunc)_film_filename_cmp);
+typedef struct dt_film_import_batch_t
+{
+  dt_film_import_t *import;
+  gchar **files;
+  dt_exif_prefetch_t **prefetch;
+  int num;
+  // the imported images, and the film rolls which are done with, to be taken care of after the commit
+  uint32_t *ids;
+  dt_image_import_result_t *results;
+  GList *done_films;
+}
+dt_film_import_batch_t;
 
-  /* let's start import of images */
-  gchar message[512] = {0};
-  double fraction = 0;
-  guint total = g_list_length(images);
-  g_snprintf(message, sizeof(message) - 1,
-             ngettext("importing %d image","importing %d images", total), total);
-  dt_progress_t *progress = dt_control_progress_create(darktable.control, TRUE, message);
+/* once the batch is committed, does the sidecar files and tells the gui about it. not on the database
+   writer thread: that would do file io with the write lock held, and the gui might be waiting for the
+   database itself while holding the gdk lock. */
+static void _film_import_batch_done(dt_film_import_batch_t *b)
+{
+  for(int k = 0; k < b->num; k++)
+    dt_image_import_finish(b->ids[k], b->files[k], b->results[k]);
+  dt_control_progress_set_progress(darktable.control, b->import->progress, b->import->fraction);
 
+  /* cleanup previously imported filmrolls */
+  for(GList *l = b->done_films; l; l = g_list_next(l))
+  {
+    dt_film_t *cfr = (dt_film_t *)l->data;
+    if(dt_film_is_empty(cfr->id))
+    {
+      dt_film_remove(cfr->id);
+    }
+    dt_film_cleanup(cfr);
+    g_free(cfr);
+  }
+  g_list_free(b->done_films);
+  g_free(b->ids);
+  g_free(b->results);
+  g_free(b->prefetch);
+  g_free(b);
+}
 
-  /* loop thru the images and import to current film roll */
-  dt_film_t *cfr = film;
-  GList *image = g_list_first(images);
-  do
+/* adds the parsed files of one batch to the database, runs on the database writer thread */
+static void _film_import_batch(sqlite3 *handle, void *data)
+{
+  dt_film_import_batch_t *b = (dt_film_import_batch_t *)data;
+  dt_film_import_t *import = b->import;
+  for(int k = 0; k < b->num; k++)
   {
-    gchar *cdn = g_path_get_dirname((const gchar *)image->data);
+    dt_film_t *cfr = import->cfr;
+    gchar *cdn = g_path_get_dirname(b->files[k]);
 
     /* check if we need to initialize a new filmroll */
     if(!cfr || g_strcmp0(cfr->dirname, cdn) != 0)
@@ -401,15 +434,10 @@ void dt_film_import1(dt_film_t *film)
         }
       }
 
-      /* cleanup previously imported filmroll*/
-      if(cfr && cfr!=film)
+      /* cleanup previously imported filmroll, after the commit */
+      if(cfr && cfr!=import->film)
       {
-        if(dt_film_is_empty(cfr->id))
-        {
-          dt_film_remove(cfr->id);
-        }
-        dt_film_cleanup(cfr);
-        g_free(cfr);
+        b->done_films = g_list_append(b->done_films, cfr);
         cfr = NULL;
       }
 
@@ -417,19 +445,89 @@ void dt_film_import1(dt_film_t *film)
       cfr = g_malloc(sizeof(dt_film_t));
       dt_film_init(cfr);
       dt_film_new(cfr, cdn);
+      import->cfr = cfr;
     }
 
     g_free(cdn);
 
     /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+    b->ids[k] = dt_image_import_prefetched(cfr->id, b->files[k], FALSE, b->prefetch[k], b->results + k);
+    dt_exif_prefetch_free(b->prefetch[k]);
+
+    import->fraction+=1.0/import->total;
+  }
+}
+
+void dt_film_import1(dt_film_t *film)
+{
+  gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
+
+  /* first of all gather all images to import */
+  GList *images = NULL;
+  images = _film_recursive_get_files(film->dirname, recursive, &images);
+  if(g_list_length(images) == 0)
+  {
+    dt_control_log(_("no supported images were found to be imported"));
+    return;
+  }
+
+  /* we got ourself a list of images, lets sort and start import */
+  images = g_list_sort(images,(GCompareFunc)_film_filename_cmp);
+
+  /* let's start import of images */
+  gchar message[512] = {0};
+  guint total = g_list_length(images);
+  g_snprintf(message, sizeof(message) - 1,
+             ngettext("importing %d image","importing %d images", total), total);
+  dt_progress_t *progress = dt_control_progress_create(darktable.control, TRUE, message);
 
-    fraction+=1.0/total;
-    dt_control_progress_set_progress(darktable.control, progress, fraction);
 
+  /* loop thru the images and import to current film roll. the metadata of a
+     batch of files is parsed in parallel, then the database writer adds the
+     whole batch in a single transaction while we go on with the next one. */
+  const int batch = MAX(DT_FILM_IMPORT_BATCH, 8 * dt_get_num_threads());
+  gchar **files = (gchar **)g_malloc(sizeof(gchar *) * total);
+  int cnt = 0;
+  for(GList *image = g_list_first(images); image; image = g_list_next(image))
+    files[cnt++] = (gchar *)image->data;
+
+  dt_film_import_t import = { film, film, progress, 0.0, total };
+  dt_film_import_batch_t *prev = NULL;
+  for(int start = 0; start < (int)total; start += batch)
+  {
+    const int end = MIN((int)total, start + batch);
+    dt_film_import_batch_t *b = (dt_film_import_batch_t *)g_malloc(sizeof(dt_film_import_batch_t));
+    b->import = &import;
+    b->files = files + start;
+    b->num = end - start;
+    b->prefetch = (dt_exif_prefetch_t **)g_malloc(sizeof(dt_exif_prefetch_t *) * b->num);
+    b->ids = (uint32_t *)g_malloc0(sizeof(uint32_t) * b->num);
+    b->results = (dt_image_import_result_t *)g_malloc0(sizeof(dt_image_import_result_t) * b->num);
+    b->done_films = NULL;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) shared(b)
+#endif
+    for(int k = 0; k < b->num; k++)
+    {
+      gchar *xmp = g_strconcat(b->files[k], ".xmp", NULL);
+      b->prefetch[k] = dt_exif_prefetch(b->files[k], xmp);
+      g_free(xmp);
+    }
 
+    // the previous batch was written while this one was parsed
+    if(prev)
+    {
+      dt_database_write_sync(darktable.db);
+      _film_import_batch_done(prev);
+    }
+    dt_database_write(darktable.db, _film_import_batch, b, NULL);
+    prev = b;
   }
-  while( (image = g_list_next(image)) != NULL);
+  // the batches point into files and import.
+  dt_database_write_sync(darktable.db);
+  if(prev) _film_import_batch_done(prev);
+  dt_film_t *cfr = import.cfr;
+  g_free(files);
 
   // only redraw at the end, to not spam the cpu with exposure events
   dt_control_queue_redraw_center();
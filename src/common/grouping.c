@@ -42,6 +42,9 @@ dt_grouping_remove_from_group(int image_id)
   sqlite3_stmt *stmt;
   int new_group_id = -1;
 
+  // the group is looked up and changed in the database directly
+  dt_image_cache_flush(darktable.image_cache);
+
   const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, image_id);
   if(img->group_id == image_id)
   {
@@ -99,25 +99,21 @@ dt_image_film_roll_name(const char *path)
 
 void dt_image_film_roll_directory(const dt_image_t *img, char *pathname, size_t pathname_len)
 {
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select folder from film_rolls where id = ?1", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "select folder from film_rolls where id = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->film_id);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     char *f = (char *)sqlite3_column_text(stmt, 0);
     snprintf(pathname, pathname_len, "%s", f);
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   pathname[pathname_len-1] = '\0';
 }
 
 
 void dt_image_film_roll(const dt_image_t *img, char *pathname, size_t pathname_len)
 {
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select folder from film_rolls where id = ?1", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "select folder from film_rolls where id = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->film_id);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -129,7 +125,7 @@ void dt_image_film_roll(const dt_image_t *img, char *pathname, size_t pathname_l
   {
     snprintf(pathname, pathname_len, "%s", _("orphaned image"));
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   pathname[pathname_len-1] = '\0';
 }
 
@@ -157,16 +153,15 @@ gboolean dt_image_safe_remove(const int32_t imgid)
 
 void dt_image_full_path(const int imgid, char *pathname, size_t pathname_len, gboolean *from_cache)
 {
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
                               "select folder || '/' || filename from images, film_rolls where "
-                              "images.film_id = film_rolls.id and images.id = ?1", -1, &stmt, NULL);
+                              "images.film_id = film_rolls.id and images.id = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     g_strlcpy(pathname, (char *)sqlite3_column_text(stmt, 0), pathname_len);
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   if (*from_cache && !g_file_test(pathname, G_FILE_TEST_EXISTS))
   {
@@ -228,14 +223,12 @@ void dt_image_path_append_version(int imgid, char *pathname, size_t pathname_len
 {
   // get duplicate suffix
   int version = 0;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select version from images where id = ?1", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "select version from images where id = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
 
   if(sqlite3_step(stmt) == SQLITE_ROW)
     version = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   dt_image_path_append_version_no_db(version, pathname, pathname_len);
 }
@@ -351,6 +344,8 @@ int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newve
 {
   sqlite3_stmt *stmt;
   int32_t newid = -1;
+  // the new row is copied from the database, make sure it's up to date.
+  dt_image_cache_flush(darktable.image_cache);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "select a.id from images as a join images as b where "
                               "a.film_id = b.film_id and a.filename = b.filename and "
@@ -651,6 +646,34 @@ void dt_image_read_duplicates(const uint32_t id, const char *filename)
 
 uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
 {
+  dt_image_import_result_t result = DT_IMAGE_IMPORT_NONE;
+  const uint32_t id = dt_image_import_prefetched(film_id, filename, override_ignore_jpegs, NULL, &result);
+  dt_image_import_finish(id, filename, result);
+  return id;
+}
+
+void dt_image_import_finish(const uint32_t id, const char *filename, dt_image_import_result_t result)
+{
+  if(result == DT_IMAGE_IMPORT_NONE) return;
+
+  if(result == DT_IMAGE_IMPORT_NEW_NO_XMP)
+  {
+    // Search for Lightroom sidecar file, import tags if found
+    dt_lightroom_import(id, NULL, TRUE);
+  }
+
+  // read all sidecar files
+  dt_image_read_duplicates(id, filename);
+  dt_image_synch_all_xmp(filename);
+
+  if(result != DT_IMAGE_IMPORT_EXISTING)
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_IMPORT, id);
+}
+
+uint32_t dt_image_import_prefetched(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                    dt_exif_prefetch_t *prefetch, dt_image_import_result_t *result)
+{
+  *result = DT_IMAGE_IMPORT_NONE;
   if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR) || dt_util_get_file_size(filename) == 0)
     return 0;
   const char *cc = filename + strlen(filename);
@@ -701,8 +724,7 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
     img->flags &= ~DT_IMAGE_REMOVE;
     dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
     dt_image_cache_read_release(darktable.image_cache, img);
-    dt_image_read_duplicates(id, filename);
-    dt_image_synch_all_xmp(filename);
+    *result = DT_IMAGE_IMPORT_EXISTING;
     return id;
   }
   sqlite3_finalize(stmt);
@@ -755,6 +777,8 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   *cc2='\0';
   gchar *sql_pattern = g_strconcat(basename, ".%", NULL);
   int group_id;
+  // the groups of the other files are read from the database
+  dt_image_cache_flush(darktable.image_cache);
   // in case we are not a jpg check if we need to change group representative
   if (strcmp(ext, "jpg") != 0 && strcmp(ext, "jpeg") != 0)
   {
@@ -831,24 +855,28 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   img->group_id = group_id;
 
   // read dttags and exif for database queries!
-  (void) dt_exif_read(img, filename);
   char dtfilename[PATH_MAX];
   g_strlcpy(dtfilename, filename, sizeof(dtfilename));
   //dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
   g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
 
-  int res = dt_exif_xmp_read(img, dtfilename, 0);
+  int res;
+  if(prefetch)
+  {
+    // the files have been parsed on another thread, only the database work is left
+    (void) dt_exif_read_prefetched(img, filename, prefetch);
+    res = dt_exif_xmp_read_prefetched(img, prefetch);
+  }
+  else
+  {
+    (void) dt_exif_read(img, filename);
+    res = dt_exif_xmp_read(img, dtfilename, 0);
+  }
 
   // write through to db, but not to xmp.
   dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
   dt_image_cache_read_release(darktable.image_cache, cimg);
 
-  if(res != 0)
-  {
-    // Search for Lightroom sidecar file, import tags if found
-    dt_lightroom_import(id, NULL, TRUE);
-  }
-
   // add a tag with the file extension
   guint tagid = 0;
   char tagname[512];
@@ -857,15 +885,12 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   dt_tag_new(tagname, &tagid);
   dt_tag_attach(tagid,id);
 
-  // read all sidecar files
-  dt_image_read_duplicates(id, filename);
-  dt_image_synch_all_xmp(filename);
-
   g_free(imgfname);
   g_free(basename);
   g_free(sql_pattern);
 
-  dt_control_signal_raise(darktable.signals,DT_SIGNAL_IMAGE_IMPORT,id);
+  // the lightroom sidecar is only looked for if there's no xmp
+  *result = res != 0 ? DT_IMAGE_IMPORT_NEW_NO_XMP : DT_IMAGE_IMPORT_NEW;
   // the following line would look logical with new_tags_set being the return value
   // from dt_tag_new above, but this could lead to too rapid signals, being able to lock up the
   // keywords side pane when trying to use it, which can lock up the whole dt GUI ..
@@ -1314,6 +1339,81 @@ void dt_image_write_sidecar_file(int imgid)
 }
 
 
+typedef struct dt_image_sidecar_timestamps_t
+{
+  int num;
+  int imgids[];
+}
+dt_image_sidecar_timestamps_t;
+
+static void _image_set_write_timestamps(sqlite3 *handle, void *data)
+{
+  dt_image_sidecar_timestamps_t *t = (dt_image_sidecar_timestamps_t *)data;
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "UPDATE images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1");
+  for(int k = 0; k < t->num; k++)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, t->imgids[k]);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  dt_database_release_statement(darktable.db, stmt);
+}
+
+void dt_image_write_sidecar_files(const int *imgids, const int num)
+{
+  for(int start = 0; start < num; start += DT_IMAGE_SIDECAR_BATCH)
+  {
+    const int n = MIN(num - start, DT_IMAGE_SIDECAR_BATCH);
+    const int *ids = imgids + start;
+    gchar **imgfnames = (gchar **)g_malloc(sizeof(gchar *) * n);
+    gchar **filenames = (gchar **)g_malloc(sizeof(gchar *) * n);
+    int *results = (int *)g_malloc(sizeof(int) * n);
+    for(int k = 0; k < n; k++)
+    {
+      gboolean from_cache = TRUE;
+      char filename[PATH_MAX] = { 0 };
+      dt_image_full_path(ids[k], filename, sizeof(filename), &from_cache);
+      imgfnames[k] = g_strdup(filename);
+      dt_image_path_append_version(ids[k], filename, sizeof(filename));
+      g_strlcat(filename, ".xmp", sizeof(filename));
+      filenames[k] = g_strdup(filename);
+    }
+
+    dt_exif_xmp_write_list(ids, (const char *const *)imgfnames, (const char *const *)filenames, n, results);
+
+    // put the timestamps into db, for all of them in one go
+    dt_image_sidecar_timestamps_t *t = (dt_image_sidecar_timestamps_t *)g_malloc(sizeof(dt_image_sidecar_timestamps_t) + sizeof(int) * n);
+    t->num = 0;
+    for(int k = 0; k < n; k++)
+      if(!results[k]) t->imgids[t->num++] = ids[k];
+    if(t->num) dt_database_write(darktable.db, _image_set_write_timestamps, t, g_free);
+    else g_free(t);
+
+    for(int k = 0; k < n; k++)
+    {
+      g_free(imgfnames[k]);
+      g_free(filenames[k]);
+    }
+    g_free(imgfnames);
+    g_free(filenames);
+    g_free(results);
+  }
+}
+
+/* runs the query and writes the sidecars of all the images it returns in one batch */
+static void _image_write_sidecar_files_query(sqlite3_stmt *stmt)
+{
+  GArray *imgids = g_array_new(FALSE, FALSE, sizeof(int));
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int imgid = sqlite3_column_int(stmt, 0);
+    if(imgid > 0) g_array_append_val(imgids, imgid);
+  }
+  sqlite3_finalize(stmt);
+  dt_image_write_sidecar_files((const int *)imgids->data, imgids->len);
+  g_array_free(imgids, TRUE);
+}
+
 void dt_image_synch_xmp(const int selected)
 {
   if(selected > 0)
@@ -1325,12 +1425,7 @@ void dt_image_synch_xmp(const int selected)
     sqlite3_stmt *stmt;
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                 "select imgid from selected_images", -1, &stmt, NULL);
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      const int imgid = sqlite3_column_int(stmt, 0);
-      dt_image_write_sidecar_file(imgid);
-    }
-    sqlite3_finalize(stmt);
+    _image_write_sidecar_files_query(stmt);
   }
 }
 
@@ -1346,12 +1441,7 @@ void dt_image_synch_all_xmp(const gchar *pathname)
                                 "where folder = ?1) and filename = ?2", -1, &stmt, NULL);
     DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, imgpath, -1, SQLITE_TRANSIENT);
     DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_TRANSIENT);
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      const int imgid = sqlite3_column_int(stmt, 0);
-      dt_image_write_sidecar_file(imgid);
-    }
-    sqlite3_finalize(stmt);
+    _image_write_sidecar_files_query(stmt);
     g_free(imgfname);
     g_free(imgpath);
   }
@@ -177,6 +177,24 @@ void dt_image_print_exif(const dt_image_t *img, char *line, size_t line_len);
 void dt_image_read_duplicates(uint32_t id, const char *filename);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. */
 uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
+/** what is left of an import once the database part is done. */
+typedef enum dt_image_import_result_t
+{
+  DT_IMAGE_IMPORT_NONE = 0,       // nothing was imported
+  DT_IMAGE_IMPORT_EXISTING = 1,   // the image was there already
+  DT_IMAGE_IMPORT_NEW = 2,        // a new image
+  DT_IMAGE_IMPORT_NEW_NO_XMP = 3  // a new image without xmp sidecar
+}
+dt_image_import_result_t;
+/** same as dt_image_import(), but with the metadata already parsed by dt_exif_prefetch() (may be NULL).
+ *  only does the database part, so it can run inside a transaction: no sidecar files, no gui. the caller
+ *  has to hand *result to dt_image_import_finish() once that's committed. */
+struct dt_exif_prefetch_t;
+uint32_t dt_image_import_prefetched(int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                    struct dt_exif_prefetch_t *prefetch, dt_image_import_result_t *result);
+/** the rest of the import: reads the duplicates' and lightroom sidecars, writes the xmp files and raises
+ *  DT_SIGNAL_IMAGE_IMPORT for new images. */
+void dt_image_import_finish(uint32_t id, const char *filename, dt_image_import_result_t result);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
 /** duplicates the given image in the database with the duplicate getting the supplied version number. if that version
@@ -271,6 +289,11 @@ gboolean dt_image_safe_remove(const int32_t imgid);
 void dt_image_local_copy_synch(void);
 // xmp functions:
 void dt_image_write_sidecar_file(int imgid);
+/** images per batch of sidecars: bounds the memory for what's read from the db and the size of its queries. */
+#define DT_IMAGE_SIDECAR_BATCH 500
+/** write the sidecars of num images, DT_IMAGE_SIDECAR_BATCH at a time with dt_exif_xmp_write_list().
+ *  unlike dt_image_write_sidecar_file() this doesn't look at write_sidecar_files. */
+void dt_image_write_sidecar_files(const int *imgids, const int num);
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_all_xmp(const gchar *pathname);
 
@@ -26,6 +26,106 @@
 
 #include <sqlite3.h>
 
+// milliseconds the write-behind thread waits for more updates before writing
+// them out, so bulk operations end up in a single transaction.
+#define DT_IMAGE_CACHE_WRITE_DELAY 100
+
+// a released image struct which still has to go to the database.
+typedef struct dt_image_cache_pending_t
+{
+  dt_image_t img;
+  // at least one of the merged releases was DT_IMAGE_CACHE_SAFE
+  int write_sidecar;
+  // cache->seq at the last merged release
+  uint32_t seq;
+}
+dt_image_cache_pending_t;
+
+// one trip of the pending image structs through the database writer.
+typedef struct dt_image_cache_write_t
+{
+  dt_image_cache_t *cache;
+  // copies of what was taken out of pending
+  dt_image_cache_pending_t *entries;
+  int num;
+  int sidecars;
+  // committed
+  int done;
+}
+dt_image_cache_write_t;
+
+// the columns _image_cache_read_row() expects, in this order.
+#define DT_IMAGE_CACHE_COLUMNS \
+  "id, group_id, film_id, width, height, filename, maker, model, lens, exposure, " \
+  "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, " \
+  "raw_parameters, longitude, latitude, color_matrix, colorspace, version, raw_black, raw_maximum"
+
+// fills img from the current row of a query selecting DT_IMAGE_CACHE_COLUMNS.
+// the profile is not touched, the caller has to take care of freeing it.
+static void
+_image_cache_read_row(sqlite3_stmt *stmt, dt_image_t *img)
+{
+  char *str;
+  img->id      = sqlite3_column_int(stmt, 0);
+  img->group_id = sqlite3_column_int(stmt, 1);
+  img->film_id = sqlite3_column_int(stmt, 2);
+  img->width   = sqlite3_column_int(stmt, 3);
+  img->height  = sqlite3_column_int(stmt, 4);
+  img->filename[0] = img->exif_maker[0] = img->exif_model[0] = img->exif_lens[0] =
+      img->exif_datetime_taken[0] = '\0';
+  str = (char *)sqlite3_column_text(stmt, 5);
+  if(str) g_strlcpy(img->filename,   str, sizeof(img->filename));
+  str = (char *)sqlite3_column_text(stmt, 6);
+  if(str) g_strlcpy(img->exif_maker, str, sizeof(img->exif_maker));
+  str = (char *)sqlite3_column_text(stmt, 7);
+  if(str) g_strlcpy(img->exif_model, str, sizeof(img->exif_model));
+  str = (char *)sqlite3_column_text(stmt, 8);
+  if(str) g_strlcpy(img->exif_lens,  str, sizeof(img->exif_lens));
+  img->exif_exposure = sqlite3_column_double(stmt, 9);
+  img->exif_aperture = sqlite3_column_double(stmt, 10);
+  img->exif_iso = sqlite3_column_double(stmt, 11);
+  img->exif_focal_length = sqlite3_column_double(stmt, 12);
+  str = (char *)sqlite3_column_text(stmt, 13);
+  if(str) g_strlcpy(img->exif_datetime_taken, str, sizeof(img->exif_datetime_taken));
+  img->flags = sqlite3_column_int(stmt, 14);
+  img->exif_crop = sqlite3_column_double(stmt, 15);
+  img->orientation = sqlite3_column_int(stmt, 16);
+  img->exif_focus_distance = sqlite3_column_double(stmt,17);
+  if(img->exif_focus_distance >= 0 && img->orientation >= 0) img->exif_inited = 1;
+  uint32_t tmp = sqlite3_column_int(stmt, 18);
+  memcpy(&img->legacy_flip, &tmp, sizeof(dt_image_raw_parameters_t));
+  if(sqlite3_column_type(stmt, 19) == SQLITE_FLOAT)
+    img->longitude = sqlite3_column_double(stmt, 19);
+  else
+    img->longitude = NAN;
+  if(sqlite3_column_type(stmt, 20) == SQLITE_FLOAT)
+    img->latitude = sqlite3_column_double(stmt, 20);
+  else
+    img->latitude = NAN;
+  const void *color_matrix = sqlite3_column_blob(stmt, 21);
+  if(color_matrix)
+    memcpy(img->d65_color_matrix, color_matrix, sizeof(img->d65_color_matrix));
+  else
+    img->d65_color_matrix[0] = NAN;
+  img->colorspace = sqlite3_column_int(stmt, 22);
+  img->version = sqlite3_column_int(stmt, 23);
+  img->raw_black_level = sqlite3_column_int(stmt, 24);
+  img->raw_white_point = sqlite3_column_int(stmt, 25);
+
+  // buffer size?
+  if(img->flags & DT_IMAGE_LDR)
+    img->bpp = 4*sizeof(float);
+  else if(img->flags & DT_IMAGE_HDR)
+  {
+    if(img->flags & DT_IMAGE_RAW)
+      img->bpp = sizeof(float);
+    else
+      img->bpp = 4*sizeof(float);
+  }
+  else // raw
+    img->bpp = sizeof(uint16_t);
+}
+
 int32_t
 dt_image_cache_allocate(void *data, const uint32_t key, int32_t *cost, void **buf)
 {
@@ -35,85 +135,53 @@ dt_image_cache_allocate(void *data, const uint32_t key, int32_t *cost, void **bu
   *cost = sizeof(dt_image_t);
 
   dt_image_t *img = c->images + slot;
-  // load stuff from db and store in cache:
-  char *str;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
-                              "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
-                              "raw_parameters, longitude, latitude, color_matrix, colorspace, version, raw_black, raw_maximum FROM images WHERE id = ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, key);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  g_free(img->profile);
+  img->profile = NULL;
+  img->profile_size = 0;
+
+  // dt_image_cache_prefetch() might have read it already:
+  dt_pthread_mutex_lock(&c->queue_mutex);
+  const dt_image_t *prefetched = g_hash_table_lookup(c->prefetched, GINT_TO_POINTER(key));
+  const int loaded = prefetched != NULL;
+  if(loaded)
   {
-    img->id      = sqlite3_column_int(stmt, 0);
-    img->group_id = sqlite3_column_int(stmt, 1);
-    img->film_id = sqlite3_column_int(stmt, 2);
-    img->width   = sqlite3_column_int(stmt, 3);
-    img->height  = sqlite3_column_int(stmt, 4);
-    img->filename[0] = img->exif_maker[0] = img->exif_model[0] = img->exif_lens[0] =
-        img->exif_datetime_taken[0] = '\0';
-    str = (char *)sqlite3_column_text(stmt, 5);
-    if(str) g_strlcpy(img->filename,   str, sizeof(img->filename));
-    str = (char *)sqlite3_column_text(stmt, 6);
-    if(str) g_strlcpy(img->exif_maker, str, sizeof(img->exif_maker));
-    str = (char *)sqlite3_column_text(stmt, 7);
-    if(str) g_strlcpy(img->exif_model, str, sizeof(img->exif_model));
-    str = (char *)sqlite3_column_text(stmt, 8);
-    if(str) g_strlcpy(img->exif_lens,  str, sizeof(img->exif_lens));
-    img->exif_exposure = sqlite3_column_double(stmt, 9);
-    img->exif_aperture = sqlite3_column_double(stmt, 10);
-    img->exif_iso = sqlite3_column_double(stmt, 11);
-    img->exif_focal_length = sqlite3_column_double(stmt, 12);
-    str = (char *)sqlite3_column_text(stmt, 13);
-    if(str) g_strlcpy(img->exif_datetime_taken, str, sizeof(img->exif_datetime_taken));
-    img->flags = sqlite3_column_int(stmt, 14);
-    img->exif_crop = sqlite3_column_double(stmt, 15);
-    img->orientation = sqlite3_column_int(stmt, 16);
-    img->exif_focus_distance = sqlite3_column_double(stmt,17);
-    if(img->exif_focus_distance >= 0 && img->orientation >= 0) img->exif_inited = 1;
-    uint32_t tmp = sqlite3_column_int(stmt, 18);
-    memcpy(&img->legacy_flip, &tmp, sizeof(dt_image_raw_parameters_t));
-    if(sqlite3_column_type(stmt, 19) == SQLITE_FLOAT)
-      img->longitude = sqlite3_column_double(stmt, 19);
-    else
-      img->longitude = NAN;
-    if(sqlite3_column_type(stmt, 20) == SQLITE_FLOAT)
-      img->latitude = sqlite3_column_double(stmt, 20);
-    else
-      img->latitude = NAN;
-    const void *color_matrix = sqlite3_column_blob(stmt, 21);
-    if(color_matrix)
-      memcpy(img->d65_color_matrix, color_matrix, sizeof(img->d65_color_matrix));
+    memcpy(img, prefetched, sizeof(dt_image_t));
+    g_hash_table_remove(c->prefetched, GINT_TO_POINTER(key));
+  }
+  dt_pthread_mutex_unlock(&c->queue_mutex);
+
+  if(!loaded)
+  {
+    // load stuff from db and store in cache:
+    sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                "SELECT " DT_IMAGE_CACHE_COLUMNS " FROM images WHERE id = ?1");
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, key);
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      _image_cache_read_row(stmt, img);
+    }
     else
-      img->d65_color_matrix[0] = NAN;
-    g_free(img->profile);
-    img->profile = NULL;
-    img->profile_size = 0;
-    img->colorspace = sqlite3_column_int(stmt, 22);
-    img->version = sqlite3_column_int(stmt, 23);
-    img->raw_black_level = sqlite3_column_int(stmt, 24);
-    img->raw_white_point = sqlite3_column_int(stmt, 25);
-
-    // buffer size?
-    if(img->flags & DT_IMAGE_LDR)
-      img->bpp = 4*sizeof(float);
-    else if(img->flags & DT_IMAGE_HDR)
     {
-      if(img->flags & DT_IMAGE_RAW)
-        img->bpp = sizeof(float);
-      else
-        img->bpp = 4*sizeof(float);
+      img->id = -1;
+      fprintf(stderr, "[image_cache_allocate] failed to open image %d from database: %s\n", key, sqlite3_errmsg(dt_database_get(darktable.db)));
     }
-    else // raw
-      img->bpp = sizeof(uint16_t);
+    dt_database_release_statement(darktable.db, stmt);
   }
-  else
+
+  if(img->id > 0)
   {
-    img->id = -1;
-    fprintf(stderr, "[image_cache_allocate] failed to open image %d from database: %s\n", key, sqlite3_errmsg(dt_database_get(darktable.db)));
+    // the database might lag behind the last write release:
+    dt_pthread_mutex_lock(&c->queue_mutex);
+    const dt_image_cache_pending_t *p = g_hash_table_lookup(c->pending, GINT_TO_POINTER(key));
+    if(!p) p = g_hash_table_lookup(c->writing, GINT_TO_POINTER(key));
+    if(p)
+    {
+      memcpy(img, &p->img, sizeof(dt_image_t));
+      img->profile = NULL;
+      img->profile_size = 0;
+    }
+    dt_pthread_mutex_unlock(&c->queue_mutex);
   }
-  sqlite3_finalize(stmt);
 
   *buf = c->images + slot;
   return 0; // no write lock required, we inited it all right here.
@@ -136,6 +204,180 @@ dt_image_cache_deallocate(void *data, const uint32_t key, void *payload)
   dt_image_init(img);
 }
 
+// writes all queued image structs to the database. runs on the database writer thread, in its transaction,
+// so the queue is only locked to take the structs out: the writer might have to wait for the gui thread,
+// which in turn might want to queue a write release.
+static void
+_image_cache_write_pending(sqlite3 *handle, void *data)
+{
+  dt_image_cache_write_t *w = (dt_image_cache_write_t *)data;
+  dt_image_cache_t *cache = w->cache;
+  // without the writer thread this runs wherever the flush came from, keep the order anyways.
+  dt_pthread_mutex_lock(&cache->write_mutex);
+
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  w->num = g_hash_table_size(cache->pending);
+  w->entries = (dt_image_cache_pending_t *)g_malloc(sizeof(dt_image_cache_pending_t) * MAX(1, w->num));
+  GHashTableIter iter;
+  gpointer key, value;
+  int k = 0;
+  g_hash_table_iter_init(&iter, cache->pending);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    // still visible to dt_image_cache_allocate() until it's committed:
+    memcpy(w->entries + k++, value, sizeof(dt_image_cache_pending_t));
+    g_hash_table_iter_steal(&iter);
+    g_hash_table_replace(cache->writing, key, value);
+  }
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                              "UPDATE images SET width = ?1, height = ?2, maker = ?3, model = ?4, "
+                              "lens = ?5, exposure = ?6, aperture = ?7, iso = ?8, focal_length = ?9, "
+                              "focus_distance = ?10, film_id = ?11, datetime_taken = ?12, flags = ?13, "
+                              "crop = ?14, orientation = ?15, raw_parameters = ?16, group_id = ?17, longitude = ?18, "
+                              "latitude = ?19, color_matrix = ?20, colorspace = ?21, raw_black = ?22, raw_maximum = ?23 WHERE id = ?24");
+  // the generation makes sure a sidecar queued again while being written isn't dropped.
+  sqlite3_stmt *sidecar_stmt = dt_database_get_statement(darktable.db,
+                              "INSERT OR REPLACE INTO pending_sidecars (imgid, generation) VALUES (?1, ?2)");
+  const gint64 generation = g_get_real_time();
+
+  for(k = 0; k < w->num; k++)
+  {
+    const dt_image_cache_pending_t *p = w->entries + k;
+    const dt_image_t *img = &p->img;
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->exif_maker, -1, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, img->exif_model, -1, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, img->exif_lens,  -1,  SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 6, img->exif_exposure);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, img->exif_aperture);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, img->exif_iso);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, img->exif_focal_length);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, img->exif_focus_distance);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, img->film_id);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 12, img->exif_datetime_taken, -1, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 13, img->flags);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 14, img->exif_crop);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 15, img->orientation);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 16, *(uint32_t*)(&img->legacy_flip));
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 17, img->group_id);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 18, img->longitude);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 19, img->latitude);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 20, &img->d65_color_matrix, sizeof(img->d65_color_matrix), SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 21, img->colorspace);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 22, img->raw_black_level);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 23, img->raw_white_point);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 24, img->id);
+    const int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    if(p->write_sidecar)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(sidecar_stmt, 1, img->id);
+      sqlite3_bind_int64(sidecar_stmt, 2, generation);
+      sqlite3_step(sidecar_stmt);
+      sqlite3_reset(sidecar_stmt);
+      sqlite3_clear_bindings(sidecar_stmt);
+      w->sidecars = 1;
+    }
+  }
+  dt_database_release_statement(darktable.db, stmt);
+  dt_database_release_statement(darktable.db, sidecar_stmt);
+  dt_pthread_mutex_unlock(&cache->write_mutex);
+}
+
+// after the commit of _image_cache_write_pending().
+static void
+_image_cache_written(void *data)
+{
+  dt_image_cache_write_t *w = (dt_image_cache_write_t *)data;
+  dt_image_cache_t *cache = w->cache;
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  for(int k = 0; k < w->num; k++)
+  {
+    // unless it was taken out again in the meantime, by a later write which isn't committed yet.
+    const gpointer key = GINT_TO_POINTER(w->entries[k].img.id);
+    const dt_image_cache_pending_t *p = g_hash_table_lookup(cache->writing, key);
+    if(p && p->seq == w->entries[k].seq) g_hash_table_remove(cache->writing, key);
+  }
+  if(w->sidecars)
+  {
+    cache->sidecars_pending = 1;
+    pthread_cond_signal(&cache->queue_cond);
+  }
+  w->done = 1;
+  pthread_cond_broadcast(&cache->written_cond);
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+  g_free(w->entries);
+  w->entries = NULL;
+}
+
+// rewrites the xmp files listed in the pending_sidecars table. must not hold queue_mutex,
+// writing a sidecar goes through the image cache itself.
+static void
+_image_cache_write_sidecars()
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *stmt;
+  GList *ids = NULL, *generations = NULL;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT imgid, generation FROM pending_sidecars", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    ids = g_list_prepend(ids, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+    gint64 *generation = (gint64 *)g_malloc(sizeof(gint64));
+    *generation = sqlite3_column_int64(stmt, 1);
+    generations = g_list_prepend(generations, generation);
+  }
+  sqlite3_finalize(stmt);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "DELETE FROM pending_sidecars WHERE imgid = ?1 AND generation = ?2", -1, &stmt, NULL);
+  for(GList *i = ids, *g = generations; i && g; i = g_list_next(i), g = g_list_next(g))
+  {
+    const int imgid = GPOINTER_TO_INT(i->data);
+    dt_image_write_sidecar_file(imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    sqlite3_bind_int64(stmt, 2, *(gint64 *)g->data);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+  sqlite3_finalize(stmt);
+  g_list_free(ids);
+  g_list_free_full(generations, g_free);
+}
+
+static void *
+_image_cache_queue_thread(void *data)
+{
+  dt_image_cache_t *cache = (dt_image_cache_t *)data;
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  while(1)
+  {
+    while(!cache->queue_stop && !cache->sidecars_pending && g_hash_table_size(cache->pending) == 0)
+      dt_pthread_cond_wait(&cache->queue_cond, &cache->queue_mutex);
+    const int stop = cache->queue_stop;
+    dt_pthread_mutex_unlock(&cache->queue_mutex);
+    // give bulk operations the chance to queue some more.
+    if(!stop) g_usleep(DT_IMAGE_CACHE_WRITE_DELAY * 1000);
+    dt_image_cache_flush(cache);
+    dt_pthread_mutex_lock(&cache->queue_mutex);
+    const int sidecars = cache->sidecars_pending;
+    cache->sidecars_pending = 0;
+    dt_pthread_mutex_unlock(&cache->queue_mutex);
+
+    if(sidecars) _image_cache_write_sidecars();
+
+    dt_pthread_mutex_lock(&cache->queue_mutex);
+    if(stop && !cache->sidecars_pending && g_hash_table_size(cache->pending) == 0) break;
+  }
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+  return NULL;
+}
+
 void
 dt_image_cache_init(dt_image_cache_t *cache)
 {
@@ -163,11 +405,38 @@ dt_image_cache_init(dt_image_cache_t *cache)
     // optimized initialization (avoid accessing conf):
     memcpy(cache->images + k, cache->images, sizeof(dt_image_t));
   }
+
+  dt_pthread_mutex_init(&cache->queue_mutex, NULL);
+  pthread_cond_init(&cache->queue_cond, NULL);
+  pthread_cond_init(&cache->written_cond, NULL);
+  dt_pthread_mutex_init(&cache->write_mutex, NULL);
+  cache->pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  cache->writing = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  cache->seq = 0;
+  cache->prefetched = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  cache->queue_stop = 0;
+  // sidecars left over from last session, in case it didn't shut down cleanly.
+  cache->sidecars_pending = 1;
+  pthread_create(&cache->queue_thread, NULL, &_image_cache_queue_thread, cache);
 }
 
 void
 dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
+  // let the write-behind thread finish everything queued so far
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  cache->queue_stop = 1;
+  pthread_cond_signal(&cache->queue_cond);
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+  pthread_join(cache->queue_thread, NULL);
+  g_hash_table_destroy(cache->pending);
+  g_hash_table_destroy(cache->writing);
+  g_hash_table_destroy(cache->prefetched);
+  pthread_cond_destroy(&cache->queue_cond);
+  pthread_cond_destroy(&cache->written_cond);
+  dt_pthread_mutex_destroy(&cache->queue_mutex);
+  dt_pthread_mutex_destroy(&cache->write_mutex);
+
   dt_cache_cleanup(&cache->cache);
   dt_free_align(cache->images);
 }
@@ -188,6 +457,61 @@ dt_image_cache_read_get(
   return (const dt_image_t *)dt_cache_read_get(&cache->cache, imgid);
 }
 
+void
+dt_image_cache_prefetch(
+  dt_image_cache_t *cache,
+  const int32_t *imgids,
+  const int num)
+{
+  // only ask the database for what isn't cached yet
+  GString *query = g_string_new("SELECT " DT_IMAGE_CACHE_COLUMNS " FROM images WHERE id IN (");
+  int missing = 0;
+  for(int k=0; k<num; k++)
+  {
+    if(imgids[k] <= 0 || dt_cache_contains(&cache->cache, imgids[k])) continue;
+    g_string_append_printf(query, missing ? ",%d" : "%d", imgids[k]);
+    missing++;
+  }
+  g_string_append(query, ")");
+  if(!missing)
+  {
+    g_string_free(query, TRUE);
+    return;
+  }
+
+  sqlite3_stmt *stmt;
+  GList *loaded = NULL;
+  sqlite3 *reader = dt_database_get_reader(darktable.db);
+  DT_DEBUG_SQLITE3_PREPARE_V2(reader, query->str, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
+    dt_image_init(img);
+    _image_cache_read_row(stmt, img);
+    dt_pthread_mutex_lock(&cache->queue_mutex);
+    g_hash_table_replace(cache->prefetched, GINT_TO_POINTER(img->id), img);
+    dt_pthread_mutex_unlock(&cache->queue_mutex);
+    loaded = g_list_prepend(loaded, GINT_TO_POINTER(img->id));
+  }
+  sqlite3_finalize(stmt);
+  dt_database_release_reader(darktable.db, reader);
+  g_string_free(query, TRUE);
+
+  // pull them into the cache, dt_image_cache_allocate() picks them up from the prefetched table.
+  for(GList *l = loaded; l; l = g_list_next(l))
+  {
+    const dt_image_t *img = dt_image_cache_read_get(cache, GPOINTER_TO_INT(l->data));
+    dt_image_cache_read_release(cache, img);
+  }
+
+  // whatever was cached by someone else in the meantime is stale now.
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  for(GList *l = loaded; l; l = g_list_next(l))
+    g_hash_table_remove(cache->prefetched, l->data);
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+  g_list_free(loaded);
+}
+
 const dt_image_t*
 dt_image_cache_read_testget(
   dt_image_cache_t *cache,
@@ -232,58 +556,59 @@ dt_image_cache_write_release(
   dt_image_cache_write_mode_t mode)
 {
   if(img->id <= 0) return;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE images SET width = ?1, height = ?2, maker = ?3, model = ?4, "
-                              "lens = ?5, exposure = ?6, aperture = ?7, iso = ?8, focal_length = ?9, "
-                              "focus_distance = ?10, film_id = ?11, datetime_taken = ?12, flags = ?13, "
-                              "crop = ?14, orientation = ?15, raw_parameters = ?16, group_id = ?17, longitude = ?18, "
-                              "latitude = ?19, color_matrix = ?20, colorspace = ?21, raw_black = ?22, raw_maximum = ?23 WHERE id = ?24", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->exif_maker, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, img->exif_model, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, img->exif_lens,  -1,  SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 6, img->exif_exposure);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, img->exif_aperture);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, img->exif_iso);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, img->exif_focal_length);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, img->exif_focus_distance);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, img->film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 12, img->exif_datetime_taken, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 13, img->flags);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 14, img->exif_crop);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 15, img->orientation);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 16, *(uint32_t*)(&img->legacy_flip));
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 17, img->group_id);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 18, img->longitude);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 19, img->latitude);
-  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 20, &img->d65_color_matrix, sizeof(img->d65_color_matrix), SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 21, img->colorspace);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 22, img->raw_black_level);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 23, img->raw_white_point);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 24, img->id);
-  int rc = sqlite3_step(stmt);
-  if (rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
 
-  // TODO: make this work in relaxed mode, too.
-  if(mode == DT_IMAGE_CACHE_SAFE)
+  // queue a copy, merging it with what's still pending for this image.
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  dt_image_cache_pending_t *p = g_hash_table_lookup(cache->pending, GINT_TO_POINTER(img->id));
+  if(!p)
   {
-    // rest about sidecars:
-    // also synch dttags file:
-    dt_image_write_sidecar_file(img->id);
+    p = (dt_image_cache_pending_t *)g_malloc0(sizeof(dt_image_cache_pending_t));
+    g_hash_table_insert(cache->pending, GINT_TO_POINTER(img->id), p);
   }
+  memcpy(&p->img, img, sizeof(dt_image_t));
+  // the color profile belongs to the cache line, and isn't stored in the db anyways.
+  p->img.profile = NULL;
+  p->img.profile_size = 0;
+  // TODO: make this work in relaxed mode, too.
+  if(mode == DT_IMAGE_CACHE_SAFE) p->write_sidecar = 1;
+  p->seq = ++cache->seq;
+  pthread_cond_signal(&cache->queue_cond);
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+
   dt_cache_write_release(&cache->cache, img->id);
 }
 
 
 // remove the image from the cache
+void
+dt_image_cache_flush(
+  dt_image_cache_t *cache)
+{
+  // the collection is set up before the image cache
+  if(!cache || !cache->pending) return;
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  const int empty = g_hash_table_size(cache->pending) == 0 && g_hash_table_size(cache->writing) == 0;
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+  if(empty) return;
+
+  // this also waits for the writes taken out before, they are queued in front of us.
+  dt_image_cache_write_t w = { cache, NULL, 0, 0, 0 };
+  dt_database_write(darktable.db, _image_cache_write_pending, &w, _image_cache_written);
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  while(!w.done) dt_pthread_cond_wait(&cache->written_cond, &cache->queue_mutex);
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
+}
+
 void
 dt_image_cache_remove(
   dt_image_cache_t *cache,
   const uint32_t imgid)
 {
+  // the image is about to vanish from the db, don't resurrect it
+  dt_pthread_mutex_lock(&cache->queue_mutex);
+  g_hash_table_remove(cache->pending, GINT_TO_POINTER(imgid));
+  g_hash_table_remove(cache->writing, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->queue_mutex);
   dt_cache_remove(&cache->cache, imgid);
 }
 
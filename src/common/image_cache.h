@@ -19,13 +19,38 @@
 #define DT_IMAGE_CACHE_H
 
 #include "common/cache.h"
+#include "common/dtpthread.h"
 #include "common/image.h"
 
+#include <glib.h>
+
 typedef struct dt_image_cache_t
 {
   // one fat block of dt_image_t, to assign `dynamic' void* in cache to.
   dt_image_t *images;
   dt_cache_t cache;
+
+  // write-behind queue for dt_image_cache_write_release().
+  // protects pending, writing, prefetched and the counters and flags below.
+  // never held while waiting for the database.
+  dt_pthread_mutex_t queue_mutex;
+  pthread_cond_t queue_cond;
+  pthread_t queue_thread;
+  // image id -> latest dt_image_cache_pending_t not yet in the database.
+  GHashTable *pending;
+  // image id -> dt_image_cache_pending_t taken out of pending, but not committed yet.
+  GHashTable *writing;
+  // numbers the write releases, to tell the states of one image apart.
+  uint32_t seq;
+  // signalled whenever a write is committed.
+  pthread_cond_t written_cond;
+  // keeps the writes in the order they were taken out of pending.
+  dt_pthread_mutex_t write_mutex;
+  // image id -> dt_image_t read by dt_image_cache_prefetch(), about to go into the cache.
+  GHashTable *prefetched;
+  // there are rows in the pending_sidecars table to be written out.
+  int sidecars_pending;
+  int queue_stop;
 }
 dt_image_cache_t;
 
@@ -56,6 +81,15 @@ dt_image_cache_read_get(
   dt_image_cache_t *cache,
   const uint32_t imgid);
 
+// reads all of the given images which aren't cached yet with a single query
+// and puts them into the cache, so drawing a page of thumbnails doesn't cost
+// one database round trip per image. ids <= 0 are skipped.
+void
+dt_image_cache_prefetch(
+  dt_image_cache_t *cache,
+  const int32_t *imgids,
+  const int num);
+
 // same as read_get, but doesn't block and returns NULL if the image
 // is currently unavailable.
 const dt_image_t*
@@ -78,14 +112,23 @@ dt_image_cache_write_get(
   const dt_image_t *img);
 
 // drops the write privileges on an image struct.
-// this triggers a write-through to sql, and if the setting
-// is present, also to xmp sidecar files (safe setting).
+// the new state is queued for sql, and if the setting
+// is present, also for the xmp sidecar files (safe setting).
+// repeated updates of the same image are merged, a background
+// thread writes them in one transaction shortly after.
 void
 dt_image_cache_write_release(
   dt_image_cache_t *cache,
   dt_image_t *img,
   dt_image_cache_write_mode_t mode);
 
+// synchronously writes all queued image structs to the database.
+// call this before querying the images table for things that might
+// just have been changed through the cache.
+void
+dt_image_cache_flush(
+  dt_image_cache_t *cache);
+
 // remove the image from the cache
 void
 dt_image_cache_remove(
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
 
 typedef union
 {
@@ -150,6 +152,67 @@ void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const
   }
 }
 
+// 4 floats to 4 halfs in the lower 16 bits of each lane (sign extended).
+static inline __m128i
+_float_to_half_sse(const __m128 f)
+{
+  const __m128 justsign = _mm_and_ps(f, _mm_set1_ps(-0.0f));
+  const __m128 absf = _mm_xor_ps(f, justsign);
+  const __m128i absi = _mm_castps_si128(absf);
+  // everything from 65520 up rounds to infinity, clamp that to the largest half instead. nan stays nan.
+  const __m128i isregular = _mm_cmpgt_epi32(_mm_set1_epi32(0x477ff000), absi);
+  const __m128i isnan = _mm_cmpgt_epi32(absi, _mm_set1_epi32(0x7f800000));
+  const __m128i special = _mm_or_si128(_mm_and_si128(isnan, _mm_set1_epi32(0x7e00)),
+                                       _mm_andnot_si128(isnan, _mm_set1_epi32(0x7bff)));
+  // below the smallest normal half: let the fpu round the mantissa by adding a magic number.
+  const __m128i magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+  const __m128i issub = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), absi);
+  const __m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(magic))), magic);
+  // normal: rebias the exponent and round the mantissa to nearest even.
+  const __m128i odd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+  const __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, _mm_set1_epi32(0xfff - ((127 - 15) << 23))), odd), 13);
+  const __m128i h = _mm_or_si128(_mm_and_si128(issub, sub), _mm_andnot_si128(issub, normal));
+  const __m128i r = _mm_or_si128(_mm_and_si128(isregular, h), _mm_andnot_si128(isregular, special));
+  return _mm_or_si128(r, _mm_srai_epi32(_mm_castps_si128(justsign), 16));
+}
+
+// 4 halfs, zero extended to 32 bits, to floats.
+static inline __m128
+_half_to_float_sse(const __m128i h)
+{
+  const __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+  const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+  // multiplying by 2^112 rebiases the exponent and takes care of denormals, too.
+  const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+                                   _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+  const __m128i infnan = _mm_and_si128(_mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+  return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infnan)));
+}
+
+void dt_image_float_to_half(const float *in, uint16_t *out, const size_t n)
+{
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) shared(in, out)
+#endif
+  for(size_t k=0; k<n; k+=4)
+  {
+    const __m128i h = _float_to_half_sse(_mm_loadu_ps(in + k));
+    _mm_storel_epi64((__m128i *)(out + k), _mm_packs_epi32(h, h));
+  }
+}
+
+void dt_image_half_to_float(const uint16_t *in, float *out, const size_t n)
+{
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) shared(in, out)
+#endif
+  for(size_t k=0; k<n; k+=4)
+  {
+    const __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(in + k)), _mm_setzero_si128());
+    _mm_storeu_ps(out + k, _half_to_float_sse(h));
+  }
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -16,12 +16,19 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 #ifndef DT_IMAGE_COMPRESSION
+#define DT_IMAGE_COMPRESSION
 #include <inttypes.h>
+#include <stddef.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH 2006. */
 void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
 void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
 
+/** ieee half floats, round to nearest even. n is the number of values and has to be a multiple of 4.
+ *  values beyond the half range are clamped to +-65504. */
+void dt_image_float_to_half(const float *in, uint16_t *out, const size_t n);
+void dt_image_half_to_float(const uint16_t *in, float *out, const size_t n);
+
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,383 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/darktable.h"
+#include "common/debug.h"
+#include "common/image_tiles.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "develop/develop.h"
+#include "develop/pixelpipe.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// all of these are called with t->lock held.
+
+static void _tiles_drop(dt_image_tiles_t *t, dt_image_tile_t *s)
+{
+  if(!s->surface) return;
+  t->memory -= (size_t)cairo_image_surface_get_stride(s->surface) * cairo_image_surface_get_height(s->surface);
+  // whoever is drawing it right now holds a reference of its own.
+  cairo_surface_destroy(s->surface);
+  s->surface = NULL;
+}
+
+static dt_image_tile_t *_tiles_find(dt_image_tiles_t *t, const int32_t imgid, const uint64_t hash,
+                                    const int level, const int32_t tx, const int32_t ty)
+{
+  for(int k=0; k<DT_IMAGE_TILES; k++)
+  {
+    dt_image_tile_t *s = t->tile + k;
+    if(s->surface && s->imgid == imgid && s->hash == hash &&
+       s->level == level && s->tx == tx && s->ty == ty) return s;
+  }
+  return NULL;
+}
+
+static void _tiles_insert(dt_image_tiles_t *t, const int32_t imgid, const uint64_t hash,
+                          const int level, const int32_t tx, const int32_t ty, cairo_surface_t *surface)
+{
+  // the first free slot, or else the least recently used one:
+  dt_image_tile_t *slot = t->tile;
+  for(int k=1; k<DT_IMAGE_TILES && slot->surface; k++)
+    if(!t->tile[k].surface || t->tile[k].used < slot->used) slot = t->tile + k;
+  _tiles_drop(t, slot);
+
+  slot->imgid = imgid;
+  slot->hash = hash;
+  slot->level = level;
+  slot->tx = tx;
+  slot->ty = ty;
+  slot->used = ++t->clock;
+  slot->surface = surface;
+  t->memory += (size_t)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+
+  while(t->memory > DT_IMAGE_TILES_MEMORY)
+  {
+    dt_image_tile_t *oldest = NULL;
+    for(int k=0; k<DT_IMAGE_TILES; k++)
+      if(t->tile[k].surface && t->tile + k != slot &&
+         (!oldest || t->tile[k].used < oldest->used)) oldest = t->tile + k;
+    if(!oldest) break;
+    _tiles_drop(t, oldest);
+  }
+}
+
+// only while no job is running.
+static void _tiles_unload(dt_image_tiles_t *t)
+{
+  if(t->pipe)
+  {
+    dt_dev_pixelpipe_cleanup(t->pipe);
+    free(t->pipe);
+    t->pipe = NULL;
+  }
+  if(t->dev)
+  {
+    dt_dev_cleanup(t->dev);
+    free(t->dev);
+    t->dev = NULL;
+  }
+  dt_mipmap_cache_read_release(darktable.mipmap_cache, &t->buf);
+  t->imgid = -1;
+  t->width = t->height = 0;
+}
+
+static int32_t _tiles_job_run(dt_job_t *job);
+
+static void _tiles_start(dt_image_tiles_t *t)
+{
+  if(t->rendering) return;
+  dt_job_t *job = dt_control_job_create(&_tiles_job_run, "render tiles");
+  if(!job) return;
+  dt_control_job_set_params(job, t);
+  t->rendering = !dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
+}
+
+// the rest runs in the job, without the lock.
+
+// what the pipe is set up from, so tiles survive changes to other images.
+static uint64_t _tiles_history_hash(const int32_t imgid)
+{
+  // bernstein hash (djb2), as for the pixelpipe cache
+  uint64_t hash = 5381 + imgid;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "select num, operation, op_params, enabled, blendop_params, multi_priority "
+                              "from history where imgid = ?1 order by num", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    for(int c=0; c<6; c++)
+    {
+      const char *str = (const char *)sqlite3_column_blob(stmt, c);
+      const int len = sqlite3_column_bytes(stmt, c);
+      for(int i=0; i<len; i++) hash = ((hash << 5) + hash) ^ str[i];
+      hash = ((hash << 5) + hash) ^ len;
+    }
+  }
+  sqlite3_finalize(stmt);
+  return hash;
+}
+
+// sets up a pipe for the full size image, the same as the one of the darkroom.
+static void _tiles_load(dt_image_tiles_t *t, const int32_t imgid, const uint64_t hash, const uint32_t generation)
+{
+  dt_pthread_mutex_lock(&t->lock);
+  _tiles_unload(t);
+  dt_pthread_mutex_unlock(&t->lock);
+
+  int32_t width = 0, height = 0;
+  dt_develop_t *dev = NULL;
+  dt_dev_pixelpipe_t *pipe = NULL;
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
+  if(buf.buf)
+  {
+    dev = (dt_develop_t *)malloc(sizeof(dt_develop_t));
+    pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
+    dt_dev_init(dev, 0);
+    dt_dev_load_image(dev, imgid);
+    if(dt_dev_pixelpipe_init(pipe))
+    {
+      dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, 1.0);
+      dt_dev_pixelpipe_create_nodes(pipe, dev);
+      dt_dev_pixelpipe_synch_all(pipe, dev);
+      dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight,
+                                      &pipe->processed_width, &pipe->processed_height);
+      width  = pipe->processed_width;
+      height = pipe->processed_height;
+    }
+    else
+    {
+      free(pipe);
+      pipe = NULL;
+    }
+  }
+
+  dt_pthread_mutex_lock(&t->lock);
+  t->dev = dev;
+  t->pipe = pipe;
+  t->buf = buf;
+  // even if it failed, so it isn't tried over and over again:
+  t->imgid = imgid;
+  t->hash = hash;
+  t->generation = generation;
+  t->width  = pipe ? width  : 0;
+  t->height = pipe ? height : 0;
+  dt_pthread_mutex_unlock(&t->lock);
+}
+
+static cairo_surface_t *_tiles_render(dt_image_tiles_t *t, const int level, const int32_t tx, const int32_t ty)
+{
+  int32_t lw, lh;
+  dt_image_tiles_get_level_size(t->width, t->height, level, &lw, &lh);
+  const int32_t x = tx * DT_IMAGE_TILE_SIZE, y = ty * DT_IMAGE_TILE_SIZE;
+  const int32_t wd = MIN(DT_IMAGE_TILE_SIZE, lw - x), ht = MIN(DT_IMAGE_TILE_SIZE, lh - y);
+  if(x < 0 || y < 0 || wd <= 0 || ht <= 0) return NULL;
+
+  // a tile goes through the pipe with the neighbourhood its modules look at, so there are no seams between
+  // tiles processed apart. modules with statistics over their roi would still put them there: then the whole
+  // level goes through the pipe, the tiles are cut from its output which stays in the pipe's cache.
+  const float scale = ldexpf(1.0f, -level);
+  const int whole = !dt_dev_pixelpipe_is_roi_independent(t->pipe);
+  const int32_t margin = whole ? 0 : dt_dev_pixelpipe_roi_margin(t->pipe, lw, lh, scale);
+  const int32_t px = whole ? 0 : MAX(0, x - margin), py = whole ? 0 : MAX(0, y - margin);
+  const int32_t pw = whole ? lw : MIN(lw, x + wd + margin) - px, ph = whole ? lh : MIN(lh, y + ht + margin) - py;
+  if(dt_dev_pixelpipe_process(t->pipe, t->dev, px, py, pw, ph, scale)) return NULL;
+
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, wd, ht);
+  if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+  {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  const int32_t stride = cairo_image_surface_get_stride(surface);
+  cairo_surface_flush(surface);
+  uint8_t *data = cairo_image_surface_get_data(surface);
+  dt_pthread_mutex_lock(&t->pipe->backbuf_mutex);
+  const int ok = t->pipe->backbuf && t->pipe->backbuf_width == pw && t->pipe->backbuf_height == ph;
+  if(ok) for(int j=0; j<ht; j++)
+    memcpy(data + (size_t)stride*j, t->pipe->backbuf + (size_t)4*((size_t)pw*(y-py+j) + x-px), (size_t)4*wd);
+  dt_pthread_mutex_unlock(&t->pipe->backbuf_mutex);
+  if(!ok)
+  {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  cairo_surface_mark_dirty(surface);
+  return surface;
+}
+
+static int32_t _tiles_job_run(dt_job_t *job)
+{
+  dt_image_tiles_t *t = dt_control_job_get_params(job);
+  dt_pthread_mutex_lock(&t->lock);
+  while(dt_control_running() && t->want_imgid > 0)
+  {
+    const uint32_t generation = darktable.mipmap_cache->generation;
+    if(t->imgid != t->want_imgid || t->generation != generation)
+    {
+      // another image, or some image changed:
+      const int32_t imgid = t->want_imgid;
+      const int loaded = t->imgid == imgid;
+      const uint64_t loaded_hash = t->hash;
+      dt_pthread_mutex_unlock(&t->lock);
+      const uint64_t hash = _tiles_history_hash(imgid);
+      if(loaded && hash == loaded_hash)
+      {
+        // not this one, the pipe and the tiles are still good.
+        dt_pthread_mutex_lock(&t->lock);
+        t->generation = generation;
+      }
+      else
+      {
+        _tiles_load(t, imgid, hash, generation);
+        dt_pthread_mutex_lock(&t->lock);
+      }
+      dt_control_queue_redraw_center();
+      continue;
+    }
+    if(!t->pipe || t->num_wanted <= 0) break;
+
+    const int level = t->want_level;
+    const int32_t tx = t->wanted[0][0], ty = t->wanted[0][1];
+    t->num_wanted--;
+    memmove(t->wanted, t->wanted + 1, sizeof(t->wanted[0]) * t->num_wanted);
+    if(_tiles_find(t, t->imgid, t->hash, level, tx, ty)) continue;
+
+    dt_pthread_mutex_unlock(&t->lock);
+    cairo_surface_t *surface = _tiles_render(t, level, tx, ty);
+    dt_pthread_mutex_lock(&t->lock);
+    if(surface)
+    {
+      _tiles_insert(t, t->imgid, t->hash, level, tx, ty, surface);
+      dt_control_queue_redraw_center();
+    }
+  }
+  t->rendering = 0;
+  if(t->release)
+  {
+    _tiles_unload(t);
+    t->release = 0;
+  }
+  dt_pthread_mutex_unlock(&t->lock);
+  return 0;
+}
+
+void dt_image_tiles_init(dt_image_tiles_t *t)
+{
+  memset(t, 0, sizeof(dt_image_tiles_t));
+  dt_pthread_mutex_init(&t->lock, NULL);
+  t->want_imgid = -1;
+  t->imgid = -1;
+  t->buf.size = DT_MIPMAP_NONE;
+}
+
+void dt_image_tiles_cleanup(dt_image_tiles_t *t)
+{
+  _tiles_unload(t);
+  for(int k=0; k<DT_IMAGE_TILES; k++) _tiles_drop(t, t->tile + k);
+  dt_pthread_mutex_destroy(&t->lock);
+}
+
+int dt_image_tiles_get_size(dt_image_tiles_t *t, const int32_t imgid, int32_t *width, int32_t *height)
+{
+  const uint32_t generation = darktable.mipmap_cache->generation;
+  dt_pthread_mutex_lock(&t->lock);
+  *width = *height = 0;
+  if(t->imgid == imgid && t->generation == generation)
+  {
+    *width  = t->width;
+    *height = t->height;
+  }
+  else
+  {
+    if(t->want_imgid != imgid)
+    {
+      t->want_imgid = imgid;
+      t->num_wanted = 0;
+    }
+    t->release = 0;
+    _tiles_start(t);
+  }
+  dt_pthread_mutex_unlock(&t->lock);
+  return *width > 0 && *height > 0;
+}
+
+int dt_image_tiles_get_levels(const int32_t width, const int32_t height)
+{
+  int levels = 1;
+  while(MAX(width, height) > (DT_IMAGE_TILE_SIZE << (levels-1)) && levels < 16) levels++;
+  return levels;
+}
+
+void dt_image_tiles_get_level_size(const int32_t width, const int32_t height, const int level,
+                                   int32_t *level_width, int32_t *level_height)
+{
+  // what the pipe gives at that scale:
+  const float scale = ldexpf(1.0f, -level);
+  *level_width  = MAX(1, (int32_t)(scale * width));
+  *level_height = MAX(1, (int32_t)(scale * height));
+}
+
+cairo_surface_t *dt_image_tiles_get(dt_image_tiles_t *t, const int32_t imgid, const int level,
+                                    const int32_t tx, const int32_t ty)
+{
+  const uint32_t generation = darktable.mipmap_cache->generation;
+  cairo_surface_t *surface = NULL;
+  dt_pthread_mutex_lock(&t->lock);
+  // until the job has checked the history again, the tiles might be outdated.
+  dt_image_tile_t *s = (t->imgid == imgid && t->generation == generation)
+                       ? _tiles_find(t, imgid, t->hash, level, tx, ty) : NULL;
+  if(s)
+  {
+    s->used = ++t->clock;
+    surface = cairo_surface_reference(s->surface);
+  }
+  dt_pthread_mutex_unlock(&t->lock);
+  return surface;
+}
+
+void dt_image_tiles_request(dt_image_tiles_t *t, const int32_t imgid, const int level,
+                            const int32_t (*txy)[2], const int num)
+{
+  dt_pthread_mutex_lock(&t->lock);
+  t->want_imgid = imgid;
+  t->want_level = level;
+  t->num_wanted = MIN(num, DT_IMAGE_TILES_WANTED);
+  memcpy(t->wanted, txy, sizeof(t->wanted[0]) * t->num_wanted);
+  t->release = 0;
+  if(t->num_wanted > 0) _tiles_start(t);
+  dt_pthread_mutex_unlock(&t->lock);
+}
+
+void dt_image_tiles_release(dt_image_tiles_t *t)
+{
+  dt_pthread_mutex_lock(&t->lock);
+  t->want_imgid = -1;
+  t->num_wanted = 0;
+  if(t->rendering) t->release = 1;
+  else _tiles_unload(t);
+  dt_pthread_mutex_unlock(&t->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
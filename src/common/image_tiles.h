@@ -0,0 +1,115 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_IMAGE_TILES_H
+#define DT_IMAGE_TILES_H
+
+#include "common/dtpthread.h"
+#include "common/mipmap_cache.h"
+
+#include <inttypes.h>
+#include <cairo.h>
+
+/**
+ * deep zoom into the developed image, for viewing huge images without a full size copy of them.
+ * the image is cut into a pyramid: level l is the processed image at scale 1/2^l, in square
+ * tiles of DT_IMAGE_TILE_SIZE pixels. only the tiles which are asked for are rendered, in the
+ * background, from the full size input through a pixelpipe which stays set up for the image.
+ * rendered tiles are kept by (image, history, level, tile) for the next redraws.
+ */
+
+#define DT_IMAGE_TILE_SIZE 256
+// rendered tiles kept, at most this many and this many bytes.
+#define DT_IMAGE_TILES 1024
+#define DT_IMAGE_TILES_MEMORY (128<<20)
+// tiles waiting to be rendered
+#define DT_IMAGE_TILES_WANTED 256
+
+typedef struct dt_image_tile_t
+{
+  int32_t imgid;
+  uint64_t hash;
+  int32_t level, tx, ty;
+  uint32_t used;
+  cairo_surface_t *surface;
+}
+dt_image_tile_t;
+
+typedef struct dt_image_tiles_t
+{
+  // protects everything below
+  dt_pthread_mutex_t lock;
+
+  dt_image_tile_t tile[DT_IMAGE_TILES];
+  uint32_t clock;
+  size_t memory;
+
+  // tiles still to be rendered, most important first. replaced by every request.
+  int32_t want_imgid, want_level;
+  int32_t num_wanted;
+  int32_t wanted[DT_IMAGE_TILES_WANTED][2];
+
+  // a job is queued or running
+  int rendering;
+  // drop the pipe as soon as the job is done
+  int release;
+
+  // the image which is set up for rendering, kept between jobs, and the hash of its history.
+  int32_t imgid;
+  uint64_t hash;
+  // the mipmap cache generation the hash was last checked at: any change of any image bumps it.
+  uint32_t generation;
+  // processed size at level 0
+  int32_t width, height;
+  struct dt_develop_t *dev;
+  struct dt_dev_pixelpipe_t *pipe;
+  dt_mipmap_buffer_t buf;
+}
+dt_image_tiles_t;
+
+void dt_image_tiles_init(dt_image_tiles_t *t);
+/** must not be called while jobs are still running, i.e. after the control is shut down. */
+void dt_image_tiles_cleanup(dt_image_tiles_t *t);
+
+/** size of the processed image. returns 0 if it's not known yet: then the pipe for
+    the image is set up in the background, and a redraw is queued once it's known. */
+int dt_image_tiles_get_size(dt_image_tiles_t *t, const int32_t imgid, int32_t *width, int32_t *height);
+
+/** number of levels worth of tiles: the coarsest one fits into one tile. */
+int dt_image_tiles_get_levels(const int32_t width, const int32_t height);
+
+/** size of the image at this level. */
+void dt_image_tiles_get_level_size(const int32_t width, const int32_t height, const int level,
+                                   int32_t *level_width, int32_t *level_height);
+
+/** a rendered tile, or NULL if it's not in the cache. the caller owns a reference on it and
+    has to destroy it after drawing. */
+cairo_surface_t *dt_image_tiles_get(dt_image_tiles_t *t, const int32_t imgid, const int level,
+                                    const int32_t tx, const int32_t ty);
+
+/** render these tiles, most important first. tiles asked for earlier which didn't start
+    yet are forgotten. a redraw is queued whenever one is ready. */
+void dt_image_tiles_request(dt_image_tiles_t *t, const int32_t imgid, const int level,
+                            const int32_t (*txy)[2], const int num);
+
+/** let go of the pipe and the full size input, once the tiles aren't needed for a while. */
+void dt_image_tiles_release(dt_image_tiles_t *t);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -23,6 +23,7 @@
 #include "common/colorlabels.h"
 #include "common/debug.h"
 #include "common/exif.h"
+#include "common/file_map.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
@@ -61,14 +62,17 @@
 
 
 // load a full-res thumbnail:
-int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height, int32_t *orientation)
+int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height, int32_t *orientation, const int32_t max_width, const int32_t max_height)
 {
   int ret = 0;
   int res = 1;
+  // only the headers and the embedded thumbnail will be touched:
+  dt_file_map_t *view = dt_file_map_open(filename, DT_FILE_MAP_RANDOM);
+  if(!view) return 1;
   // raw image thumbnail
   libraw_data_t *raw = libraw_init(0);
   libraw_processed_image_t *image = NULL;
-  ret = libraw_open_file(raw, filename);
+  ret = libraw_open_buffer(raw, view->data, view->size);
   if(ret) goto libraw_fail;
   ret = libraw_unpack_thumb(raw);
   if(ret) goto libraw_fail;
@@ -82,6 +86,8 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
   {
     dt_imageio_jpeg_t jpg;
     if(dt_imageio_jpeg_decompress_header(image->data, image->data_size, &jpg)) goto libraw_fail;
+    if(*orientation & ORIENTATION_SWAP_XY) dt_imageio_jpeg_scale(&jpg, max_height, max_width);
+    else dt_imageio_jpeg_scale(&jpg, max_width, max_height);
     *buffer = (uint8_t *)malloc((size_t)sizeof(uint8_t)*jpg.width*jpg.height*4);
     if(!*buffer) goto libraw_fail;
     *width = jpg.width;
@@ -106,6 +112,7 @@ libraw_fail:
     libraw_close(raw);
     res = 1;
   }
+  dt_file_map_close(view);
   return res;
 }
 
@@ -119,6 +126,7 @@ libraw_fail:
     if(verb) fprintf(stderr,"[imageio] %s: %s\n", filename, libraw_strerror(ret)); \
     libraw_close(raw);                         \
     raw = NULL; \
+    dt_file_map_close(view); \
     return DT_IMAGEIO_FILE_CORRUPTED;                                   \
   }                                                       \
 }
@@ -331,8 +339,12 @@ dt_imageio_open_raw(
 {
   if(!_blacklisted_ext(filename)) return DT_IMAGEIO_FILE_CORRUPTED;
 
+  // one view of the file for exiv2 and libraw:
+  dt_file_map_t *view = dt_file_map_open(filename, DT_FILE_MAP_SEQUENTIAL);
+  if(!view) return DT_IMAGEIO_FILE_CORRUPTED;
+
   if(!img->exif_inited)
-    (void) dt_exif_read(img, filename);
+    (void) dt_exif_read_from_map(img, filename, view->data, view->size);
 
   int ret;
   libraw_data_t *raw = libraw_init(0);
@@ -363,7 +375,7 @@ dt_imageio_open_raw(
   // raw->params.amaze_ca_refine = 0;
   raw->params.fbdd_noiserd    = 0;
 
-  ret = libraw_open_file(raw, filename);
+  ret = libraw_open_buffer(raw, view->data, view->size);
   HANDLE_ERRORS(ret, 0);
   raw->params.user_qual = 0;
   raw->params.half_size = 0;
@@ -404,6 +416,7 @@ dt_imageio_open_raw(
     libraw_recycle(raw);
     libraw_close(raw);
     free(image);
+    dt_file_map_close(view);
     return DT_IMAGEIO_CACHE_FULL;
   }
   if(img->filters)
@@ -418,6 +431,7 @@ dt_imageio_open_raw(
   libraw_recycle(raw);
   libraw_close(raw);
   free(image);
+  dt_file_map_close(view);
   raw = NULL;
   image = NULL;
 
@@ -598,6 +612,83 @@ int dt_imageio_export(
                                         0, 0, high_quality, 0, NULL,copy_metadata,storage,storage_params);
 }
 
+// streaming export: run the pipe over bands of rows and hand each one to the format
+// as soon as it's done, so compression overlaps processing and the full 8-bit
+// output buffer is never needed.
+static int
+_export_in_bands(
+  const uint32_t              imgid,
+  const char                 *filename,
+  dt_imageio_module_format_t *format,
+  dt_imageio_module_data_t   *format_params,
+  dt_dev_pixelpipe_t         *pipe,
+  dt_develop_t               *dev,
+  const int                   processed_width,
+  const int                   processed_height,
+  const double                scale,
+  const int32_t               ignore_exif,
+  const int32_t               display_byteorder,
+  const int                   sRGB,
+  const int                   band_height,
+  const int                   margin)
+{
+  format_params->width  = processed_width;
+  format_params->height = processed_height;
+
+  int res;
+  if(!ignore_exif)
+  {
+    int length;
+    uint8_t exif_profile[65535]; // C++ alloc'ed buffer is uncool, so we waste some bits here.
+    char pathname[PATH_MAX];
+    gboolean from_cache = TRUE;
+    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+    // last param is dng mode, it's false here
+    length = dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+    res = format->write_image_begin(format_params, filename, exif_profile, length, imgid);
+  }
+  else
+  {
+    res = format->write_image_begin(format_params, filename, NULL, 0, imgid);
+  }
+  if(res) return res;
+
+  for(int y=0; y<processed_height; y+=band_height)
+  {
+    const int rows = MIN(band_height, processed_height - y);
+    // the band with the neighbourhood of its first and last rows, which is cut off again:
+    const int y0 = MAX(0, y - margin), y1 = MIN(processed_height, y + rows + margin);
+    if(dt_dev_pixelpipe_process(pipe, dev, 0, y0, processed_width, y1 - y0, scale))
+    {
+      // the format will complain about missing rows and clean up after itself,
+      // but don't leave a truncated file behind.
+      format->write_image_end(format_params);
+      g_unlink(filename);
+      return 1;
+    }
+    uint8_t *const buf8 = pipe->backbuf + (size_t)4*processed_width*(y - y0);
+    if(!display_byteorder)
+    {
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(static) shared(buf8)
+#endif
+      for(size_t k=0; k<(size_t)processed_width*rows; k++)
+      {
+        uint8_t tmp = buf8[4*k+0];
+        buf8[4*k+0] = buf8[4*k+2];
+        buf8[4*k+2] = tmp;
+      }
+    }
+    if(format->write_image_rows(format_params, buf8, rows))
+    {
+      // the format has cleaned up already.
+      g_unlink(filename);
+      return 1;
+    }
+  }
+  return format->write_image_end(format_params);
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(
   const uint32_t              imgid,
@@ -704,7 +795,10 @@ int dt_imageio_export_with_flags(
     }
   }
 
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, 1.0);
+  // the float preview might be stored as half floats:
+  float *scratch = buf.size == DT_MIPMAP_F ? dt_mipmap_cache_alloc_scratchmem_f(darktable.mipmap_cache) : NULL;
+  float *input = buf.size == DT_MIPMAP_F ? dt_mipmap_cache_decompress_f(&buf, scratch) : (float *)buf.buf;
+  dt_dev_pixelpipe_set_input(&pipe, &dev, input, buf.width, buf.height, 1.0);
   dt_dev_pixelpipe_create_nodes(&pipe, &dev);
   dt_dev_pixelpipe_synch_all(&pipe, &dev);
   dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width, &pipe.processed_height);
@@ -763,6 +857,22 @@ int dt_imageio_export_with_flags(
   uint8_t *outbuf = pipe.backbuf;
   uint8_t *moutbuf = NULL; // keep track of alloc'ed memory
   dt_get_times(&start);
+
+  // formats which can write rows incrementally get them band by band, if the image is big enough to bother
+  // and no module needs to see all of it at once. the bands overlap by the neighbourhood the modules need,
+  // unless that would process everything more than twice.
+  const int band_height = dt_conf_get_int("plugins/imageio/export/band_height");
+  const int band_margin = dt_dev_pixelpipe_roi_margin(&pipe, processed_width, processed_height, scale);
+  if(bpp == 8 && !high_quality_processing && !thumbnail_export && format->write_image_begin
+     && band_height > 0 && processed_height > band_height && 2*band_margin <= band_height
+     && dt_dev_pixelpipe_is_roi_independent(&pipe))
+  {
+    res = _export_in_bands(imgid, filename, format, format_params, &pipe, &dev, processed_width, processed_height,
+                           scale, ignore_exif, display_byteorder, sRGB, band_height, band_margin);
+    dt_show_times(&start, "[dev_process_export] pixel pipeline processing and streaming write", NULL);
+    goto written;
+  }
+
   if(high_quality_processing)
   {
     dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
@@ -883,9 +993,11 @@ int dt_imageio_export_with_flags(
     res = format->write_image (format_params, filename, outbuf, NULL, 0, imgid);
   }
 
+written:
   dt_dev_pixelpipe_cleanup(&pipe);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+  dt_free_align(scratch);
   dt_free_align(moutbuf);
   /* now write xmp into that container, if possible */
   if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP)) {
@@ -98,7 +98,8 @@ void dt_imageio_flip_buffers_ui16_to_float(float *out, const uint16_t *in, const
 void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const float black, const float white, const int ch, const int wd, const int ht, const int fwd, const int fht, const int stride, const dt_image_orientation_t orientation);
 
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
-int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height, dt_image_orientation_t *orientation);
+// if max_width and max_height are > 0, it is decoded at a smaller size which still covers them.
+int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height, dt_image_orientation_t *orientation, const int32_t max_width, const int32_t max_height);
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
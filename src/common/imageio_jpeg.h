@@ -46,6 +46,9 @@ dt_imageio_jpeg_t;
 int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_jpeg_t *jpg);
 /** reads the whole image to the out buffer, which has to be large enough. */
 int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out);
+/** after reading the header: have the next decompress/read scale the image down by 1/2, 1/4 or 1/8 while
+ *  decoding, as far as it still covers width x height. updates width/height in the jpg struct. */
+void dt_imageio_jpeg_scale(dt_imageio_jpeg_t *jpg, const int width, const int height);
 /** compresses in to out buffer with given quality (0..100). out buffer must be large enough. returns actual data length. */
 int dt_imageio_jpeg_compress(const uint8_t *in, uint8_t *out, const int width, const int height, const int quality);
 
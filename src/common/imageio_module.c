@@ -100,6 +100,10 @@ dt_imageio_load_module_format (dt_imageio_module_format_t *module, const char *l
   if(!g_module_symbol(module->module, "free_params",                  (gpointer)&(module->free_params)))                  goto error;
   if(!g_module_symbol(module->module, "set_params",                   (gpointer)&(module->set_params)))                   goto error;
   if(!g_module_symbol(module->module, "write_image",                  (gpointer)&(module->write_image)))                  goto error;
+  if(!g_module_symbol(module->module, "write_image_begin",            (gpointer)&(module->write_image_begin)))            module->write_image_begin = NULL;
+  if(!g_module_symbol(module->module, "write_image_rows",             (gpointer)&(module->write_image_rows)))             module->write_image_rows = NULL;
+  if(!g_module_symbol(module->module, "write_image_end",              (gpointer)&(module->write_image_end)))              module->write_image_end = NULL;
+  if(!module->write_image_rows || !module->write_image_end) module->write_image_begin = NULL;
   if(!g_module_symbol(module->module, "bpp",                          (gpointer)&(module->bpp)))                          goto error;
   if(!g_module_symbol(module->module, "flags",                        (gpointer)&(module->flags)))                        module->flags = _default_format_flags;
   if(!g_module_symbol(module->module, "levels",                       (gpointer)&(module->levels)))                       module->levels = _default_format_levels;
@@ -102,6 +102,11 @@ typedef struct dt_imageio_module_format_t
   int (*bpp)(dt_imageio_module_data_t *data);
   /* write to file, with exif if not NULL, and icc profile if supported. */
   int (*write_image)(dt_imageio_module_data_t *data, const char *filename, const void *in, void *exif, int exif_len, int imgid);
+  /* optional: streaming interface, write the image in bands of rows as they come out of the pixelpipe.
+   * rows are 8-bit, 4 channels, data->width wide. NULL if the format can only write whole images. */
+  int (*write_image_begin)(dt_imageio_module_data_t *data, const char *filename, void *exif, int exif_len, int imgid);
+  int (*write_image_rows)(dt_imageio_module_data_t *data, const void *in, const int num_rows);
+  int (*write_image_end)(dt_imageio_module_data_t *data);
   /* flag that describes the available precision/levels of output format. mainly used for dithering. */
   int (*levels)(dt_imageio_module_data_t *data);
 
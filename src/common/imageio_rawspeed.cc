@@ -23,7 +23,7 @@
 #include <memory>
 
 #include "rawspeed/RawSpeed/StdAfx.h"
-#include "rawspeed/RawSpeed/FileReader.h"
+#include "rawspeed/RawSpeed/FileMap.h"
 #include "rawspeed/RawSpeed/RawDecoder.h"
 #include "rawspeed/RawSpeed/RawParser.h"
 #include "rawspeed/RawSpeed/CameraMetaData.h"
@@ -34,6 +34,7 @@ extern "C"
 #include "imageio.h"
 #include "common/imageio_rawspeed.h"
 #include "common/exif.h"
+#include "common/file_map.h"
 #include "common/darktable.h"
 #include "common/colorspaces.h"
 #include "common/file_location.h"
@@ -55,6 +56,14 @@ using namespace RawSpeed;
 dt_imageio_retval_t dt_imageio_open_rawspeed_sraw(dt_image_t *img, RawImage r, dt_mipmap_cache_allocator_t a);
 static CameraMetaData *meta = NULL;
 
+// closes the mapped input file on every way out, including exceptions.
+struct dt_file_map_guard_t
+{
+  dt_file_map_t *map;
+  explicit dt_file_map_guard_t(dt_file_map_t *m) : map(m) {}
+  ~dt_file_map_guard_t() { dt_file_map_close(map); }
+};
+
 #if 0
 static void
 scale_black_white(uint16_t *const buf, const uint16_t black, const uint16_t white, const int width, const int height, const int stride)
@@ -81,19 +90,13 @@ dt_imageio_open_rawspeed(
   const char  *filename,
   dt_mipmap_cache_allocator_t a)
 {
-  if(!img->exif_inited)
-    (void) dt_exif_read(img, filename);
+  // one view of the file shared by exiv2 and rawspeed, instead of a heap copy each.
+  dt_file_map_guard_t view(dt_file_map_open(filename, DT_FILE_MAP_SEQUENTIAL));
+  if(!view.map)
+    return DT_IMAGEIO_FILE_CORRUPTED;
 
-#ifdef __WIN32__
-  const size_t len = strlen(filename) + 1;
-  wchar_t filen[len];
-  mbstowcs(filen, filename, len);
-  FileReader f(filen);
-#else
-  char filen[PATH_MAX];
-  snprintf(filen, sizeof(filen), "%s", filename);
-  FileReader f(filen);
-#endif
+  if(!img->exif_inited)
+    (void) dt_exif_read_from_map(img, filename, view.map->data, view.map->size);
 
 #ifdef __APPLE__
   std::auto_ptr<RawDecoder> d;
@@ -120,10 +123,11 @@ dt_imageio_open_rawspeed(
       dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
     }
 
+    // rawspeed doesn't own the data, the view stays alive until we return.
 #ifdef __APPLE__
-    m = auto_ptr<FileMap>(f.readFile());
+    m = auto_ptr<FileMap>(new FileMap(view.map->data, view.map->size));
 #else
-    m = unique_ptr<FileMap>(f.readFile());
+    m = unique_ptr<FileMap>(new FileMap(view.map->data, view.map->size));
 #endif
 
     RawParser t(m.get());
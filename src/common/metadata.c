@@ -18,6 +18,7 @@
 
 #include "common/metadata.h"
 #include "common/debug.h"
+#include "common/image_cache.h"
 
 #include <stdlib.h>
 
@@ -85,6 +86,8 @@ static GList* dt_metadata_get_xmp(int id, const char* key, uint32_t* count)
   {
     if(strncmp(key, "Xmp.xmp.Rating", 14) == 0)
     {
+      // the flags are read from the database, which might not have the latest ones yet
+      dt_image_cache_flush(darktable.image_cache);
       if(id == -1)
       {
         DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
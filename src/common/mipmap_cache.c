@@ -17,9 +17,11 @@
 */
 
 #include "common/darktable.h"
+#include "common/dxt.h"
 #include "common/exif.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/image_compression.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
 #include "common/imageio_jpeg.h"
@@ -38,6 +40,7 @@
 #include <unistd.h>
 #include <sys/fcntl.h>
 #include <limits.h>
+#include <float.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <errno.h>
@@ -48,6 +51,7 @@
 #define DT_MIPMAP_CACHE_DEFAULT_FILE_NAME "mipmaps"
 
 #define DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE (1<<0)
+#define DT_MIPMAP_BUFFER_DSC_FLAG_PREFETCHED (1<<1)
 
 struct dt_mipmap_buffer_dsc
 {
@@ -497,8 +501,18 @@ int32_t
 dt_mipmap_cache_allocate(void *data, const uint32_t key, int32_t *cost, void **buf)
 {
   dt_mipmap_cache_one_t *c = (dt_mipmap_cache_one_t *)data;
-  // slot is exactly aligned with encapsulated cache's position and already allocated
+  // slots are fixed size, but only allocated while in use, so other levels can have the memory.
   *cost = c->buffer_size;
+  if(!*buf)
+  {
+    *buf = dt_alloc_align(64, c->buffer_size);
+    if(!*buf)
+    {
+      fprintf(stderr, "[mipmap cache] memory allocation failed!\n");
+      exit(1);
+    }
+    __sync_fetch_and_add(&c->bytes, c->buffer_size);
+  }
   struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)*buf;
   // set width and height:
   dsc->width = c->max_width;
@@ -510,14 +524,21 @@ dt_mipmap_cache_allocate(void *data, const uint32_t key, int32_t *cost, void **b
   return 1;
 }
 
-#if 0
 void
 dt_mipmap_cache_deallocate(void *data, const uint32_t key, void *payload)
 {
-  // nothing. memory is only allocated once.
-  // TODO: overwrite buffer with not-found image?
+  dt_mipmap_cache_one_t *c = (dt_mipmap_cache_one_t *)data;
+  __sync_fetch_and_sub(&c->bytes, c->buffer_size);
+  dt_free_align(payload);
+}
+
+// at shutdown, for the buffers still in the cache.
+static int
+_free_buffer(const uint32_t key, const void *data, void *user_data)
+{
+  if(data && data != (void *)dt_mipmap_cache_static_dead_image) dt_free_align((void *)data);
+  return 0;
 }
-#endif
 
 
 // callback for the imageio core to allocate memory.
@@ -540,8 +561,12 @@ dt_mipmap_cache_alloc(dt_image_t *img, dt_mipmap_size_t size, dt_mipmap_cache_al
   // so only check size and re-alloc if necessary:
   if(!(*dsc) || ((*dsc)->size < buffer_size) || ((void *)*dsc == (void *)dt_mipmap_cache_static_dead_image))
   {
-    if((void *)*dsc != (void *)dt_mipmap_cache_static_dead_image)
+    volatile size_t *bytes = &darktable.mipmap_cache->mip[DT_MIPMAP_FULL].bytes;
+    if(*dsc && (void *)*dsc != (void *)dt_mipmap_cache_static_dead_image)
+    {
+      __sync_fetch_and_sub(bytes, (*dsc)->size);
       dt_free_align(*dsc);
+    }
     *dsc = dt_alloc_align(64, buffer_size);
     // fprintf(stderr, "[mipmap cache] alloc for key %u %p\n", get_key(img->id, size), *buf);
     if(!(*dsc))
@@ -553,6 +578,7 @@ dt_mipmap_cache_alloc(dt_image_t *img, dt_mipmap_size_t size, dt_mipmap_cache_al
     }
     // set buffer size only if we're making it larger.
     (*dsc)->size = buffer_size;
+    __sync_fetch_and_add(bytes, buffer_size);
   }
   (*dsc)->width = wd;
   (*dsc)->height = ht;
@@ -602,12 +628,13 @@ dt_mipmap_cache_allocate_dynamic(void *data, const uint32_t key, int32_t *cost,
       dsc->height = 0;
       dsc->size = sizeof(*dsc)+sizeof(float)*4*64;
     }
+    __sync_fetch_and_add(&cache->bytes, dsc->size);
   }
   assert(dsc->size >= sizeof(*dsc));
   dsc->flags = DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
 
   // cost is just flat one for the buffer, as the buffers might have different sizes,
-  // to make sure quota is meaningful.
+  // to make sure quota is meaningful. the memory is accounted for in cache->bytes.
   *cost = 1;
   // fprintf(stderr, "dummy allocing %p\n", *buf);
   return 1; // request write lock
@@ -617,12 +644,46 @@ void
 dt_mipmap_cache_deallocate_dynamic(void *data, const uint32_t key, void *payload)
 {
   dt_mipmap_cache_one_t *cache = (dt_mipmap_cache_one_t *)data;
-  if(cache->size == DT_MIPMAP_F)
+  // full images might have fallen back to the static dead image:
+  if(!payload || payload == (void *)dt_mipmap_cache_static_dead_image) return;
+  struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)payload;
+  __sync_fetch_and_sub(&cache->bytes, dsc->size);
+  dt_free_align(payload);
+}
+
+// keeps all levels together within the memory budget: while it's exceeded, drop the least
+// recently used buffer of the level where that one is worth the least, i.e. the cheapest to
+// regenerate per byte, weighted by how long ago it was used. buffers in use are skipped, so
+// this gives up if everything is locked.
+static void
+_mipmap_cache_gc(dt_mipmap_cache_t *cache, const size_t needed)
+{
+  for(int tries=0; tries<64; tries++)
   {
-    free(payload);
+    size_t total = 0;
+    for(int k=0; k<=DT_MIPMAP_FULL; k++) total += cache->mip[k].bytes;
+    if(total + needed <= cache->max_mem) return;
+
+    int victim = -1;
+    float worth = FLT_MAX;
+    for(int k=0; k<=DT_MIPMAP_FULL; k++)
+    {
+      uint32_t stamp;
+      if(!cache->mip[k].bytes || dt_cache_lru_stamp(&cache->mip[k].cache, &stamp)) continue;
+      // full images vary in size, these count entries:
+      const size_t per_buffer = k == DT_MIPMAP_FULL ? cache->mip[k].bytes / MAX(1, cache->mip[k].cache.cost)
+                                                    : cache->mip[k].buffer_size;
+      const float age = (uint32_t)(cache->clock - stamp) + 1.0f;
+      const float w = cache->mip[k].gen_ms / (age * (float)per_buffer);
+      if(w < worth)
+      {
+        worth = w;
+        victim = k;
+      }
+    }
+    if(victim < 0 || dt_cache_evict_lru(&cache->mip[victim].cache)) return;
+    __sync_fetch_and_add(&cache->mip[victim].stats_evictions, 1);
   }
-  // else:
-  // don't clean up anything, as we are re-allocating.
 }
 
 static uint32_t
@@ -639,6 +700,7 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc+1));
 
+  cache->generation = 0;
   cache->compression_type = 0;
   gchar *compression = dt_conf_get_string("cache_compression");
   if(compression)
@@ -652,6 +714,7 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 
   dt_print(DT_DEBUG_CACHE, "[mipmap_cache_init] using %s\n", cache->compression_type == 0 ? "no compression" :
            (cache->compression_type == 1 ? "low quality compression" : "slow high quality compression"));
+  cache->half_float = dt_conf_get_bool("cache_half_float");
 
   // adjust numbers to be large enough to hold what mem limit suggests.
   // we want at least 100MB, and consider 8G just still reasonable.
@@ -696,7 +759,9 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
              cnt, cnt* wd*ht*sizeof(uint32_t)/(1024.0*1024.0));
   }
 
-  for(int k=DT_MIPMAP_3; k>=0; k--)
+  cache->max_mem = max_mem;
+  cache->clock = 0;
+  for(int k=0; k<=DT_MIPMAP_FULL; k++)
   {
     // clear stats:
     cache->mip[k].stats_requests = 0;
@@ -704,67 +769,74 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
     cache->mip[k].stats_misses = 0;
     cache->mip[k].stats_fetches = 0;
     cache->mip[k].stats_standin = 0;
+    cache->mip[k].stats_prefetches = 0;
+    cache->mip[k].stats_prefetch_hits = 0;
+    cache->mip[k].stats_evictions = 0;
+    cache->mip[k].bytes = 0;
+    // rough guesses until we measured it: thumbnails come from embedded jpgs or larger mips,
+    // the float preview and the full image need the raw to be loaded.
+    cache->mip[k].gen_ms = k < DT_MIPMAP_F ? 10.0f*(k+1) : (k == DT_MIPMAP_F ? 300.0f : 1000.0f);
+  }
+
+  for(int k=DT_MIPMAP_3; k>=0; k--)
+  {
     // buffer stores width and height + actual data
     const int width  = cache->mip[k].max_width;
     const int height = cache->mip[k].max_height;
     // header + adjusted for dxt compression:
     cache->mip[k].buffer_size = 4*sizeof(uint32_t) + compressed_buffer_size(cache->compression_type, width, height);
     cache->mip[k].size = k;
+    cache->mip[k].buf = NULL;
+    // enough slots to spend the whole budget on this level, if that's what is browsed.
+    // the buffers are allocated on demand, so empty slots only cost the hashtable entry.
     // level of parallelism also gives minimum size (which is twice that)
-    // is rounded to a power of two by the cache anyways, we might as well.
-    // XXX this needs adjustment for video mode (more full-res thumbs for replay)
-    // TODO: collect hit/miss stats and auto-adjust to user browsing behaviour
-    // TODO: can #prefetches be collected this way, too?
-    const size_t max_mem2 = (k == 0) ? (max_mem) : (max_mem/(k+4));
-    uint32_t thumbnails = MAX(2, nearest_power_of_two((uint32_t)((double)max_mem2/cache->mip[k].buffer_size)));
-    while(thumbnails > parallel && (size_t)thumbnails * cache->mip[k].buffer_size > max_mem2) thumbnails /= 2;
-
-    // try to utilize that memory well (use 90% quota), the hopscotch paper claims good scalability up to
-    // even more than that.
-    dt_cache_init(&cache->mip[k].cache, thumbnails,
-                  parallel,
-                  64, 0.9f*thumbnails*cache->mip[k].buffer_size);
+    uint32_t thumbnails = MAX(2*parallel, nearest_power_of_two((uint32_t)MIN(1<<16, max_mem/cache->mip[k].buffer_size)));
 
-    // might have been rounded to power of two:
-    thumbnails = dt_cache_capacity(&cache->mip[k].cache);
-    max_mem -= thumbnails * cache->mip[k].buffer_size;
-    // dt_print(DT_DEBUG_CACHE, "[mipmap mem] %4.02f left\n", max_mem/(1024.0*1024.0));
-    cache->mip[k].buf = dt_alloc_align(64, thumbnails * cache->mip[k].buffer_size);
-    dt_cache_static_allocation(&cache->mip[k].cache, (uint8_t *)cache->mip[k].buf, cache->mip[k].buffer_size);
+    // the common budget is enforced by _mipmap_cache_gc() before allocating. the quota of the
+    // level itself only kicks in if it would run out of slots.
+    dt_cache_init(&cache->mip[k].cache, thumbnails, parallel, 64,
+                  MIN(1.25*max_mem, (double)thumbnails*cache->mip[k].buffer_size));
+    dt_cache_set_clock(&cache->mip[k].cache, &cache->clock);
     dt_cache_set_allocate_callback(&cache->mip[k].cache,
                                    dt_mipmap_cache_allocate, &cache->mip[k]);
-    // dt_cache_set_cleanup_callback(&cache->mip[k].cache,
-    // &dt_mipmap_cache_deallocate, &cache->mip[k]);
+    dt_cache_set_cleanup_callback(&cache->mip[k].cache,
+                                  dt_mipmap_cache_deallocate, &cache->mip[k]);
 
     dt_print(DT_DEBUG_CACHE,
-             "[mipmap_cache_init] cache has % 5d entries for mip %d (% 4.02f MB).\n",
-             thumbnails, k, thumbnails * cache->mip[k].buffer_size/(1024.0*1024.0));
+             "[mipmap_cache_init] cache has % 5d entries for mip %d (% 4.02f MB each).\n",
+             dt_cache_capacity(&cache->mip[k].cache), k, cache->mip[k].buffer_size/(1024.0*1024.0));
   }
 
   // full buffer needs dynamic alloc:
   const int full_entries = MAX(2, parallel); // even with one thread you want two buffers. one for dr one for thumbs.
-  int32_t max_mem_bufs = nearest_power_of_two(full_entries);
+  // these count entries, not bytes. allow as many as the budget might hold of them.
+  int32_t max_mem_bufs = nearest_power_of_two(MAX(full_entries, max_mem/(64u<<20)));
 
   // for this buffer, because it can be very busy during import, we want the minimum
   // number of entries in the hashtable to be 16, but leave the quota as is. the dynamic
   // alloc/free properties of this cache take care that no more memory is required.
   dt_cache_init(&cache->mip[DT_MIPMAP_FULL].cache, max_mem_bufs, parallel, 64, max_mem_bufs);
+  dt_cache_set_clock(&cache->mip[DT_MIPMAP_FULL].cache, &cache->clock);
   dt_cache_set_allocate_callback(&cache->mip[DT_MIPMAP_FULL].cache,
                                  dt_mipmap_cache_allocate_dynamic, &cache->mip[DT_MIPMAP_FULL]);
-  // dt_cache_set_cleanup_callback(&cache->mip[DT_MIPMAP_FULL].cache,
-  // &dt_mipmap_cache_deallocate_dynamic, &cache->mip[DT_MIPMAP_FULL]);
+  // free evicted images, so their memory goes back to the common budget:
+  dt_cache_set_cleanup_callback(&cache->mip[DT_MIPMAP_FULL].cache,
+                                dt_mipmap_cache_deallocate_dynamic, &cache->mip[DT_MIPMAP_FULL]);
   cache->mip[DT_MIPMAP_FULL].buffer_size = 0;
   cache->mip[DT_MIPMAP_FULL].size = DT_MIPMAP_FULL;
   cache->mip[DT_MIPMAP_FULL].buf = NULL;
 
   // same for mipf:
-  dt_cache_init(&cache->mip[DT_MIPMAP_F].cache, max_mem_bufs, parallel, 64, max_mem_bufs);
+  cache->mip[DT_MIPMAP_F].buffer_size = 4*sizeof(uint32_t) +
+                                        4*(cache->half_float ? sizeof(uint16_t) : sizeof(float)) *
+                                        cache->mip[DT_MIPMAP_F].max_width * cache->mip[DT_MIPMAP_F].max_height;
+  const int32_t f_bufs = nearest_power_of_two(MAX(full_entries, max_mem/cache->mip[DT_MIPMAP_F].buffer_size));
+  dt_cache_init(&cache->mip[DT_MIPMAP_F].cache, f_bufs, parallel, 64, f_bufs);
+  dt_cache_set_clock(&cache->mip[DT_MIPMAP_F].cache, &cache->clock);
   dt_cache_set_allocate_callback(&cache->mip[DT_MIPMAP_F].cache,
                                  dt_mipmap_cache_allocate_dynamic, &cache->mip[DT_MIPMAP_F]);
   dt_cache_set_cleanup_callback(&cache->mip[DT_MIPMAP_F].cache,
                                 dt_mipmap_cache_deallocate_dynamic, &cache->mip[DT_MIPMAP_F]);
-  cache->mip[DT_MIPMAP_F].buffer_size = 4*sizeof(uint32_t) +
-                                        4*sizeof(float) * cache->mip[DT_MIPMAP_F].max_width * cache->mip[DT_MIPMAP_F].max_height;
   cache->mip[DT_MIPMAP_F].size = DT_MIPMAP_F;
   cache->mip[DT_MIPMAP_F].buf = NULL;
 
@@ -774,14 +846,12 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_serialize(cache);
-  for(int k=0; k<DT_MIPMAP_F; k++)
+  for(int k=0; k<=DT_MIPMAP_FULL; k++)
   {
+    // the cache doesn't free what's still in there:
+    dt_cache_for_all(&cache->mip[k].cache, _free_buffer, NULL);
     dt_cache_cleanup(&cache->mip[k].cache);
-    // now mem is actually freed, not during cache cleanup
-    dt_free_align(cache->mip[k].buf);
   }
-  dt_cache_cleanup(&cache->mip[DT_MIPMAP_FULL].cache);
-  dt_cache_cleanup(&cache->mip[DT_MIPMAP_F].cache);
 
   // clean up temporary buffers for decompressed images, if any:
   if(cache->compression_type)
@@ -819,6 +889,14 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
            dt_cache_size(&cache->scratchmem.cache),
            dt_cache_capacity(&cache->scratchmem.cache));
   }
+  size_t total = 0;
+  for(int k=0; k<=(int)DT_MIPMAP_FULL; k++) total += cache->mip[k].bytes;
+  printf("[mipmap_cache] common budget %.2f/%.2f MB (%.2f%%)\n", total/(1024.0*1024.0), cache->max_mem/(1024.0*1024.0),
+         100.0f*(float)total/(float)cache->max_mem);
+  printf("[mipmap_cache] level |       MB | regenerate | evicted\n");
+  for(int k=0; k<=(int)DT_MIPMAP_FULL; k++)
+    printf("[mipmap_cache] %c%d    | %8.2f | %7.1f ms | %7ld\n", k > 3 ? 'f' : 'i', k,
+        cache->mip[k].bytes/(1024.0*1024.0), cache->mip[k].gen_ms, cache->mip[k].stats_evictions);
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
   uint64_t sum_standins = 0;
@@ -836,11 +914,114 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
         100.0*cache->mip[k].stats_standin/(float)sum_standins,
         100.0*cache->mip[k].stats_fetches/(float)sum_fetches,
         100.0*cache->mip[k].stats_requests/(float)sum);
+  printf("[mipmap_cache] level | prefetched | shown\n");
+  for(int k=0; k<(int)DT_MIPMAP_F; k++)
+    printf("[mipmap_cache] i%d    | %10ld | %6.2f%%\n", k,
+        cache->mip[k].stats_prefetches,
+        100.0*cache->mip[k].stats_prefetch_hits/(float)MAX(1, cache->mip[k].stats_prefetches));
   printf("\n\n");
   // very verbose stats about locks/users
   //dt_cache_print(&cache->mip[DT_MIPMAP_3].cache);
 }
 
+// size of an 8-bit mip filled from iw x ih pixels, never upscaled.
+static inline void
+_size_8(
+  const dt_mipmap_cache_t *cache,
+  const dt_mipmap_size_t   mip,
+  const uint32_t           iw,
+  const uint32_t           ih,
+  uint32_t                *width,
+  uint32_t                *height)
+{
+  const float scale = fminf(1.0f, fminf(cache->mip[mip].max_width/(float)iw, cache->mip[mip].max_height/(float)ih));
+  *width  = CLAMP(iw*scale, 1, cache->mip[mip].max_width);
+  *height = CLAMP(ih*scale, 1, cache->mip[mip].max_height);
+}
+
+// fill an 8-bit mip by downsampling a bigger one of the same image which is already in the
+// cache, without waiting for locks. returns 0 on success.
+static int
+_init_8_from_larger(
+  dt_mipmap_cache_t      *cache,
+  uint8_t                *buf,
+  uint32_t               *width,
+  uint32_t               *height,
+  const uint32_t          imgid,
+  const dt_mipmap_size_t  mip)
+{
+  for(int k=DT_MIPMAP_3; k>(int)mip; k--)
+  {
+    dt_mipmap_buffer_t src;
+    dt_mipmap_cache_read_get(cache, &src, imgid, k, DT_MIPMAP_TESTLOCK);
+    if(!src.buf) continue;
+    // skip skulls and failed ones
+    if(src.width > 8 && src.height > 8)
+    {
+      uint8_t *scratchmem = dt_mipmap_cache_alloc_scratchmem(cache);
+      const uint8_t *in = dt_mipmap_cache_decompress(&src, scratchmem);
+      _size_8(cache, mip, src.width, src.height, width, height);
+      dt_iop_downsample_8(in, src.width, src.height, buf, *width, *height);
+      dt_mipmap_cache_read_release(cache, &src);
+      dt_free_align(scratchmem);
+      return 0;
+    }
+    dt_mipmap_cache_read_release(cache, &src);
+  }
+  return 1;
+}
+
+// fill all 8-bit mips smaller than mip from the freshly generated pixels of that one, so
+// a new image only runs the pipe (or decodes its embedded thumbnail) once, and not again
+// for every zoom level of the lighttable.
+static void
+_init_8_smaller(
+  dt_mipmap_cache_t      *cache,
+  const uint8_t          *in,
+  const uint32_t          iw,
+  const uint32_t          ih,
+  const uint32_t          imgid,
+  const dt_mipmap_size_t  mip)
+{
+  if(iw <= 8 || ih <= 8) return;
+  uint8_t *scratchmem = NULL;
+  for(int k=(int)mip-1; k>=DT_MIPMAP_0; k--)
+  {
+    const uint32_t key = get_key(imgid, k);
+    // don't touch what is there already or is being generated elsewhere:
+    if(dt_cache_contains(&cache->mip[k].cache, key)) continue;
+    _mipmap_cache_gc(cache, cache->mip[k].buffer_size);
+    struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)dt_cache_read_get(&cache->mip[k].cache, key);
+    if(!dsc) continue;
+    if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
+    {
+      // we're write locked, as for any other fresh buffer.
+      __sync_fetch_and_add (&(cache->mip[k].stats_fetches), 1);
+      _size_8(cache, k, iw, ih, &dsc->width, &dsc->height);
+      if(cache->compression_type)
+      {
+        if(!scratchmem) scratchmem = dt_mipmap_cache_alloc_scratchmem(cache);
+        dt_iop_downsample_8(in, iw, ih, scratchmem, dsc->width, dsc->height);
+        dt_mipmap_buffer_t buf;
+        buf.width  = dsc->width;
+        buf.height = dsc->height;
+        buf.imgid  = imgid;
+        buf.size   = k;
+        buf.buf    = (uint8_t *)(dsc+1);
+        dt_mipmap_cache_compress(&buf, scratchmem);
+      }
+      else
+      {
+        dt_iop_downsample_8(in, iw, ih, (uint8_t *)(dsc+1), dsc->width, dsc->height);
+      }
+      dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+      dt_cache_write_release(&cache->mip[k].cache, key);
+    }
+    dt_cache_read_release(&cache->mip[k].cache, key);
+  }
+  dt_free_align(scratchmem);
+}
+
 void
 dt_mipmap_cache_read_get(
   dt_mipmap_cache_t *cache,
@@ -880,7 +1061,10 @@ dt_mipmap_cache_read_get(
   }
   else if(flags == DT_MIPMAP_BLOCKING)
   {
-    // simple case: blocking get
+    // simple case: blocking get. make room first if it needs to be allocated
+    // (full images don't know their size yet, they're checked after loading).
+    if(!dt_cache_contains(&cache->mip[mip].cache, key))
+      _mipmap_cache_gc(cache, cache->mip[mip].buffer_size);
     struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)dt_cache_read_get(&cache->mip[mip].cache, key);
     if(!dsc)
     {
@@ -901,6 +1085,7 @@ dt_mipmap_cache_read_get(
       if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
       {
         __sync_fetch_and_add (&(cache->mip[mip].stats_fetches), 1);
+        const double start = dt_get_wtime();
         // fprintf(stderr, "[mipmap cache get] now initializing buffer for img %u mip %d!\n", imgid, mip);
         // we're write locked here, as requested by the alloc callback.
         // now fill it with data:
@@ -953,7 +1138,22 @@ dt_mipmap_cache_read_get(
         }
         else if(mip == DT_MIPMAP_F)
         {
-          _init_f((float *)(dsc+1), &dsc->width, &dsc->height, imgid);
+          if(cache->half_float)
+          {
+            // generate in full precision, then convert. skulls stay floats.
+            float *tmp = dt_mipmap_cache_alloc_scratchmem_f(cache);
+            if(tmp) _init_f(tmp, &dsc->width, &dsc->height, imgid);
+            else dsc->width = dsc->height = 0;
+            if(dsc->width > 8 && dsc->height > 8)
+              dt_image_float_to_half(tmp, (uint16_t *)(dsc+1), (size_t)4*dsc->width*dsc->height);
+            else if(dsc->width && dsc->height)
+              memcpy(dsc+1, tmp, sizeof(float)*4*dsc->width*dsc->height);
+            dt_free_align(tmp);
+          }
+          else
+          {
+            _init_f((float *)(dsc+1), &dsc->width, &dsc->height, imgid);
+          }
         }
         else
         {
@@ -965,24 +1165,31 @@ dt_mipmap_cache_read_get(
             // const void *cbuf =
             dt_cache_read_get(&cache->scratchmem.cache, key);
             uint8_t *scratchmem = (uint8_t *)dt_cache_write_get(&cache->scratchmem.cache, key);
-            _init_8(scratchmem, &dsc->width, &dsc->height, imgid, mip);
+            if(_init_8_from_larger(cache, scratchmem, &dsc->width, &dsc->height, imgid, mip))
+              _init_8(scratchmem, &dsc->width, &dsc->height, imgid, mip);
             buf->width  = dsc->width;
             buf->height = dsc->height;
             buf->imgid  = imgid;
             buf->size   = mip;
             buf->buf = (uint8_t *)(dsc+1);
             dt_mipmap_cache_compress(buf, scratchmem);
+            _init_8_smaller(cache, scratchmem, dsc->width, dsc->height, imgid, mip);
             dt_cache_write_release(&cache->scratchmem.cache, key);
             dt_cache_read_release(&cache->scratchmem.cache, key);
           }
           else
           {
-            _init_8((uint8_t *)(dsc+1), &dsc->width, &dsc->height, imgid, mip);
+            if(_init_8_from_larger(cache, (uint8_t *)(dsc+1), &dsc->width, &dsc->height, imgid, mip))
+              _init_8((uint8_t *)(dsc+1), &dsc->width, &dsc->height, imgid, mip);
+            _init_8_smaller(cache, (uint8_t *)(dsc+1), dsc->width, dsc->height, imgid, mip);
           }
         }
         dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
         // drop the write lock
         dt_cache_write_release(&cache->mip[mip].cache, key);
+        // remember what it takes to get this back, for the eviction order:
+        cache->mip[mip].gen_ms = 0.9f*cache->mip[mip].gen_ms + 0.1f*1000.0*(dt_get_wtime() - start);
+        if(mip == DT_MIPMAP_FULL) _mipmap_cache_gc(cache, 0);
         /* raise signal that mipmaps has been flushed to cache */
         dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED);
       }
@@ -1013,6 +1220,13 @@ dt_mipmap_cache_read_get(
       if(buf->buf && buf->width > 0 && buf->height > 0)
       {
         if(mip != k) __sync_fetch_and_add (&(cache->mip[k].stats_standin), 1);
+        struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)buf->buf - 1;
+        if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_PREFETCHED)
+        {
+          // only count the first time it's shown
+          dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_PREFETCHED;
+          __sync_fetch_and_add (&(cache->mip[k].stats_prefetch_hits), 1);
+        }
         return;
       }
       // didn't succeed the first time? prefetch for later!
@@ -1106,6 +1320,42 @@ dt_mipmap_cache_get_matching_size(
   return best;
 }
 
+void
+dt_mipmap_cache_prefetch(
+  dt_mipmap_cache_t *cache,
+  const int32_t *imgids,
+  const int num,
+  const dt_mipmap_size_t mip)
+{
+  if(mip >= DT_MIPMAP_F || (int)mip < DT_MIPMAP_0) return;
+  for(int k=0; k<num; k++)
+  {
+    if(imgids[k] <= 0 || dt_cache_contains(&cache->mip[mip].cache, get_key(imgids[k], mip))) continue;
+    __sync_fetch_and_add (&(cache->mip[mip].stats_prefetches), 1);
+    // the background queue is fifo and doesn't get in the way of what's on screen.
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, dt_image_prefetch_job_create(imgids[k], mip));
+  }
+}
+
+void
+dt_mipmap_cache_prefetch_cancel(
+  dt_mipmap_cache_t *cache)
+{
+  const int cancelled = dt_image_prefetch_jobs_cancel();
+  if(cancelled) dt_print(DT_DEBUG_CACHE, "[mipmap_cache] cancelled %d stale prefetches\n", cancelled);
+}
+
+void
+dt_mipmap_cache_prefetched(
+  dt_mipmap_cache_t *cache,
+  dt_mipmap_buffer_t *buf)
+{
+  if(!buf->buf || buf->size >= DT_MIPMAP_F) return;
+  struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)buf->buf - 1;
+  if((void *)dsc == (void *)dt_mipmap_cache_static_dead_image) return;
+  dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_PREFETCHED;
+}
+
 void
 dt_mipmap_cache_remove(
   dt_mipmap_cache_t *cache,
@@ -1117,6 +1367,7 @@ dt_mipmap_cache_remove(
     const uint32_t key = get_key(imgid, k);
     dt_cache_remove(&cache->mip[k].cache, key);
   }
+  __sync_fetch_and_add(&cache->generation, 1);
 }
 
 static void
@@ -1306,6 +1557,8 @@ _init_8(
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        if(orientation & ORIENTATION_SWAP_XY) dt_imageio_jpeg_scale(&jpg, ht, wd);
+        else dt_imageio_jpeg_scale(&jpg, wd, ht);
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t)*jpg.width*jpg.height*4);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
         {
@@ -1321,7 +1574,7 @@ _init_8(
       uint8_t *tmp = 0;
       int32_t thumb_width, thumb_height;
       dt_image_orientation_t orientation;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, &orientation);
+      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, &orientation, wd, ht);
       if(!res)
       {
         // scale to fit
@@ -1338,6 +1591,7 @@ _init_8(
     _dummy_data_t dat;
     format.bpp = _bpp;
     format.write_image = _write_image;
+    format.write_image_begin = NULL;
     format.levels = _levels;
     dat.head.max_width  = wd;
     dat.head.max_height = ht;
@@ -1363,7 +1617,6 @@ _init_8(
   }
 
   // TODO: various speed optimizations:
-  // TODO: also init all smaller mips!
   // TODO: use mipf, but:
   // TODO: if output is cropped, don't use mipf!
 }
@@ -1393,19 +1646,40 @@ dt_mipmap_cache_decompress(
   const dt_mipmap_buffer_t *buf,
   uint8_t *scratchmem)
 {
-#ifdef HAVE_SQUISH
   if(darktable.mipmap_cache->compression_type && buf->width > 8 && buf->height > 8)
   {
-    squish_decompress_image(scratchmem, buf->width, buf->height, buf->buf, squish_dxt1);
+    dt_dxt1_decompress(buf->buf, buf->width, buf->height, scratchmem);
     return scratchmem;
   }
   else
-#endif
   {
     return buf->buf;
   }
 }
 
+float*
+dt_mipmap_cache_alloc_scratchmem_f(
+  const dt_mipmap_cache_t *cache)
+{
+  if(!cache->half_float) return NULL;
+  return dt_alloc_align(64, (size_t)4*sizeof(float) *
+                        cache->mip[DT_MIPMAP_F].max_width * cache->mip[DT_MIPMAP_F].max_height);
+}
+
+float*
+dt_mipmap_cache_decompress_f(
+  const dt_mipmap_buffer_t *buf,
+  float *scratchmem)
+{
+  // dead images are 8x8 floats, see above.
+  if(darktable.mipmap_cache->half_float && buf->width > 8 && buf->height > 8)
+  {
+    dt_image_half_to_float((const uint16_t *)buf->buf, scratchmem, (size_t)4*buf->width*buf->height);
+    return scratchmem;
+  }
+  return (float *)buf->buf;
+}
+
 // writes the scratchmem buffer to compressed
 // format into the mipmap cache. does nothing
 // if compression is disabled.
@@ -1414,17 +1688,18 @@ dt_mipmap_cache_compress(
   dt_mipmap_buffer_t *buf,
   uint8_t *const scratchmem)
 {
-#ifdef HAVE_SQUISH
   // only do something if compression is on, don't compress skulls:
   if(darktable.mipmap_cache->compression_type && buf->width > 8 && buf->height > 8)
   {
-    int flags = squish_dxt1;
-    // low quality:
-    if(darktable.mipmap_cache->compression_type == 1) flags |= squish_colour_range_fit;
-    squish_compress_image(scratchmem, buf->width, buf->height, buf->buf, squish_dxt1);
+#ifdef HAVE_SQUISH
+    // high quality: squish's cluster fit is still better than range fit, but an order of magnitude slower.
+    if(darktable.mipmap_cache->compression_type == 2)
+      squish_compress_image(scratchmem, buf->width, buf->height, buf->buf, squish_dxt1);
+    else
+#endif
+      dt_dxt1_compress(scratchmem, buf->width, buf->height, buf->buf);
   }
   else
-#endif
   {
     memcpy(buf->buf, scratchmem, (size_t)buf->width*buf->height*4*sizeof(uint8_t));
   }
@@ -80,6 +80,10 @@ typedef struct dt_mipmap_cache_one_t
   uint32_t max_width, max_height;
   // size of an element inside buf
   uint32_t buffer_size;
+  // memory held by the buffers of this level, counted against the common budget
+  volatile size_t bytes;
+  // running average of the time it takes to fill one buffer, in ms
+  float gen_ms;
   // 1) no memory fragmentation:
   //    - fixed slots with fixed size (could waste a few bytes for extreme
   //      aspect ratios)
@@ -99,6 +103,9 @@ typedef struct dt_mipmap_cache_one_t
   long int stats_misses;      // nothing returned at all.
   long int stats_fetches;     // texture was fetched (either as a stand-in or as per request)
   long int stats_standin;     // texture used as stand-in
+  long int stats_prefetches;  // speculatively loaded ahead of time
+  long int stats_prefetch_hits; // of those, shown later on
+  long int stats_evictions;   // dropped to make room in the common budget
 }
 dt_mipmap_cache_one_t;
 
@@ -108,8 +115,18 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip[DT_MIPMAP_NONE];
   // global setting: which compression type are we using?
   int compression_type; // 0 - none, 1 - low quality, 2 - slow
+  // store the float previews as half floats?
+  int half_float;
   // per-thread cache of uncompressed buffers, in case compression is requested.
   dt_mipmap_cache_one_t scratchmem;
+  // all levels share this much memory. when it's used up, the least recently used
+  // buffer goes which is cheapest to regenerate per byte, whatever level it's on.
+  size_t max_mem;
+  // access counter shared by the lru lists of all levels, to compare their ages.
+  uint32_t clock;
+  // bumped whenever thumbnails are removed to be regenerated, so copies made
+  // from them elsewhere know they are outdated.
+  volatile uint32_t generation;
 }
 dt_mipmap_cache_t;
 
@@ -158,6 +175,26 @@ dt_mipmap_cache_write_release(
   dt_mipmap_cache_t *cache,
   dt_mipmap_buffer_t *buf);
 
+// speculatively load the thumbnails of images which might be shown soon, most important
+// first, behind everything requested for display. the ones in cache already are skipped.
+void
+dt_mipmap_cache_prefetch(
+  dt_mipmap_cache_t *cache,
+  const int32_t *imgids,
+  const int num,
+  const dt_mipmap_size_t mip);
+
+// drop the speculative loads which didn't start yet, because they are stale.
+void
+dt_mipmap_cache_prefetch_cancel(
+  dt_mipmap_cache_t *cache);
+
+// flag a buffer as loaded by a prefetch, to count it as a hit once it's shown.
+void
+dt_mipmap_cache_prefetched(
+  dt_mipmap_cache_t *cache,
+  dt_mipmap_buffer_t *buf);
+
 // remove thumbnails, so they will be regenerated:
 void
 dt_mipmap_cache_remove(
@@ -200,6 +237,20 @@ dt_mipmap_cache_compress(
   dt_mipmap_buffer_t *buf,
   uint8_t *const scratchmem);
 
+// allocate enough memory for a float preview stored as half floats.
+// returns NULL if the cache keeps them as floats.
+float*
+dt_mipmap_cache_alloc_scratchmem_f(
+  const dt_mipmap_cache_t *cache);
+
+// the DT_MIPMAP_F buffer as floats: converted into scratchmem
+// if it is stored as half floats, otherwise the buffer itself
+// (scratchmem can be NULL then).
+float*
+dt_mipmap_cache_decompress_f(
+  const dt_mipmap_buffer_t *buf,
+  float *scratchmem);
+
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
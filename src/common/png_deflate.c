@@ -0,0 +1,252 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/png_deflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+// uncompressed bytes per independently deflated block, same as pigz' default.
+#define DT_PNG_DEFLATE_BLOCK (128*1024)
+// deflate window, the tail of the previous block which is used as preset dictionary.
+#define DT_PNG_DEFLATE_DICT  (32*1024)
+
+typedef struct dt_png_deflate_block_t
+{
+  uint8_t *data;
+  size_t size;
+  size_t in_size;
+  uLong adler;
+}
+dt_png_deflate_block_t;
+
+// sum of absolute values of the residuals, interpreted as signed bytes.
+// this is the heuristic suggested by the png spec for adaptive filtering.
+static inline uint32_t
+_sad(const uint8_t *const restrict f, const size_t n)
+{
+  uint32_t sum = 0;
+  for(size_t i=0; i<n; i++)
+  {
+    const int v = (int8_t)f[i];
+    sum += v < 0 ? -v : v;
+  }
+  return sum;
+}
+
+void
+dt_png_filter_row(const uint8_t *const restrict row, const uint8_t *const restrict prev, uint8_t *const restrict out,
+                  uint8_t *const restrict scratch, const size_t rowbytes, const int bytes_per_pixel)
+{
+  const size_t bpp = bytes_per_pixel;
+  uint8_t *const restrict sub   = scratch;
+  uint8_t *const restrict up    = scratch +   rowbytes;
+  uint8_t *const restrict avg   = scratch + 2*rowbytes;
+  uint8_t *const restrict paeth = scratch + 3*rowbytes;
+
+  // all of the loops are branch free so the compiler can vectorise them.
+  for(size_t i=0; i<rowbytes; i++) up[i] = row[i] - prev[i];
+  for(size_t i=0; i<bpp; i++)
+  {
+    sub[i]   = row[i];
+    avg[i]   = row[i] - (prev[i] >> 1);
+    paeth[i] = row[i] - prev[i];
+  }
+  for(size_t i=bpp; i<rowbytes; i++)
+  {
+    const int a = row[i-bpp], b = prev[i], c = prev[i-bpp];
+    sub[i] = row[i] - a;
+    avg[i] = row[i] - ((a + b) >> 1);
+    const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2*c);
+    const int pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+    paeth[i] = row[i] - pred;
+  }
+
+  const uint8_t *const cand[5] = { row, sub, up, avg, paeth };
+  int best = 0;
+  uint32_t best_sum = _sad(row, rowbytes);
+  for(int k=1; k<5; k++)
+  {
+    const uint32_t sum = _sad(cand[k], rowbytes);
+    if(sum < best_sum)
+    {
+      best_sum = sum;
+      best = k;
+    }
+  }
+  out[0] = best;
+  memcpy(out + 1, cand[best], rowbytes);
+}
+
+static int
+_deflate_block(const uint8_t *const filtered, const size_t begin, const size_t end, const int last,
+               const int level, dt_png_deflate_block_t *block)
+{
+  z_stream s;
+  memset(&s, 0, sizeof(s));
+  // raw deflate, the zlib header and checksum are written once for the whole stream.
+  if(deflateInit2(&s, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 1;
+
+  if(begin > 0)
+  {
+    const size_t dict = begin > DT_PNG_DEFLATE_DICT ? DT_PNG_DEFLATE_DICT : begin;
+    if(deflateSetDictionary(&s, filtered + begin - dict, dict) != Z_OK)
+    {
+      deflateEnd(&s);
+      return 1;
+    }
+  }
+
+  block->in_size = end - begin;
+  // leave some room for the sync flush marker.
+  const size_t capacity = deflateBound(&s, block->in_size) + 16;
+  block->data = (uint8_t *)malloc(capacity);
+  if(!block->data)
+  {
+    deflateEnd(&s);
+    return 1;
+  }
+
+  s.next_in   = (Bytef *)(filtered + begin);
+  s.avail_in  = block->in_size;
+  s.next_out  = block->data;
+  s.avail_out = capacity;
+
+  // all blocks but the last end on a byte boundary with an empty stored block,
+  // so they can simply be concatenated.
+  const int ret = deflate(&s, last ? Z_FINISH : Z_SYNC_FLUSH);
+  const int ok = last ? (ret == Z_STREAM_END) : (ret == Z_OK && s.avail_in == 0 && s.avail_out > 0);
+  block->size = capacity - s.avail_out;
+  deflateEnd(&s);
+  if(!ok) return 1;
+
+  block->adler = adler32(adler32(0L, Z_NULL, 0), filtered + begin, block->in_size);
+  return 0;
+}
+
+int
+dt_png_deflate(const uint8_t *rows, const int width, const int height, const int bytes_per_pixel,
+               const int level, uint8_t **out, size_t *out_len)
+{
+  *out = NULL;
+  *out_len = 0;
+  if(width <= 0 || height <= 0) return 1;
+
+  const size_t rowbytes = (size_t)width * bytes_per_pixel;
+  const size_t linebytes = rowbytes + 1;
+  const size_t total = linebytes * height;
+
+#ifdef _OPENMP
+  const int nthreads = omp_get_max_threads();
+#else
+  const int nthreads = 1;
+#endif
+
+  uint8_t *filtered = (uint8_t *)malloc(total);
+  uint8_t *zero = (uint8_t *)calloc(rowbytes, 1);
+  uint8_t *scratch = (uint8_t *)malloc(4 * rowbytes * nthreads);
+  if(!filtered || !zero || !scratch)
+  {
+    free(filtered);
+    free(zero);
+    free(scratch);
+    return 1;
+  }
+
+  // filtering only depends on the unfiltered input, so rows are independent.
+#ifdef _OPENMP
+  #pragma omp parallel for shared(rows, filtered, zero, scratch) schedule(static)
+#endif
+  for(int y=0; y<height; y++)
+  {
+#ifdef _OPENMP
+    uint8_t *tmp = scratch + 4 * rowbytes * omp_get_thread_num();
+#else
+    uint8_t *tmp = scratch;
+#endif
+    dt_png_filter_row(rows + rowbytes * y, y ? rows + rowbytes * (y-1) : zero,
+                      filtered + linebytes * y, tmp, rowbytes, bytes_per_pixel);
+  }
+  free(scratch);
+  free(zero);
+
+  // cut at row boundaries, that's not needed by deflate but keeps the blocks tidy.
+  const int rows_per_block = linebytes >= DT_PNG_DEFLATE_BLOCK ? 1 : DT_PNG_DEFLATE_BLOCK / linebytes;
+  const int nblocks = (height + rows_per_block - 1) / rows_per_block;
+  dt_png_deflate_block_t *blocks = (dt_png_deflate_block_t *)calloc(nblocks, sizeof(dt_png_deflate_block_t));
+  if(!blocks)
+  {
+    free(filtered);
+    return 1;
+  }
+
+  int err = 0;
+#ifdef _OPENMP
+  #pragma omp parallel for shared(filtered, blocks) schedule(dynamic, 1) reduction(|:err)
+#endif
+  for(int b=0; b<nblocks; b++)
+  {
+    const size_t begin = linebytes * rows_per_block * b;
+    const size_t end = b == nblocks-1 ? total : linebytes * rows_per_block * (b+1);
+    err |= _deflate_block(filtered, begin, end, b == nblocks-1, level, blocks + b);
+  }
+  free(filtered);
+
+  size_t size = 2 + 4;
+  for(int b=0; b<nblocks; b++) size += blocks[b].size;
+  uint8_t *buf = err ? NULL : (uint8_t *)malloc(size);
+
+  if(buf)
+  {
+    // zlib header: deflate with 32k window, compression level hint and check bits.
+    const int lvl = level < 0 ? 6 : level;
+    const int flevel = lvl < 2 ? 0 : (lvl < 6 ? 1 : (lvl == 6 ? 2 : 3));
+    const int cmf = 0x78;
+    int flg = flevel << 6;
+    flg += (31 - ((cmf << 8) + flg) % 31) % 31;
+    buf[0] = cmf;
+    buf[1] = flg;
+
+    size_t pos = 2;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for(int b=0; b<nblocks; b++)
+    {
+      memcpy(buf + pos, blocks[b].data, blocks[b].size);
+      pos += blocks[b].size;
+      adler = adler32_combine(adler, blocks[b].adler, blocks[b].in_size);
+    }
+    buf[pos++] = adler >> 24;
+    buf[pos++] = adler >> 16;
+    buf[pos++] = adler >> 8;
+    buf[pos++] = adler;
+
+    *out = buf;
+    *out_len = pos;
+  }
+
+  for(int b=0; b<nblocks; b++) free(blocks[b].data);
+  free(blocks);
+  return buf ? 0 : 1;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
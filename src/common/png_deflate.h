@@ -0,0 +1,48 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_PNG_DEFLATE_H
+#define DT_PNG_DEFLATE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/** rows below this count are not worth splitting, use libpng's own zlib stream. */
+#define DT_PNG_DEFLATE_MIN_ROWS 256
+
+/**
+ * filter and compress the given scanlines into one zlib stream, ready to be
+ * cut into IDAT chunks. rows are packed, already in png byte order (big endian
+ * for 16-bit), bytes_per_pixel is used for the sub/avg/paeth predictors.
+ *
+ * the image is split into independent row blocks which are compressed
+ * concurrently, each primed with the last 32k of its predecessor as preset
+ * dictionary, and stitched together with sync flushes (the way pigz does it).
+ *
+ * on success returns 0 and a malloc'ed buffer in *out, which the caller has to free().
+ */
+int dt_png_deflate(const uint8_t *rows, const int width, const int height, const int bytes_per_pixel,
+                   const int level, uint8_t **out, size_t *out_len);
+
+/** pick the png filter for one row (adaptive, minimum sum of absolute differences) and write it to out[0..rowbytes]. */
+void dt_png_filter_row(const uint8_t *row, const uint8_t *prev, uint8_t *out, uint8_t *scratch,
+                       const size_t rowbytes, const int bytes_per_pixel);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -24,7 +24,7 @@
 #include "gui/gtk.h"
 
 
-void dt_ratings_apply_to_image (int imgid, int rating)
+static void _ratings_apply_to_image(int imgid, int rating)
 {
   const dt_image_t *cimg = dt_image_cache_read_get(darktable.image_cache, imgid);
   dt_image_t *image = dt_image_cache_write_get(darktable.image_cache, cimg);
@@ -35,6 +35,13 @@ void dt_ratings_apply_to_image (int imgid, int rating)
   dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
   dt_image_cache_read_release(darktable.image_cache, image);
 
+  // it might have dropped out of the filtered collection
+  dt_collection_image_changed(darktable.collection, imgid);
+}
+
+void dt_ratings_apply_to_image (int imgid, int rating)
+{
+  _ratings_apply_to_image(imgid, rating);
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -61,9 +68,10 @@ void dt_ratings_apply_to_selection (int rating)
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select imgid from selected_images", -1, &stmt, NULL);
     while(sqlite3_step(stmt) == SQLITE_ROW)
     {
-      dt_ratings_apply_to_image(sqlite3_column_int(stmt, 0), rating);
+      _ratings_apply_to_image(sqlite3_column_int(stmt, 0), rating);
     }
     sqlite3_finalize(stmt);
+    dt_collection_hint_message(darktable.collection);
 
     /* redraw view */
     /* dt_control_queue_redraw_center() */
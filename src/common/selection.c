@@ -19,8 +19,23 @@
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/collection.h"
+#include "common/bitmap.h"
 #include "control/signal.h"
 
+#include <sqlite3.h>
+
+/* the selected image ids. this is what every connection sees as selected_images (a virtual table
+   in the temp schema, which shadows the table in the db file), the table itself is only brought up to
+   date now and then by the writer, so it's still there when darktable starts next time. */
+static struct
+{
+  dt_pthread_mutex_t mutex;
+  dt_bitmap_t ids;
+  dt_bitmap_t persisted;  // what main.selected_images holds, as far as we know
+  int persist_queued;
+}
+_selection_index;
+
 typedef struct dt_selection_t
 {
   /* the collection clone used for selection */
@@ -35,6 +50,299 @@ dt_selection_t;
 /* updates the internal collection of an selection */
 static void _selection_update_collection(gpointer instance, gpointer user_data);
 
+/* writes the difference between what was persisted last time and the current selection to main.selected_images. */
+static void _selection_persist_job(sqlite3 *handle, void *data)
+{
+  dt_bitmap_t added, removed;
+  dt_bitmap_init(&added);
+  dt_bitmap_init(&removed);
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  _selection_index.persist_queued = 0;
+  dt_bitmap_copy(&added, &_selection_index.ids);
+  dt_bitmap_andnot(&added, &_selection_index.persisted);
+  dt_bitmap_copy(&removed, &_selection_index.persisted);
+  dt_bitmap_andnot(&removed, &_selection_index.ids);
+  const int empty = dt_bitmap_count(&_selection_index.ids) == 0;
+  dt_bitmap_copy(&_selection_index.persisted, &_selection_index.ids);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+
+  uint32_t id = 0;
+  if(empty && dt_bitmap_count(&removed))
+    DT_DEBUG_SQLITE3_EXEC(handle, "DELETE FROM main.selected_images", NULL, NULL, NULL);
+  else if(dt_bitmap_count(&removed))
+  {
+    sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "DELETE FROM main.selected_images WHERE imgid = ?1");
+    for(id = 0; dt_bitmap_next(&removed, id, &id); id++)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+    dt_database_release_statement(darktable.db, stmt);
+  }
+  if(dt_bitmap_count(&added))
+  {
+    sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "INSERT OR IGNORE INTO main.selected_images (imgid) VALUES (?1)");
+    for(id = 0; dt_bitmap_next(&added, id, &id); id++)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+    dt_database_release_statement(darktable.db, stmt);
+  }
+  dt_bitmap_cleanup(&added);
+  dt_bitmap_cleanup(&removed);
+}
+
+void dt_selection_index_persist()
+{
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  const int queue = !_selection_index.persist_queued;
+  _selection_index.persist_queued = 1;
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+  if(queue) dt_database_write(darktable.db, _selection_persist_job, NULL, NULL);
+}
+
+/* to be called after every change of the selection from here */
+static void _selection_changed()
+{
+  dt_selection_index_persist();
+
+  /* update hint message */
+  dt_collection_hint_message(darktable.collection);
+}
+
+gboolean dt_selection_is_selected(const int32_t imgid)
+{
+  if(imgid <= 0) return FALSE;
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  const int selected = dt_bitmap_contains(&_selection_index.ids, imgid);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+  return selected;
+}
+
+uint32_t dt_selection_get_count()
+{
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  const uint32_t count = dt_bitmap_count(&_selection_index.ids);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+  return count;
+}
+
+/* the virtual table module behind temp.selected_images. rowid and imgid are the same, lookups by either
+   are answered from the bitmap, scans run in ascending id order. */
+
+typedef struct _selection_cursor_t
+{
+  sqlite3_vtab_cursor base;
+  uint32_t id;
+  int eof, single;
+}
+_selection_cursor_t;
+
+static int _selection_vtab_connect(sqlite3 *db, void *aux, int argc, const char *const *argv,
+                                   sqlite3_vtab **vtab, char **err)
+{
+  const int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(imgid INTEGER PRIMARY KEY)");
+  if(rc != SQLITE_OK) return rc;
+  *vtab = (sqlite3_vtab *)sqlite3_malloc(sizeof(sqlite3_vtab));
+  if(!*vtab) return SQLITE_NOMEM;
+  memset(*vtab, 0, sizeof(sqlite3_vtab));
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_disconnect(sqlite3_vtab *vtab)
+{
+  sqlite3_free(vtab);
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+  info->idxNum = 0;
+  info->estimatedCost = 1 + dt_selection_get_count();
+  for(int k = 0; k < info->nConstraint; k++)
+  {
+    const struct sqlite3_index_constraint *c = info->aConstraint + k;
+    if(c->usable && c->op == SQLITE_INDEX_CONSTRAINT_EQ && (c->iColumn == 0 || c->iColumn == -1))
+    {
+      info->idxNum = 1;
+      info->aConstraintUsage[k].argvIndex = 1;
+      info->aConstraintUsage[k].omit = 1;
+      info->estimatedCost = 1;
+      break;
+    }
+  }
+  if(info->nOrderBy == 1 && (info->aOrderBy[0].iColumn == 0 || info->aOrderBy[0].iColumn == -1)
+     && !info->aOrderBy[0].desc)
+    info->orderByConsumed = 1;
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor)
+{
+  _selection_cursor_t *c = (_selection_cursor_t *)sqlite3_malloc(sizeof(_selection_cursor_t));
+  if(!c) return SQLITE_NOMEM;
+  memset(c, 0, sizeof(_selection_cursor_t));
+  *cursor = &c->base;
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_close(sqlite3_vtab_cursor *cursor)
+{
+  sqlite3_free(cursor);
+  return SQLITE_OK;
+}
+
+/* the cursor only remembers where it is, so rows can come and go while it walks */
+static void _selection_vtab_seek(_selection_cursor_t *c, const uint32_t from)
+{
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  c->eof = !dt_bitmap_next(&_selection_index.ids, from, &c->id);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+}
+
+static int _selection_vtab_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str,
+                                  int argc, sqlite3_value **argv)
+{
+  _selection_cursor_t *c = (_selection_cursor_t *)cursor;
+  c->single = idx_num == 1;
+  if(c->single)
+  {
+    const sqlite3_int64 id = sqlite3_value_int64(argv[0]);
+    c->id = id;
+    c->eof = sqlite3_value_type(argv[0]) != SQLITE_INTEGER || id <= 0 || id > UINT32_MAX
+             || !dt_selection_is_selected(id);
+  }
+  else
+    _selection_vtab_seek(c, 0);
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_next(sqlite3_vtab_cursor *cursor)
+{
+  _selection_cursor_t *c = (_selection_cursor_t *)cursor;
+  if(c->single || c->id == UINT32_MAX) c->eof = 1;
+  else _selection_vtab_seek(c, c->id + 1);
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_eof(sqlite3_vtab_cursor *cursor)
+{
+  return ((_selection_cursor_t *)cursor)->eof;
+}
+
+static int _selection_vtab_column(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+  sqlite3_result_int64(context, ((_selection_cursor_t *)cursor)->id);
+  return SQLITE_OK;
+}
+
+static int _selection_vtab_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid)
+{
+  *rowid = ((_selection_cursor_t *)cursor)->id;
+  return SQLITE_OK;
+}
+
+/* insert, delete and update by whatever sql the rest of darktable runs on selected_images. inserting
+   an id twice is fine, as it was with "insert or ignore". these changes aren't undone by a rollback. */
+static int _selection_vtab_update(sqlite3_vtab *vtab, int argc, sqlite3_value **argv, sqlite3_int64 *rowid)
+{
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  if(sqlite3_value_type(argv[0]) != SQLITE_NULL)
+    dt_bitmap_remove(&_selection_index.ids, sqlite3_value_int64(argv[0]));
+  if(argc > 1)
+  {
+    // the new imgid, or the new rowid if only that was given
+    sqlite3_value *value = sqlite3_value_type(argv[2]) != SQLITE_NULL ? argv[2] : argv[1];
+    const sqlite3_int64 id = sqlite3_value_int64(value);
+    if(id > 0 && id <= UINT32_MAX) dt_bitmap_add(&_selection_index.ids, id);
+    *rowid = id;
+  }
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+  return SQLITE_OK;
+}
+
+static sqlite3_module _selection_module =
+{
+  0,                           // iVersion
+  _selection_vtab_connect,     // xCreate
+  _selection_vtab_connect,     // xConnect
+  _selection_vtab_best_index,  // xBestIndex
+  _selection_vtab_disconnect,  // xDisconnect
+  _selection_vtab_disconnect,  // xDestroy
+  _selection_vtab_open,        // xOpen
+  _selection_vtab_close,       // xClose
+  _selection_vtab_filter,      // xFilter
+  _selection_vtab_next,        // xNext
+  _selection_vtab_eof,         // xEof
+  _selection_vtab_column,      // xColumn
+  _selection_vtab_rowid,       // xRowid
+  _selection_vtab_update,      // xUpdate
+  NULL,                        // xBegin
+  NULL,                        // xSync
+  NULL,                        // xCommit
+  NULL,                        // xRollback
+  NULL,                        // xFindFunction
+  NULL                         // xRename
+};
+
+void dt_selection_index_attach(sqlite3 *handle)
+{
+  sqlite3_create_module(handle, "dt_selection", &_selection_module, NULL);
+  DT_DEBUG_SQLITE3_EXEC(handle, "CREATE VIRTUAL TABLE temp.selected_images USING dt_selection", NULL, NULL, NULL);
+}
+
+void dt_selection_index_load(sqlite3 *handle)
+{
+  sqlite3_stmt *stmt;
+  dt_bitmap_t ids;
+  dt_bitmap_init(&ids);
+  DT_DEBUG_SQLITE3_PREPARE_V2(handle, "SELECT imgid FROM main.selected_images", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int id = sqlite3_column_int(stmt, 0);
+    if(id > 0) dt_bitmap_add(&ids, id);
+  }
+  sqlite3_finalize(stmt);
+
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  dt_bitmap_copy(&_selection_index.persisted, &ids);
+  dt_bitmap_swap(&_selection_index.ids, &ids);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+  dt_bitmap_cleanup(&ids);
+}
+
+void dt_selection_index_init()
+{
+  memset(&_selection_index, 0, sizeof(_selection_index));
+  dt_pthread_mutex_init(&_selection_index.mutex, NULL);
+}
+
+void dt_selection_index_cleanup()
+{
+  dt_bitmap_cleanup(&_selection_index.ids);
+  dt_bitmap_cleanup(&_selection_index.persisted);
+  dt_pthread_mutex_destroy(&_selection_index.mutex);
+}
+
+/* replaces the selection by the ids of collection, or by the ones in there which aren't selected yet. */
+static void _selection_set_collection(const dt_collection_t *collection, const int invert)
+{
+  uint32_t num = 0;
+  const int32_t *ids = dt_collection_get_ids(collection, &num);
+  dt_bitmap_t set;
+  dt_bitmap_init(&set);
+  dt_bitmap_add_array(&set, (const uint32_t *)ids, num);
+
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  if(invert) dt_bitmap_andnot(&set, &_selection_index.ids);
+  dt_bitmap_swap(&_selection_index.ids, &set);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
+  dt_bitmap_cleanup(&set);
+}
+
 void _selection_update_collection(gpointer instance, gpointer user_data)
 {
   dt_selection_t *selection = (dt_selection_t *)user_data;
@@ -79,198 +387,110 @@ void dt_selection_free (dt_selection_t *selection)
 
 void dt_selection_invert(dt_selection_t *selection)
 {
-  gchar *fullq = NULL;
-
   if (!selection->collection)
     return;
 
-  fullq = dt_util_dstrcat(fullq, "%s", "insert or ignore into selected_images ");
-  fullq = dt_util_dstrcat(fullq, "%s", dt_collection_get_query(selection->collection));
-
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "insert into memory.tmp_selection select imgid from selected_images",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from selected_images",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), fullq,
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from selected_images where imgid in (select imgid from memory.tmp_selection)",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from memory.tmp_selection",
-                        NULL, NULL, NULL);
-
-  g_free(fullq);
+  /* everything in the collection which isn't selected now */
+  _selection_set_collection(selection->collection, 1);
 
-  /* update hint message */
-  dt_collection_hint_message(darktable.collection);
+  _selection_changed();
 }
 
 void dt_selection_clear(const dt_selection_t *selection)
 {
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from selected_images", NULL, NULL, NULL);
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  dt_bitmap_clear(&_selection_index.ids);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
 
-  /* update hint message */
-  dt_collection_hint_message(darktable.collection);
+  _selection_changed();
 }
 
 void dt_selection_select_single(dt_selection_t *selection, uint32_t imgid)
 {
-  gchar *query = NULL;
   selection->last_single_id = imgid;
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from selected_images", NULL, NULL, NULL);
 
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  dt_bitmap_clear(&_selection_index.ids);
   if (imgid != -1)
-  {
-    query = dt_util_dstrcat(query,"insert or ignore into selected_images values(%d)", imgid);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query, NULL, NULL, NULL);
-    g_free(query);
-  }
+    dt_bitmap_add(&_selection_index.ids, imgid);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
 
-  /* update hint message */
-  dt_collection_hint_message(darktable.collection);
+  _selection_changed();
 }
 
 void dt_selection_toggle(dt_selection_t *selection, uint32_t imgid)
 {
-  gchar *query = NULL;
-  sqlite3_stmt *stmt;
-  gboolean exists = FALSE;
-
   if (imgid == -1) return;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select imgid from selected_images where imgid=?1",-1,&stmt,NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-    exists = TRUE;
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  const int exists = dt_bitmap_remove(&_selection_index.ids, imgid);
+  if (!exists)
+    dt_bitmap_add(&_selection_index.ids, imgid);
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
 
-  sqlite3_finalize(stmt);
+  selection->last_single_id = exists ? -1 : imgid;
 
-  if (exists)
-  {
-    selection->last_single_id = -1;
-    query = dt_util_dstrcat(query,"delete from selected_images where imgid = %d", imgid);
-  }
-  else
-  {
-    selection->last_single_id = imgid;
-    query = dt_util_dstrcat(query,"insert or ignore into selected_images values(%d)", imgid);
-  }
-
-  sqlite3_exec(dt_database_get(darktable.db), query, NULL, NULL, NULL);
-
-  g_free(query);
-
-  /* update hint message */
-  dt_collection_hint_message(darktable.collection);
+  _selection_changed();
 }
 
 void dt_selection_select_all(dt_selection_t *selection)
 {
-  gchar *fullq = NULL;
-
   if (!selection->collection)
     return;
 
-  fullq = dt_util_dstrcat(fullq, "%s", "insert or ignore into selected_images ");
-  fullq = dt_util_dstrcat(fullq, "%s", dt_collection_get_query(selection->collection));
-
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from selected_images", NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), fullq, NULL, NULL, NULL);
+  _selection_set_collection(selection->collection, 0);
 
   selection->last_single_id = -1;
 
-  g_free(fullq);
-
-  /* update hint message */
-  dt_collection_hint_message(darktable.collection);
+  _selection_changed();
 }
 
 void dt_selection_select_range(dt_selection_t *selection, uint32_t imgid)
 {
-  gchar *fullq = NULL;
-  sqlite3_stmt *stmt;
   if (!selection->collection || selection->last_single_id == -1)
     return;
 
   /* get start and end rows for range selection */
-  int rc=0;
+  uint32_t num = 0;
+  const int32_t *ids = dt_collection_get_ids(selection->collection, &num);
   uint32_t sr=-1,er=-1;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              dt_collection_get_query(selection->collection), -1, &stmt, NULL);
-
-  while(sqlite3_step(stmt)==SQLITE_ROW)
+  for(uint32_t rc=0; rc<num && (sr == -1 || er == -1); rc++)
   {
-    int id = sqlite3_column_int(stmt, 0);
-    if (id == selection->last_single_id)
+    if (ids[rc] == selection->last_single_id)
       sr = rc;
 
-    if (id == imgid)
+    if (ids[rc] == imgid)
       er = rc;
-
-    if (sr != -1 && er != -1 )
-      break;
-
-    rc++;
   }
 
-  sqlite3_finalize(stmt);
-
   /* select the images in range from start to end */
-  uint32_t old_flags = dt_collection_get_query_flags(selection->collection);
-
-  /* use the limit to select range of images */
-  dt_collection_set_query_flags(selection->collection,
-                                (old_flags |COLLECTION_QUERY_USE_LIMIT));
-
-  dt_collection_update(selection->collection);
-
-  fullq = dt_util_dstrcat(fullq, "%s", "insert or ignore into selected_images ");
-  fullq = dt_util_dstrcat(fullq, "%s", dt_collection_get_query(selection->collection));
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              fullq, -1, &stmt, NULL);
-
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, MIN(sr,er));
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, (MAX(sr,er)-MIN(sr,er))+1);
-
-  sqlite3_step(stmt);
+  if (sr != -1 && er != -1)
+  {
+    dt_pthread_mutex_lock(&_selection_index.mutex);
+    dt_bitmap_add_array(&_selection_index.ids, (const uint32_t *)ids + MIN(sr,er), (MAX(sr,er)-MIN(sr,er))+1);
+    dt_pthread_mutex_unlock(&_selection_index.mutex);
+  }
 
-  /* reset filter */
-  dt_collection_set_query_flags(selection->collection,
-                                old_flags);
-  dt_collection_update(selection->collection);
   selection->last_single_id = -1;
+
+  dt_selection_index_persist();
 }
 
 void dt_selection_select_filmroll(dt_selection_t *selection)
 {
-  // clear at start, too, just to be sure:
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from memory.tmp_selection", NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "insert into memory.tmp_selection select imgid from selected_images",
-                        NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from selected_images", NULL, NULL, NULL);
+  /* the subquery is done before the first row goes in */
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "insert or ignore into selected_images select id from images where film_id in "
-                        "(select film_id from images as a join memory.tmp_selection as "
+                        "(select film_id from images as a join selected_images as "
                         "b on a.id = b.imgid)",
                         NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from memory.tmp_selection", NULL, NULL, NULL);
   selection->last_single_id = -1;
+
+  dt_selection_index_persist();
 }
 
 void dt_selection_select_unaltered(dt_selection_t *selection)
 {
-  char *fullq = NULL;
-
   if (!selection->collection)
     return;
 
@@ -281,54 +501,33 @@ void dt_selection_select_unaltered(dt_selection_t *selection)
                                    COLLECTION_FILTER_UNALTERED));
   dt_collection_update(selection->collection);
 
-
-  fullq = dt_util_dstrcat(fullq, "%s", "insert or ignore into selected_images ");
-  fullq = dt_util_dstrcat(fullq, "%s", dt_collection_get_query(selection->collection));
-
-
   /* clean current selection and select unaltered images */
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        "delete from selected_images", NULL, NULL, NULL);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
-                        fullq, NULL, NULL, NULL);
+  _selection_set_collection(selection->collection, 0);
 
   /* restore collection filter and update query */
   dt_collection_set_filter_flags(selection->collection, old_filter_flags);
   dt_collection_update(selection->collection);
 
-  g_free(fullq);
-
   selection->last_single_id = -1;
+
+  dt_selection_index_persist();
 }
 
 
 void dt_selection_select_list(struct dt_selection_t *selection, GList * list)
 {
   if(!list) return;
-  while(list) {
-    int count = 1;
-    gchar *query = NULL;
 
+  dt_pthread_mutex_lock(&_selection_index.mutex);
+  for(; list; list = g_list_next(list))
+  {
     int imgid = GPOINTER_TO_INT(list->data);
     selection->last_single_id = imgid;
-    query = dt_util_dstrcat(query,"insert or ignore into selected_images values (%d)",imgid);
-    list = g_list_next(list);
-    while(list && count < 400) {
-      int imgid = GPOINTER_TO_INT(list->data);
-      count++;
-      selection->last_single_id = imgid;
-      query = dt_util_dstrcat(query,",(%d)",imgid);
-      list = g_list_next(list);
-    }
-    char * result = NULL;
-
-    sqlite3_exec(dt_database_get(darktable.db), query, NULL, NULL, &result);
-
-    g_free(query);
+    if(imgid > 0) dt_bitmap_add(&_selection_index.ids, imgid);
   }
+  dt_pthread_mutex_unlock(&_selection_index.mutex);
 
-    /* update hint message */
-    dt_collection_hint_message(darktable.collection);
+  _selection_changed();
 }
 
 
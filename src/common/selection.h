@@ -44,6 +44,23 @@ void dt_selection_select_filmroll(struct dt_selection_t *selection);
 void dt_selection_select_unaltered(struct dt_selection_t *selection);
 /** selects a set of images from a list. the list is unaltered */
 void dt_selection_select_list(struct dt_selection_t *selection, GList * list);
+
+/** is imgid selected. a bit test, no query */
+gboolean dt_selection_is_selected(const int32_t imgid);
+/** the number of selected images, no query either */
+uint32_t dt_selection_get_count();
+
+/** the selection lives in memory, shared by all connections through a virtual table which shadows
+ *  the selected_images table in the db file. setup and teardown, around dt_database_init/destroy. */
+void dt_selection_index_init();
+void dt_selection_index_cleanup();
+struct sqlite3;
+/** create temp.selected_images on a connection. */
+void dt_selection_index_attach(struct sqlite3 *handle);
+/** read the selection of the last session from main.selected_images. */
+void dt_selection_index_load(struct sqlite3 *handle);
+/** queue writing the changes since last time to main.selected_images, for the next session. */
+void dt_selection_index_persist();
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -76,16 +76,8 @@ gboolean dt_tag_new_from_gui(const char *name,guint *tagid)
 
 guint dt_tag_remove(const guint tagid, gboolean final)
 {
-  int rv, count=-1;
   sqlite3_stmt *stmt;
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT count() FROM tagged_images WHERE tagid=?1", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
-  rv = sqlite3_step(stmt);
-  if( rv == SQLITE_ROW)
-    count = sqlite3_column_int(stmt,0);
-  sqlite3_finalize(stmt);
+  const int count = dt_tag_count_images(tagid);
 
   if (final == TRUE )
   {
@@ -273,21 +265,19 @@ uint32_t dt_tag_get_attached(gint imgid,GList **result)
   sqlite3_stmt *stmt;
   if(imgid > 0)
   {
-    char query[1024];
-    snprintf(query, sizeof(query),
-             "SELECT DISTINCT T.id, T.name FROM tagged_images "
-             "JOIN tags T on T.id = tagged_images.tagid "
-             "WHERE tagged_images.imgid = %d", imgid);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1,
-                                &stmt, NULL);
+    stmt = dt_database_get_statement(darktable.db,
+                                     "SELECT DISTINCT T.id, T.name FROM tagged_images "
+                                     "JOIN tags T on T.id = tagged_images.tagid "
+                                     "WHERE tagged_images.imgid = ?1");
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   }
   else
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT DISTINCT T.id, T.name "
-                                "FROM tagged_images,tags as T "
-                                "WHERE tagged_images.imgid in (select imgid from selected_images)"
-                                "  AND T.id = tagged_images.tagid", -1, &stmt, NULL);
+    stmt = dt_database_get_statement(darktable.db,
+                                     "SELECT DISTINCT T.id, T.name "
+                                     "FROM tagged_images,tags as T "
+                                     "WHERE tagged_images.imgid in (select imgid from selected_images)"
+                                     "  AND T.id = tagged_images.tagid");
   }
 
   // Create result
@@ -300,7 +290,7 @@ uint32_t dt_tag_get_attached(gint imgid,GList **result)
     *result=g_list_append(*result,t);
     count++;
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   return count;
 }
 
@@ -400,7 +390,7 @@ gchar *dt_tag_get_hierarchical(gint imgid, const gchar *separator)
  * do a large number of operations and thus makes the user experience
  * snappy.
  *
- * SELECT T.id FROM tags T WHERE T.name LIKE '?1';  --> into temp table
+ * dt_tag_get_matching('%keyword%');  --> into temp table
  * SELECT TXT.id2 FROM tagxtag TXT WHERE TXT.id1 IN (temp table)
  *   AND TXT.count > 0 ORDER BY TXT.count DESC;
  * SELECT TXT.id1 FROM tagxtag TXT WHERE TXT.id2 IN (temp table)
@@ -412,7 +402,6 @@ gchar *dt_tag_get_hierarchical(gint imgid, const gchar *separator)
 uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
 {
   sqlite3_stmt *stmt;
-  char query[1024];
   /*
    * Earlier versions of this function used a large collation of selects
    * and joins, resulting in multi-*second* timings for sqlite3_exec().
@@ -427,13 +416,21 @@ uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
   if (keyword == 0)
     return 0;
 
-  /* SELECT T.id FROM tags T WHERE T.name LIKE '%%%s%%';  --> into temp table */
-  memset(query, 0, sizeof(query));
-  snprintf(query, sizeof(query),
-           "INSERT INTO memory.tagq (id) SELECT id FROM tags T WHERE "
-           "T.name LIKE '%%%s%%' ", keyword);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query,
-                        NULL, NULL, NULL);
+  /* the tags containing the keyword come from the tag index --> into temp table */
+  gchar *pattern = g_strdup_printf("%%%s%%", keyword);
+  GList *matching = NULL;
+  dt_tag_get_matching(pattern, &matching);
+  g_free(pattern);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO memory.tagq (id) VALUES (?1)", -1, &stmt, NULL);
+  for(GList *m = matching; m; m = g_list_next(m))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, ((dt_tag_t *)m->data)->id);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+  dt_tag_free_result(&matching);
 
   /*
    * SELECT TXT.id2 FROM tagxtag TXT WHERE TXT.id1 IN (temp table)
@@ -507,6 +504,414 @@ uint32_t dt_tag_get_recent_used(GList **result)
 {
   return 0;
 }
+
+/*
+ * the tag index: every tag with its ascii lower case name (that's what LIKE compares) and the sorted
+ * ids of the images it is attached to. patterns with a literal prefix are answered with a binary search
+ * on the names ordered in that way, everything else scans the names, which is still only microseconds
+ * for tens of thousands of tags.
+ *
+ * sqlite calls dt_tag_index_sql_update() from within sqlite3_step() while holding the connection's mutex,
+ * so the index mutex must never be held while calling into sqlite.
+ */
+typedef struct dt_tag_index_entry_t
+{
+  guint id;
+  gchar *name;
+  gchar *lower;
+  int32_t *images;
+  uint32_t num_images, alloc_images;
+}
+dt_tag_index_entry_t;
+
+typedef struct dt_tag_index_update_t
+{
+  dt_tag_index_op_t op;
+  guint tagid;
+  int32_t imgid;
+  gchar *name;
+}
+dt_tag_index_update_t;
+
+typedef struct dt_tag_index_t
+{
+  dt_pthread_mutex_t mutex;
+  gboolean valid;
+  // updates coming in while the index is read from the db, replayed on top of it afterwards.
+  gboolean loading;
+  GList *log;
+  GHashTable *tags;   // id -> dt_tag_index_entry_t
+  GPtrArray *sorted;  // the entries ordered by lower case name
+  gboolean sorted_valid;
+}
+dt_tag_index_t;
+
+static dt_tag_index_t _tag_index;
+
+static void _tag_index_entry_free(gpointer data)
+{
+  dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)data;
+  g_free(e->name);
+  g_free(e->lower);
+  g_free(e->images);
+  g_free(e);
+}
+
+static void _tag_index_update_free(gpointer data)
+{
+  g_free(((dt_tag_index_update_t *)data)->name);
+  g_free(data);
+}
+
+// first position in the sorted image ids that isn't smaller than imgid
+static uint32_t _tag_index_image_pos(const dt_tag_index_entry_t *e, const int32_t imgid)
+{
+  uint32_t lo = 0, hi = e->num_images;
+  while(lo < hi)
+  {
+    const uint32_t mid = (lo + hi) / 2;
+    if(e->images[mid] < imgid) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static void _tag_index_attach(dt_tag_index_entry_t *e, const int32_t imgid)
+{
+  const uint32_t pos = _tag_index_image_pos(e, imgid);
+  if(pos < e->num_images && e->images[pos] == imgid) return;
+  if(e->num_images == e->alloc_images)
+  {
+    e->alloc_images = MAX(8, 2 * e->alloc_images);
+    e->images = (int32_t *)g_realloc(e->images, sizeof(int32_t) * e->alloc_images);
+  }
+  memmove(e->images + pos + 1, e->images + pos, sizeof(int32_t) * (e->num_images - pos));
+  e->images[pos] = imgid;
+  e->num_images++;
+}
+
+static void _tag_index_detach(dt_tag_index_entry_t *e, const int32_t imgid)
+{
+  const uint32_t pos = _tag_index_image_pos(e, imgid);
+  if(pos >= e->num_images || e->images[pos] != imgid) return;
+  memmove(e->images + pos, e->images + pos + 1, sizeof(int32_t) * (e->num_images - pos - 1));
+  e->num_images--;
+}
+
+static dt_tag_index_entry_t *_tag_index_insert(GHashTable *tags, const guint id, const char *name)
+{
+  dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)g_hash_table_lookup(tags, GUINT_TO_POINTER(id));
+  if(!e)
+  {
+    e = (dt_tag_index_entry_t *)g_malloc0(sizeof(dt_tag_index_entry_t));
+    e->id = id;
+    g_hash_table_insert(tags, GUINT_TO_POINTER(id), e);
+  }
+  g_free(e->name);
+  g_free(e->lower);
+  e->name = g_strdup(name ? name : "");
+  e->lower = g_ascii_strdown(e->name, -1);
+  return e;
+}
+
+// has to be called with the mutex held
+static void _tag_index_apply(const dt_tag_index_op_t op, const guint tagid, const int32_t imgid, const char *name)
+{
+  dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)g_hash_table_lookup(_tag_index.tags, GUINT_TO_POINTER(tagid));
+  switch(op)
+  {
+    case DT_TAG_INDEX_INSERT_TAG:
+    case DT_TAG_INDEX_RENAME_TAG:
+      _tag_index_insert(_tag_index.tags, tagid, name);
+      _tag_index.sorted_valid = FALSE;
+      break;
+    case DT_TAG_INDEX_DELETE_TAG:
+      if(e)
+      {
+        g_hash_table_remove(_tag_index.tags, GUINT_TO_POINTER(tagid));
+        _tag_index.sorted_valid = FALSE;
+      }
+      break;
+    case DT_TAG_INDEX_ATTACH:
+      if(e) _tag_index_attach(e, imgid);
+      break;
+    case DT_TAG_INDEX_DETACH:
+      if(e) _tag_index_detach(e, imgid);
+      break;
+  }
+}
+
+static int _tag_index_cmp_int(const void *a, const void *b)
+{
+  return *(const int32_t *)a - *(const int32_t *)b;
+}
+
+// reads the whole index from the db. no locks held, see above.
+static GHashTable *_tag_index_load()
+{
+  GHashTable *tags = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _tag_index_entry_free);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id, name FROM tags", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    _tag_index_insert(tags, sqlite3_column_int(stmt, 0), (const char *)sqlite3_column_text(stmt, 1));
+  sqlite3_finalize(stmt);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT tagid, imgid FROM tagged_images", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)g_hash_table_lookup(tags, GUINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+    if(!e) continue;
+    if(e->num_images == e->alloc_images)
+    {
+      e->alloc_images = MAX(8, 2 * e->alloc_images);
+      e->images = (int32_t *)g_realloc(e->images, sizeof(int32_t) * e->alloc_images);
+    }
+    e->images[e->num_images++] = sqlite3_column_int(stmt, 1);
+  }
+  sqlite3_finalize(stmt);
+
+  // (imgid, tagid) is the primary key, so there are no duplicates to take care of.
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, tags);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)value;
+    qsort(e->images, e->num_images, sizeof(int32_t), _tag_index_cmp_int);
+  }
+  return tags;
+}
+
+static int _tag_index_cmp_entry(const void *a, const void *b)
+{
+  const dt_tag_index_entry_t *ea = *(const dt_tag_index_entry_t **)a;
+  const dt_tag_index_entry_t *eb = *(const dt_tag_index_entry_t **)b;
+  return strcmp(ea->lower, eb->lower);
+}
+
+/* returns with the mutex held and the index up to date */
+static void _tag_index_lock()
+{
+  dt_pthread_mutex_lock(&_tag_index.mutex);
+  // someone else is reading it from the db already
+  while(_tag_index.loading)
+  {
+    dt_pthread_mutex_unlock(&_tag_index.mutex);
+    g_usleep(1000);
+    dt_pthread_mutex_lock(&_tag_index.mutex);
+  }
+  if(!_tag_index.valid)
+  {
+    _tag_index.loading = TRUE;
+    dt_pthread_mutex_unlock(&_tag_index.mutex);
+
+    // changes made by queued writes before we started logging would be lost otherwise.
+    dt_database_write_sync(darktable.db);
+    GHashTable *tags = _tag_index_load();
+
+    dt_pthread_mutex_lock(&_tag_index.mutex);
+    if(_tag_index.tags) g_hash_table_destroy(_tag_index.tags);
+    _tag_index.tags = tags;
+    // the updates are idempotent, so replaying ones the load already saw doesn't hurt.
+    _tag_index.log = g_list_reverse(_tag_index.log);
+    for(GList *l = _tag_index.log; l; l = g_list_next(l))
+    {
+      const dt_tag_index_update_t *u = (const dt_tag_index_update_t *)l->data;
+      _tag_index_apply(u->op, u->tagid, u->imgid, u->name);
+    }
+    g_list_free_full(_tag_index.log, _tag_index_update_free);
+    _tag_index.log = NULL;
+    _tag_index.loading = FALSE;
+    _tag_index.sorted_valid = FALSE;
+    _tag_index.valid = TRUE;
+  }
+
+  if(!_tag_index.sorted_valid)
+  {
+    g_ptr_array_set_size(_tag_index.sorted, 0);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, _tag_index.tags);
+    while(g_hash_table_iter_next(&iter, NULL, &value)) g_ptr_array_add(_tag_index.sorted, value);
+    g_ptr_array_sort(_tag_index.sorted, _tag_index_cmp_entry);
+    _tag_index.sorted_valid = TRUE;
+  }
+}
+
+// sql LIKE on lower case strings, % matches any sequence and _ any single character.
+static gboolean _tag_index_like(const char *text, const char *pattern)
+{
+  const char *star = NULL, *resume = NULL;
+  while(*text)
+  {
+    if(*pattern == '%')
+    {
+      star = ++pattern;
+      resume = text;
+    }
+    else if(*pattern == '_' || *pattern == *text)
+    {
+      pattern++;
+      text++;
+    }
+    else if(star)
+    {
+      pattern = star;
+      text = ++resume;
+    }
+    else
+      return FALSE;
+  }
+  while(*pattern == '%') pattern++;
+  return *pattern == '\0';
+}
+
+gboolean dt_tag_like(const gchar *name, const gchar *pattern)
+{
+  gchar *n = g_ascii_strdown(name, -1), *p = g_ascii_strdown(pattern, -1);
+  const gboolean res = _tag_index_like(n, p);
+  g_free(n);
+  g_free(p);
+  return res;
+}
+
+/* calls func for every entry matching pattern, in name order. has to be called with the mutex held. */
+static void _tag_index_foreach_matching(const gchar *pattern, void (*func)(dt_tag_index_entry_t *e, gpointer data), gpointer data)
+{
+  gchar *lower = g_ascii_strdown(pattern, -1);
+  // the part before the first wildcard narrows down the range of names to look at
+  const size_t prefix = strcspn(lower, "%_");
+  GPtrArray *sorted = _tag_index.sorted;
+  guint k = 0;
+  if(prefix > 0)
+  {
+    guint lo = 0, hi = sorted->len;
+    while(lo < hi)
+    {
+      const guint mid = (lo + hi) / 2;
+      if(strncmp(((dt_tag_index_entry_t *)g_ptr_array_index(sorted, mid))->lower, lower, prefix) < 0) lo = mid + 1;
+      else hi = mid;
+    }
+    k = lo;
+  }
+  for(; k < sorted->len; k++)
+  {
+    dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)g_ptr_array_index(sorted, k);
+    if(prefix > 0 && strncmp(e->lower, lower, prefix) != 0) break;
+    if(_tag_index_like(e->lower, lower)) func(e, data);
+  }
+  g_free(lower);
+}
+
+static void _tag_index_collect_tag(dt_tag_index_entry_t *e, gpointer data)
+{
+  GList **result = (GList **)data;
+  dt_tag_t *t = g_malloc(sizeof(dt_tag_t));
+  t->id = e->id;
+  t->tag = g_strdup(e->name);
+  *result = g_list_prepend(*result, t);
+}
+
+uint32_t dt_tag_get_matching(const gchar *pattern, GList **result)
+{
+  GList *tags = NULL;
+  _tag_index_lock();
+  _tag_index_foreach_matching(pattern, _tag_index_collect_tag, &tags);
+  dt_pthread_mutex_unlock(&_tag_index.mutex);
+  const uint32_t count = g_list_length(tags);
+  *result = g_list_concat(*result, g_list_reverse(tags));
+  return count;
+}
+
+static void _tag_index_collect_entry(dt_tag_index_entry_t *e, gpointer data)
+{
+  g_ptr_array_add((GPtrArray *)data, e);
+}
+
+uint32_t dt_tag_get_images(const gchar *pattern, int32_t **imgids)
+{
+  GPtrArray *matching = g_ptr_array_new();
+  _tag_index_lock();
+  _tag_index_foreach_matching(pattern, _tag_index_collect_entry, matching);
+
+  uint32_t num = 0;
+  for(guint k = 0; k < matching->len; k++) num += ((dt_tag_index_entry_t *)g_ptr_array_index(matching, k))->num_images;
+  int32_t *ids = (int32_t *)g_malloc(sizeof(int32_t) * MAX(num, 1));
+  num = 0;
+  for(guint k = 0; k < matching->len; k++)
+  {
+    const dt_tag_index_entry_t *e = (const dt_tag_index_entry_t *)g_ptr_array_index(matching, k);
+    memcpy(ids + num, e->images, sizeof(int32_t) * e->num_images);
+    num += e->num_images;
+  }
+  dt_pthread_mutex_unlock(&_tag_index.mutex);
+
+  // with more than one tag an image can show up several times
+  if(matching->len > 1)
+  {
+    qsort(ids, num, sizeof(int32_t), _tag_index_cmp_int);
+    uint32_t unique = 0;
+    for(uint32_t k = 0; k < num; k++)
+      if(unique == 0 || ids[unique - 1] != ids[k]) ids[unique++] = ids[k];
+    num = unique;
+  }
+  g_ptr_array_free(matching, TRUE);
+
+  if(imgids) *imgids = ids;
+  else g_free(ids);
+  return num;
+}
+
+uint32_t dt_tag_count_images(const guint tagid)
+{
+  _tag_index_lock();
+  const dt_tag_index_entry_t *e = (const dt_tag_index_entry_t *)g_hash_table_lookup(_tag_index.tags, GUINT_TO_POINTER(tagid));
+  const uint32_t count = e ? e->num_images : 0;
+  dt_pthread_mutex_unlock(&_tag_index.mutex);
+  return count;
+}
+
+void dt_tag_index_sql_update(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+  const dt_tag_index_op_t op = sqlite3_value_int(argv[0]);
+  const guint tagid = sqlite3_value_int(argv[1]);
+  const int with_name = op == DT_TAG_INDEX_INSERT_TAG || op == DT_TAG_INDEX_RENAME_TAG;
+  const char *name = with_name ? (const char *)sqlite3_value_text(argv[2]) : NULL;
+  const int32_t imgid = with_name ? 0 : sqlite3_value_int(argv[2]);
+
+  dt_pthread_mutex_lock(&_tag_index.mutex);
+  if(_tag_index.valid)
+    _tag_index_apply(op, tagid, imgid, name);
+  else if(_tag_index.loading)
+  {
+    dt_tag_index_update_t *u = (dt_tag_index_update_t *)g_malloc(sizeof(dt_tag_index_update_t));
+    u->op = op;
+    u->tagid = tagid;
+    u->imgid = imgid;
+    u->name = g_strdup(name);
+    _tag_index.log = g_list_prepend(_tag_index.log, u);
+  }
+  // else: nothing to keep up to date yet, the first query reads it all from the db.
+  dt_pthread_mutex_unlock(&_tag_index.mutex);
+
+  sqlite3_result_null(context);
+}
+
+void dt_tag_index_init()
+{
+  memset(&_tag_index, 0, sizeof(_tag_index));
+  dt_pthread_mutex_init(&_tag_index.mutex, NULL);
+  _tag_index.sorted = g_ptr_array_new();
+}
+
+void dt_tag_index_cleanup()
+{
+  if(_tag_index.tags) g_hash_table_destroy(_tag_index.tags);
+  g_list_free_full(_tag_index.log, _tag_index_update_free);
+  g_ptr_array_free(_tag_index.sorted, TRUE);
+  dt_pthread_mutex_destroy(&_tag_index.mutex);
+  memset(&_tag_index, 0, sizeof(_tag_index));
+}
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
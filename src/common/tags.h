@@ -79,6 +79,41 @@ void dt_tag_free_result(GList **result);
 /** reorganize tags */
 void dt_tag_reorganize(const gchar *source, const gchar *dest);
 
+/** the functions below answer from an in-memory index of all tags and the images they are attached to.
+ *  it's built from the db on first use and kept in sync by temporary triggers on tags and tagged_images. */
+
+/** retrieves the tags whose name matches the sql LIKE pattern (% and _, ascii case insensitive), ordered by
+ *  name. \param[out] result a list of dt_tag_t. \return the count */
+uint32_t dt_tag_get_matching(const gchar *pattern, GList **result);
+
+/** retrieves the images that have a tag matching the sql LIKE pattern attached. \param[out] imgids sorted
+ *  ids without duplicates, free with g_free(). may be NULL to only count them. \return the count */
+uint32_t dt_tag_get_images(const gchar *pattern, int32_t **imgids);
+
+/** the number of images tagid is attached to. */
+uint32_t dt_tag_count_images(const guint tagid);
+
+/** sql LIKE on a tag name, the way the index matches it. */
+gboolean dt_tag_like(const gchar *name, const gchar *pattern);
+
+/** what the triggers on tags and tagged_images report to dt_tag_index_sql_update(). */
+typedef enum dt_tag_index_op_t
+{
+  DT_TAG_INDEX_INSERT_TAG = 0, // tag id, name
+  DT_TAG_INDEX_DELETE_TAG = 1, // tag id
+  DT_TAG_INDEX_RENAME_TAG = 2, // tag id, new name
+  DT_TAG_INDEX_ATTACH     = 3, // tag id, image id
+  DT_TAG_INDEX_DETACH     = 4  // tag id, image id
+}
+dt_tag_index_op_t;
+
+/** set up and free the index. */
+void dt_tag_index_init();
+void dt_tag_index_cleanup();
+
+/** sql function dt_tag_index_update(op, tagid, name or imgid), registered on each read-write connection. */
+void dt_tag_index_sql_update(sqlite3_context *context, int argc, sqlite3_value **argv);
+
 
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -27,6 +27,7 @@
 #include "common/database.h"
 #include "common/history.h"
 #include "common/image.h"
+#include "common/image_cache.h"
 #include "control/conf.h"
 #include "gui/gtk.h"
 
@@ -58,6 +59,9 @@ GList * dt_control_crawler_run()
   GList *result = NULL;
   gboolean look_for_xmp = dt_conf_get_bool("write_sidecar_files");
 
+  // the flags are read and written right here, get the queued image writes out of the way first.
+  dt_image_cache_flush(darktable.image_cache);
+
   sqlite3_prepare_v2(dt_database_get(darktable.db),
                      "SELECT images.id, write_timestamp, version, folder || '/' || filename, flags "
                      "FROM images, film_rolls WHERE images.film_id = film_rolls.id "
@@ -21,6 +21,7 @@
 
 #include "control/jobs.h"
 #include "control/control.h"
+#include <string.h>
 
 #define DT_CONTROL_FG_PRIORITY 4
 #define DT_CONTROL_MAX_JOBS 30
@@ -39,6 +40,7 @@ typedef struct _dt_job_t
 {
   dt_job_execute_callback execute;
   void *params;
+  size_t params_size;
   int32_t result;
 
   dt_pthread_mutex_t state_mutex;
@@ -56,15 +58,17 @@ _dt_job_t;
 
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't match
     we don't want to compare result, priority or state since these will change during the course of processing.
-    TODO: somehow compare params. maybe we have to pass the sizeof(params) when setting the params to do a memcmp, or maybe even
-          allow to pass a comparator for that.
+    only jobs which told us the size of their params can be equal, everything else might own its params.
  */
 static inline int dt_control_job_equal(_dt_job_t * j1, _dt_job_t * j2)
 {
   return (j1->execute == j2->execute              &&
      j1->state_changed_cb == j2->state_changed_cb &&
      j1->queue == j2->queue                       &&
-     g_strcmp0(j1->description, j2->description)
+     j1->params_size                              &&
+     j1->params_size == j2->params_size           &&
+     !memcmp(j1->params, j2->params, j1->params_size) &&
+     !g_strcmp0(j1->description, j2->description)
     );
 }
 
@@ -94,6 +98,13 @@ void dt_control_job_set_params(_dt_job_t *job, void * params)
   job->params = params;
 }
 
+void dt_control_job_set_params_with_size(_dt_job_t *job, void *params, size_t size)
+{
+  if(!job || dt_control_job_get_state(job) != DT_JOB_STATE_INITIALIZED) return;
+  job->params = params;
+  job->params_size = size;
+}
+
 void * dt_control_job_get_params(const _dt_job_t *job)
 {
   if(!job) return NULL;
@@ -362,6 +373,8 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
         *queue = g_list_delete_link(*queue, iter);
         length--;
         dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+        // params with a size are plain memory, and the duplicate won't run to free them
+        free(job->params);
         dt_control_job_dispose(job);
         job = other_job;
         break; // there can't be any further copy in the list
@@ -404,6 +417,33 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   return 0;
 }
 
+int dt_control_cancel_jobs(dt_control_t *control, dt_job_queue_t queue_id, dt_job_execute_callback execute)
+{
+  if(((unsigned int)queue_id) >= DT_JOB_QUEUE_MAX) return 0;
+
+  int cancelled = 0;
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  GList **queue = &control->queues[queue_id];
+  GList *iter = *queue;
+  while(iter)
+  {
+    GList *next = g_list_next(iter);
+    _dt_job_t *job = (_dt_job_t*)iter->data;
+    // jobs in the queue haven't been picked up by a worker yet, so they are ours to dispose:
+    if(job->execute == execute)
+    {
+      *queue = g_list_delete_link(*queue, iter);
+      control->queue_length[queue_id]--;
+      dt_control_job_set_state(job, DT_JOB_STATE_CANCELLED);
+      dt_control_job_dispose(job);
+      cancelled++;
+    }
+    iter = next;
+  }
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+  return cancelled;
+}
+
 static __thread int threadid = -1;
 
 int32_t dt_control_get_threadid()
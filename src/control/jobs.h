@@ -22,6 +22,7 @@
 #define DT_CONTROL_JOBS_H
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #define DT_CONTROL_DESCRIPTION_LEN 256
 // reserved workers
@@ -68,6 +69,9 @@ dt_job_state_t dt_control_job_get_state(dt_job_t *job);
 void dt_control_job_wait(dt_job_t *job);
 /** accessors for internal fields */
 void dt_control_job_set_params(dt_job_t *job, void * params);
+/** same, for params which are one block of plain malloc()ed memory. only such jobs are compared on the system
+    foreground queue: adding one equal to a queued job moves that one to the top and frees the new one's params. */
+void dt_control_job_set_params_with_size(dt_job_t *job, void * params, size_t size);
 void * dt_control_job_get_params(const dt_job_t *job);
 
 struct dt_control_t;
@@ -75,6 +79,8 @@ void dt_control_jobs_init(struct dt_control_t *control);
 
 int dt_control_add_job(struct dt_control_t *control, dt_job_queue_t queue_id, dt_job_t *job);
 int32_t dt_control_add_job_res(struct dt_control_t *s, dt_job_t *job, int32_t res);
+/** cancel and dispose all jobs of the queue with this execute callback which didn't start yet. returns how many. */
+int dt_control_cancel_jobs(struct dt_control_t *control, dt_job_queue_t queue_id, dt_job_execute_callback execute);
 
 int32_t dt_control_get_threadid();
 
@@ -155,33 +155,18 @@ static dt_job_t * dt_control_generic_images_job_create(dt_job_execute_callback e
 
 static int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
 {
-  int imgid = -1;
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
   GList *t = params->index;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "UPDATE images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1", -1, &stmt, NULL);
-  while(t)
+  const int num = g_list_length(t);
+  int *imgids = (int *)g_malloc(sizeof(int) * MAX(num, 1));
+  for(int k = 0; t; k++)
   {
-    gboolean from_cache = FALSE;
-    imgid = GPOINTER_TO_INT(t->data);
-    const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, (int32_t)imgid);
-    char dtfilename[PATH_MAX];
-    dt_image_full_path(img->id, dtfilename, sizeof(dtfilename), &from_cache);
-    dt_image_path_append_version(img->id, dtfilename, sizeof(dtfilename));
-    g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
-    if(!dt_exif_xmp_write(imgid, dtfilename))
-    {
-      // put the timestamp into db. this can't be done in exif.cc since that code gets called
-      // for the copy exporter, too
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-      sqlite3_step(stmt);
-      sqlite3_reset(stmt);
-      sqlite3_clear_bindings(stmt);
-    }
-    dt_image_cache_read_release(darktable.image_cache, img);
+    imgids[k] = GPOINTER_TO_INT(t->data);
     t = g_list_delete_link(t, t);
   }
-  sqlite3_finalize(stmt);
+  // all of them in a few batches, the timestamps go into the db from there
+  dt_image_write_sidecar_files(imgids, num);
+  g_free(imgids);
   free(params);
   return 0;
 }
@@ -432,6 +417,8 @@ static char *_get_image_list(GList *l)
 static void _set_remove_flag(char *imgs)
 {
   sqlite3_stmt *stmt = NULL;
+  // a queued write release would set the flags back
+  dt_image_cache_flush(darktable.image_cache);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "UPDATE images SET flags = (flags|?1) WHERE id IN (?2)", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, DT_IMAGE_REMOVE);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgs, -1, SQLITE_STATIC);
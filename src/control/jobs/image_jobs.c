@@ -58,12 +58,60 @@ dt_job_t * dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
     dt_control_job_dispose(job);
     return NULL;
   }
+  params->imgid = id;
+  params->mip = mip;
+  dt_control_job_set_params_with_size(job, params, sizeof(dt_image_load_t));
+  return job;
+}
+
+static int32_t dt_image_prefetch_job_run(dt_job_t *job)
+{
+  dt_image_load_t *params = dt_control_job_get_params(job);
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_read_get(
+    darktable.mipmap_cache,
+    &buf,
+    params->imgid,
+    params->mip,
+    DT_MIPMAP_BLOCKING);
+
+  if(buf.buf)
+  {
+    dt_mipmap_cache_prefetched(darktable.mipmap_cache, &buf);
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+  }
+  return 0;
+}
+
+static void dt_image_prefetch_job_state(dt_job_t *job, dt_job_state_t state)
+{
+  // these can be cancelled before they run, so the params go with the job itself:
+  if(state == DT_JOB_STATE_DISPOSED) free(dt_control_job_get_params(job));
+}
+
+dt_job_t * dt_image_prefetch_job_create(int32_t id, dt_mipmap_size_t mip)
+{
+  dt_job_t *job = dt_control_job_create(&dt_image_prefetch_job_run, "prefetch image %d mip %d", id, mip);
+  if(!job) return NULL;
+  dt_image_load_t *params = (dt_image_load_t *)calloc(1, sizeof(dt_image_load_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
   dt_control_job_set_params(job, params);
+  dt_control_job_set_state_callback(job, dt_image_prefetch_job_state);
   params->imgid = id;
   params->mip = mip;
   return job;
 }
 
+int dt_image_prefetch_jobs_cancel()
+{
+  return dt_control_cancel_jobs(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, &dt_image_prefetch_job_run);
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
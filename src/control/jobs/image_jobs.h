@@ -25,6 +25,11 @@
 
 dt_job_t * dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
 
+/** speculative load of a thumbnail which might be needed soon, to be added to DT_JOB_QUEUE_SYSTEM_BG. */
+dt_job_t * dt_image_prefetch_job_create(int32_t imgid, dt_mipmap_size_t mip);
+/** cancel all prefetch jobs which didn't start yet. */
+int dt_image_prefetch_jobs_cancel();
+
 dt_job_t * dt_image_import_job_create(uint32_t filmid, const char *filename);
 
 
@@ -44,6 +44,10 @@
 #define DT_DEV_AVERAGE_DELAY_START            250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START     50
 #define DT_DEV_AVERAGE_DELAY_COUNT              5
+// show a coarse version of the image first, if developing it takes longer than this (ms):
+#define DT_DEV_PROGRESSIVE_DELAY              100
+// at this fraction of the resolution:
+#define DT_DEV_PROGRESSIVE_FACTOR               4
 
 const gchar* dt_dev_histogram_type_names[DT_DEV_HISTOGRAM_N] = { "logarithmic", "linear", "waveform" };
 
@@ -67,6 +71,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
 
   dt_image_init(&dev->image_storage);
   dev->image_status = dev->preview_status = DT_DEV_PIXELPIPE_DIRTY;
+  dev->image_coarse = 0;
   dev->image_loading = dev->preview_loading = 0;
   dev->image_force_reload = 0;
   dev->preview_input_changed = 0;
@@ -130,6 +135,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
     dt_dev_pixelpipe_cleanup(dev->preview_pipe);
     free(dev->preview_pipe);
   }
+  dt_free_align(dev->preview_input);
   while(dev->history)
   {
     free(((dt_dev_history_item_t *)dev->history->data)->params);
@@ -203,8 +209,10 @@ void dt_dev_process_preview_job(dt_develop_t *dev)
     dt_pthread_mutex_unlock(&dev->preview_pipe_mutex);
     return; // not loaded yet. load will issue a gtk redraw on completion, which in turn will trigger us again later.
   }
+  if(!dev->preview_input) dev->preview_input = dt_mipmap_cache_alloc_scratchmem_f(darktable.mipmap_cache);
   // init pixel pipeline for preview.
-  dt_dev_pixelpipe_set_input(dev->preview_pipe, dev, (float *)buf.buf, buf.width, buf.height, dev->image_storage.width/(float)buf.width);
+  dt_dev_pixelpipe_set_input(dev->preview_pipe, dev, dt_mipmap_cache_decompress_f(&buf, dev->preview_input),
+                             buf.width, buf.height, dev->image_storage.width/(float)buf.width);
 
   if(dev->preview_loading)
   {
@@ -267,6 +275,7 @@ void dt_dev_process_image_job(dt_develop_t *dev)
   dt_pthread_mutex_lock(&dev->pipe_mutex);
   dt_control_log_busy_enter();
   // let gui know to draw preview instead of us, if it's there:
+  dev->image_coarse = 0;
   dev->image_status = DT_DEV_PIXELPIPE_RUNNING;
 
   dt_mipmap_buffer_t buf;
@@ -313,7 +322,7 @@ void dt_dev_process_image_job(dt_develop_t *dev)
 
   dt_dev_zoom_t zoom;
   float zoom_x, zoom_y, scale;
-  int x, y;
+  int x, y, progressive;
 
   // adjust pipeline according to changed flag set by {add,pop}_history_item.
 restart:
@@ -326,6 +335,11 @@ restart:
     return;
   }
   dev->pipe->input_timestamp = dev->timestamp;
+  // the old coarse version doesn't fit the new run any more, keep the screen as it is until there's a new one.
+  dev->image_coarse = 0;
+  // only worth it for edits: panning is mostly served by the cached tiles anyways.
+  progressive = dev->gui_attached && (dev->pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH))
+                && dev->average_delay > DT_DEV_PROGRESSIVE_DELAY && dt_conf_get_bool("darkroom/ui/progressive");
   // this locks dev->history_mutex.
   dt_dev_pixelpipe_change(dev->pipe, dev);
   // determine scale according to new dimensions
@@ -339,8 +353,23 @@ restart:
   x = MAX(0, scale*dev->pipe->processed_width *(.5+zoom_x)-dev->capwidth/2);
   y = MAX(0, scale*dev->pipe->processed_height*(.5+zoom_y)-dev->capheight/2);
 
+  if(progressive && MIN(dev->capwidth, dev->capheight) >= 32*DT_DEV_PROGRESSIVE_FACTOR)
+  {
+    // a quick look at the same region at a fraction of the resolution first. if it's
+    // interrupted, the real run below will notice and start over as well.
+    dt_get_times(&start);
+    if(!dt_dev_pixelpipe_process_coarse(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale, DT_DEV_PROGRESSIVE_FACTOR) &&
+       dev->pipe->changed == DT_DEV_PIPE_UNCHANGED)
+    {
+      dt_show_times(&start, "[dev_process_image] coarse pixel pipeline processing", NULL);
+      dev->image_coarse = 1;
+      dt_control_queue_redraw_center();
+    }
+  }
+
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale))
+  // panning only runs the pipe for the newly exposed tiles:
+  if(dt_dev_pixelpipe_process_tiled(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale))
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -362,6 +391,7 @@ restart:
 
   // cool, we got a new image!
   dev->image_status = DT_DEV_PIXELPIPE_VALID;
+  dev->image_coarse = 0;
   dev->image_loading = 0;
 
   dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
@@ -78,11 +78,13 @@ typedef struct dt_develop_t
   int32_t image_loading, first_load, image_force_reload;
   int32_t preview_loading, preview_input_changed;
   dt_dev_pixelpipe_status_t image_status, preview_status;
+  int32_t image_coarse; // set while the full pipe's backbuf holds a coarse version of what is being developed.
   uint32_t timestamp;
   uint32_t average_delay;
   uint32_t preview_average_delay;
   struct dt_iop_module_t *gui_module; // this module claims gui expose/event callbacks.
   float preview_downsampling; // < 1.0: optionally downsample preview
+  float *preview_input; // mip f converted back to floats, if the cache keeps it as half floats
 
   // width, height: dimensions of window
   // capwidth, capheight: actual dimensions of scaled image inside window.
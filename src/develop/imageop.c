@@ -1277,6 +1277,7 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params, dt_d
 
     // assume process_cl is ready, commit_params can overwrite this.
     if(module->process_cl) piece->process_cl_ready = 1;
+    piece->process_roi_dependent = 0;
     module->commit_params(module, params, pipe, piece);
     for(int i=0; i<length; i++) hash = ((hash << 5) + hash) ^ str[i];
     piece->hash = hash;
@@ -1900,6 +1901,43 @@ void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw
   }
 }
 
+void
+dt_iop_downsample_8(
+  const uint8_t *const in,
+  const int32_t iw,
+  const int32_t ih,
+  uint8_t *const out,
+  const int32_t ow,
+  const int32_t oh)
+{
+  const float scalex = iw/(float)ow;
+  const float scaley = ih/(float)oh;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for(int32_t j=0; j<oh; j++)
+  {
+    // average all input pixels which fall into the footprint of the output pixel:
+    const int32_t y0 = j*scaley;
+    const int32_t y1 = MAX(y0+1, MIN(ih, (int32_t)((j+1)*scaley)));
+    uint8_t *out2 = out + 4*ow*j;
+    for(int32_t i=0; i<ow; i++)
+    {
+      const int32_t x0 = i*scalex;
+      const int32_t x1 = MAX(x0+1, MIN(iw, (int32_t)((i+1)*scalex)));
+      uint32_t sum[4] = {0, 0, 0, 0};
+      for(int32_t y=y0; y<y1; y++)
+      {
+        const uint8_t *in2 = in + 4*(iw*y + x0);
+        for(int32_t x=x0; x<x1; x++, in2+=4)
+          for(int k=0; k<4; k++) sum[k] += in2[k];
+      }
+      const uint32_t n = (x1-x0)*(y1-y0);
+      for(int k=0; k<4; k++) out2[4*i+k] = (sum[k] + n/2)/n;
+    }
+  }
+}
+
 void
 dt_iop_clip_and_zoom(float *out, const float *const in,
                      const dt_iop_roi_t *const roi_out, const dt_iop_roi_t * const roi_in, const int32_t out_stride, const int32_t in_stride)
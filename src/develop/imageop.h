@@ -536,6 +536,9 @@ dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw, int32_t ibh,
                             uint8_t *o, int32_t ox, int32_t oy, int32_t ow, int32_t oh, int32_t obw, int32_t obh);
 
+/** box filter the whole rgba 8-bit buffer in down to ow x oh, keeps the channel order. */
+void dt_iop_downsample_8(const uint8_t *const in, const int32_t iw, const int32_t ih, uint8_t *const out, const int32_t ow, const int32_t oh);
+
 void dt_iop_YCbCr_to_RGB(const float *yuv, float *rgb);
 void dt_iop_RGB_to_YCbCr(const float *rgb, float *yuv);
 
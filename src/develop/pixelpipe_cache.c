@@ -20,6 +20,7 @@
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -214,6 +215,96 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses)/(float)cache->queries);
 }
 
+int dt_dev_pixelpipe_tiles_init(dt_dev_pixelpipe_tiles_t *tiles, int entries)
+{
+  tiles->entries = entries;
+  tiles->data = (uint8_t **)calloc(entries, sizeof(uint8_t *));
+  tiles->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
+  tiles->tx   = (int32_t *)calloc(entries, sizeof(int32_t));
+  tiles->ty   = (int32_t *)calloc(entries, sizeof(int32_t));
+  tiles->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  tiles->out = NULL;
+  tiles->out_size = 0;
+  tiles->queries = tiles->misses = 0;
+  if(!tiles->data || !tiles->hash || !tiles->tx || !tiles->ty || !tiles->used)
+  {
+    free(tiles->data);
+    free(tiles->hash);
+    free(tiles->tx);
+    free(tiles->ty);
+    free(tiles->used);
+    memset(tiles, 0, sizeof(dt_dev_pixelpipe_tiles_t));
+    return 0;
+  }
+  for(int k=0; k<entries; k++) tiles->hash[k] = -1;
+  return 1;
+}
+
+void dt_dev_pixelpipe_tiles_cleanup(dt_dev_pixelpipe_tiles_t *tiles)
+{
+  for(int k=0; k<tiles->entries; k++) dt_free_align(tiles->data[k]);
+  dt_free_align(tiles->out);
+  free(tiles->data);
+  free(tiles->hash);
+  free(tiles->tx);
+  free(tiles->ty);
+  free(tiles->used);
+  memset(tiles, 0, sizeof(dt_dev_pixelpipe_tiles_t));
+}
+
+uint8_t *dt_dev_pixelpipe_tiles_get(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const int32_t tx, const int32_t ty)
+{
+  tiles->queries++;
+  uint8_t *data = NULL;
+  for(int k=0; k<tiles->entries; k++)
+  {
+    tiles->used[k]++; // age all entries
+    if(tiles->hash[k] == hash && tiles->tx[k] == tx && tiles->ty[k] == ty)
+    {
+      data = tiles->data[k];
+      tiles->used[k] = 0; // this is the MRU entry
+    }
+  }
+  if(!data) tiles->misses++;
+  return data;
+}
+
+uint8_t *dt_dev_pixelpipe_tiles_put(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const int32_t tx, const int32_t ty)
+{
+  if(!tiles->entries) return NULL;
+  int max = 0;
+  for(int k=0; k<tiles->entries; k++)
+  {
+    // the same tile again, or else an empty slot, or else the LRU one
+    if(tiles->hash[k] == hash && tiles->tx[k] == tx && tiles->ty[k] == ty)
+    {
+      max = k;
+      break;
+    }
+    if(tiles->hash[max] != (uint64_t)-1 &&
+       (tiles->hash[k] == (uint64_t)-1 || tiles->used[k] > tiles->used[max])) max = k;
+  }
+  if(!tiles->data[max])
+  {
+    tiles->data[max] = (uint8_t *)dt_alloc_align(16, (size_t)4*DT_DEV_PIXELPIPE_TILE_SIZE*DT_DEV_PIXELPIPE_TILE_SIZE);
+    if(!tiles->data[max]) return NULL;
+  }
+  tiles->hash[max] = hash;
+  tiles->tx[max] = tx;
+  tiles->ty[max] = ty;
+  tiles->used[max] = 0;
+  return tiles->data[max];
+}
+
+void dt_dev_pixelpipe_tiles_flush(dt_dev_pixelpipe_tiles_t *tiles)
+{
+  for(int k=0; k<tiles->entries; k++)
+  {
+    tiles->hash[k] = -1;
+    tiles->used[k] = 0;
+  }
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
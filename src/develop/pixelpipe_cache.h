@@ -73,6 +73,44 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
+/**
+ * the 8-bit output of the last module, cut into square tiles. the grid starts at the top left
+ * corner of the image at each scale, so it stays put when panning, and only the newly exposed
+ * tiles have to go through the pipe again. tiles are found by tile position and the hash of the
+ * module stack and scale (but not the position), and are allocated on first use.
+ */
+#define DT_DEV_PIXELPIPE_TILE_SIZE 256
+
+typedef struct dt_dev_pixelpipe_tiles_t
+{
+  int32_t  entries;
+  // DT_DEV_PIXELPIPE_TILE_SIZE^2 pixels of 4 bytes each, rows of the full tile size
+  uint8_t  **data;
+  uint64_t *hash;
+  int32_t  *tx, *ty;
+  int32_t  *used;
+  // the tiles for the backbuffer, put together
+  uint8_t  *out;
+  size_t   out_size;
+  // profiling:
+  uint64_t queries;
+  uint64_t misses;
+}
+dt_dev_pixelpipe_tiles_t;
+
+/** constructs a tile cache with room for that many tiles. returns 0 if it fails to allocate. */
+int dt_dev_pixelpipe_tiles_init(dt_dev_pixelpipe_tiles_t *tiles, int entries);
+void dt_dev_pixelpipe_tiles_cleanup(dt_dev_pixelpipe_tiles_t *tiles);
+
+/** the tile, or NULL if it's not in the cache. */
+uint8_t *dt_dev_pixelpipe_tiles_get(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const int32_t tx, const int32_t ty);
+
+/** a buffer to put this tile into, in place of the least recently used one. NULL if out of memory. */
+uint8_t *dt_dev_pixelpipe_tiles_put(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const int32_t tx, const int32_t ty);
+
+/** invalidates all tiles. */
+void dt_dev_pixelpipe_tiles_flush(dt_dev_pixelpipe_tiles_t *tiles);
+
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -112,6 +112,13 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   int res = dt_dev_pixelpipe_init_cached(pipe, 4*sizeof(float)*darktable.thumbnail_width*darktable.thumbnail_height, 5);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
+  // tiles for a few screens worth of panning around
+  const int tiles = (darktable.thumbnail_width /DT_DEV_PIXELPIPE_TILE_SIZE + 2) *
+                    (darktable.thumbnail_height/DT_DEV_PIXELPIPE_TILE_SIZE + 2);
+  if(res) dt_dev_pixelpipe_tiles_init(&pipe->tiles, 4*tiles);
+  // the coarse runs get their own few lines, they grow as needed. can do without them.
+  if(res && !dt_dev_pixelpipe_cache_init(&pipe->coarse_cache, 5, pipe->backbuf_size/16))
+    memset(&pipe->coarse_cache, 0, sizeof(dt_dev_pixelpipe_cache_t));
   return res;
 }
 
@@ -123,10 +130,13 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
+  memset(&pipe->tiles, 0, sizeof(dt_dev_pixelpipe_tiles_t));
+  memset(&pipe->coarse_cache, 0, sizeof(dt_dev_pixelpipe_cache_t));
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size))
     return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
+  pipe->backbuf_coarse = 0;
   pipe->processing = 0;
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
@@ -157,6 +167,8 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_dev_pixelpipe_tiles_cleanup(&(pipe->tiles));
+  dt_dev_pixelpipe_cache_cleanup(&(pipe->coarse_cache));
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -207,6 +219,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
       piece->data = NULL;
       piece->hash = 0;
       piece->process_cl_ready = 0;
+      piece->process_roi_dependent = 0;
       dt_iop_init_pipe(piece->module, pipe,piece);
       pipe->nodes = g_list_append(pipe->nodes, piece);
     }
@@ -2280,6 +2293,7 @@ restart:
   pipe->backbuf = buf;
   pipe->backbuf_width  = width;
   pipe->backbuf_height = height;
+  pipe->backbuf_coarse = 0;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
   // printf("pixelpipe homebrew process end\n");
@@ -2287,9 +2301,194 @@ restart:
   return 0;
 }
 
+int dt_dev_pixelpipe_process_tiled(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height, float scale)
+{
+  dt_dev_pixelpipe_tiles_t *tiles = &pipe->tiles;
+  const int ts = DT_DEV_PIXELPIPE_TILE_SIZE;
+  // the grid ends where the image does at this scale
+  const int wd = scale*pipe->processed_width, ht = scale*pipe->processed_height;
+  const int tx0 = x/ts, ty0 = y/ts;
+  const int tx1 = (x+width-1)/ts, ty1 = (y+height-1)/ts;
+  // anything else goes through in one piece, as do views which would push their own tiles out of the cache,
+  // and pipes with modules which would put seams between tiles processed apart (the tile hash has no position).
+  // the others get the neighbourhood of the missing tiles processed with them, unless it's bigger than a tile.
+  if(x < 0 || y < 0 || width <= 0 || height <= 0 || x+width > wd || y+height > ht ||
+     2*(tx1-tx0+1)*(ty1-ty0+1) > tiles->entries || !dt_dev_pixelpipe_is_roi_independent(pipe))
+    return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+  const int margin = dt_dev_pixelpipe_roi_margin(pipe, wd, ht, scale);
+  if(margin > ts) return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+
+  // processing will flush the caches, the tiles go now:
+  if(pipe->cache_obsolete) dt_dev_pixelpipe_tiles_flush(tiles);
+
+  // all the modules and the scale, but not the position:
+  const dt_iop_roi_t roi_all = (dt_iop_roi_t)
+  {
+    0, 0, wd, ht, scale
+  };
+  const uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi_all, pipe, g_list_length(pipe->nodes));
+
+  // per row of tiles, the columns which aren't there yet
+  const int rows = ty1-ty0+1;
+  int *span = (int *)malloc(sizeof(int)*2*rows);
+  if(!span) return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+  for(int ty=ty0; ty<=ty1; ty++)
+  {
+    int *c = span + 2*(ty-ty0);
+    c[0] = tx1+1;
+    c[1] = tx0-1;
+    for(int tx=tx0; tx<=tx1; tx++)
+      if(!dt_dev_pixelpipe_tiles_get(tiles, hash, tx, ty))
+      {
+        c[0] = MIN(c[0], tx);
+        c[1] = MAX(c[1], tx);
+      }
+  }
+
+  // rows with the same columns missing go through the pipe together. after a pan that's
+  // the newly exposed strip, or two for a diagonal one.
+  for(int ty=ty0; ty<=ty1;)
+  {
+    const int *c = span + 2*(ty-ty0);
+    int end = ty;
+    while(end < ty1 && !memcmp(c, span + 2*(end+1-ty0), sizeof(int)*2)) end++;
+    if(c[0] <= c[1])
+    {
+      const int rx = MAX(0, c[0]*ts - margin), ry = MAX(0, ty*ts - margin);
+      const int rw = MIN((c[1]+1)*ts + margin, wd) - rx, rh = MIN((end+1)*ts + margin, ht) - ry;
+      if(dt_dev_pixelpipe_process(pipe, dev, rx, ry, rw, rh, scale))
+      {
+        free(span);
+        return 1;
+      }
+      // we are the only ones writing the backbuffer
+      for(int j=ty; j<=end; j++) for(int i=c[0]; i<=c[1]; i++)
+      {
+        uint8_t *tile = dt_dev_pixelpipe_tiles_put(tiles, hash, i, j);
+        if(!tile) continue;
+        const int tw = MIN(ts, wd - i*ts), th = MIN(ts, ht - j*ts);
+        for(int k=0; k<th; k++)
+          memcpy(tile + (size_t)4*ts*k, pipe->backbuf + (size_t)4*((size_t)rw*(j*ts + k - ry) + i*ts - rx), (size_t)4*tw);
+      }
+    }
+    ty = end+1;
+  }
+  free(span);
+
+  // put the view together
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const size_t size = (size_t)4*width*height;
+  if(tiles->out_size < size)
+  {
+    if(pipe->backbuf == tiles->out)
+    {
+      pipe->backbuf = NULL;
+      pipe->backbuf_width = pipe->backbuf_height = 0;
+    }
+    dt_free_align(tiles->out);
+    tiles->out = (uint8_t *)dt_alloc_align(16, size);
+    tiles->out_size = tiles->out ? size : 0;
+  }
+  int complete = tiles->out != NULL;
+  for(int ty=ty0; ty<=ty1 && complete; ty++) for(int tx=tx0; tx<=tx1 && complete; tx++)
+  {
+    const uint8_t *tile = dt_dev_pixelpipe_tiles_get(tiles, hash, tx, ty);
+    if(!tile)
+    {
+      complete = 0;
+      break;
+    }
+    const int i0 = MAX(x, tx*ts), i1 = MIN(x+width,  (tx+1)*ts);
+    const int j0 = MAX(y, ty*ts), j1 = MIN(y+height, (ty+1)*ts);
+    for(int j=j0; j<j1; j++)
+      memcpy(tiles->out + (size_t)4*((size_t)width*(j-y) + i0-x),
+             tile + (size_t)4*((size_t)ts*(j-ty*ts) + i0-tx*ts), (size_t)4*(i1-i0));
+  }
+  if(complete)
+  {
+    const dt_iop_roi_t roi = (dt_iop_roi_t)
+    {
+      x, y, width, height, scale
+    };
+    pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
+    pipe->backbuf = tiles->out;
+    pipe->backbuf_width  = width;
+    pipe->backbuf_height = height;
+    pipe->backbuf_coarse = 0;
+  }
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  // out of memory for the tiles, do it the old way:
+  if(!complete) return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+  return 0;
+}
+
+int dt_dev_pixelpipe_process_coarse(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height, float scale, int factor)
+{
+  // not set up for it, just skip the coarse run:
+  if(!pipe->coarse_cache.entries) return 1;
+  if(pipe->cache_obsolete)
+  {
+    // the real run still has to see this, too:
+    dt_dev_pixelpipe_cache_flush(&pipe->coarse_cache);
+    dt_dev_pixelpipe_cache_flush(&pipe->cache);
+    dt_dev_pixelpipe_tiles_flush(&pipe->tiles);
+    pipe->cache_obsolete = 0;
+  }
+  // run on the coarse cache lines: the early modules' output at this resolution stays around for the
+  // next edit, the full resolution lines the refinement wants to reuse aren't evicted, and the
+  // backbuf stays valid for display while the refinement runs.
+  const dt_dev_pixelpipe_cache_t cache = pipe->cache;
+  pipe->cache = pipe->coarse_cache;
+  const int err = dt_dev_pixelpipe_process(pipe, dev, x/factor, y/factor,
+                                           MAX(1, width/factor), MAX(1, height/factor), scale/factor);
+  pipe->coarse_cache = pipe->cache;
+  pipe->cache = cache;
+  if(err) return err;
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  pipe->backbuf_coarse = factor;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  return 0;
+}
+
+int dt_dev_pixelpipe_is_roi_independent(dt_dev_pixelpipe_t *pipe)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && piece->process_roi_dependent) return 0;
+  }
+  return 1;
+}
+
+int dt_dev_pixelpipe_roi_margin(dt_dev_pixelpipe_t *pipe, int width, int height, float scale)
+{
+  const dt_iop_roi_t roi = (dt_iop_roi_t)
+  {
+    0, 0, width, height, scale
+  };
+  float margin = 0.0f;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    // the overlap the module asks for when it is tiled itself, a border it can't get right otherwise:
+    dt_develop_tiling_t tiling = { 0 };
+    piece->module->tiling_callback(piece->module, piece, &roi, &roi, &tiling);
+    margin += tiling.overlap;
+    const dt_develop_blend_params_t *d = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(d && d->mask_mode != DEVELOP_MASK_DISABLED && fabsf(d->radius) > 0.1f)
+      margin += ceilf(4.0f * fabsf(d->radius) * scale / piece->iscale);
+  }
+  // modules before demosaic count full resolution pixels, which are bigger than ours only when zoomed in.
+  return ceilf(margin * fmaxf(1.0f, scale));
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  dt_dev_pixelpipe_cache_flush(&pipe->coarse_cache);
+  dt_dev_pixelpipe_tiles_flush(&pipe->tiles);
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in, int height_in, int *width, int *height)
@@ -55,6 +55,8 @@ typedef struct dt_dev_pixelpipe_iop_t
   int colors;                      // how many colors per pixel
   dt_iop_roi_t buf_in, buf_out;    // theoretical full buffer regions of interest, as passed through modify_roi_out
   int process_cl_ready;            // set this to 0 in commit_params to temporarily disable the use of process_cl
+  int process_roi_dependent;       // set this to 1 in commit_params if the output depends on statistics over the whole roi,
+                                   // or on neighbours further away than the overlap of tiling_callback
   float processed_maximum[3];      // sensor saturation after this iop, used internally for caching
 }
 dt_dev_pixelpipe_iop_t;
@@ -81,6 +83,10 @@ typedef struct dt_dev_pixelpipe_t
   dt_dev_pixelpipe_cache_t cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
+  // output tiles, for dt_dev_pixelpipe_process_tiled()
+  dt_dev_pixelpipe_tiles_t tiles;
+  // separate cache lines for dt_dev_pixelpipe_process_coarse()
+  dt_dev_pixelpipe_cache_t coarse_cache;
   // input buffer
   float *input;
   // width and height of input buffer
@@ -102,6 +108,8 @@ typedef struct dt_dev_pixelpipe_t
   size_t backbuf_size;
   int backbuf_width, backbuf_height;
   uint64_t backbuf_hash;
+  // != 0 if the backbuf holds the region at only 1/backbuf_coarse of the resolution
+  int backbuf_coarse;
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
   // working?
   int processing;
@@ -166,9 +174,20 @@ void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale);
+// same, but the output is put together from tiles, and only those which aren't cached go through the pipe.
+int dt_dev_pixelpipe_process_tiled(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale);
+// same region, but only at 1/factor of the resolution, for a quick first look. leaves the caches of the other two alone.
+int dt_dev_pixelpipe_process_coarse(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale, int factor);
 // convenience method that does not gamma-compress the image.
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale);
 
+// returns 1 if the output can be put together from separately processed regions, i.e. no enabled module
+// computes statistics over its whole roi. each region still has to be grown by dt_dev_pixelpipe_roi_margin().
+int dt_dev_pixelpipe_is_roi_independent(dt_dev_pixelpipe_t *pipe);
+// pixels of output a region has to be grown by on each side, so its inner part comes out the same as if the
+// whole image went through the pipe: the neighbourhoods of all enabled modules and their mask blurs add up.
+int dt_dev_pixelpipe_roi_margin(dt_dev_pixelpipe_t *pipe, int width, int height, float scale);
+
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
 // disable given op and all that comes before it in the pipe:
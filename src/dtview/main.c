@@ -253,6 +253,7 @@ process_next_image()
   buf.levels = levels;
   buf.bpp = bpp;
   buf.write_image = write_image;
+  buf.write_image_begin = NULL;
   dat.max_width  = width;
   dat.max_height = height;
   dat.style[0] = '\0';
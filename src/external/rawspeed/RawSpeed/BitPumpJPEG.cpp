@@ -29,31 +29,41 @@ namespace RawSpeed {
 
 
 BitPumpJPEG::BitPumpJPEG(ByteStream *s):
-    buffer(s->getData()), size(s->getRemainSize() + sizeof(uint32)), mLeft(0), off(0), stuffed(0) {
+    buffer(s->getData()), mCurr(0), size(s->getRemainSize() + sizeof(uint32)), mLeft(0), off(0), stuffed(0) {
   init();
 }
 
 BitPumpJPEG::BitPumpJPEG(const uchar8* _buffer, uint32 _size) :
-    buffer(_buffer), size(_size + sizeof(uint32)), mLeft(0), off(0), stuffed(0) {
+    buffer(_buffer), mCurr(0), size(_size + sizeof(uint32)), mLeft(0), off(0), stuffed(0) {
   init();
 }
 
 __inline void BitPumpJPEG::init() {
-  memset(current_buffer,0,16);
   fill();
 }
 
 void BitPumpJPEG::_fill()
 {
-  // Fill in 96 bits
-  int* b = (int*)current_buffer;
-  if ((off + 12) >= size) {
-    while(mLeft <= 64 && off < size) {
-      for (int i = (mLeft>>3); i >= 0; i--)
-        current_buffer[i+1] = current_buffer[i];
-      uchar8 val = buffer[off++];
+  // Top up to between 56 and 63 bits, so mLeft never reaches 64.
+  if (off + 8 <= size) {
+    uint64 v = get8BE(&buffer[off]);
+    uint64 ff = ~v;
+    // No 0xff byte in the next eight, so there is neither stuffing nor a
+    // marker to handle and all the bytes can be shifted in at once.
+    if (!((ff - 0x0101010101010101ULL) & ~ff & 0x8080808080808080ULL)) {
+      uint32 n = (63 - mLeft) >> 3;
+      mCurr = (mCurr << (n*8)) | (v >> (64 - n*8));
+      off += n;
+      mLeft += n*8;
+      return;
+    }
+  }
+  while (mLeft <= 55) {
+    uchar8 val = 0;
+    if (off < size) {
+      val = buffer[off++];
       if (val == 0xff) {
-        if (buffer[off] == 0)
+        if (off < size && buffer[off] == 0)
           off++;
         else {
           // We hit another marker - don't forward bitpump anymore
@@ -62,33 +72,12 @@ void BitPumpJPEG::_fill()
           stuffed++;
         }
       }
-      current_buffer[0] = val;
-      mLeft+=8;
-    }
-    while (mLeft < 64) {
-      b[2] = b[1];
-      b[1] = b[0];
-      b[0] = 0;
-      mLeft +=32;
-      stuffed +=4;  //We are adding to mLeft without incrementing offset
-    }
-    return;
-  }
-  b[3] = b[0];
-  for (int i = 0; i < 12; i++) {
-    uchar8 val = buffer[off++];
-    if (val == 0xff) {
-      if (buffer[off] == 0)
-        off++;
-      else {
-        val = 0;
-        off--;
-        stuffed++;
-      }
+    } else {
+      stuffed++;  //We are adding to mLeft without incrementing offset
     }
-    current_buffer[11-i] = val;
+    mCurr = (mCurr << 8) | val;
+    mLeft += 8;
   }
-  mLeft+=96;
 }
 
 
@@ -120,6 +109,7 @@ void BitPumpJPEG::setAbsoluteOffset(unsigned int offset) {
     throw IOException("Offset set out of buffer");
 
   mLeft = 0;
+  mCurr = 0;
   off = offset;
   _fill();
 }
@@ -43,22 +43,18 @@ public:
   __inline uint32 getOffset() { return off-(mLeft>>3)+stuffed;}
   __inline void checkPos()  { if (off>=size || stuffed > (mLeft>>3)) ThrowIOE("Out of buffer read");};        // Check if we have a valid position
 
-  // Fill the buffer with at least 24 bits
-  void fill() {if (mLeft<25) _fill();}
+  // Fill the buffer with at least 32 bits
+  void fill() {if (mLeft<32) _fill();}
  __inline uint32 peekBitsNoFill( uint32 nbits )
  {
-   int shift = mLeft-nbits;
-   uint32 ret = *(uint32*)&current_buffer[shift>>3];
-   ret >>= shift & 7;
-   return ret & ((1 << nbits) - 1);
+   return (uint32)((mCurr >> (mLeft-nbits)) & ((1ULL << nbits) - 1));
  }
 
 
 __inline uint32 getBit() {
   if (!mLeft) _fill();
   mLeft--;
-  uint32 _byte = mLeft >> 3;
-  return (current_buffer[_byte] >> (mLeft & 0x7)) & 1;
+  return (uint32)(mCurr >> mLeft) & 1;
 }
 
 __inline uint32 getBitsNoFill(uint32 nbits) {
@@ -73,19 +69,15 @@ __inline uint32 getBits(uint32 nbits) {
 
 __inline uint32 peekBit() {
   if (!mLeft) _fill();
-  return (current_buffer[(mLeft-1) >> 3] >> ((mLeft-1) & 0x7)) & 1;
+  return (uint32)(mCurr >> (mLeft-1)) & 1;
 }
 __inline uint32 getBitNoFill() {
   mLeft--;
-  uint32 ret = (current_buffer[mLeft >> 3] >> (mLeft & 0x7)) & 1;
-  return ret;
+  return (uint32)(mCurr >> mLeft) & 1;
 }
 
 __inline uint32 peekByteNoFill() {
-  int shift = mLeft-8;
-  uint32 ret = *(uint32*)&current_buffer[shift>>3];
-  ret >>= shift & 7;
-  return ret & 0xff;
+  return (uint32)(mCurr >> (mLeft-8)) & 0xff;
 }
 
 __inline uint32 peekBits(uint32 nbits) {
@@ -119,10 +111,7 @@ __inline uint32 peekByte() {
   __inline unsigned char getByte() {
     fill();
     mLeft-=8;
-    int shift = mLeft;
-    uint32 ret = *(uint32*)&current_buffer[shift>>3];
-    ret >>= shift & 7;
-    return ret & 0xff;
+    return (uint32)(mCurr >> mLeft) & 0xff;
   }
 
   virtual ~BitPumpJPEG(void);
@@ -130,7 +119,7 @@ protected:
   void __inline init();
   void _fill();
   const uchar8* buffer;
-  uchar8 current_buffer[16];
+  uint64 mCurr;                // Bit cache, the lowest mLeft bits are valid
   const uint32 size;            // This if the end of buffer.
   uint32 mLeft;
   uint32 off;                  // Offset in bytes
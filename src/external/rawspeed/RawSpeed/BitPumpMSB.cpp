@@ -30,60 +30,41 @@ namespace RawSpeed {
 
 BitPumpMSB::BitPumpMSB(ByteStream *s):
     buffer(s->getData()), size(s->getRemainSize() + sizeof(uint32)), mLeft(0), off(0) {
+  mCurr = 0;
   init();
 }
 
 BitPumpMSB::BitPumpMSB(const uchar8* _buffer, uint32 _size) :
     buffer(_buffer), size(_size + sizeof(uint32)), mLeft(0), off(0) {
+  mCurr = 0;
   init();
 }
 
 __inline void BitPumpMSB::init() {
   mStuffed = 0;
-  memset(current_buffer,0,16);
   fill();
 }
 
 void BitPumpMSB::_fill()
 {
-  // Fill in 96 bits
-  int* b = (int*)current_buffer;
-  if ((off + 12) > size) {
-    while(mLeft <= 64 && off < size) {
-      for (int i = (mLeft>>3); i >= 0; i--)
-        current_buffer[i+1] = current_buffer[i];
-      current_buffer[0] = buffer[off++];
-      mLeft+=8;
-    }
-    while (mLeft <= 64) {
-      b[3] = b[2];
-      b[2] = b[1];
-      b[1] = b[0];
-      b[0] = 0;
-      mLeft +=32;
-      mStuffed += 4;
-    }
+  // Top up to between 56 and 63 bits, so mLeft never reaches 64.
+  if (off + 8 <= size) {
+    uint32 n = (63 - mLeft) >> 3;
+    mCurr = (mCurr << (n*8)) | (get8BE(&buffer[off]) >> (64 - n*8));
+    off += n;
+    mLeft += n*8;
     return;
   }
-  b[3] = b[0];
-#if defined(LE_PLATFORM_HAS_BSWAP)
-  int* buf = (int*)&buffer[off];
-  b[2] = PLATFORM_BSWAP32(buf[0]);
-  b[1] = PLATFORM_BSWAP32(buf[1]);
-  b[0] = PLATFORM_BSWAP32(buf[2]);
-  off+=12;
-#else
-  b[2] = (buffer[off] << 24) | (buffer[off+1] << 16)  | (buffer[off+2] << 8) | buffer[off+3];
-  off+=4;
-  b[1] = (buffer[off] << 24) | (buffer[off+1] << 16)  | (buffer[off+2] << 8) | buffer[off+3];
-  off+=4;
-  b[0] = (buffer[off] << 24) | (buffer[off+1] << 16)  | (buffer[off+2] << 8) | buffer[off+3];
-  off+=4;
-#endif
-  mLeft+=96;
+  while (mLeft <= 55) {
+    mCurr <<= 8;
+    if (off < size)
+      mCurr |= buffer[off++];
+    else
+      mStuffed++;
+    mLeft += 8;
+  }
 }
 
-
 uint32 BitPumpMSB::getBitSafe() {
   fill();
   checkPos();
@@ -112,6 +93,7 @@ void BitPumpMSB::setAbsoluteOffset(unsigned int offset) {
     ThrowIOE("Offset set out of buffer");
 
   mLeft = 0;
+  mCurr = 0;
   mStuffed = 0;
   off = offset;
   fill();
@@ -152,6 +152,12 @@ inline uint32 clampbits(int x, uint32 n) {
   return x;
 }
 
+/* Big endian 64 bit load, compilers turn this into a single load and bswap */
+inline uint64 get8BE(const uchar8* p) {
+  return ((uint64)p[0] << 56) | ((uint64)p[1] << 48) | ((uint64)p[2] << 40) | ((uint64)p[3] << 32) |
+         ((uint64)p[4] << 24) | ((uint64)p[5] << 16) | ((uint64)p[6] << 8) | (uint64)p[7];
+}
+
 /* This is faster - at least when compiled on visual studio 32 bits */
 inline int other_abs(int x) { int const mask = x >> 31; return (x + mask) ^ mask;}
 
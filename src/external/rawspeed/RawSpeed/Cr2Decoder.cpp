@@ -29,6 +29,8 @@ namespace RawSpeed {
 Cr2Decoder::Cr2Decoder(TiffIFD *rootIFD, FileMap* file) :
     RawDecoder(file), mRootIFD(rootIFD) {
   decoderVersion = 4;
+  mFlipDims = false;
+  mFirstSliceFailed = false;
 }
 
 Cr2Decoder::~Cr2Decoder(void) {
@@ -113,29 +115,33 @@ RawImage Cr2Decoder::decodeRawInternal() {
   } else {
     s_width.push_back(slices[0].w);
   }
-  uint32 offY = 0;
-
   if (s_width.size() > 15)
     ThrowRDE("CR2 Decoder: No more than 15 slices supported");
   _RPT1(0,"Org slices:%d\n", s_width.size());
+
+  mSlices = slices;
+  mSliceWidths = s_width;
+  mFlipDims = flipDims;
+  mSliceOffY.clear();
+  uint32 offY = 0;
   for (uint32 i = 0; i < slices.size(); i++) {
-    Cr2Slice slice = slices[i];
+    mSliceOffY.push_back(offY);
+    offY += slices[i].w;
+  }
+
+  if (slices.size() == 1) {
     try {
-      LJpegPlain l(mFile, mRaw);
-      l.addSlices(s_width);
-      l.mUseBigtable = true;
-      l.mCanonFlipDim = flipDims;
-      l.startDecoder(slice.offset, slice.count, 0, offY);
-    } catch (RawDecoderException &e) {
-      if (i == 0)
-        throw;
-      // These may just be single slice error - store the error and move on
-      mRaw->setError(e.what());
+      decodeSlice(0);
     } catch (IOException &e) {
       // Let's try to ignore this - it might be truncated data, so something might be useful.
       mRaw->setError(e.what());
     }
-    offY += slice.w;
+  } else {
+    // Every strip is an independent lossless JPEG stream, decode them in parallel.
+    mFirstSliceFailed = false;
+    startTasks(slices.size());
+    if (mFirstSliceFailed)
+      ThrowRDE("CR2 Decoder: Unable to decode first slice: %s", mRaw->errors.empty() ? "" : mRaw->errors[0]);
   }
 
   if (mRaw->subsampling.x > 1 || mRaw->subsampling.y > 1)
@@ -144,6 +150,29 @@ RawImage Cr2Decoder::decodeRawInternal() {
   return mRaw;
 }
 
+void Cr2Decoder::decodeSlice(uint32 i) {
+  Cr2Slice slice = mSlices[i];
+  LJpegPlain l(mFile, mRaw);
+  l.addSlices(mSliceWidths);
+  l.mUseBigtable = true;
+  l.mCanonFlipDim = mFlipDims;
+  l.startDecoder(slice.offset, slice.count, 0, mSliceOffY[i]);
+}
+
+void Cr2Decoder::decodeThreaded(RawDecoderThread* t) {
+  try {
+    decodeSlice(t->taskNo);
+  } catch (RawDecoderException &e) {
+    // Errors in later slices may just be single slice errors - store the error and move on
+    if (t->taskNo == 0)
+      mFirstSliceFailed = true;
+    mRaw->setError(e.what());
+  } catch (IOException &e) {
+    // Let's try to ignore this - it might be truncated data, so something might be useful.
+    mRaw->setError(e.what());
+  }
+}
+
 void Cr2Decoder::checkSupportInternal(CameraMetaData *meta) {
   vector<TiffIFD*> data = mRootIFD->getIFDsWithTag(MODEL);
   if (data.empty())
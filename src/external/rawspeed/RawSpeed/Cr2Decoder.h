@@ -28,6 +28,16 @@
 
 namespace RawSpeed {
 
+class Cr2Slice {
+public:
+  Cr2Slice() { w = h = offset = count = 0;};
+  ~Cr2Slice() {};
+  uint32 w;
+  uint32 h;
+  uint32 offset;
+  uint32 count;
+};
+
 class Cr2Decoder :
   public RawDecoder
 {
@@ -37,10 +47,13 @@ public:
   virtual void checkSupportInternal(CameraMetaData *meta);
   virtual void decodeMetaDataInternal(CameraMetaData *meta);
   virtual TiffIFD* getRootIFD() {return mRootIFD;}
+  virtual void decodeThreaded(RawDecoderThread* t);
   virtual ~Cr2Decoder(void);
 protected:
   int sraw_coeffs[3];
 
+  void decodeSlice(uint32 i);
+
   void sRawInterpolate();
   int getHue();
   void interpolate_420(int w, int h, int start_h , int end_h);
@@ -49,16 +62,11 @@ protected:
   void interpolate_420_new(int w, int h, int start_h , int end_h);
   void interpolate_422_new(int w, int h, int start_h , int end_h);
   TiffIFD *mRootIFD;
-};
-
-class Cr2Slice {
-public:
-  Cr2Slice() { w = h = offset = count = 0;};
-  ~Cr2Slice() {};
-  uint32 w;
-  uint32 h;
-  uint32 offset;
-  uint32 count;
+  vector<Cr2Slice> mSlices;
+  vector<int> mSliceWidths;
+  vector<uint32> mSliceOffY;
+  bool mFlipDims;
+  bool mFirstSliceFailed;
 };
 
 } // namespace RawSpeed
@@ -29,17 +29,20 @@ namespace RawSpeed {
 #endif
 #define CHECKSIZE(A) if (A > size) ThrowIOE("Error decoding DNG Slice (invalid size). File Corrupt")
 
-void *DecodeThread(void *_this) {
-  DngDecoderThread* me = (DngDecoderThread*)_this;
-  DngDecoderSlices* parent = me->parent;
-  try {
-    parent->decodeSlice(me);
-  } catch (...) {
-    parent->mRaw->setError("DNGDEcodeThread: Caught exception.");
+/* Decodes one DngDecoderThread worth of slices per pool task */
+class DngSliceJob : public ThreadPoolJob
+{
+public:
+  DngSliceJob(DngDecoderSlices* _parent) : parent(_parent) {};
+  virtual void runTask(uint32 task) {
+    try {
+      parent->decodeSlice(parent->threads[task]);
+    } catch (...) {
+      parent->mRaw->setError("DNGDEcodeThread: Caught exception.");
+    }
   }
-  pthread_exit(NULL);
-  return NULL;
-}
+  DngDecoderSlices* parent;
+};
 
 
 DngDecoderSlices::DngDecoderSlices(FileMap* file, RawImage img, int _compression) :
@@ -56,36 +59,22 @@ void DngDecoderSlices::addSlice(DngSliceElement slice) {
 }
 
 void DngDecoderSlices::startDecoding() {
-  // Create threads
-
-  nThreads = getThreadCount();
-  int slicesPerThread = ((int)slices.size() + nThreads - 1) / nThreads;
-//  decodedSlices = 0;
-  pthread_attr_t attr;
-  /* Initialize and set thread detached attribute */
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
-  for (uint32 i = 0; i < nThreads; i++) {
+  // One task per slice, the shared pool balances them across its threads.
+  nThreads = (uint32)slices.size();
+  while (!slices.empty()) {
     DngDecoderThread* t = new DngDecoderThread();
-    for (int j = 0; j < slicesPerThread ; j++) {
-      if (!slices.empty()) {
-        t->slices.push(slices.front());
-        slices.pop();
-      }
-    }
+    t->slices.push(slices.front());
+    slices.pop();
     t->parent = this;
-    pthread_create(&t->threadid, &attr, DecodeThread, t);
     threads.push_back(t);
   }
-  pthread_attr_destroy(&attr);
 
-  void *status;
-  for (uint32 i = 0; i < nThreads; i++) {
-    pthread_join(threads[i]->threadid, &status);
-    delete(threads[i]);
-  }
+  DngSliceJob job(this);
+  ThreadPool::getInstance()->runTasks(&job, nThreads);
 
+  for (uint32 i = 0; i < nThreads; i++)
+    delete(threads[i]);
+  threads.clear();
 }
 
 #if JPEG_LIB_VERSION < 80
@@ -87,6 +87,7 @@ LJpegDecompressor::LJpegDecompressor(FileMap* file, RawImage img):
   for (int i = 0; i < 4; i++) {
     huff[i].initialized = false;
     huff[i].bigTable = 0;
+    huff[i].bigTableBits = 0;
   }
   mDNGCompatible = false;
   slicesW.clear();
@@ -444,8 +445,7 @@ void LJpegDecompressor::createHuffmanTable(HuffmanTable *htbl) {
       }
     }
   }
-  if (mUseBigtable)
-    createBigTable(htbl);
+  createBigTable(htbl);
   htbl->initialized = true;
 }
 
@@ -454,26 +454,32 @@ void LJpegDecompressor::createHuffmanTable(HuffmanTable *htbl) {
  *
  * This is expanding the concept of fast lookups
  *
- * A complete table for 14 arbitrary bits will be
+ * A complete table for 12 or 14 arbitrary bits will be
  * created that enables fast lookup of number of bits used,
  * and final delta result.
  * Hit rate is about 90-99% for typical LJPEGS, usually about 98%
+ * for 14 bits. Small images use 12 bits, which is quicker to build.
  *
  ************************************/
 
 void LJpegDecompressor::createBigTable(HuffmanTable *htbl) {
-  const uint32 bits = 14;      // HuffDecode functions must be changed, if this is modified.
+  const uint32 bits = mUseBigtable ? 14 : 12;
   const uint32 size = 1 << bits;
   int rv = 0;
   int temp;
   uint32 l;
 
+  if (htbl->bigTable && htbl->bigTableBits != bits) {
+    _aligned_free(htbl->bigTable);
+    htbl->bigTable = 0;
+  }
   if (!htbl->bigTable)
     htbl->bigTable = (int*)_aligned_malloc(size * sizeof(int), 16);
   if (!htbl->bigTable)
 	ThrowRDE("Out of memory, failed to allocate %d bytes", size*sizeof(int));
+  htbl->bigTableBits = bits;
   for (uint32 i = 0; i < size; i++) {
-    ushort16 input = i << 2; // Calculate input value
+    ushort16 input = i << (16 - bits); // Calculate input value
     int code = input >> 8;   // Get 8 bits
     uint32 val = htbl->numbits[code];
     l = val & 15;
@@ -491,7 +497,7 @@ void LJpegDecompressor::createBigTable(HuffmanTable *htbl) {
       * With garbage input we may reach the sentinel value l = 17.
       */
 
-      if (l > frame.prec || htbl->valptr[l] == 0xff) {
+      if (l > bits || l > frame.prec || htbl->valptr[l] == 0xff) {
         htbl->bigTable[i] = 0xff;
         continue;
       } else {
@@ -529,10 +535,11 @@ void LJpegDecompressor::createBigTable(HuffmanTable *htbl) {
 /*
 *--------------------------------------------------------------
 *
-* HuffDecode --
+* HuffDecodeSlow --
 *
 * Taken from Figure F.16: extract next coded symbol from
-* input stream.  This should becode a macro.
+* input stream. Only used for codes that HuffDecode
+* could not look up in the big table.
 *
 * Results:
 * Next coded symbol
@@ -542,31 +549,22 @@ void LJpegDecompressor::createBigTable(HuffmanTable *htbl) {
 *
 *--------------------------------------------------------------
 */
-int LJpegDecompressor::HuffDecode(HuffmanTable *htbl) {
+int LJpegDecompressor::HuffDecodeSlow(HuffmanTable *htbl) {
   int rv;
   int temp;
   int code, val;
   uint32 l;
-  /**
-   * First attempt to do complete decode, by using the first 14 bits
-   */
-
-  bits->fill();
-  code = bits->peekBitsNoFill(14);
-  if (htbl->bigTable) {
-    val = htbl->bigTable[code];
-    if ((val&0xff) !=  0xff) {
-      bits->skipBitsNoFill(val&0xff);
-      return val >> 8;
-    }
-  }
+
+  // HuffDecode has filled the pump, so at least 32 bits are available,
+  // enough for a 16 bit code and a 16 bit difference.
+  code = bits->peekByteNoFill();
+
   /*
   * If the huffman code is less than 8 bits, we can use the fast
   * table lookup to get its value.  It's more than 8 bits about
   * 3-4% of the time.
   */
   rv = 0;
-  code = code>>6;
   val = htbl->numbits[code];
   l = val & 15;
   if (l) {
@@ -599,13 +597,8 @@ int LJpegDecompressor::HuffDecode(HuffmanTable *htbl) {
     return -32768;
   }
 
-  // Ensure we have enough bits
-  if ((rv + l) > 24) {
-    if (rv > 16) // There is no values above 16 bits.
-      ThrowRDE("Corrupt JPEG data: Too many bits requested.");
-    else
-      bits->fill();
-  }
+  if (rv > 16) // There is no values above 16 bits.
+    ThrowRDE("Corrupt JPEG data: Too many bits requested.");
 
   /*
   * Section F.2.2.1: decode the difference and
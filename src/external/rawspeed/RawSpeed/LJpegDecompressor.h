@@ -146,7 +146,8 @@ struct HuffmanTable {
   int maxcode[18];
   short valptr[17];
   uint32 numbits[256];
-  int* bigTable;
+  int* bigTable;         // (diff << 8) | bits used, 0xff if the code doesn't fit
+  uint32 bigTableBits;   // Number of bits bigTable is indexed with
   bool initialized;
 };
 
@@ -170,7 +171,7 @@ public:
   virtual void startDecoder(uint32 offset, uint32 size, uint32 offsetX, uint32 offsetY);
   virtual void getSOF(SOFInfo* i, uint32 offset, uint32 size);
   bool mDNGCompatible;  // DNG v1.0.x compatibility
-  bool mUseBigtable;    // Use only for large images
+  bool mUseBigtable;    // Use a 14 bit lookup table instead of 12 bits, for large images
   bool mCanonFlipDim;   // Fix Canon 6D mRaw where width/height is flipped
   virtual void addSlices(vector<int> slices) {slicesW=slices;};  // CR2 slices.
 protected:
@@ -181,7 +182,8 @@ protected:
   virtual void decodeScan() {ThrowRDE("LJpegDecompressor: No Scan decoder found");};
   JpegMarker getNextMarker(bool allowskip);
   void parseDHT();
-  int HuffDecode(HuffmanTable *htbl);
+  __inline int HuffDecode(HuffmanTable *htbl);
+  int HuffDecodeSlow(HuffmanTable *htbl);
   ByteStream* input;
   BitPumpJPEG* bits;
   FileMap *mFile;
@@ -196,6 +198,20 @@ protected:
   HuffmanTable huff[4]; 
 };
 
+/*
+ * Decode one symbol and its difference with a single table lookup.
+ * Codes that don't fit in the table take the bit by bit path.
+ */
+__inline int LJpegDecompressor::HuffDecode(HuffmanTable *htbl) {
+  bits->fill();
+  int val = htbl->bigTable[bits->peekBitsNoFill(htbl->bigTableBits)];
+  if ((val&0xff) != 0xff) {
+    bits->skipBitsNoFill(val&0xff);
+    return val >> 8;
+  }
+  return HuffDecodeSlow(htbl);
+}
+
 } // namespace RawSpeed
 
 #endif
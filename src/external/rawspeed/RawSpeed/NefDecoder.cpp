@@ -206,31 +206,48 @@ void NefDecoder::DecodeUncompressed() {
   if (msb_hint != hints.end())
     bitorder = (0 == (msb_hint->second).compare("true"));
 
+  mSlices = slices;
+  mSliceOffY.clear();
   offY = 0;
   for (uint32 i = 0; i < slices.size(); i++) {
-    NefSlice slice = slices[i];
-    ByteStream in(mFile->getData(slice.offset), slice.count);
-    iPoint2D size(width, slice.h);
-    iPoint2D pos(0, offY);
-    try {
-      if (hints.find(string("coolpixmangled")) != hints.end())
-        readCoolpixMangledRaw(in, size, pos, width*bitPerPixel / 8);
-      else if (hints.find(string("coolpixsplit")) != hints.end())
-        readCoolpixSplitRaw(in, size, pos, width*bitPerPixel / 8);
-      else
-        readUncompressedRaw(in, size, pos, width*bitPerPixel / 8, bitPerPixel, bitorder ? BitOrder_Jpeg : BitOrder_Plain);
-    } catch (RawDecoderException e) {
-      if (i>0)
-        mRaw->setError(e.what());
-      else
-        throw;
-    } catch (IOException e) {
-      if (i>0)
-        mRaw->setError(e.what());
-      else
-        ThrowRDE("NEF decoder: IO error occurred in first slice, unable to decode more. Error is: %s", e.what());
-    }
-    offY += slice.h;
+    mSliceOffY.push_back(offY);
+    offY += slices[i].h;
+  }
+  mSliceWidth = width;
+  mBitPerPixel = bitPerPixel;
+  mBitorder = bitorder;
+  mFirstSliceError.clear();
+
+  // Strips are independent, unpack them in parallel.
+  startTasks(slices.size());
+  if (!mFirstSliceError.empty())
+    ThrowRDE("%s", mFirstSliceError.c_str());
+}
+
+void NefDecoder::decodeThreaded(RawDecoderThread* t) {
+  uint32 i = t->taskNo;
+  NefSlice slice = mSlices[i];
+  uint32 width = mSliceWidth;
+  ByteStream in(mFile->getData(slice.offset), slice.count);
+  iPoint2D size(width, slice.h);
+  iPoint2D pos(0, mSliceOffY[i]);
+  try {
+    if (hints.find(string("coolpixmangled")) != hints.end())
+      readCoolpixMangledRaw(in, size, pos, width*mBitPerPixel / 8);
+    else if (hints.find(string("coolpixsplit")) != hints.end())
+      readCoolpixSplitRaw(in, size, pos, width*mBitPerPixel / 8);
+    else
+      readUncompressedRaw(in, size, pos, width*mBitPerPixel / 8, mBitPerPixel, mBitorder ? BitOrder_Jpeg : BitOrder_Plain);
+  } catch (RawDecoderException e) {
+    if (i>0)
+      mRaw->setError(e.what());
+    else
+      mFirstSliceError = e.what();
+  } catch (IOException e) {
+    if (i>0)
+      mRaw->setError(e.what());
+    else
+      mFirstSliceError = string("NEF decoder: IO error occurred in first slice, unable to decode more. Error is: ") + e.what();
   }
 }
 
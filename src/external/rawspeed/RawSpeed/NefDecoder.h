@@ -31,6 +31,15 @@
 
 namespace RawSpeed {
 
+class NefSlice {
+public:
+  NefSlice() { h = offset = count = 0;};
+  ~NefSlice() {};
+  uint32 h;
+  uint32 offset;
+  uint32 count;
+};
+
 class NefDecoder :
   public RawDecoder
 {
@@ -42,6 +51,7 @@ public:
   virtual void checkSupportInternal(CameraMetaData *meta);
   TiffIFD *mRootIFD;
   virtual TiffIFD* getRootIFD() {return mRootIFD;}
+  virtual void decodeThreaded(RawDecoderThread* t);
 private:
   bool D100IsCompressed(uint32 offset);
   void DecodeUncompressed();
@@ -50,15 +60,13 @@ private:
   void readCoolpixSplitRaw(ByteStream &input, iPoint2D& size, iPoint2D& offset, int inputPitch);
   TiffIFD* FindBestImage(vector<TiffIFD*>* data);
   string getMode();
-};
-
-class NefSlice {
-public:
-  NefSlice() { h = offset = count = 0;};
-  ~NefSlice() {};
-  uint32 h;
-  uint32 offset;
-  uint32 count;
+  /* State shared by the threads unpacking uncompressed strips */
+  vector<NefSlice> mSlices;
+  vector<uint32> mSliceOffY;
+  uint32 mSliceWidth;
+  uint32 mBitPerPixel;
+  bool mBitorder;
+  string mFirstSliceError;
 };
 
 } // namespace RawSpeed
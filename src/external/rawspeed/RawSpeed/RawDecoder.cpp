@@ -538,20 +538,24 @@ void RawDecoder::setMetaData(CameraMetaData *meta, string make, string model, st
 void *RawDecoderDecodeThread(void *_this) {
   RawDecoderThread* me = (RawDecoderThread*)_this;
   try {
-    if (me->taskNo >= 0)
-      me->parent->decodeThreaded(me);
-    else
-      me->parent->decodeThreaded(me);
+    me->parent->decodeThreaded(me);
   } catch (RawDecoderException &ex) {
     me->parent->mRaw->setError(ex.what());
   } catch (IOException &ex) {
     me->parent->mRaw->setError(ex.what());
   }
-
-  pthread_exit(NULL);
   return 0;
 }
 
+/* Runs RawDecoder::decodeThreaded() on the shared thread pool, one task per RawDecoderThread */
+class RawDecoderJob : public ThreadPoolJob
+{
+public:
+  RawDecoderJob(RawDecoderThread* _t) : t(_t) {};
+  virtual void runTask(uint32 task) {RawDecoderDecodeThread(&t[task]);}
+  RawDecoderThread* t;
+};
+
 void RawDecoder::startThreads() {
   uint32 threads;
   threads = getThreadCount(); 
@@ -559,27 +563,20 @@ void RawDecoder::startThreads() {
   int y_per_thread = (mRaw->dim.y + threads - 1) / threads;
   RawDecoderThread *t = new RawDecoderThread[threads];
 
-  /* Initialize and set thread detached attribute */
-  pthread_attr_t attr;
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
   for (uint32 i = 0; i < threads; i++) {
     t[i].start_y = y_offset;
     t[i].end_y = MIN(y_offset + y_per_thread, mRaw->dim.y);
     t[i].parent = this;
-    pthread_create(&t[i].threadid, &attr, RawDecoderDecodeThread, &t[i]);
+    t[i].taskNo = i;
     y_offset = t[i].end_y;
   }
 
-  void *status;
-  for (uint32 i = 0; i < threads; i++) {
-    pthread_join(t[i].threadid, &status);
-  }
+  RawDecoderJob job(t);
+  ThreadPool::getInstance()->runTasks(&job, threads);
+  delete[] t;
+
   if (mRaw->errors.size() >= threads)
     ThrowRDE("RawDecoder::startThreads: All threads reported errors. Cannot load image.");
-
-  delete[] t;
 }
 
 void RawDecoder::decodeThreaded(RawDecoderThread * t) {
@@ -631,43 +628,18 @@ void RawDecoder::checkSupport(CameraMetaData *meta)
 
 void RawDecoder::startTasks( uint32 tasks )
 {
-  uint32 threads;
-  threads = min(tasks, getThreadCount()); 
-  int ctask = 0;
-  RawDecoderThread *t = new RawDecoderThread[threads];
-
-  if (threads == 1) {
-    t[0].parent = this;
-    while ((uint32)ctask < tasks) {
-      t[0].taskNo = ctask++;
-      RawDecoderDecodeThread(t);
-    }
-    delete[] t;
-    return;
+  RawDecoderThread *t = new RawDecoderThread[tasks];
+  for (uint32 i = 0; i < tasks; i++) {
+    t[i].taskNo = i;
+    t[i].parent = this;
   }
-  pthread_attr_t attr;
-
-  /* Initialize and set thread detached attribute */
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-  /* TODO: Create a way to re-use threads */
-  void *status;
-  while ((uint32)ctask < tasks) {
-    for (uint32 i = 0; i < threads && (uint32)ctask < tasks; i++) {
-      t[i].taskNo = ctask++;
-      t[i].parent = this;
-      pthread_create(&t[i].threadid, &attr, RawDecoderDecodeThread, &t[i]);
-    }
-    for (uint32 i = 0; i < threads; i++) {
-      pthread_join(t[i].threadid, &status);
-    }
-  } 
+  RawDecoderJob job(t);
+  ThreadPool::getInstance()->runTasks(&job, tasks);
+  delete[] t;
 
   if (mRaw->errors.size() >= tasks)
     ThrowRDE("RawDecoder::startThreads: All threads reported errors. Cannot load image.");
-
-  delete[] t;
 }
 
 } // namespace RawSpeed
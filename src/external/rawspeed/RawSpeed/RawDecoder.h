@@ -3,6 +3,7 @@
 
 #include "RawDecoderException.h"
 #include "FileMap.h"
+#include "ThreadPool.h"
 #include "BitPumpJPEG.h" // Includes bytestream
 #include "RawImage.h"
 #include "BitPumpMSB.h"
@@ -46,7 +47,6 @@ class RawDecoderThread
     uint32 start_y;
     uint32 end_y;
     const char* error;
-    pthread_t threadid;
     RawDecoder* parent;
     uint32 taskNo;
 };
@@ -135,13 +135,13 @@ protected:
   virtual void decodeMetaDataInternal(CameraMetaData *meta) = 0;
   virtual void checkSupportInternal(CameraMetaData *meta) = 0;
 
-  /* Helper function for decoders - splits the image vertically and starts of decoder threads */
-  /* The function returns when all threads are done */
+  /* Helper function for decoders - splits the image vertically and runs the parts on the shared thread pool */
+  /* The function returns when all parts are done */
   /* All errors are silently pushed into the "errors" array.*/
   /* If all threads report an error an exception will be thrown*/
   void startThreads();
 
-  /* Helper function for decoders -  */
+  /* Helper function for decoders - runs decodeThreaded() with taskNo 0..tasks-1 on the shared thread pool */
   /* The function returns when all tasks are done */
   /* All errors are silently pushed into the "errors" array.*/
   /* If all threads report an error an exception will be thrown*/
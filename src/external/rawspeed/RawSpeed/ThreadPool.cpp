@@ -0,0 +1,147 @@
+#include "StdAfx.h"
+#include "ThreadPool.h"
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2009-2014 Klaus Post
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+    http://www.klauspost.com
+*/
+
+namespace RawSpeed {
+
+class ThreadPoolBatch
+{
+public:
+  ThreadPoolBatch(ThreadPoolJob* _job, uint32 _tasks) : job(_job), tasks(_tasks), next(0), done(0) {
+    pthread_cond_init(&finished, NULL);
+  };
+  ~ThreadPoolBatch(void) {pthread_cond_destroy(&finished);};
+  ThreadPoolJob* job;
+  const uint32 tasks;
+  uint32 next;             // next task to hand out, protected by the pool mutex
+  uint32 done;             // number of finished tasks, protected by the pool mutex
+  pthread_cond_t finished;
+};
+
+static ThreadPool* pool_instance = NULL;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+void ThreadPool::createInstance() {
+  pool_instance = new ThreadPool(getThreadCount());
+}
+
+ThreadPool* ThreadPool::getInstance() {
+  pthread_once(&pool_once, createInstance);
+  return pool_instance;
+}
+
+ThreadPool::ThreadPool(uint32 threads) {
+  pthread_mutex_init(&mMutex, NULL);
+  pthread_cond_init(&mWork, NULL);
+  // The calling thread always helps, so one thread less is enough.
+  nThreads = threads > 1 ? threads - 1 : 0;
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (uint32 i = 0; i < nThreads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, workerThread, this)) {
+      nThreads = i;
+      break;
+    }
+  }
+  pthread_attr_destroy(&attr);
+}
+
+ThreadPool::~ThreadPool(void) {
+  // The pool lives until the process exits, workers are never joined.
+}
+
+void* ThreadPool::workerThread(void *_this) {
+  ThreadPool* me = (ThreadPool*)_this;
+  me->work();
+  return NULL;
+}
+
+bool ThreadPool::takeTask(ThreadPoolBatch* batch, uint32 *task) {
+  if (batch->next >= batch->tasks)
+    return false;
+  *task = batch->next++;
+  // Nothing more to hand out, let the workers move on to the next batch.
+  if (batch->next >= batch->tasks)
+    mBatches.remove(batch);
+  return true;
+}
+
+void ThreadPool::finishTask(ThreadPoolBatch* batch) {
+  if (++batch->done == batch->tasks)
+    pthread_cond_broadcast(&batch->finished);
+}
+
+void ThreadPool::work() {
+  pthread_mutex_lock(&mMutex);
+  while (true) {
+    while (mBatches.empty())
+      pthread_cond_wait(&mWork, &mMutex);
+    ThreadPoolBatch* batch = mBatches.front();
+    uint32 task;
+    if (!takeTask(batch, &task))
+      continue;
+    pthread_mutex_unlock(&mMutex);
+    try {
+      batch->job->runTask(task);
+    } catch (...) {
+      // Jobs report their own errors, never let anything kill a pool thread.
+    }
+    pthread_mutex_lock(&mMutex);
+    finishTask(batch);
+  }
+}
+
+void ThreadPool::runTasks(ThreadPoolJob* job, uint32 tasks) {
+  if (!tasks)
+    return;
+  if (tasks == 1 || !nThreads) {
+    for (uint32 i = 0; i < tasks; i++)
+      job->runTask(i);
+    return;
+  }
+
+  ThreadPoolBatch batch(job, tasks);
+  pthread_mutex_lock(&mMutex);
+  mBatches.push_back(&batch);
+  pthread_cond_broadcast(&mWork);
+
+  // Help out until everything has been handed out, then wait for the stragglers.
+  uint32 task;
+  while (takeTask(&batch, &task)) {
+    pthread_mutex_unlock(&mMutex);
+    try {
+      job->runTask(task);
+    } catch (...) {
+    }
+    pthread_mutex_lock(&mMutex);
+    finishTask(&batch);
+  }
+  while (batch.done < batch.tasks)
+    pthread_cond_wait(&batch.finished, &mMutex);
+  pthread_mutex_unlock(&mMutex);
+}
+
+} // namespace RawSpeed
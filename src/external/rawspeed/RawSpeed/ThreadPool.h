@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "Common.h"
+#include <list>
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2009-2014 Klaus Post
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+    http://www.klauspost.com
+*/
+
+namespace RawSpeed {
+
+/* A unit of work that can be split into independent tasks, */
+/* such as the slices or tiles of an image. */
+class ThreadPoolJob
+{
+public:
+  virtual ~ThreadPoolJob(void) {};
+  /* Called once for every task number in [0, tasks), from any thread. */
+  /* Exceptions must not escape from this function. */
+  virtual void runTask(uint32 task) = 0;
+};
+
+class ThreadPoolBatch;
+
+/* Process wide pool of decoder threads, created on first use and reused */
+/* for every image instead of starting new threads for each slice. */
+class ThreadPool
+{
+public:
+  static ThreadPool* getInstance();
+  /* Runs all tasks of the job and returns when they are done. */
+  /* The calling thread works on the tasks as well, so nested calls */
+  /* from within a task cannot deadlock. */
+  void runTasks(ThreadPoolJob* job, uint32 tasks);
+  uint32 size() {return nThreads;}
+private:
+  ThreadPool(uint32 threads);
+  ~ThreadPool(void);
+  static void createInstance();
+  static void* workerThread(void *_this);
+  void work();
+  /* Fetches the next task of a batch, returns false if none are left */
+  bool takeTask(ThreadPoolBatch* batch, uint32 *task);
+  void finishTask(ThreadPoolBatch* batch);
+  pthread_mutex_t mMutex;
+  pthread_cond_t mWork;
+  list<ThreadPoolBatch*> mBatches;  // batches with tasks left to hand out
+  uint32 nThreads;
+};
+
+} // namespace RawSpeed
+
+#endif
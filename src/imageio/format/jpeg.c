@@ -40,6 +40,14 @@
 
 DT_MODULE(1)
 
+// error functions
+struct dt_imageio_jpeg_error_mgr
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+}
+dt_imageio_jpeg_error_mgr;
+
 typedef struct dt_imageio_jpeg_t
 {
   int max_width, max_height;
@@ -50,6 +58,7 @@ typedef struct dt_imageio_jpeg_t
   struct jpeg_destination_mgr dest;
   struct jpeg_decompress_struct dinfo;
   struct jpeg_compress_struct   cinfo;
+  struct dt_imageio_jpeg_error_mgr jerr; // for streaming writes, which span several calls
   FILE *f;
 }
 dt_imageio_jpeg_t;
@@ -61,14 +70,6 @@ typedef struct dt_imageio_jpeg_gui_data_t
 dt_imageio_jpeg_gui_data_t;
 
 
-// error functions
-struct dt_imageio_jpeg_error_mgr
-{
-  struct jpeg_error_mgr pub;
-  jmp_buf setjmp_buffer;
-}
-dt_imageio_jpeg_error_mgr;
-
 typedef struct dt_imageio_jpeg_error_mgr *dt_imageio_jpeg_error_ptr;
 
 static void
@@ -322,23 +323,27 @@ read_icc_profile (j_decompress_ptr cinfo,
 
 
 int
-write_image (dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp, void *exif, int exif_len, int imgid)
+write_image_begin (dt_imageio_module_data_t *jpg_tmp, const char *filename, void *exif, int exif_len, int imgid)
 {
   dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t*)jpg_tmp;
-  const uint8_t*in =(const uint8_t*)in_tmp;
-  struct dt_imageio_jpeg_error_mgr jerr;
-
-  jpg->cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
-  if (setjmp(jerr.setjmp_buffer))
+  jpg->f = NULL;
+  jpg->cinfo.err = jpeg_std_error(&jpg->jerr.pub);
+  jpg->jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if (setjmp(jpg->jerr.setjmp_buffer))
   {
     jpeg_destroy_compress(&(jpg->cinfo));
+    if(jpg->f) fclose(jpg->f);
+    jpg->f = NULL;
     return 1;
   }
   jpeg_create_compress(&(jpg->cinfo));
-  FILE *f = fopen(filename, "wb");
-  if(!f) return 1;
-  jpeg_stdio_dest(&(jpg->cinfo), f);
+  jpg->f = fopen(filename, "wb");
+  if(!jpg->f)
+  {
+    jpeg_destroy_compress(&(jpg->cinfo));
+    return 1;
+  }
+  jpeg_stdio_dest(&(jpg->cinfo), jpg->f);
 
   jpg->cinfo.image_width = jpg->width;
   jpg->cinfo.image_height = jpg->height;
@@ -374,22 +379,61 @@ write_image (dt_imageio_module_data_t *jpg_tmp, const char *filename, const void
   if(exif && exif_len > 0 && exif_len < 65534)
     jpeg_write_marker(&(jpg->cinfo), JPEG_APP0+1, exif, exif_len);
 
+  return 0;
+}
+
+int
+write_image_rows (dt_imageio_module_data_t *jpg_tmp, const void *in_tmp, const int num_rows)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t*)jpg_tmp;
+  const uint8_t *in = (const uint8_t*)in_tmp;
+  if (setjmp(jpg->jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&(jpg->cinfo));
+    fclose(jpg->f);
+    jpg->f = NULL;
+    return 1;
+  }
+
   uint8_t row[3*jpg->width];
-  const uint8_t *buf;
-  while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  for(int j=0; j<num_rows && jpg->cinfo.next_scanline < jpg->cinfo.image_height; j++)
   {
     JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
+    const uint8_t *buf = in + (size_t)j * jpg->width * 4;
     for(int i=0; i<jpg->width; i++) for(int k=0; k<3; k++) row[3*i+k] = buf[4*i+k];
     tmp[0] = row;
     jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
   }
+  return 0;
+}
+
+int
+write_image_end (dt_imageio_module_data_t *jpg_tmp)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t*)jpg_tmp;
+  if (setjmp(jpg->jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&(jpg->cinfo));
+    fclose(jpg->f);
+    jpg->f = NULL;
+    return 1;
+  }
   jpeg_finish_compress (&(jpg->cinfo));
   jpeg_destroy_compress(&(jpg->cinfo));
-  fclose(f);
+  fclose(jpg->f);
+  jpg->f = NULL;
   return 0;
 }
 
+int
+write_image (dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp, void *exif, int exif_len, int imgid)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t*)jpg_tmp;
+  if(write_image_begin(jpg_tmp, filename, exif, exif_len, imgid)) return 1;
+  if(write_image_rows(jpg_tmp, in_tmp, jpg->height)) return 1;
+  return write_image_end(jpg_tmp);
+}
+
 int read_header(const char *filename, dt_imageio_jpeg_t *jpg)
 {
   jpg->f = fopen(filename, "rb");
@@ -34,6 +34,7 @@
 #include "control/conf.h"
 #include "dtgtk/slider.h"
 #include "common/imageio_format.h"
+#include "common/png_deflate.h"
 
 DT_MODULE(1)
 
@@ -151,10 +152,16 @@ write_image (dt_imageio_module_data_t *p_tmp, const char *filename, const void *
     return 1;
   }
 
+  // buffers of the parallel encoder below, which libpng's errors would otherwise longjmp past.
+  uint8_t *volatile pending_rows = NULL;
+  uint8_t *volatile pending_idat = NULL;
+
   if (setjmp(png_jmpbuf(png_ptr)))
   {
+    dt_free_align(pending_rows);
+    free(pending_idat);
     fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
     return 1;
   }
 
@@ -171,8 +178,68 @@ write_image (dt_imageio_module_data_t *p_tmp, const char *filename, const void *
                p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
                PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
+  // text chunks go before the image data, so both paths below can use them.
+  PNGwriteRawProfile(png_ptr, info_ptr, "exif", exif, exif_len);
+
+  // TODO: embed icc profile!
+
   png_write_info(png_ptr, info_ptr);
 
+  const int bytespp = 3 * p->bpp / 8;
+  if(height >= DT_PNG_DEFLATE_MIN_ROWS && dt_get_num_threads() > 1)
+  {
+    // large export: pack all rows and let the parallel encoder do filtering and deflate.
+    uint8_t *rows = (uint8_t *)dt_alloc_align(64, (size_t)bytespp*width*height);
+    pending_rows = rows;
+    if(rows)
+    {
+      if(p->bpp > 8)
+      {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) shared(in, rows)
+#endif
+        for (int y = 0; y < height; y++)
+          for(int x=0; x<width; x++) for(int k=0; k<3; k++)
+            {
+              const uint16_t pix = ((uint16_t *)in)[(size_t)4*width*y + 4*x + k];
+              uint8_t *out = rows + (size_t)6*width*y + 6*x + 2*k;
+              out[0] = pix >> 8;
+              out[1] = pix & 0xff;
+            }
+      }
+      else
+      {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) shared(in, rows)
+#endif
+        for (int y = 0; y < height; y++)
+          for(int x=0; x<width; x++) for(int k=0; k<3; k++)
+              rows[(size_t)3*width*y + 3*x + k] = in[(size_t)4*width*y + 4*x + k];
+      }
+
+      uint8_t *idat = NULL;
+      size_t idat_len = 0;
+      const int err = dt_png_deflate(rows, width, height, bytespp, Z_BEST_COMPRESSION, &idat, &idat_len);
+      dt_free_align(rows);
+      pending_rows = NULL;
+      if(!err)
+      {
+        pending_idat = idat;
+        const size_t chunk = 1<<20;
+        for(size_t pos = 0; pos < idat_len; pos += chunk)
+          png_write_chunk(png_ptr, (png_const_bytep)"IDAT", idat + pos, MIN(chunk, idat_len - pos));
+        free(idat);
+        pending_idat = NULL;
+        // the image data did not go through libpng's own stream, so png_write_end() would refuse to finish.
+        png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        fclose(f);
+        return 0;
+      }
+      // nothing has been written after the header yet, fall back to libpng.
+    }
+  }
+
   // png_bytep row_pointer = (png_bytep) in;
   png_byte row[6*width];
   // unsigned long rowbytes = png_get_rowbytes(png_ptr, info_ptr);
@@ -199,10 +266,6 @@ write_image (dt_imageio_module_data_t *p_tmp, const char *filename, const void *
     }
   }
 
-  PNGwriteRawProfile(png_ptr, info_ptr, "exif", exif, exif_len);
-
-  // TODO: embed icc profile!
-
   png_write_end(png_ptr, info_ptr);
   png_destroy_write_struct(&png_ptr, &info_ptr);
   fclose(f);
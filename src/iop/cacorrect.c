@@ -1265,6 +1265,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *params, dt_de
   // dt_iop_cacorrect_data_t *d = (dt_iop_cacorrect_data_t *)piece->data;
   // preview pipe doesn't have mosaiced data either:
   if(!(pipe->image.flags & DT_IMAGE_RAW) || dt_dev_pixelpipe_uses_downsampled_input(pipe)) piece->enabled = 0;
+  // the shifts are fitted to the whole roi
+  piece->process_roi_dependent = 1;
 }
 
 void init_pipe     (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
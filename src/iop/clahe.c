@@ -269,6 +269,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
   d->radius = p->radius;
   d->slope = p->slope;
 #endif
+  // local histograms over a radius it doesn't declare
+  piece->process_roi_dependent = 1;
 }
 
 void init_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
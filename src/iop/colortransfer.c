@@ -512,6 +512,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
     // if(p->flag == ACQUIRE) p->flag = ACQUIRE2;
   }
 #endif
+  // clusters the colors of the whole roi
+  piece->process_roi_dependent = 1;
 }
 #endif
 
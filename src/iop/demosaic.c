@@ -1990,6 +1990,9 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *params, dt_de
   // OpenCL can not (yet) green-equilibrate over full image.
   if(d->green_eq == DT_IOP_GREEN_EQ_FULL || d->green_eq == DT_IOP_GREEN_EQ_BOTH)
     piece->process_cl_ready = 0;
+
+  // the full image green equilibration averages over the whole roi.
+  piece->process_roi_dependent = (d->green_eq == DT_IOP_GREEN_EQ_FULL || d->green_eq == DT_IOP_GREEN_EQ_BOTH);
 }
 
 void init_pipe     (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -465,6 +465,9 @@ commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpi
   d->drago.max_light = p->drago.max_light;
   d->detail = p->detail;
 
+  // drago needs the maximum L-value of the whole roi.
+  piece->process_roi_dependent = (d->operator == OPERATOR_DRAGO);
+
 #ifdef HAVE_OPENCL
   if(d->detail != 0.0f)
     piece->process_cl_ready = (piece->process_cl_ready && !(darktable.opencl->avoid_atomics));
@@ -613,6 +613,9 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
   // no OpenCL for DT_IOP_HIGHLIGHTS_INPAINT yet.
   if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT)
     piece->process_cl_ready = 0;
+
+  // both reconstruct from neighbours, inpainting along whole rows.
+  piece->process_roi_dependent = (d->mode != DT_IOP_HIGHLIGHTS_CLIP);
 }
 
 void init_global(dt_iop_module_so_t *module)
@@ -312,6 +312,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *params, dt_de
   d->markfixed = p->markfixed && (pipe->type != DT_DEV_PIXELPIPE_EXPORT) && (pipe->type != DT_DEV_PIXELPIPE_THUMBNAIL);
   if (!(pipe->image.flags & DT_IMAGE_RAW)|| dt_dev_pixelpipe_uses_downsampled_input(pipe) || p->strength == 0.0)
     piece->enabled = 0;
+  // doesn't declare the neighbours it looks at
+  piece->process_roi_dependent = 1;
 }
 
 void init_pipe     (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -428,6 +428,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *params, dt_de
   if (!(pipe->image.flags & DT_IMAGE_RAW) || dt_dev_pixelpipe_uses_downsampled_input(pipe))
     piece->enabled = 0;
   d->threshold = p->threshold;
+  // the wavelet scales reach further than any overlap it declares
+  piece->process_roi_dependent = 1;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
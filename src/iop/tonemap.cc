@@ -242,6 +242,8 @@ extern "C"
     dt_iop_tonemapping_data_t *d = (dt_iop_tonemapping_data_t *)piece->data;
     d->contrast = p->contrast;
     d->Fsize = p->Fsize;
+    // the bilateral grid spans the whole roi
+    piece->process_roi_dependent = 1;
   }
 
   void init_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -19,6 +19,7 @@
 #include "common/darktable.h"
 #include "common/film.h"
 #include "common/collection.h"
+#include "common/tags.h"
 #include "common/debug.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -1060,7 +1061,6 @@ static void tags_view (dt_lib_collect_rule_t *dr)
 {
   // update related list
   dt_lib_collect_t *d = get_collect(dr);
-  sqlite3_stmt *stmt;
   GtkTreeIter uncategorized, temp;
   memset(&uncategorized,0,sizeof(GtkTreeIter));
 
@@ -1077,19 +1077,25 @@ static void tags_view (dt_lib_collect_rule_t *dr)
 
   set_properties (dr);
 
-  /* query construction */
-  char query[1024];
+  /* all tags from the tag index, the ones matching the text are visible */
   const gchar *text = NULL;
   text = gtk_entry_get_text(GTK_ENTRY(dr->text));
-  gchar *escaped_text = NULL;
-  escaped_text = dt_util_str_replace(text, "'", "''");
-  snprintf(query, sizeof(query), "SELECT distinct name, id, name LIKE '%%%s%%' FROM tags ORDER BY UPPER(name) DESC", escaped_text);
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-
-  while (sqlite3_step(stmt) == SQLITE_ROW)
+  gchar *pattern = g_strdup_printf("%%%s%%", text);
+  GList *tags = NULL, *matching = NULL;
+  dt_tag_get_matching("%", &tags);
+  dt_tag_get_matching(pattern, &matching);
+  g_free(pattern);
+  GHashTable *visible = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(GList *m = matching; m; m = g_list_next(m))
+    g_hash_table_insert(visible, GUINT_TO_POINTER(((dt_tag_t *)m->data)->id), GINT_TO_POINTER(1));
+  dt_tag_free_result(&matching);
+
+  // every row goes in at the top, so go through them in reverse order
+  for(GList *t = g_list_last(tags); t; t = g_list_previous(t))
   {
-    if(strchr((const char *)sqlite3_column_text(stmt, 0),'|')==0)
+    const gchar *name = ((dt_tag_t *)t->data)->tag;
+    const int is_visible = g_hash_table_lookup(visible, GUINT_TO_POINTER(((dt_tag_t *)t->data)->id)) != NULL;
+    if(strchr(name,'|')==0)
     {
       /* add uncategorized root iter if not exists */
       if (!uncategorized.stamp)
@@ -1101,16 +1107,16 @@ static void tags_view (dt_lib_collect_rule_t *dr)
 
       /* adding an uncategorized tag */
       gtk_tree_store_insert(GTK_TREE_STORE(tagsmodel), &temp, &uncategorized,0);
-      gtk_tree_store_set(GTK_TREE_STORE(tagsmodel), &temp, DT_LIB_COLLECT_COL_TEXT, sqlite3_column_text(stmt, 0),
-                         DT_LIB_COLLECT_COL_PATH, sqlite3_column_text(stmt, 0),
-                         DT_LIB_COLLECT_COL_VISIBLE, sqlite3_column_int(stmt, 2), -1);
+      gtk_tree_store_set(GTK_TREE_STORE(tagsmodel), &temp, DT_LIB_COLLECT_COL_TEXT, name,
+                         DT_LIB_COLLECT_COL_PATH, name,
+                         DT_LIB_COLLECT_COL_VISIBLE, is_visible, -1);
     }
     else
     {
       int level = 0;
       char *value;
       GtkTreeIter current,iter;
-      char **pch = g_strsplit((char *)sqlite3_column_text(stmt, 0),"|", -1);
+      char **pch = g_strsplit(name,"|", -1);
 
       if (pch != NULL)
       {
@@ -1161,7 +1167,7 @@ static void tags_view (dt_lib_collect_rule_t *dr)
             gtk_tree_store_set(GTK_TREE_STORE(tagsmodel), &iter, DT_LIB_COLLECT_COL_TEXT, pch[j],
                               DT_LIB_COLLECT_COL_PATH, pth2,
                               DT_LIB_COLLECT_COL_COUNT, count,
-                              DT_LIB_COLLECT_COL_VISIBLE, sqlite3_column_int(stmt, 2), -1);
+                              DT_LIB_COLLECT_COL_VISIBLE, is_visible, -1);
             current = iter;
           }
 
@@ -1174,7 +1180,8 @@ static void tags_view (dt_lib_collect_rule_t *dr)
       }
     }
   }
-  sqlite3_finalize(stmt);
+  g_hash_table_destroy(visible);
+  dt_tag_free_result(&tags);
 
   gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(view), DT_LIB_COLLECT_COL_TOOLTIP);
   gtk_tree_view_set_model(GTK_TREE_VIEW(view), tagsmodel);
@@ -0,0 +1,201 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the compressed bitmap behind the selection, checked against a plain byte array,
+// plus the timings of select all / invert / count on a big collection. usage: bitmap [images]
+#include "common/bitmap.h"
+#include "common/bitmap.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#define RANGE 300000
+
+static double
+get_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (1.0/1000000.0)*time.tv_usec;
+}
+
+static uint32_t seed = 1;
+static uint32_t
+rnd(void)
+{
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+static void
+check(const dt_bitmap_t *b, const uint8_t *ref)
+{
+  uint64_t card = 0;
+  for(uint32_t v=0; v<RANGE; v++)
+  {
+    assert(dt_bitmap_contains(b, v) == ref[v]);
+    card += ref[v];
+  }
+  assert(dt_bitmap_count(b) == card);
+
+  // walking with next() has to visit exactly the set values, in order
+  uint32_t v = 0, n = 0, prev = 0;
+  while(dt_bitmap_next(b, v, &v))
+  {
+    assert(ref[v]);
+    assert(n == 0 || v > prev);
+    prev = v;
+    n++;
+    v++;
+  }
+  assert(n == card);
+}
+
+// dense around some places (bit sets), sparse elsewhere (arrays).
+static void
+fill(dt_bitmap_t *b, uint8_t *ref, const int num)
+{
+  for(int k=0; k<num; k++)
+  {
+    const uint32_t v = (k & 1) ? rnd() % RANGE : 70000 + rnd() % 20000;
+    ref[v] = 1;
+    dt_bitmap_add(b, v);
+  }
+}
+
+int main(int argc, char *arg[])
+{
+  const int num = argc > 1 ? atoi(arg[1]) : 200000;
+
+  uint8_t *ref_a = (uint8_t *)calloc(RANGE, 1), *ref_b = (uint8_t *)calloc(RANGE, 1), *ref = (uint8_t *)calloc(RANGE, 1);
+  dt_bitmap_t a, b, c;
+  dt_bitmap_init(&a);
+  dt_bitmap_init(&b);
+  dt_bitmap_init(&c);
+
+  // single adds and removes, crossing the array / bit set limit both ways
+  fill(&a, ref_a, 40000);
+  check(&a, ref_a);
+  for(int k=0; k<60000; k++)
+  {
+    const uint32_t v = (k & 1) ? rnd() % RANGE : 70000 + rnd() % 20000;
+    assert(dt_bitmap_remove(&a, v) == ref_a[v]);
+    ref_a[v] = 0;
+  }
+  check(&a, ref_a);
+  assert(!dt_bitmap_add(&a, 5) || !ref_a[5]);
+  ref_a[5] = 1;
+  assert(!dt_bitmap_add(&a, 5));
+  check(&a, ref_a);
+
+  // bulk adds on top of what's there, in any order and with duplicates
+  uint32_t bulk[5000];
+  for(int k=0; k<5000; k++)
+  {
+    bulk[k] = (k & 1) ? rnd() % RANGE : 200000 + rnd() % 6000;
+    ref_a[bulk[k]] = 1;
+  }
+  dt_bitmap_add_array(&a, bulk, 5000);
+  check(&a, ref_a);
+  fprintf(stderr, "[passed] add, add_array, remove, contains, next\n");
+
+  // set algebra, all combinations of sparse and dense blocks
+  fill(&a, ref_a, 30000);
+  fill(&b, ref_b, 50000);
+  const int ops = 3;
+  for(int op=0; op<ops; op++)
+  {
+    dt_bitmap_copy(&c, &a);
+    check(&c, ref_a);
+    for(uint32_t v=0; v<RANGE; v++)
+      ref[v] = op == 0 ? (ref_a[v] | ref_b[v]) : op == 1 ? (ref_a[v] & ref_b[v]) : (ref_a[v] & !ref_b[v]);
+    if(op == 0) dt_bitmap_or(&c, &b);
+    else if(op == 1) dt_bitmap_and(&c, &b);
+    else dt_bitmap_andnot(&c, &b);
+    check(&c, ref);
+  }
+  dt_bitmap_andnot(&c, &c);
+  assert(dt_bitmap_count(&c) == 0);
+  dt_bitmap_swap(&a, &b);
+  check(&a, ref_b);
+  check(&b, ref_a);
+  fprintf(stderr, "[passed] or, and, andnot, copy, swap\n");
+
+  // what the lighttable does on a big collection: ids in some sort order, a few selected by hand
+  uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t)*num);
+  for(int k=0; k<num; k++) ids[k] = k+1;
+  for(int k=num-1; k>0; k--)
+  {
+    const int j = rnd() % (k+1);
+    const uint32_t t = ids[k];
+    ids[k] = ids[j];
+    ids[j] = t;
+  }
+  dt_bitmap_t selected, collection;
+  dt_bitmap_init(&selected);
+  dt_bitmap_init(&collection);
+  for(int k=0; k<100; k++) dt_bitmap_add(&selected, ids[rnd() % num]);
+
+  double t0 = get_wtime();
+  dt_bitmap_clear(&selected);
+  dt_bitmap_add_array(&selected, ids, num);
+  const double t_all = get_wtime() - t0;
+  assert(dt_bitmap_count(&selected) == (uint64_t)num);
+
+  dt_bitmap_clear(&selected);
+  for(int k=0; k<num; k+=3) dt_bitmap_add(&selected, ids[k]);
+  const uint64_t before = dt_bitmap_count(&selected);
+  t0 = get_wtime();
+  dt_bitmap_add_array(&collection, ids, num);
+  dt_bitmap_andnot(&collection, &selected);
+  dt_bitmap_swap(&collection, &selected);
+  dt_bitmap_clear(&collection);
+  const double t_invert = get_wtime() - t0;
+  assert(dt_bitmap_count(&selected) == (uint64_t)num - before);
+
+  t0 = get_wtime();
+  int hits = 0;
+  for(int k=0; k<num; k++) hits += dt_bitmap_contains(&selected, ids[k]);
+  const double t_contains = get_wtime() - t0;
+  assert(hits == num - before);
+
+  size_t bytes = 0;
+  for(uint32_t k=0; k<selected.num; k++)
+    bytes += selected.c[k].bits ? 8192 : 2*selected.c[k].alloc;
+  fprintf(stderr, "%d images\n", num);
+  fprintf(stderr, "  select all : %7.3f ms\n", 1e3 * t_all);
+  fprintf(stderr, "  invert     : %7.3f ms\n", 1e3 * t_invert);
+  fprintf(stderr, "  contains   : %7.3f ns/image\n", 1e9 * t_contains / num);
+  fprintf(stderr, "  size       : %zu bytes for %" PRIu64 " images\n", bytes, dt_bitmap_count(&selected));
+
+  dt_bitmap_cleanup(&a);
+  dt_bitmap_cleanup(&b);
+  dt_bitmap_cleanup(&c);
+  dt_bitmap_cleanup(&selected);
+  dt_bitmap_cleanup(&collection);
+  free(ids);
+  free(ref);
+  free(ref_a);
+  free(ref_b);
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
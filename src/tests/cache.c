@@ -18,8 +18,12 @@
 
 
 #define DT_UNIT_TEST
-// define dt alloc, so we don't need to include the rest of dt:
+#define _XOPEN_SOURCE 500
+#include <unistd.h>
+// define dt alloc and glib's sleep, so we don't need to include the rest of dt:
 #define dt_alloc_align(A, B) malloc(B)
+#define dt_free_align(A) free(A)
+#define g_usleep(A) usleep(A)
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 // unit test for the concurrent hopscotch hashmap and the LRU cache built on top of it.
@@ -124,6 +128,48 @@ int main(int argc, char *arg[])
     dt_cache_cleanup(&cache2);
   }
 
+  {
+    // two caches on one clock: evicting from whichever has the older lru entry has to
+    // drop entries in global access order, and never the ones in use.
+    dt_cache_t a, b;
+    uint32_t clock = 0;
+    dt_cache_init(&a, 64, 1, 64, 1000);
+    dt_cache_init(&b, 64, 1, 64, 1000);
+    dt_cache_set_allocate_callback(&a, alloc_dummy, NULL);
+    dt_cache_set_allocate_callback(&b, alloc_dummy, NULL);
+    dt_cache_set_clock(&a, &clock);
+    dt_cache_set_clock(&b, &clock);
+    for(int k=1; k<=20; k++)
+    {
+      dt_cache_t *c = (k % 3) ? &a : &b;
+      dt_cache_read_get(c, k);
+      dt_cache_read_release(c, k);
+    }
+    // keep 1 locked, touch 2 again:
+    dt_cache_read_get(&a, 1);
+    dt_cache_read_get(&a, 2);
+    dt_cache_read_release(&a, 2);
+    for(int k=3; k<=20; k++)
+    {
+      uint32_t sa = 0, sb = 0;
+      const int ea = dt_cache_lru_stamp(&a, &sa), eb = dt_cache_lru_stamp(&b, &sb);
+      assert(!ea || !eb);
+      dt_cache_t *c = (!ea && (eb || sa < sb)) ? &a : &b;
+      assert(c == ((k % 3) ? &a : &b));
+      assert(dt_cache_evict_lru(c) == 0);
+      assert(!dt_cache_contains(c, k));
+    }
+    assert(dt_cache_contains(&a, 1) && dt_cache_contains(&a, 2));
+    assert(dt_cache_evict_lru(&a) == 0);
+    assert(!dt_cache_contains(&a, 2));
+    assert(dt_cache_evict_lru(&a) == 1);
+    assert(dt_cache_evict_lru(&b) == 1);
+    dt_cache_read_release(&a, 1);
+    fprintf(stderr, "[passed] eviction across caches sharing a clock\n");
+    dt_cache_cleanup(&a);
+    dt_cache_cleanup(&b);
+  }
+
   exit(0);
 }
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -0,0 +1,152 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// checks the dxt1 codec of the mipmap cache against squish: the decoders have to agree to the
+// byte on each other's blocks, and the encoder error has to stay close to squish's range fit.
+// also prints the timings for a mip3 sized thumbnail. usage: dxt [runs]
+#include "common/dxt.h"
+#include "common/dxt.c"
+#include "external/squish/csquish.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+
+static double
+get_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (1.0/1000000.0)*time.tv_usec;
+}
+
+static uint32_t seed = 1;
+static uint32_t
+rnd(void)
+{
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+// something thumbnail like: smooth gradients, some texture and hard edges.
+static void
+fill(uint8_t *img, const int wd, const int ht)
+{
+  for(int j=0; j<ht; j++) for(int i=0; i<wd; i++)
+  {
+    uint8_t *p = img + 4*((size_t)wd*j + i);
+    const int edge = ((i / 37) + (j / 23)) & 1;
+    const int n = (int)(rnd() % 17) - 8;
+    const int v[3] =
+    {
+      (i * 255) / wd + n,
+      (j * 255) / ht + (edge ? 60 : -40) + n,
+      ((i + j) & 0xff) / 2 + (edge ? 90 : 0) + n
+    };
+    for(int c=0; c<3; c++) p[c] = v[c] < 0 ? 0 : (v[c] > 255 ? 255 : v[c]);
+    p[3] = 0;
+  }
+}
+
+static double
+rmse(const uint8_t *a, const uint8_t *b, const int wd, const int ht)
+{
+  double sum = 0.0;
+  for(size_t k=0; k<(size_t)wd*ht; k++) for(int c=0; c<3; c++)
+  {
+    const double d = (double)a[4*k+c] - b[4*k+c];
+    sum += d*d;
+  }
+  return sqrt(sum / (3.0*wd*ht));
+}
+
+static void
+check(const int wd, const int ht, const int runs)
+{
+  const size_t size = (size_t)wd*ht*4;
+  uint8_t *img = (uint8_t *)malloc(size), *dec = (uint8_t *)malloc(size), *ref = (uint8_t *)malloc(size);
+  uint8_t *ours = (uint8_t *)malloc(dt_dxt1_size(wd, ht)), *theirs = (uint8_t *)malloc(dt_dxt1_size(wd, ht));
+  fill(img, wd, ht);
+
+  double t0 = get_wtime();
+  for(int r=0; r<runs; r++) dt_dxt1_compress(img, wd, ht, ours);
+  const double t_ours = (get_wtime() - t0) / runs;
+  t0 = get_wtime();
+  for(int r=0; r<runs; r++) dt_dxt1_decompress(ours, wd, ht, dec);
+  const double t_dec = (get_wtime() - t0) / runs;
+  const double e_ours = rmse(img, dec, wd, ht);
+  squish_decompress_image(ref, wd, ht, ours, squish_dxt1);
+  assert(!memcmp(dec, ref, size));
+
+  t0 = get_wtime();
+  for(int r=0; r<runs; r++) squish_compress_image(img, wd, ht, theirs, squish_dxt1 | squish_colour_range_fit);
+  const double t_range = (get_wtime() - t0) / runs;
+  t0 = get_wtime();
+  for(int r=0; r<runs; r++) squish_decompress_image(ref, wd, ht, theirs, squish_dxt1);
+  const double t_sdec = (get_wtime() - t0) / runs;
+  dt_dxt1_decompress(theirs, wd, ht, dec);
+  assert(!memcmp(dec, ref, size));
+  const double e_range = rmse(img, ref, wd, ht);
+
+  t0 = get_wtime();
+  squish_compress_image(img, wd, ht, theirs, squish_dxt1);
+  const double t_cluster = get_wtime() - t0;
+  dt_dxt1_decompress(theirs, wd, ht, dec);
+  const double e_cluster = rmse(img, dec, wd, ht);
+
+  fprintf(stderr, "%dx%d\n", wd, ht);
+  fprintf(stderr, "  dt range fit     : %8.3f ms  rmse %.3f, decode %.3f ms\n", 1e3*t_ours, e_ours, 1e3*t_dec);
+  fprintf(stderr, "  squish range fit : %8.3f ms  rmse %.3f, decode %.3f ms\n", 1e3*t_range, e_range, 1e3*t_sdec);
+  fprintf(stderr, "  squish cluster   : %8.3f ms  rmse %.3f\n", 1e3*t_cluster, e_cluster);
+  // same kind of fit, so no more than a few percent worse than squish's.
+  assert(e_ours <= 1.05 * e_range);
+
+  free(img);
+  free(dec);
+  free(ref);
+  free(ours);
+  free(theirs);
+}
+
+int main(int argc, char *arg[])
+{
+  const int runs = argc > 1 ? atoi(arg[1]) : 10;
+
+  // a single colour, and a block which quantises to a single colour, have to come out flat.
+  uint8_t px[64], blk[8], out[64];
+  for(int k=0; k<64; k++) px[k] = (k & 3) == 3 ? 0 : 100;
+  dt_dxt1_compress(px, 4, 4, blk);
+  dt_dxt1_decompress(blk, 4, 4, out);
+  for(int k=1; k<16; k++) assert(!memcmp(out, out + 4*k, 4));
+  px[0] = 101;
+  dt_dxt1_compress(px, 4, 4, blk);
+  dt_dxt1_decompress(blk, 4, 4, out);
+  for(int k=1; k<16; k++) assert(!memcmp(out, out + 4*k, 4));
+  fprintf(stderr, "[passed] flat blocks\n");
+
+  // odd sizes hit the border blocks
+  check(13, 7, 1);
+  check(1437, 899, 1);
+  fprintf(stderr, "[passed] borders\n");
+  check(1440, 900, runs);
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
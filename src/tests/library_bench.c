@@ -0,0 +1,342 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// query benchmark for library.db: generates a synthetic library with the tables and indexes of
+// _create_schema(), replays the queries collection.c, tags.c and the lighttable generate, and
+// prints query plans and timings before and after adding the indexes of the latest schema upgrade.
+// usage: library_bench [-n images] [-r runs] [-o library.db]
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sqlite3.h>
+#include <sys/time.h>
+
+#define MAX_QUERIES 64
+
+typedef struct query_t
+{
+  const char *name;
+  const char *sql;
+}
+query_t;
+
+// the tables the queries below touch, as created by _create_schema() (version 6).
+static const char *schema[] =
+{
+  "CREATE TABLE film_rolls (id INTEGER PRIMARY KEY, datetime_accessed CHAR(20), folder VARCHAR(1024))",
+  "CREATE INDEX film_rolls_folder_index ON film_rolls (folder)",
+  "CREATE TABLE images (id INTEGER PRIMARY KEY AUTOINCREMENT, group_id INTEGER, film_id INTEGER, "
+  "width INTEGER, height INTEGER, filename VARCHAR, maker VARCHAR, model VARCHAR, "
+  "lens VARCHAR, exposure REAL, aperture REAL, iso REAL, focal_length REAL, "
+  "focus_distance REAL, datetime_taken CHAR(20), flags INTEGER, "
+  "output_width INTEGER, output_height INTEGER, crop REAL, "
+  "raw_parameters INTEGER, raw_denoise_threshold REAL, "
+  "raw_auto_bright_threshold REAL, raw_black INTEGER, raw_maximum INTEGER, "
+  "caption VARCHAR, description VARCHAR, license VARCHAR, sha1sum CHAR(40), "
+  "orientation INTEGER, histogram BLOB, lightmap BLOB, longitude REAL, "
+  "latitude REAL, color_matrix BLOB, colorspace INTEGER, version INTEGER, max_version INTEGER, write_timestamp INTEGER)",
+  "CREATE INDEX images_group_id_index ON images (group_id)",
+  "CREATE INDEX images_film_id_index ON images (film_id)",
+  "CREATE INDEX images_filename_index ON images (filename)",
+  "CREATE TABLE selected_images (imgid INTEGER PRIMARY KEY)",
+  "CREATE TABLE history (imgid INTEGER, num INTEGER, module INTEGER, "
+  "operation VARCHAR(256), op_params BLOB, enabled INTEGER, "
+  "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))",
+  "CREATE INDEX history_imgid_index ON history (imgid)",
+  "CREATE TABLE tags (id INTEGER PRIMARY KEY, name VARCHAR, icon BLOB, description VARCHAR, flags INTEGER)",
+  "CREATE TABLE tagged_images (imgid INTEGER, tagid INTEGER, PRIMARY KEY (imgid, tagid))",
+  "CREATE INDEX tagged_images_tagid_index ON tagged_images (tagid)",
+  "CREATE TABLE color_labels (imgid INTEGER, color INTEGER)",
+  "CREATE UNIQUE INDEX color_labels_idx ON color_labels (imgid, color)",
+  "CREATE TABLE meta_data (id INTEGER, key INTEGER, value VARCHAR)",
+  "CREATE INDEX metadata_index ON meta_data (id, key)",
+  NULL
+};
+
+// what the upgrade to version 8 adds, keep in sync with _upgrade_schema_step().
+static const char *indexes[] =
+{
+  "CREATE INDEX tags_name_index ON tags (name)",
+  "CREATE INDEX meta_data_key_index ON meta_data (key, id)",
+  NULL
+};
+
+// the collection filters of get_query_string(), wrapped the way dt_collection_update() does it
+// (default rating filter, sorted by filename), and the hot per image queries.
+#define COLLECTION(W) "select distinct id from images where (flags & 7) >= 0 and (flags & 7) != 6 and " W " order by filename, version"
+#define COLLECTION_DATE(W) "select distinct id from images where (flags & 7) >= 0 and (flags & 7) != 6 and " W " order by datetime_taken, filename, version"
+static const query_t queries[] =
+{
+  { "film roll",           COLLECTION("(film_id in (select id from film_rolls where folder like '/home/user/photos/2007/roll_0042'))") },
+  { "folder",              COLLECTION("(film_id in (select id from film_rolls where folder like '/home/user/photos/2012%'))") },
+  { "color label",         COLLECTION("(id in (select imgid from color_labels where color=2))") },
+  { "any color label",     COLLECTION("(id in (select imgid from color_labels where color IS NOT NULL))") },
+  { "history altered",     COLLECTION("(id in (select imgid from history where imgid=images.id))") },
+  { "camera",              COLLECTION("(maker || ' ' || model like '%EOS 5D%')") },
+  { "tag",                 COLLECTION("(id in (select imgid from tags as b cross join tagged_images as a on a.tagid = b.id where name like 'places|europe|city_16'))") },
+  { "title",               COLLECTION("(id in (select id from meta_data where key = 0 and value like '%sunset%'))") },
+  { "lens",                COLLECTION("(lens like '%24-105%')") },
+  { "iso",                 COLLECTION("(iso >= 3200)") },
+  { "day",                 COLLECTION("(datetime_taken like '%2012:07:14%')") },
+  { "all, by date",        COLLECTION_DATE("(1=1)") },
+  { "film roll, by date",  COLLECTION_DATE("(film_id = 42)") },
+  { "count all",           "select count(id) from images where (flags & 7) >= 0 and (flags & 7) != 6" },
+  { "tag exists",          "SELECT id FROM tags WHERE name = 'places|europe|city_16'" },
+  { "tags of image",       "SELECT DISTINCT T.id, T.name FROM tagged_images JOIN tags T on T.id = tagged_images.tagid WHERE tagged_images.imgid = 4711" },
+  { "color of image",      "select color from color_labels where imgid=4711" },
+  { "history of image",    "select num from history where imgid = 4711" },
+  { "image by id",         "SELECT id, group_id, film_id, width, height, filename FROM images WHERE id = 4711" },
+  { NULL, NULL }
+};
+
+static double
+get_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (1.0/1000000.0)*time.tv_usec;
+}
+
+static void
+exec(sqlite3 *db, const char *sql)
+{
+  char *err = NULL;
+  if(sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK)
+  {
+    fprintf(stderr, "[library_bench] `%s': %s\n", sql, err);
+    sqlite3_free(err);
+    exit(1);
+  }
+}
+
+static uint32_t seed = 1;
+static int
+rnd(const int n)
+{
+  seed = seed * 1103515245u + 12345u;
+  return (seed >> 8) % n;
+}
+
+static void
+populate(sqlite3 *db, const int num)
+{
+  static const char *makers[][2] =
+  {
+    { "Canon", "EOS 5D Mark III" }, { "Canon", "EOS 550D" }, { "NIKON CORPORATION", "NIKON D800" },
+    { "NIKON CORPORATION", "NIKON D7000" }, { "SONY", "NEX-7" }, { "FUJIFILM", "X-E1" },
+    { "OLYMPUS IMAGING CORP.", "E-M5" }, { "Panasonic", "DMC-GH3" }
+  };
+  static const char *lenses[] = { "EF24-105mm f/4L IS USM", "EF50mm f/1.8 II", "24.0-70.0 mm f/2.8", "XF35mmF1.4 R", "OLYMPUS M.12-50mm F3.5-6.3" };
+  static const char *words[] = { "sunset", "portrait", "family", "holiday", "street", "landscape", "wedding", "concert" };
+  const int per_roll = 500, num_tags = 2000;
+  const int num_rolls = (num + per_roll - 1) / per_roll;
+  char buf[1024];
+  sqlite3_stmt *stmt;
+
+  exec(db, "BEGIN TRANSACTION");
+
+  sqlite3_prepare_v2(db, "INSERT INTO film_rolls (id, folder) VALUES (?1, ?2)", -1, &stmt, NULL);
+  for(int k=1; k<=num_rolls; k++)
+  {
+    snprintf(buf, sizeof(buf), "/home/user/photos/%d/roll_%04d", 2005 + k % 10, k);
+    sqlite3_bind_int(stmt, 1, k);
+    sqlite3_bind_text(stmt, 2, buf, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  sqlite3_prepare_v2(db, "INSERT INTO tags (id, name) VALUES (?1, ?2)", -1, &stmt, NULL);
+  for(int k=1; k<=num_tags; k++)
+  {
+    if(k % 4 == 0) snprintf(buf, sizeof(buf), "places|europe|city_%d", k);
+    else if(k % 4 == 1) snprintf(buf, sizeof(buf), "people|person_%d", k);
+    else if(k % 4 == 2) snprintf(buf, sizeof(buf), "darktable|format|ext_%d", k);
+    else snprintf(buf, sizeof(buf), "keyword_%d", k);
+    sqlite3_bind_int(stmt, 1, k);
+    sqlite3_bind_text(stmt, 2, buf, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  sqlite3_stmt *img, *tag, *label, *hist, *meta;
+  sqlite3_prepare_v2(db, "INSERT INTO images (id, group_id, film_id, width, height, filename, maker, model, lens, "
+                         "exposure, aperture, iso, focal_length, datetime_taken, flags, version, max_version) "
+                         "VALUES (?1, ?1, ?2, 6000, 4000, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, 0, 0)", -1, &img, NULL);
+  sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO tagged_images (imgid, tagid) VALUES (?1, ?2)", -1, &tag, NULL);
+  sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO color_labels (imgid, color) VALUES (?1, ?2)", -1, &label, NULL);
+  sqlite3_prepare_v2(db, "INSERT INTO history (imgid, num, module, operation, enabled) VALUES (?1, ?2, 1, 'exposure', 1)", -1, &hist, NULL);
+  sqlite3_prepare_v2(db, "INSERT INTO meta_data (id, key, value) VALUES (?1, ?2, ?3)", -1, &meta, NULL);
+  for(int k=1; k<=num; k++)
+  {
+    const int roll = 1 + (k-1) / per_roll, cam = (roll * 7) % 8;
+    snprintf(buf, sizeof(buf), "IMG_%04d.CR2", k % 10000);
+    sqlite3_bind_int(img, 1, k);
+    sqlite3_bind_int(img, 2, roll);
+    sqlite3_bind_text(img, 3, buf, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(img, 4, makers[cam][0], -1, SQLITE_STATIC);
+    sqlite3_bind_text(img, 5, makers[cam][1], -1, SQLITE_STATIC);
+    sqlite3_bind_text(img, 6, lenses[rnd(5)], -1, SQLITE_STATIC);
+    sqlite3_bind_double(img, 7, 1.0 / (1 << rnd(12)));
+    sqlite3_bind_double(img, 8, 1.4 * (1 + rnd(10)));
+    sqlite3_bind_double(img, 9, 100 << rnd(7));
+    sqlite3_bind_double(img, 10, 12 + rnd(200));
+    // one roll is shot within a day or two, rolls spread over ten years.
+    const long day = (long)roll * 3650 / num_rolls + rnd(2);
+    snprintf(buf, sizeof(buf), "%04ld:%02ld:%02ld %02d:%02d:%02d", 2005 + day / 365, 1 + (day % 365) / 31 % 12,
+             1 + (day % 365) % 28, rnd(24), rnd(60), rnd(60));
+    sqlite3_bind_text(img, 11, buf, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(img, 12, rnd(7));
+    sqlite3_step(img);
+    sqlite3_reset(img);
+
+    const int ntags = rnd(6);
+    for(int t=0; t<ntags; t++)
+    {
+      sqlite3_bind_int(tag, 1, k);
+      sqlite3_bind_int(tag, 2, 1 + rnd(num_tags));
+      sqlite3_step(tag);
+      sqlite3_reset(tag);
+    }
+    if(rnd(5) == 0)
+    {
+      sqlite3_bind_int(label, 1, k);
+      sqlite3_bind_int(label, 2, rnd(5));
+      sqlite3_step(label);
+      sqlite3_reset(label);
+    }
+    if(rnd(3) == 0) for(int h=0; h<3; h++)
+      {
+        sqlite3_bind_int(hist, 1, k);
+        sqlite3_bind_int(hist, 2, h);
+        sqlite3_step(hist);
+        sqlite3_reset(hist);
+      }
+    if(rnd(10) == 0)
+    {
+      snprintf(buf, sizeof(buf), "%s %d", words[rnd(8)], k);
+      sqlite3_bind_int(meta, 1, k);
+      sqlite3_bind_int(meta, 2, 0);
+      sqlite3_bind_text(meta, 3, buf, -1, SQLITE_TRANSIENT);
+      sqlite3_step(meta);
+      sqlite3_reset(meta);
+    }
+  }
+  sqlite3_finalize(img);
+  sqlite3_finalize(tag);
+  sqlite3_finalize(label);
+  sqlite3_finalize(hist);
+  sqlite3_finalize(meta);
+
+  exec(db, "COMMIT");
+}
+
+static void
+print_plan(sqlite3 *db, const char *sql)
+{
+  char explain[4096];
+  snprintf(explain, sizeof(explain), "EXPLAIN QUERY PLAN %s", sql);
+  sqlite3_stmt *stmt;
+  if(sqlite3_prepare_v2(db, explain, -1, &stmt, NULL) != SQLITE_OK) return;
+  // the detail is the last column, independent of the sqlite version
+  const int detail = sqlite3_column_count(stmt) - 1;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    fprintf(stderr, "      %s\n", (const char *)sqlite3_column_text(stmt, detail));
+  sqlite3_finalize(stmt);
+}
+
+// best of runs, in milliseconds. also returns the number of rows.
+static double
+time_query(sqlite3 *db, const char *sql, const int runs, int *rows)
+{
+  double best = 1e10;
+  for(int r=0; r<runs; r++)
+  {
+    sqlite3_stmt *stmt;
+    const double t0 = get_wtime();
+    if(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[library_bench] `%s': %s\n", sql, sqlite3_errmsg(db));
+      exit(1);
+    }
+    int n = 0;
+    while(sqlite3_step(stmt) == SQLITE_ROW) n++;
+    sqlite3_finalize(stmt);
+    const double t = get_wtime() - t0;
+    if(t < best) best = t;
+    *rows = n;
+  }
+  return 1000.0 * best;
+}
+
+static void
+run_queries(sqlite3 *db, const int runs, double *times)
+{
+  for(int k=0; queries[k].name; k++)
+  {
+    int rows = 0;
+    times[k] = time_query(db, queries[k].sql, runs, &rows);
+    fprintf(stderr, "  %-20s %10.3f ms %8d rows\n", queries[k].name, times[k], rows);
+    print_plan(db, queries[k].sql);
+  }
+}
+
+int main(int argc, char *arg[])
+{
+  int num = 1000000, runs = 3;
+  const char *filename = ":memory:";
+  for(int k=1; k<argc-1; k+=2)
+  {
+    if(!strcmp(arg[k], "-n")) num = atoi(arg[k+1]);
+    else if(!strcmp(arg[k], "-r")) runs = atoi(arg[k+1]);
+    else if(!strcmp(arg[k], "-o")) filename = arg[k+1];
+  }
+
+  sqlite3 *db;
+  if(sqlite3_open(filename, &db) != SQLITE_OK)
+  {
+    fprintf(stderr, "[library_bench] could not open `%s'\n", filename);
+    exit(1);
+  }
+  for(int k=0; schema[k]; k++) exec(db, schema[k]);
+
+  double t0 = get_wtime();
+  populate(db, num);
+  fprintf(stderr, "generated %d images in %.1f secs\n\n", num, get_wtime() - t0);
+
+  double before[MAX_QUERIES], after[MAX_QUERIES];
+  fprintf(stderr, "schema version 6:\n");
+  run_queries(db, runs, before);
+
+  t0 = get_wtime();
+  for(int k=0; indexes[k]; k++) exec(db, indexes[k]);
+  fprintf(stderr, "\nadded indexes in %.1f secs\n\nschema version 8:\n", get_wtime() - t0);
+  run_queries(db, runs, after);
+
+  fprintf(stderr, "\n%-22s %12s %12s %8s\n", "query", "before [ms]", "after [ms]", "speedup");
+  for(int k=0; queries[k].name; k++)
+    fprintf(stderr, "%-22s %12.3f %12.3f %7.1fx\n", queries[k].name, before[k], after[k], before[k] / after[k]);
+
+  sqlite3_close(db);
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
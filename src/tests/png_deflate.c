@@ -0,0 +1,163 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test and benchmark for the parallel png deflate encoder versus libpng's own zlib stream.
+#include "common/png_deflate.h"
+#include "common/png_deflate.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <png.h>
+#include <sys/time.h>
+
+static double
+get_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (1.0/1000000.0)*time.tv_usec;
+}
+
+// smooth gradients with a bit of noise, roughly what a developed 16-bit export looks like.
+static uint8_t *
+make_image(const int width, const int height)
+{
+  uint8_t *buf = (uint8_t *)malloc((size_t)width*height*6);
+  uint32_t seed = 1;
+  for(int j=0; j<height; j++) for(int i=0; i<width; i++) for(int k=0; k<3; k++)
+      {
+        seed = seed * 1103515245u + 12345u;
+        const uint16_t v = (uint16_t)((i*40000/width + j*20000/height + k*3000 + ((seed >> 16) & 0xff)) & 0xffff);
+        uint8_t *px = buf + (size_t)6*width*j + 6*i + 2*k;
+        px[0] = v >> 8;
+        px[1] = v & 0xff;
+      }
+  return buf;
+}
+
+static void
+write_serial(const char *filename, const uint8_t *rows, const int width, const int height)
+{
+  FILE *f = fopen(filename, "wb");
+  png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  png_init_io(png_ptr, f);
+  png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
+  png_set_IHDR(png_ptr, info_ptr, width, height, 16, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png_ptr, info_ptr);
+  for(int y=0; y<height; y++) png_write_row(png_ptr, (png_bytep)rows + (size_t)6*width*y);
+  png_write_end(png_ptr, info_ptr);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+  fclose(f);
+}
+
+static void
+write_parallel(const char *filename, const uint8_t *rows, const int width, const int height)
+{
+  uint8_t *idat = NULL;
+  size_t idat_len = 0;
+  const int err = dt_png_deflate(rows, width, height, 6, Z_BEST_COMPRESSION, &idat, &idat_len);
+  assert(!err);
+
+  FILE *f = fopen(filename, "wb");
+  png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  png_init_io(png_ptr, f);
+  png_set_IHDR(png_ptr, info_ptr, width, height, 16, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png_ptr, info_ptr);
+  for(size_t pos=0; pos<idat_len; pos+=1<<20)
+    png_write_chunk(png_ptr, (png_const_bytep)"IDAT", idat + pos, idat_len - pos < (1<<20) ? idat_len - pos : (1<<20));
+  png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+  fclose(f);
+  free(idat);
+}
+
+static void
+check_file(const char *filename, const uint8_t *rows, const int width, const int height)
+{
+  FILE *f = fopen(filename, "rb");
+  png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  png_init_io(png_ptr, f);
+  png_read_info(png_ptr, info_ptr);
+  assert(png_get_image_width(png_ptr, info_ptr) == (png_uint_32)width);
+  assert(png_get_image_height(png_ptr, info_ptr) == (png_uint_32)height);
+  uint8_t *row = (uint8_t *)malloc((size_t)6*width);
+  for(int y=0; y<height; y++)
+  {
+    png_read_row(png_ptr, row, NULL);
+    assert(!memcmp(row, rows + (size_t)6*width*y, (size_t)6*width));
+  }
+  png_read_end(png_ptr, NULL);
+  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+  free(row);
+  fclose(f);
+}
+
+static long
+file_size(const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+int main(int argc, char *arg[])
+{
+  const int width  = argc > 1 ? atoi(arg[1]) : 6000;
+  const int height = argc > 2 ? atoi(arg[2]) : 4000;
+  uint8_t *rows = make_image(width, height);
+
+  // tiny images, single rows and single blocks are the corner cases of the stitching.
+  const int small[][2] = { {1, 1}, {3, 1}, {1, 300}, {700, 41}, {11000, 13} };
+  for(int k=0; k<sizeof(small)/sizeof(small[0]); k++)
+  {
+    uint8_t *s = make_image(small[k][0], small[k][1]);
+    write_parallel("/tmp/dt_png_deflate_small.png", s, small[k][0], small[k][1]);
+    check_file("/tmp/dt_png_deflate_small.png", s, small[k][0], small[k][1]);
+    free(s);
+  }
+  fprintf(stderr, "[passed] small images round trip\n");
+
+  double t0 = get_wtime();
+  write_serial("/tmp/dt_png_deflate_serial.png", rows, width, height);
+  const double t_serial = get_wtime() - t0;
+
+  t0 = get_wtime();
+  write_parallel("/tmp/dt_png_deflate_parallel.png", rows, width, height);
+  const double t_parallel = get_wtime() - t0;
+
+  check_file("/tmp/dt_png_deflate_serial.png", rows, width, height);
+  check_file("/tmp/dt_png_deflate_parallel.png", rows, width, height);
+  fprintf(stderr, "[passed] %dx%d 16-bit image round trip\n", width, height);
+
+  fprintf(stderr, "libpng   : %.3f secs, %ld bytes\n", t_serial, file_size("/tmp/dt_png_deflate_serial.png"));
+  fprintf(stderr, "parallel : %.3f secs, %ld bytes\n", t_parallel, file_size("/tmp/dt_png_deflate_parallel.png"));
+
+  free(rows);
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
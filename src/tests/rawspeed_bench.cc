@@ -0,0 +1,165 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// decode benchmark for rawspeed: decodes every raw given on the command line a few times
+// and reports throughput per decoder. usage: rawspeed_bench [-c cameras.xml] [-n runs] files..
+#include "external/rawspeed/RawSpeed/StdAfx.h"
+#include "external/rawspeed/RawSpeed/FileReader.h"
+#include "external/rawspeed/RawSpeed/RawParser.h"
+#include "external/rawspeed/RawSpeed/CameraMetaData.h"
+
+#include <map>
+#include <string>
+#include <cxxabi.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace RawSpeed;
+
+// normally provided by darktable.
+int rawspeed_get_number_of_processor_cores()
+{
+  const long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
+
+static double
+get_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (1.0/1000000.0)*time.tv_usec;
+}
+
+typedef struct stats_t
+{
+  int files;
+  double bytes, pixels, secs;
+}
+stats_t;
+
+static std::string
+decoder_name(RawDecoder *d)
+{
+  int status = 0;
+  char *name = abi::__cxa_demangle(typeid(*d).name(), NULL, NULL, &status);
+  std::string res = status == 0 ? name : typeid(*d).name();
+  free(name);
+  return res;
+}
+
+int main(int argc, char *arg[])
+{
+  const char *camfile = "../external/rawspeed/data/cameras.xml";
+  int runs = 5;
+  int first = 1;
+  for(; first < argc - 1 && arg[first][0] == '-'; first += 2)
+  {
+    if(!strcmp(arg[first], "-c")) camfile = arg[first+1];
+    else if(!strcmp(arg[first], "-n")) runs = MAX(1, atoi(arg[first+1]));
+  }
+  if(first >= argc)
+  {
+    fprintf(stderr, "usage: %s [-c cameras.xml] [-n runs] raw files..\n", arg[0]);
+    exit(1);
+  }
+
+  CameraMetaData *meta = NULL;
+  try
+  {
+    meta = new CameraMetaData((char *)camfile);
+  }
+  catch(...)
+  {
+    fprintf(stderr, "[rawspeed_bench] could not load `%s', decoding without camera hints\n", camfile);
+  }
+
+  std::map<std::string, stats_t> stats;
+  for(int k = first; k < argc; k++)
+  {
+    FileMap *m = NULL;
+    try
+    {
+      FileReader f(arg[k]);
+      m = f.readFile();
+    }
+    catch(FileIOException &e)
+    {
+      fprintf(stderr, "[rawspeed_bench] %s: %s\n", arg[k], e.what());
+      continue;
+    }
+
+    // best of n, the first run also pays for page faults in the output buffer.
+    double best = 1e10;
+    std::string name;
+    iPoint2D dim;
+    int cpp = 1;
+    for(int r = 0; r < runs; r++)
+    {
+      RawDecoder *d = NULL;
+      try
+      {
+        RawParser t(m);
+        d = t.getDecoder();
+        if(meta) d->checkSupport(meta);
+        const double t0 = get_wtime();
+        d->decodeRaw();
+        const double t1 = get_wtime() - t0;
+        if(t1 < best) best = t1;
+        name = decoder_name(d);
+        dim = d->mRaw->dim;
+        cpp = d->mRaw->getCpp();
+      }
+      catch(RawDecoderException &e)
+      {
+        fprintf(stderr, "[rawspeed_bench] %s: %s\n", arg[k], e.what());
+        best = -1.0;
+      }
+      catch(...)
+      {
+        fprintf(stderr, "[rawspeed_bench] %s: failed to decode\n", arg[k]);
+        best = -1.0;
+      }
+      delete d;
+      if(best < 0.0) break;
+    }
+
+    if(best >= 0.0)
+    {
+      const double mb = m->getSize() / (1024.0 * 1024.0), mpix = (double)dim.x * dim.y * cpp / 1e6;
+      fprintf(stderr, "%-40s %-20s %8.2f MB/s %8.2f Mpix/s\n", arg[k], name.c_str(), mb / best, mpix / best);
+      stats_t &s = stats[name];
+      s.files++;
+      s.bytes += mb;
+      s.pixels += mpix;
+      s.secs += best;
+    }
+    delete m;
+  }
+
+  fprintf(stderr, "\n%-20s %6s %10s %12s\n", "decoder", "files", "MB/s", "Mpix/s");
+  for(std::map<std::string, stats_t>::iterator i = stats.begin(); i != stats.end(); i++)
+    fprintf(stderr, "%-20s %6d %10.2f %12.2f\n", i->first.c_str(), i->second.files,
+            i->second.bytes / i->second.secs, i->second.pixels / i->second.secs);
+
+  delete meta;
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,140 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 the darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the per image metadata fetch of the image cache: compiling the statement for
+// every image (what dt_image_cache_allocate() used to do) versus resetting a cached one
+// (dt_database_get_statement()). usage: sql_statements [images] [library.db]
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sqlite3.h>
+#include <sys/time.h>
+
+static const char *select_image =
+  "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
+  "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
+  "raw_parameters, longitude, latitude, color_matrix, colorspace, version, raw_black, raw_maximum FROM images WHERE id = ?1";
+
+static double
+get_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (1.0/1000000.0)*time.tv_usec;
+}
+
+static void
+create_library(sqlite3 *db, const int num)
+{
+  sqlite3_exec(db, "CREATE TABLE images (id INTEGER PRIMARY KEY AUTOINCREMENT, group_id INTEGER, film_id INTEGER, "
+                   "width INTEGER, height INTEGER, filename VARCHAR, maker VARCHAR, model VARCHAR, "
+                   "lens VARCHAR, exposure REAL, aperture REAL, iso REAL, focal_length REAL, "
+                   "focus_distance REAL, datetime_taken CHAR(20), flags INTEGER, "
+                   "output_width INTEGER, output_height INTEGER, crop REAL, "
+                   "raw_parameters INTEGER, raw_denoise_threshold REAL, "
+                   "raw_auto_bright_threshold REAL, raw_black REAL, raw_maximum REAL, "
+                   "caption VARCHAR, description VARCHAR, license VARCHAR, sha1sum CHAR(40), "
+                   "orientation INTEGER, histogram BLOB, lightmap BLOB, longitude REAL, "
+                   "latitude REAL, color_matrix BLOB, colorspace INTEGER, version INTEGER, max_version INTEGER)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, "INSERT INTO images (id, group_id, film_id, width, height, filename, maker, model, lens, "
+                         "exposure, aperture, iso, focal_length, datetime_taken, flags, orientation, version) "
+                         "VALUES (?1, ?1, ?2, 6000, 4000, ?3, 'Canon', 'EOS 5D Mark III', 'EF24-105mm f/4L IS USM', "
+                         "0.004, 8.0, 200, 50, '2014:05:01 12:00:00', 1, 0, 0)", -1, &stmt, NULL);
+  for(int k=1; k<=num; k++)
+  {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "IMG_%05d.CR2", k);
+    sqlite3_bind_int(stmt, 1, k);
+    sqlite3_bind_int(stmt, 2, 1 + k/500);
+    sqlite3_bind_text(stmt, 3, filename, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+}
+
+// reads what the image cache reads, returns a checksum so nothing gets optimised away.
+static int
+fetch(sqlite3_stmt *stmt, const int id)
+{
+  int sum = 0;
+  sqlite3_bind_int(stmt, 1, id);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    for(int k=0; k<26; k++) sqlite3_column_text(stmt, k);
+    sum = sqlite3_column_int(stmt, 0);
+  }
+  return sum;
+}
+
+int main(int argc, char *arg[])
+{
+  const int num = argc > 1 ? atoi(arg[1]) : 50000;
+  const char *filename = argc > 2 ? arg[2] : ":memory:";
+
+  sqlite3 *db;
+  if(sqlite3_open(filename, &db) != SQLITE_OK)
+  {
+    fprintf(stderr, "[sql_statements] could not open `%s'\n", filename);
+    exit(1);
+  }
+  create_library(db, num);
+
+  // scroll through the library in lighttable order, twice for each variant.
+  for(int pass=0; pass<2; pass++)
+  {
+    double t0 = get_wtime();
+    long sum_prepare = 0;
+    for(int k=1; k<=num; k++)
+    {
+      sqlite3_stmt *stmt;
+      sqlite3_prepare_v2(db, select_image, -1, &stmt, NULL);
+      sum_prepare += fetch(stmt, k);
+      sqlite3_finalize(stmt);
+    }
+    const double t_prepare = get_wtime() - t0;
+
+    t0 = get_wtime();
+    long sum_cached = 0;
+    sqlite3_stmt *cached;
+    sqlite3_prepare_v2(db, select_image, -1, &cached, NULL);
+    for(int k=1; k<=num; k++)
+    {
+      sum_cached += fetch(cached, k);
+      sqlite3_reset(cached);
+      sqlite3_clear_bindings(cached);
+    }
+    sqlite3_finalize(cached);
+    const double t_cached = get_wtime() - t0;
+
+    assert(sum_prepare == sum_cached);
+    fprintf(stderr, "pass %d, %d images\n", pass, num);
+    fprintf(stderr, "  prepare + finalize : %7.3f us/image\n", 1e6 * t_prepare / num);
+    fprintf(stderr, "  cached statement   : %7.3f us/image (%.1fx)\n", 1e6 * t_cached / num, t_prepare / t_cached);
+  }
+
+  sqlite3_close(db);
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
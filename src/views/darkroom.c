@@ -181,40 +181,49 @@ void expose(dt_view_t *self, cairo_t *cri, int32_t width_i, int32_t height_i, in
     dt_view_set_scrollbar(self, zx+.5-boxw*.5, 1.0, boxw, zy+.5-boxh*.5, 1.0, boxh);
   }
 
-  if((dev->image_status == DT_DEV_PIXELPIPE_VALID) && dev->pipe->input_timestamp >= dev->preview_pipe->input_timestamp)
+  if((dev->image_status == DT_DEV_PIXELPIPE_VALID || (dev->image_status == DT_DEV_PIXELPIPE_RUNNING && dev->image_coarse))
+     && dev->pipe->input_timestamp >= dev->preview_pipe->input_timestamp)
   {
-    // draw image
-    roi_hash_old = roi_hash;
     mutex = &dev->pipe->backbuf_mutex;
     dt_pthread_mutex_lock(mutex);
-    wd = dev->pipe->backbuf_width;
-    ht = dev->pipe->backbuf_height;
-    stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, wd);
-    surface = cairo_image_surface_create_for_data (dev->pipe->backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
-    cairo_set_source_rgb (cr, .2, .2, .2);
-    cairo_paint(cr);
-    cairo_translate(cr, .5f*(width-wd), .5f*(height-ht));
-    if(closeup)
+    // a coarse version is blown up to where the real image will be. while the refinement
+    // is being put together, the backbuf has nothing to show, so keep what's on screen.
+    const int coarse = dev->pipe->backbuf_coarse;
+    if(coarse || dev->image_status == DT_DEV_PIXELPIPE_VALID)
     {
-      const float closeup_scale = 2.0;
-      cairo_scale(cr, closeup_scale, closeup_scale);
-      float boxw = 1, boxh = 1, zx0 = zoom_x, zy0 = zoom_y, zx1 = zoom_x, zy1 = zoom_y, zxm = -1.0, zym = -1.0;
-      dt_dev_check_zoom_bounds(dev, &zx0, &zy0, zoom, 0, &boxw, &boxh);
-      dt_dev_check_zoom_bounds(dev, &zx1, &zy1, zoom, 1, &boxw, &boxh);
-      dt_dev_check_zoom_bounds(dev, &zxm, &zym, zoom, 1, &boxw, &boxh);
-      const float fx = 1.0 - fmaxf(0.0, (zx0 - zx1)/(zx0 - zxm)), fy = 1.0 - fmaxf(0.0, (zy0 - zy1)/(zy0 - zym));
-      cairo_translate(cr, -wd/(2.0*closeup_scale) * fx, -ht/(2.0*closeup_scale) * fy);
+      // draw image
+      const float f = MAX(1, coarse);
+      roi_hash_old = roi_hash;
+      wd = dev->pipe->backbuf_width;
+      ht = dev->pipe->backbuf_height;
+      stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, wd);
+      surface = cairo_image_surface_create_for_data (dev->pipe->backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
+      cairo_set_source_rgb (cr, .2, .2, .2);
+      cairo_paint(cr);
+      cairo_translate(cr, .5f*(width-f*wd), .5f*(height-f*ht));
+      if(closeup)
+      {
+        const float closeup_scale = 2.0;
+        cairo_scale(cr, closeup_scale, closeup_scale);
+        float boxw = 1, boxh = 1, zx0 = zoom_x, zy0 = zoom_y, zx1 = zoom_x, zy1 = zoom_y, zxm = -1.0, zym = -1.0;
+        dt_dev_check_zoom_bounds(dev, &zx0, &zy0, zoom, 0, &boxw, &boxh);
+        dt_dev_check_zoom_bounds(dev, &zx1, &zy1, zoom, 1, &boxw, &boxh);
+        dt_dev_check_zoom_bounds(dev, &zxm, &zym, zoom, 1, &boxw, &boxh);
+        const float fx = 1.0 - fmaxf(0.0, (zx0 - zx1)/(zx0 - zxm)), fy = 1.0 - fmaxf(0.0, (zy0 - zy1)/(zy0 - zym));
+        cairo_translate(cr, -f*wd/(2.0*closeup_scale) * fx, -f*ht/(2.0*closeup_scale) * fy);
+      }
+      cairo_scale(cr, f, f);
+      cairo_rectangle(cr, 0, 0, wd, ht);
+      cairo_set_source_surface (cr, surface, 0, 0);
+      cairo_pattern_set_filter(cairo_get_source(cr), coarse ? CAIRO_FILTER_GOOD : CAIRO_FILTER_FAST);
+      cairo_fill_preserve(cr);
+      cairo_set_line_width(cr, 1.0/f);
+      cairo_set_source_rgb (cr, .3, .3, .3);
+      cairo_stroke(cr);
+      cairo_surface_destroy (surface);
+      image_surface_imgid = dev->image_storage.id;
     }
-    cairo_rectangle(cr, 0, 0, wd, ht);
-    cairo_set_source_surface (cr, surface, 0, 0);
-    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
-    cairo_fill_preserve(cr);
-    cairo_set_line_width(cr, 1.0);
-    cairo_set_source_rgb (cr, .3, .3, .3);
-    cairo_stroke(cr);
-    cairo_surface_destroy (surface);
     dt_pthread_mutex_unlock(mutex);
-    image_surface_imgid = dev->image_storage.id;
   }
   else if((dev->preview_status == DT_DEV_PIXELPIPE_VALID) && (roi_hash != roi_hash_old))
   {
@@ -31,6 +31,7 @@
 #include "common/focus.h"
 #include "common/grouping.h"
 #include "common/history.h"
+#include "common/image_tiles.h"
 #include "common/ratings.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -101,10 +102,25 @@ typedef struct dt_library_t
   dt_image_orientation_t full_res_thumb_orientation;
   dt_focus_cluster_t full_res_focus[49];
 
+  /* zoom into the full preview, 1 fits the image to the screen */
+  float full_zoom;
+  /* where the pointer was last, the zoomed in view follows it */
+  float full_pointer_x, full_pointer_y;
+  /* tiles of the zoomed in full preview */
+  dt_image_tiles_t *full_tiles;
+
   int32_t last_mouse_over_id;
 
   int32_t collection_count;
 
+  /* scroll speed and direction, to guess which thumbnails to prefetch */
+  struct
+  {
+    int32_t offset;   // first visible image at the last move
+    double time;      // time of that move
+    float velocity;   // images per second, positive when scrolling down
+  } scroll;
+
   // stuff for the audio player
   GPid audio_player_pid;     // the pid of the child process
   int32_t audio_player_id;   // the imgid of the image the audio is played for
@@ -397,6 +413,10 @@ void init(dt_view_t *self)
   lib->last_mouse_over_id = -1;
   lib->full_res_thumb = 0;
   lib->full_res_thumb_id = -1;
+  lib->full_zoom = 1.0f;
+  lib->full_pointer_x = lib->full_pointer_y = -1.0f;
+  lib->full_tiles = (dt_image_tiles_t *)malloc(sizeof(dt_image_tiles_t));
+  dt_image_tiles_init(lib->full_tiles);
   lib->audio_player_id = -1;
 
   GtkStyle *style = gtk_rc_get_style_by_paths(gtk_settings_get_default(), "dt-stars", NULL, G_TYPE_NONE);
@@ -427,6 +447,8 @@ void cleanup(dt_view_t *self)
   if(lib->audio_player_id != -1)
     _stop_audio(lib);
   free(lib->full_res_thumb);
+  dt_image_tiles_cleanup(lib->full_tiles);
+  free(lib->full_tiles);
   free(self->data);
 }
 
@@ -448,6 +470,61 @@ grid_to_index (int row, int col, int stride, int offset)
 }
 #endif
 
+/**
+ * queues the thumbnails which will probably be shown next, for a view which starts at offset and
+ * shows visible images in rows of stride, at size mip. what's queued from the last time and didn't
+ * start yet gets cancelled first. always the next half page in scroll direction. when scrolling fast,
+ * also the page the view will be at in about a second, one size smaller so it is ready in time.
+ */
+static void
+_prefetch(dt_library_t *lib, const int32_t offset, const int32_t visible, const int32_t stride, const dt_mipmap_size_t mip)
+{
+  const double now = dt_get_wtime();
+  if(offset != lib->scroll.offset)
+  {
+    const double dt = now - lib->scroll.time;
+    const float v = (offset - lib->scroll.offset) / fmax(dt, 0.01);
+    // average over quick successive moves, start over after a pause or when turning around:
+    if(dt > 0.5 || v * lib->scroll.velocity <= 0.0f) lib->scroll.velocity = v;
+    else lib->scroll.velocity = 0.5f*(lib->scroll.velocity + v);
+    lib->scroll.offset = offset;
+    lib->scroll.time = now;
+  }
+  else if(now - lib->scroll.time > 0.5) lib->scroll.velocity = 0.0f;
+
+  uint32_t count = 0;
+  const int32_t *ids = dt_collection_get_ids(darktable.collection, &count);
+  if(!ids || !count) return;
+
+  dt_mipmap_cache_prefetch_cancel(darktable.mipmap_cache);
+
+  const int dir = lib->scroll.velocity < 0.0f ? -1 : 1;
+  const int32_t near = (visible/stride/2 + 1)*stride;
+  const int32_t near_begin = dir > 0 ? offset + visible : offset - near;
+  int32_t imgids[near];
+  int num = 0;
+  for(int32_t k=0; k<near; k++)
+  {
+    // in order of distance to what's on screen:
+    const int32_t i = dir > 0 ? near_begin + k : near_begin + near - 1 - k;
+    if(i >= 0 && (uint32_t)i < count) imgids[num++] = ids[i];
+  }
+  dt_image_cache_prefetch(darktable.image_cache, imgids, num);
+  dt_mipmap_cache_prefetch(darktable.mipmap_cache, imgids, num, mip);
+
+  // where are we going to be in a second, at most a few pages away?
+  const int32_t travel = (int32_t)fminf(4.0f*visible, fabsf(lib->scroll.velocity)) / stride * stride;
+  if(travel > near)
+  {
+    const int32_t far_begin = offset + dir*travel;
+    int32_t far[visible];
+    num = 0;
+    for(int32_t i=MAX(0, far_begin); i<far_begin+visible && (uint32_t)i < count; i++)
+      far[num++] = ids[i];
+    dt_mipmap_cache_prefetch(darktable.mipmap_cache, far, num, MAX(DT_MIPMAP_0, (int)mip-1));
+  }
+}
+
 static void
 expose_filemanager (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t pointerx, int32_t pointery)
 {
@@ -588,6 +665,8 @@ expose_filemanager (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height,
   }
 
 end_query_cache:
+  // one query for all image structs of this page instead of one per thumbnail.
+  dt_image_cache_prefetch(darktable.image_cache, query_ids, max_rows*max_cols);
   mouse_over_id = -1;
   cairo_save(cr);
   int current_image =0;
@@ -792,37 +871,12 @@ after_drawing:
   /* check if offset was changed and we need to prefetch thumbs */
   if (offset_changed)
   {
-    int32_t imgids_num = 0;
-    const int prefetchrows = .5*max_rows+1;
-    int32_t imgids[prefetchrows*iir];
-
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    /* setup offest and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows*iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows*iir);
-
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows*iir)
-      imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
-
+    lib->offset_changed = FALSE;
     float imgwd = iir == 1 ? 0.97 : 0.8;
     dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
                              darktable.mipmap_cache,
                              imgwd*wd, imgwd*(iir==1?height:ht));
-    while(imgids_num > 0)
-    {
-      imgids_num --;
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_read_get(
-        darktable.mipmap_cache,
-        &buf,
-        imgids[imgids_num],
-        mip,
-        DT_MIPMAP_PREFETCH);
-    }
+    _prefetch(lib, offset, max_rows*iir, iir, mip);
   }
 
   free(query_ids);
@@ -1068,6 +1122,13 @@ expose_zoomable (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, in
   }
 failure:
 
+  /* prefetch around the new position, rows are DT_LIBRARY_MAX_ZOOM wide here */
+  if(zoom != 1 && lib->offset != lib->scroll.offset)
+  {
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, .8f*wd, .8f*ht);
+    _prefetch(lib, MAX(0, lib->offset), max_rows*DT_LIBRARY_MAX_ZOOM, DT_LIBRARY_MAX_ZOOM, mip);
+  }
+
   lib->zoom_x = zoom_x;
   lib->zoom_y = zoom_y;
   lib->track  = 0;
@@ -1076,6 +1137,141 @@ failure:
     dt_mipmap_cache_print(darktable.mipmap_cache);
 }
 
+typedef struct _full_tile_t
+{
+  int32_t tx, ty;
+  float dist;
+}
+_full_tile_t;
+
+static int _full_tile_cmp(const void *a, const void *b)
+{
+  const float da = ((const _full_tile_t *)a)->dist, db = ((const _full_tile_t *)b)->dist;
+  return (da > db) - (da < db);
+}
+
+/**
+ * Draws the full preview zoomed in, from tiles of the developed full size image at the
+ * resolution on screen. Only the visible ones are rendered, in the background, and until
+ * they are ready the next coarser ones in the cache, or else the thumbnail, stand in.
+ * Returns 0 if it can't be done yet, because the size of the developed image isn't known.
+ */
+static int
+_expose_full_preview_zoomed(dt_library_t *lib, cairo_t *cr, int32_t width, int32_t height, int32_t pointerx, int32_t pointery)
+{
+  const int32_t imgid = lib->full_preview_id;
+  int32_t wd, ht;
+  if(!dt_image_tiles_get_size(lib->full_tiles, imgid, &wd, &ht)) return 0;
+
+  // up to two screen pixels per image pixel
+  const float fit = fminf(width/(float)wd, height/(float)ht);
+  lib->full_zoom = CLAMP(lib->full_zoom, 1.0f, fmaxf(1.0f, 2.0f/fit));
+  if(lib->full_zoom <= 1.0f) return 0;
+  const float scale = fit * lib->full_zoom;
+  const float sw = scale * wd, sh = scale * ht;
+
+  // the pointer scans the whole image across the screen, and the point under it
+  // stays where it is when zooming:
+  if(pointerx >= 0 && pointery >= 0)
+  {
+    lib->full_pointer_x = pointerx;
+    lib->full_pointer_y = pointery;
+  }
+  const float fx = lib->full_pointer_x < 0.0f ? 0.5f : CLAMP(lib->full_pointer_x/width,  0.0f, 1.0f);
+  const float fy = lib->full_pointer_y < 0.0f ? 0.5f : CLAMP(lib->full_pointer_y/height, 0.0f, 1.0f);
+  const float ox = sw > width  ? -(sw - width ) * fx : 0.5f*(width  - sw);
+  const float oy = sh > height ? -(sh - height) * fy : 0.5f*(height - sh);
+
+  // the thumbnail goes underneath, for whatever isn't rendered yet
+  dt_mipmap_buffer_t buf;
+  const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, width, height);
+  dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_BEST_EFFORT);
+  if(buf.buf)
+  {
+    cairo_surface_t *surface = dt_view_image_get_surface(&buf);
+    if(surface)
+    {
+      cairo_save(cr);
+      cairo_translate(cr, ox, oy);
+      cairo_scale(cr, sw/buf.width, sh/buf.height);
+      cairo_set_source_surface(cr, surface, 0, 0);
+      cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+      cairo_rectangle(cr, 0, 0, buf.width, buf.height);
+      cairo_fill(cr);
+      cairo_restore(cr);
+    }
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+  }
+
+  // the finest level which isn't smaller than the screen, so tiles are scaled by f in (.5, 2]
+  const int levels = dt_image_tiles_get_levels(wd, ht);
+  const int level = CLAMP((int)floorf(-log2f(scale)), 0, levels-1);
+  const float f = ldexpf(scale, level);
+  int32_t lw, lh;
+  dt_image_tiles_get_level_size(wd, ht, level, &lw, &lh);
+  const int32_t nx = (lw + DT_IMAGE_TILE_SIZE - 1) / DT_IMAGE_TILE_SIZE;
+  const int32_t ny = (lh + DT_IMAGE_TILE_SIZE - 1) / DT_IMAGE_TILE_SIZE;
+  const int32_t x0 = MAX(0, (int32_t)floorf(-ox/f/DT_IMAGE_TILE_SIZE));
+  const int32_t y0 = MAX(0, (int32_t)floorf(-oy/f/DT_IMAGE_TILE_SIZE));
+  const int32_t x1 = MIN(nx-1, (int32_t)floorf((width  - ox)/f/DT_IMAGE_TILE_SIZE));
+  const int32_t y1 = MIN(ny-1, (int32_t)floorf((height - oy)/f/DT_IMAGE_TILE_SIZE));
+  const float cx = (0.5f*width  - ox)/f/DT_IMAGE_TILE_SIZE;
+  const float cy = (0.5f*height - oy)/f/DT_IMAGE_TILE_SIZE;
+
+  _full_tile_t missing[DT_IMAGE_TILES_WANTED];
+  int num_missing = 0;
+  cairo_save(cr);
+  cairo_translate(cr, ox, oy);
+  cairo_scale(cr, f, f);
+  for(int32_t ty=y0; ty<=y1; ty++) for(int32_t tx=x0; tx<=x1; tx++)
+  {
+    cairo_surface_t *tile = dt_image_tiles_get(lib->full_tiles, imgid, level, tx, ty);
+    int l = level;
+    if(!tile)
+    {
+      if(num_missing < DT_IMAGE_TILES_WANTED)
+      {
+        missing[num_missing].tx = tx;
+        missing[num_missing].ty = ty;
+        missing[num_missing].dist = (tx + 0.5f - cx)*(tx + 0.5f - cx) + (ty + 0.5f - cy)*(ty + 0.5f - cy);
+        num_missing++;
+      }
+      // the part of a coarser tile covering it will do for now:
+      for(l=level+1; l<levels && l<=level+4 && !tile; l++)
+        tile = dt_image_tiles_get(lib->full_tiles, imgid, l, tx >> (l-level), ty >> (l-level));
+      l--;
+    }
+    if(!tile) continue;
+
+    const int k = 1 << (l - level);
+    cairo_save(cr);
+    cairo_rectangle(cr, tx*DT_IMAGE_TILE_SIZE, ty*DT_IMAGE_TILE_SIZE, DT_IMAGE_TILE_SIZE, DT_IMAGE_TILE_SIZE);
+    cairo_clip(cr);
+    cairo_translate(cr, (tx/k)*k*DT_IMAGE_TILE_SIZE, (ty/k)*k*DT_IMAGE_TILE_SIZE);
+    cairo_scale(cr, k, k);
+    cairo_set_source_surface(cr, tile, 0, 0);
+    // no seams between the tiles, and the pixels as they are when zoomed in beyond 1:1
+    cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD);
+    cairo_pattern_set_filter(cairo_get_source(cr), (k == 1 && f > 1.0f) ? CAIRO_FILTER_NEAREST : CAIRO_FILTER_GOOD);
+    cairo_rectangle(cr, 0, 0, cairo_image_surface_get_width(tile), cairo_image_surface_get_height(tile));
+    cairo_fill(cr);
+    cairo_restore(cr);
+    cairo_surface_destroy(tile);
+  }
+  cairo_restore(cr);
+
+  // the ones in the middle of the screen first. this also forgets the ones we panned away from.
+  qsort(missing, num_missing, sizeof(_full_tile_t), _full_tile_cmp);
+  int32_t wanted[DT_IMAGE_TILES_WANTED][2];
+  for(int k=0; k<num_missing; k++)
+  {
+    wanted[k][0] = missing[k].tx;
+    wanted[k][1] = missing[k].ty;
+  }
+  dt_image_tiles_request(lib->full_tiles, imgid, level, (const int32_t (*)[2])wanted, num_missing);
+  return 1;
+}
+
 /**
  * Displays a full screen preview of the image currently under the mouse pointer.
  */
@@ -1092,16 +1288,7 @@ void expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
     /* If more than one image is selected, iterate over these. */
     /* If only one image is selected, scroll through all known images. */
 
-    int sel_img_count = 0;
-    {
-      sqlite3_stmt *stmt;
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select COUNT(*) from selected_images", -1, &stmt, NULL);
-      if (sqlite3_step(stmt) == SQLITE_ROW)
-      {
-        sel_img_count = sqlite3_column_int(stmt, 0);
-      }
-      sqlite3_finalize(stmt);
-    }
+    const int sel_img_count = dt_selection_get_count();
 
     const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, lib->full_preview_id);
 
@@ -1144,6 +1331,7 @@ void expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
     {
       lib->full_preview_id = sqlite3_column_int(stmt, 0);
       lib->full_preview_rowid = sqlite3_column_int(stmt, 1);
+      lib->full_zoom = 1.0f;
       dt_control_set_mouse_over_id(lib->full_preview_id);
     }
 
@@ -1169,7 +1357,8 @@ void expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
           &lib->full_res_thumb,
           &lib->full_res_thumb_wd,
           &lib->full_res_thumb_ht,
-          &lib->full_res_thumb_orientation))
+          &lib->full_res_thumb_orientation,
+          0, 0))
         lib->full_res_thumb_id = lib->full_preview_id;
 
       if(lib->full_res_thumb_id == lib->full_preview_id)
@@ -1182,67 +1371,13 @@ void expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
       }
     }
   }
-#if 0 // expose full res thumbnail:
-  if(lib->full_res_thumb_id == lib->full_preview_id)
-  {
-    static float pointerx_c = 0, pointery_c = 0;
-    const int32_t stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, lib->full_res_thumb_wd);
-    cairo_surface_t *surface = cairo_image_surface_create_for_data (lib->full_res_thumb, CAIRO_FORMAT_RGB24, lib->full_res_thumb_wd, lib->full_res_thumb_ht, stride);
-    cairo_save(cr);
-    int wd = lib->full_res_thumb_wd, ht = lib->full_res_thumb_ht;
-    if(lib->full_res_thumb_orientation & ORIENTATION_SWAP_XY)
-      wd = lib->full_res_thumb_ht, ht = lib->full_res_thumb_wd;
-    if(pointerx >= 0 && pointery >= 0)
-    { // avoid jumps in case mouse leaves drawing area
-      pointerx_c = pointerx;
-      pointery_c = pointery;
-    }
-    const float tx = -(wd - width ) * CLAMP(pointerx_c/(float)width,  0.0f, 1.0f),
-                ty = -(ht - height) * CLAMP(pointery_c/(float)height, 0.0f, 1.0f);
-    cairo_translate(cr, tx, ty);
-    if(lib->full_res_thumb_orientation & ORIENTATION_SWAP_XY)
-    {
-      cairo_matrix_t m = (cairo_matrix_t){0.0, 1.0, 1.0, 0.0, 0.0, 0.0};
-      cairo_transform(cr, &m);
-    }
-    if(lib->full_res_thumb_orientation & ORIENTATION_FLIP_X)
-    {
-      cairo_scale(cr, 1, -1);
-      cairo_translate(cr, 0, -lib->full_res_thumb_ht-1);
-    }
-    if(lib->full_res_thumb_orientation & ORIENTATION_FLIP_Y)
-    {
-      cairo_scale(cr, -1, 1);
-      cairo_translate(cr, -lib->full_res_thumb_wd-1, 0);
-    }
-    cairo_set_source_surface (cr, surface, 0, 0);
-      cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
-    cairo_rectangle(cr, 0, 0, lib->full_res_thumb_wd, lib->full_res_thumb_ht);
-    cairo_fill(cr);
-    cairo_surface_destroy (surface);
+  // zoomed in, or else the thumbnail fit to the screen:
+  const int zoomed = lib->full_zoom > 1.0f &&
+                     _expose_full_preview_zoomed(lib, cr, width, height, pointerx, pointery);
+  if(!zoomed)
+    dt_view_image_expose(&(lib->image_over), lib->full_preview_id, cr, width, height, 1, pointerx, pointery, TRUE);
 
-    // draw clustered focus regions
-    for(int k=0;k<49;k++)
-    {
-      const float intens = (lib->full_res_focus[k].thrs - FOCUS_THRS)/FOCUS_THRS;
-      if(lib->full_res_focus[k].n > lib->full_res_thumb_wd*lib->full_res_thumb_ht/49.0f * 0.01f)
-      // if(intens > 0.5f)
-      {
-        const float stddevx = sqrtf(lib->full_res_focus[k].x2 - lib->full_res_focus[k].x*lib->full_res_focus[k].x);
-        const float stddevy = sqrtf(lib->full_res_focus[k].y2 - lib->full_res_focus[k].y*lib->full_res_focus[k].y);
-        cairo_set_source_rgb(cr, intens, 0.0, 0.0);
-        cairo_set_line_width(cr, 5.0f*intens);
-        cairo_rectangle(cr, lib->full_res_focus[k].x - stddevx, lib->full_res_focus[k].y - stddevy, 2*stddevx, 2*stddevy);
-        cairo_stroke(cr);
-      }
-    }
-    cairo_restore(cr);
-  }
-  else
-#endif
-  dt_view_image_expose(&(lib->image_over), lib->full_preview_id, cr, width, height, 1, pointerx, pointery, TRUE);
-
-  if(lib->display_focus && (lib->full_res_thumb_id == lib->full_preview_id))
+  if(!zoomed && lib->display_focus && (lib->full_res_thumb_id == lib->full_preview_id))
     dt_focus_draw_clusters(cr,
         width, height,
         lib->full_preview_id,
@@ -1458,6 +1593,11 @@ void leave(dt_view_t *self)
   dt_library_t *lib = (dt_library_t *)self->data;
   lib->button = 0;
   lib->pan = 0;
+
+  // whatever we guessed isn't going to be needed any time soon
+  dt_mipmap_cache_prefetch_cancel(darktable.mipmap_cache);
+  // nor the pipe for the zoomed in full preview
+  dt_image_tiles_release(lib->full_tiles);
 }
 
 void reset(dt_view_t *self)
@@ -1497,7 +1637,14 @@ int scrolled(dt_view_t *self, double x, double y, int up, int state)
 {
   dt_library_t *lib = (dt_library_t *)self->data;
   const int layout = dt_conf_get_int("plugins/lighttable/layout");
-  if(lib->full_preview_id > -1)
+  if(lib->full_preview_id > -1 && (state & GDK_CONTROL_MASK) == GDK_CONTROL_MASK)
+  {
+    // zoom into the full preview, the upper limit depends on the image and is set when drawing
+    if(up) lib->full_zoom *= M_SQRT2;
+    else   lib->full_zoom = MAX(1.0f, lib->full_zoom / M_SQRT2);
+    dt_control_queue_redraw_center();
+  }
+  else if(lib->full_preview_id > -1)
   {
     if(up) lib->track = -DT_LIBRARY_MAX_ZOOM;
     else   lib->track = +DT_LIBRARY_MAX_ZOOM;
@@ -1733,6 +1880,9 @@ int key_released(dt_view_t *self, guint key, guint state)
 
     lib->full_preview = 0;
     lib->display_focus = 0;
+    lib->full_zoom = 1.0f;
+    lib->full_pointer_x = lib->full_pointer_y = -1.0f;
+    dt_image_tiles_release(lib->full_tiles);
   }
 
   return 1;
@@ -24,6 +24,7 @@
 #include "common/mipmap_cache.h"
 #include "common/debug.h"
 #include "common/history.h"
+#include "common/selection.h"
 #include "libs/lib.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -42,10 +43,114 @@
 
 #define DECORATION_SIZE_LIMIT 40
 
+// decoded thumbnails kept around for redraws, at most this many and this many bytes.
+#define DT_VIEW_SURFACES 256
+#define DT_VIEW_SURFACES_MEMORY (64<<20)
+
+typedef struct dt_view_surface_t
+{
+  uint32_t imgid;
+  dt_mipmap_size_t mip;
+  uint32_t generation;
+  uint32_t used;
+  cairo_surface_t *surface;
+}
+dt_view_surface_t;
+
+// gui thread only, as all the drawing.
+static dt_view_surface_t _view_surfaces[DT_VIEW_SURFACES];
+static uint32_t _view_surfaces_clock = 0;
+static size_t _view_surfaces_memory = 0;
+
+static void _view_surface_drop(dt_view_surface_t *s)
+{
+  if(!s->surface) return;
+  _view_surfaces_memory -= (size_t)cairo_image_surface_get_stride(s->surface) * cairo_image_surface_get_height(s->surface);
+  cairo_surface_destroy(s->surface);
+  s->surface = NULL;
+}
+
+/**
+ * returns a ready to paint surface of the thumbnail in buf, owned by the cache. thumbnails are
+ * decompressed and copied only the first time they're drawn, redraws for hovering and scrolling
+ * are just blits. they're found by image, mip size and generation of the mipmap cache.
+ */
+cairo_surface_t *dt_view_image_get_surface(const dt_mipmap_buffer_t *buf)
+{
+  const uint32_t generation = darktable.mipmap_cache->generation;
+  dt_view_surface_t *slot = NULL, *lru = _view_surfaces;
+  for(int k=0; k<DT_VIEW_SURFACES; k++)
+  {
+    dt_view_surface_t *s = _view_surfaces + k;
+    if(s->surface && s->imgid == buf->imgid && s->mip == buf->size)
+    {
+      slot = s;
+      break;
+    }
+    // the first free slot, or else the least recently used one:
+    if(lru->surface && (!s->surface || s->used < lru->used)) lru = s;
+  }
+
+  if(slot && slot->generation == generation &&
+     cairo_image_surface_get_width(slot->surface) == buf->width &&
+     cairo_image_surface_get_height(slot->surface) == buf->height)
+  {
+    slot->used = ++_view_surfaces_clock;
+    return slot->surface;
+  }
+
+  // outdated or not there at all
+  if(!slot) slot = lru;
+  _view_surface_drop(slot);
+
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, buf->width, buf->height);
+  if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+  {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  const int32_t stride = cairo_image_surface_get_stride(surface);
+  cairo_surface_flush(surface);
+  uint8_t *data = cairo_image_surface_get_data(surface);
+  if(stride == 4*buf->width)
+  {
+    // decompresses right into the surface, or gives us the uncompressed buffer back:
+    const uint8_t *in = dt_mipmap_cache_decompress(buf, data);
+    if(in != data) memcpy(data, in, (size_t)stride*buf->height);
+  }
+  else
+  {
+    uint8_t *scratchmem = dt_mipmap_cache_alloc_scratchmem(darktable.mipmap_cache);
+    const uint8_t *in = dt_mipmap_cache_decompress(buf, scratchmem);
+    for(int j=0; j<buf->height; j++)
+      memcpy(data + (size_t)stride*j, in + (size_t)4*buf->width*j, (size_t)4*buf->width);
+    dt_free_align(scratchmem);
+  }
+  cairo_surface_mark_dirty(surface);
+
+  slot->imgid = buf->imgid;
+  slot->mip = buf->size;
+  slot->generation = generation;
+  slot->used = ++_view_surfaces_clock;
+  slot->surface = surface;
+  _view_surfaces_memory += (size_t)stride * buf->height;
+
+  // stay within the memory budget, but keep the one we're about to draw:
+  while(_view_surfaces_memory > DT_VIEW_SURFACES_MEMORY)
+  {
+    dt_view_surface_t *oldest = NULL;
+    for(int k=0; k<DT_VIEW_SURFACES; k++)
+      if(_view_surfaces[k].surface && _view_surfaces + k != slot &&
+         (!oldest || _view_surfaces[k].used < oldest->used)) oldest = _view_surfaces + k;
+    if(!oldest) break;
+    _view_surface_drop(oldest);
+  }
+  return surface;
+}
+
 void dt_view_manager_init(dt_view_manager_t *vm)
 {
   /* prepare statements */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select * from selected_images where imgid = ?1", -1, &vm->statements.is_selected, NULL);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "delete from selected_images where imgid = ?1", -1, &vm->statements.delete_from_selected, NULL);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "insert or ignore into selected_images values (?1)", -1, &vm->statements.make_selected, NULL);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select num from history where imgid = ?1", -1, &vm->statements.have_history, NULL);
@@ -85,6 +190,7 @@ void dt_view_manager_init(dt_view_manager_t *vm)
 void dt_view_manager_cleanup(dt_view_manager_t *vm)
 {
   for(int k=0; k<vm->num_views; k++) dt_view_unload_module(vm->view + k);
+  for(int k=0; k<DT_VIEW_SURFACES; k++) _view_surface_drop(_view_surfaces + k);
 }
 
 const dt_view_t *dt_view_manager_get_current_view(dt_view_manager_t *vm)
@@ -706,14 +812,7 @@ dt_view_get_image_to_act_on()
   }
   else
   {
-    /* clear and reset statement */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-    DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-
-    /* setup statement and iterate over rows */
-    DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, mouse_over_id);
-
-    if (mouse_over_id <= 0 || sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW)
+    if (mouse_over_id <= 0 || dt_selection_is_selected(mouse_over_id))
       return -1;
     else
       return mouse_over_id;
@@ -744,19 +843,6 @@ dt_view_image_expose(
 #define DRAW_HISTORY 1
 #define DRAW_AUDIO 1
 
-#if DRAW_THUMB == 1
-  // this function is not thread-safe (gui-thread only), so we
-  // can safely allocate this leaking bit of memory to decompress thumbnails:
-  static int first_time = 1;
-  static uint8_t *scratchmem = NULL;
-  if(first_time)
-  {
-    // scratchmem might still be NULL after this, if compression is off.
-    scratchmem = dt_mipmap_cache_alloc_scratchmem(darktable.mipmap_cache);
-    first_time = 0;
-  }
-#endif
-
   cairo_save (cr);
   float bgcol = 0.4, fontcol = 0.425, bordercol = 0.1, outlinecol = 0.2;
   int selected = 0, altered = 0, imgsel = -1, is_grouped = 0;
@@ -764,14 +850,8 @@ dt_view_image_expose(
   imgsel = dt_control_get_mouse_over_id();//  darktable.control->global_settings.lib_image_mouse_over_id;
 
 #if DRAW_SELECTED == 1
-  /* clear and reset statements */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-  DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-  /* bind imgid to prepared statments */
-  DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, imgid);
   /* lets check if imgid is selected */
-  if(sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW)
-    selected = 1;
+  selected = dt_selection_is_selected(imgid);
 #endif
 
   const dt_image_t *img = dt_image_cache_read_testget(darktable.image_cache, imgid);
@@ -843,15 +923,11 @@ dt_view_image_expose(
 
 #if DRAW_THUMB == 1
   float scale = 1.0;
-  // decompress image, if necessary. if compression is off, scratchmem will be == NULL,
-  // so get the real pointer back:
-  uint8_t *buf_decompressed = dt_mipmap_cache_decompress(&buf, scratchmem);
-
+  // decoded once, kept for the next redraws:
   cairo_surface_t *surface = NULL;
-  if(buf.buf)
+  if(buf.buf) surface = dt_view_image_get_surface(&buf);
+  if(surface)
   {
-    const int32_t stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, buf.width);
-    surface = cairo_image_surface_create_for_data (buf_decompressed, CAIRO_FORMAT_RGB24, buf.width, buf.height, stride);
     if(zoom == 1)
     {
       scale = fminf(
@@ -867,7 +943,7 @@ dt_view_image_expose(
   cairo_translate(cr, width/2.0, height/2.0);
   cairo_scale(cr, scale, scale);
 
-  if(buf.buf)
+  if(surface)
   {
     cairo_translate(cr, -0.5*buf.width, -0.5*buf.height);
     cairo_set_source_surface (cr, surface, 0, 0);
@@ -879,7 +955,6 @@ dt_view_image_expose(
       cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
     cairo_rectangle(cr, 0, 0, buf.width, buf.height);
     cairo_fill(cr);
-    cairo_surface_destroy (surface);
 
     cairo_rectangle(cr, 0, 0, buf.width, buf.height);
   }
@@ -1226,14 +1301,7 @@ dt_view_image_expose(
  */
 void dt_view_set_selection(int imgid, int value)
 {
-  /* clear and reset statement */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-  DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-
-  /* setup statement and iterate over rows */
-  DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, imgid);
-
-  if(sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW)
+  if(dt_selection_is_selected(imgid))
   {
     if(!value)
     {
@@ -1269,14 +1337,7 @@ void dt_view_set_selection(int imgid, int value)
  */
 void dt_view_toggle_selection(int imgid)
 {
-
-  /* clear and reset statement */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-  DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-
-  /* setup statement and iterate over rows */
-  DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, imgid);
-  if(sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW)
+  if(dt_selection_is_selected(imgid))
   {
     /* clear and reset statement */
     DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.delete_from_selected);
@@ -1309,25 +1370,10 @@ void dt_view_filter_reset(const dt_view_manager_t *vm, gboolean smart_filter)
 
 void dt_view_filmstrip_scroll_relative(const int diff, int offset)
 {
-  const gchar *qin = dt_collection_get_query (darktable.collection);
-  if(qin)
+  const int imgid = dt_collection_get_nth(darktable.collection, offset + diff);
+  if(imgid > 0 && !darktable.develop->image_loading)
   {
-    int imgid = -1;
-    sqlite3_stmt *stmt;
-
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + diff);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      imgid = sqlite3_column_int(stmt, 0);
-
-      if (!darktable.develop->image_loading)
-      {
-        dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, TRUE);
-      }
-    }
-    sqlite3_finalize(stmt);
+    dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, TRUE);
   }
 
 }
@@ -1386,18 +1432,16 @@ void dt_view_filmstrip_prefetch()
     offset = dt_collection_image_offset(imgid);
   }
 
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-  // only get one more image:
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset+1);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset+2);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  // only get one more image, the next one in the direction we're going through the collection:
+  static int last_offset = -1;
+  const int dir = (last_offset >= 0 && offset < last_offset) ? -1 : 1;
+  last_offset = offset;
+  const int32_t prefetchid = dt_collection_get_nth(darktable.collection, offset+dir);
+  if(prefetchid > 0)
   {
-    const uint32_t prefetchid = sqlite3_column_int(stmt, 0);
     // dt_control_log("prefetching image %u", prefetchid);
     dt_mipmap_cache_read_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH);
   }
-  sqlite3_finalize(stmt);
 }
 
 void dt_view_manager_view_toolbox_add(dt_view_manager_t *vm,GtkWidget *tool)
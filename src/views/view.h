@@ -21,6 +21,7 @@
 #define DT_VIEW_H
 
 #include "common/image.h"
+#include "common/mipmap_cache.h"
 #ifdef HAVE_MAP
 #include "osm-gps-map-source.h"
 #endif
@@ -128,6 +129,12 @@ dt_view_image_expose(
   int32_t py,
   gboolean full_preview);
 
+/** ready to paint surface of the thumbnail in buf. it belongs to the view manager, which
+    keeps it around for the next redraws, so don't destroy it and don't hold on to it. */
+cairo_surface_t *
+dt_view_image_get_surface(
+  const dt_mipmap_buffer_t *buf);
+
 /** Set the selection bit to a given value for the specified image */
 void dt_view_set_selection(int imgid, int value);
 /** toggle selection of given image. */
@@ -151,8 +158,6 @@ typedef struct dt_view_manager_t
   {
     /* select num from history where imgid = ?1*/
     sqlite3_stmt *have_history;
-    /* select * from selected_images where imgid = ?1 */
-    sqlite3_stmt *is_selected;
     /* delete from selected_images where imgid = ?1 */
     sqlite3_stmt *delete_from_selected;
     /* insert into selected_images values (?1) */